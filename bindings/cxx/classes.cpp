@@ -271,6 +271,15 @@ void Context::set_resource_reader(ResourceReader *reader)
 	}
 }
 
+shared_ptr<Converter> Context::create_converter(
+		shared_ptr<OutputFormat> output_format,
+		map<string, Glib::VariantBase> options)
+{
+	return shared_ptr<Converter>{new Converter{shared_from_this(),
+		move(output_format), move(options)},
+		default_delete<Converter>{}};
+}
+
 shared_ptr<Session> Context::create_session()
 {
 	return shared_ptr<Session>{new Session{shared_from_this()},
@@ -330,9 +339,31 @@ shared_ptr<Packet> Context::create_logic_packet(
 	return shared_ptr<Packet>{new Packet{nullptr, packet}, default_delete<Packet>{}};
 }
 
-shared_ptr<Packet> Context::create_analog_packet(
-	vector<shared_ptr<Channel> > channels,
-	const float *data_pointer, unsigned int num_samples, const Quantity *mq,
+shared_ptr<Packet> Context::create_logic_packet(
+	void *data_pointer, size_t data_length, unsigned int unit_size,
+	PacketDataDeleter deleter)
+{
+	auto result = create_logic_packet(data_pointer, data_length, unit_size);
+	auto packet = result->_structure;
+	result->_release = [packet, data_pointer, deleter]() {
+		if (deleter)
+			deleter(data_pointer);
+		g_free(const_cast<void *>(packet->payload));
+		g_free(const_cast<struct sr_datafeed_packet *>(packet));
+	};
+	return result;
+}
+
+shared_ptr<Packet> Context::create_logic_packet(
+	vector<uint8_t> data, unsigned int unit_size)
+{
+	auto owned = new vector<uint8_t>{move(data)};
+	return create_logic_packet(owned->data(), owned->size(), unit_size,
+		[owned](void *) { delete owned; });
+}
+
+static struct sr_datafeed_packet *analog_packet_new(GSList *channels,
+	void *data_pointer, unsigned int num_samples, const Quantity *mq,
 	const Unit *unit, vector<const QuantityFlag *> mqflags)
 {
 	auto analog = g_new0(struct sr_datafeed_analog, 1);
@@ -342,8 +373,7 @@ shared_ptr<Packet> Context::create_analog_packet(
 
 	analog->meaning = meaning;
 
-	for (const auto &channel : channels)
-		meaning->channels = g_slist_append(meaning->channels, channel->_structure);
+	meaning->channels = channels;
 	meaning->mq = static_cast<sr_mq>(mq->id());
 	meaning->unit = static_cast<sr_unit>(unit->id());
 	meaning->mqflags = static_cast<sr_mqflag>(QuantityFlag::mask_from_flags(move(mqflags)));
@@ -370,13 +400,70 @@ shared_ptr<Packet> Context::create_analog_packet(
 	spec->spec_digits = 0;
 
 	analog->num_samples = num_samples;
-	analog->data = (float*)data_pointer;
+	analog->data = data_pointer;
 	auto packet = g_new(struct sr_datafeed_packet, 1);
 	packet->type = SR_DF_ANALOG;
 	packet->payload = analog;
+	return packet;
+}
+
+shared_ptr<Packet> Context::create_analog_packet(
+	vector<shared_ptr<Channel> > channels,
+	const float *data_pointer, unsigned int num_samples, const Quantity *mq,
+	const Unit *unit, vector<const QuantityFlag *> mqflags)
+{
+	GSList *channel_list = nullptr;
+	for (const auto &channel : channels)
+		channel_list = g_slist_append(channel_list, channel->_structure);
+	auto packet = analog_packet_new(channel_list, (float *)data_pointer,
+		num_samples, mq, unit, move(mqflags));
 	return shared_ptr<Packet>{new Packet{nullptr, packet}, default_delete<Packet>{}};
 }
 
+shared_ptr<Packet> Context::create_analog_packet(
+	vector<shared_ptr<Channel> > channels,
+	void *data_pointer, unsigned int num_samples,
+	unsigned int unitsize, bool is_signed, bool is_float,
+	bool is_bigendian, pair<int64_t, uint64_t> scale,
+	pair<int64_t, uint64_t> offset, const Quantity *mq,
+	const Unit *unit, vector<const QuantityFlag *> mqflags,
+	PacketDataDeleter deleter)
+{
+	if (!scale.second || !offset.second)
+		throw Error(SR_ERR_ARG);
+
+	GSList *channel_list = nullptr;
+	for (const auto &channel : channels)
+		channel_list = g_slist_append(channel_list, channel->_structure);
+	auto packet = analog_packet_new(channel_list, data_pointer,
+		num_samples, mq, unit, move(mqflags));
+	auto analog = static_cast<struct sr_datafeed_analog *>(
+		const_cast<void *>(packet->payload));
+	auto encoding = analog->encoding;
+	encoding->unitsize = unitsize;
+	encoding->is_signed = is_signed;
+	encoding->is_float = is_float;
+	encoding->is_bigendian = is_bigendian;
+	encoding->scale.p = scale.first;
+	encoding->scale.q = scale.second;
+	encoding->offset.p = offset.first;
+	encoding->offset.q = offset.second;
+
+	auto result = shared_ptr<Packet>{new Packet{nullptr, packet},
+		default_delete<Packet>{}};
+	result->_release = [packet, analog, data_pointer, deleter]() {
+		if (deleter)
+			deleter(data_pointer);
+		g_slist_free(analog->meaning->channels);
+		g_free(analog->meaning);
+		g_free(analog->encoding);
+		g_free(analog->spec);
+		g_free(analog);
+		g_free(packet);
+	};
+	return result;
+}
+
 shared_ptr<Session> Context::load_session(string filename)
 {
 	return shared_ptr<Session>{
@@ -551,6 +638,53 @@ void Configurable::config_set(const ConfigKey *key, const Glib::VariantBase &val
 		key->id(), const_cast<GVariant*>(value.gobj())));
 }
 
+map<const ConfigKey *, Glib::VariantBase> Configurable::config_get_multi(
+	const vector<const ConfigKey *> &keys) const
+{
+	GSList *config_list = nullptr;
+	for (const auto key : keys) {
+		auto *const config = g_new(struct sr_config, 1);
+		config->key = key->id();
+		config->data = nullptr;
+		config_list = g_slist_append(config_list, config);
+	}
+
+	int ret = sr_config_get_multi(
+		config_driver, config_sdi, config_channel_group, config_list);
+
+	map<const ConfigKey *, Glib::VariantBase> result;
+	for (GSList *l = config_list; l; l = l->next) {
+		auto *const config = static_cast<struct sr_config *>(l->data);
+		if (config->data)
+			result[ConfigKey::get(config->key)] =
+				Glib::VariantBase(config->data);
+	}
+	g_slist_free_full(config_list, g_free);
+
+	check(ret);
+
+	return result;
+}
+
+void Configurable::config_set_multi(
+	const vector<pair<const ConfigKey *, Glib::VariantBase>> &values)
+{
+	GSList *config_list = nullptr;
+	for (const auto &entry : values) {
+		auto *const config = g_new(struct sr_config, 1);
+		config->key = entry.first->id();
+		config->data = const_cast<GVariant*>(entry.second.gobj());
+		config_list = g_slist_append(config_list, config);
+	}
+
+	int ret = sr_config_set_multi(
+		config_sdi, config_channel_group, config_list);
+
+	g_slist_free_full(config_list, g_free);
+
+	check(ret);
+}
+
 set<const Capability *> Configurable::config_capabilities(const ConfigKey *key) const
 {
 	int caps = sr_dev_config_capabilities_list(config_sdi,
@@ -714,6 +848,11 @@ shared_ptr<Channel> UserDevice::add_channel(unsigned int index,
 	return get_channel(ch);
 }
 
+void UserDevice::send(shared_ptr<Packet> packet)
+{
+	check(sr_dev_inst_user_send(Device::_structure, packet->_structure));
+}
+
 Channel::Channel(struct sr_channel *structure) :
 	_structure(structure),
 	_type(ChannelType::get(_structure->type))
@@ -1066,6 +1205,43 @@ shared_ptr<Context> Session::context()
 	return _context;
 }
 
+void Session::set_stats_enabled(bool enabled)
+{
+	check(sr_session_stats_enable(_structure, enabled));
+}
+
+void Session::reset_stats()
+{
+	check(sr_session_stats_reset(_structure));
+}
+
+vector<SessionStats> Session::stats()
+{
+	GSList *stats;
+	check(sr_session_stats_get(_structure, &stats));
+	vector<SessionStats> result;
+	for (GSList *l = stats; l; l = l->next) {
+		auto *const entry = static_cast<struct sr_session_stats *>(l->data);
+		SessionStats item;
+		item.stage = entry->stage;
+		item.id = entry->id;
+		item.name = valid_string(entry->name);
+		for (int i = 0; i < SR_STATS_PACKET_TYPES; i++)
+			if (entry->packets[i])
+				item.packets[PacketType::get(SR_DF_HEADER + i)] =
+					entry->packets[i];
+		item.bytes = entry->bytes;
+		item.calls = entry->calls;
+		item.total_us = entry->total_us;
+		item.max_us = entry->max_us;
+		item.latency.assign(entry->latency,
+			entry->latency + SR_STATS_LATENCY_BUCKETS);
+		result.push_back(move(item));
+	}
+	sr_session_stats_free(stats);
+	return result;
+}
+
 Packet::Packet(shared_ptr<Device> device,
 	const struct sr_datafeed_packet *structure) :
 	_structure(structure),
@@ -1098,6 +1274,8 @@ Packet::Packet(shared_ptr<Device> device,
 
 Packet::~Packet()
 {
+	if (_release)
+		_release();
 }
 
 const PacketType *Packet::type() const
@@ -1206,6 +1384,18 @@ unsigned int Logic::unit_size() const
 	return _structure->unitsize;
 }
 
+vector<shared_ptr<Channel>> Logic::channels()
+{
+	vector<shared_ptr<Channel>> result;
+	/* Packets created by the user don't come from a device. */
+	if (!_parent || !_parent->_device)
+		return result;
+	for (auto channel : _parent->_device->channels())
+		if (channel->type() == ChannelType::LOGIC && channel->enabled())
+			result.push_back(channel);
+	return result;
+}
+
 Analog::Analog(const struct sr_datafeed_analog *structure) :
 	PacketPayload(),
 	_structure(structure)
@@ -1632,7 +1822,8 @@ Output::Output(shared_ptr<OutputFormat> format,
 		map_to_hash_variant(options), device->_structure, nullptr)),
 	_format(move(format)),
 	_device(move(device)),
-	_options(move(options))
+	_options(move(options)),
+	_sink(sr_output_sink_new_arena())
 {
 }
 
@@ -1642,28 +1833,98 @@ Output::Output(string filename, shared_ptr<OutputFormat> format,
 		map_to_hash_variant(options), device->_structure, filename.c_str())),
 	_format(move(format)),
 	_device(move(device)),
-	_options(move(options))
+	_options(move(options)),
+	_sink(sr_output_sink_new_arena())
 {
 }
 
 Output::~Output()
 {
+	sr_output_sink_free(_sink);
 	check(sr_output_free(_structure));
 }
 
 string Output::receive(shared_ptr<Packet> packet)
 {
-	GString *out;
-	check(sr_output_send(_structure, packet->_structure, &out));
-	if (out) {
-		auto result = string(out->str, out->str + out->len);
-		g_string_free(out, true);
-		return result;
-	} else {
-		return string();
+	string result;
+	receive(move(packet), [&result](const uint8_t *data, size_t length) {
+		result.assign(reinterpret_cast<const char *>(data), length);
+	});
+	return result;
+}
+
+void Output::receive(shared_ptr<Packet> packet, OutputWriteFunction write)
+{
+	size_t length;
+
+	sr_output_sink_arena_reset(_sink);
+	check(sr_output_send_to(_structure, packet->_structure, _sink));
+	auto data = sr_output_sink_arena_data(_sink, &length);
+	if (data)
+		write(data, length);
+}
+
+Converter::Converter(shared_ptr<Context> context,
+		shared_ptr<OutputFormat> output_format,
+		map<string, Glib::VariantBase> options) :
+	_structure(nullptr),
+	_context(move(context)),
+	_output_format(move(output_format))
+{
+	check(sr_convert_new(_context->_structure, &_structure));
+	auto params = map_to_hash_variant(options);
+	auto ret = sr_convert_set_output(_structure,
+		_output_format->_structure, params);
+	g_hash_table_unref(params);
+	if (ret != SR_OK) {
+		sr_convert_free(_structure);
+		throw Error(ret);
 	}
 }
 
+Converter::~Converter()
+{
+	check(sr_convert_free(_structure));
+}
+
+void Converter::set_input_format(shared_ptr<InputFormat> format,
+		map<string, Glib::VariantBase> options)
+{
+	auto params = map_to_hash_variant(options);
+	auto ret = sr_convert_set_input(_structure,
+		format ? format->_structure : nullptr, params);
+	g_hash_table_unref(params);
+	check(ret);
+	_input_format = move(format);
+}
+
+void Converter::set_workers(unsigned int num_workers)
+{
+	check(sr_convert_set_workers(_structure, num_workers));
+}
+
+void Converter::convert(string input_file, string output_file)
+{
+	check(sr_convert_file(_structure,
+		input_file.c_str(), output_file.c_str()));
+}
+
+void Converter::convert(vector<string> input_files,
+		vector<string> output_files)
+{
+	if (input_files.size() != output_files.size())
+		throw Error(SR_ERR_ARG);
+
+	vector<const char *> infiles, outfiles;
+	for (const auto &file : input_files)
+		infiles.push_back(file.c_str());
+	for (const auto &file : output_files)
+		outfiles.push_back(file.c_str());
+
+	check(sr_convert_files(_structure, infiles.data(), outfiles.data(),
+		infiles.size()));
+}
+
 #include <enums.cpp>
 
 }
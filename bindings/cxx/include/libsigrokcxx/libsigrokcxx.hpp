@@ -119,6 +119,7 @@ class SR_API Rational;
 class SR_API Input;
 class SR_API InputDevice;
 class SR_API Output;
+class SR_API Converter;
 class SR_API DataType;
 class SR_API Option;
 class SR_API UserDevice;
@@ -215,6 +216,12 @@ protected:
 /** Type of log callback */
 typedef function<void(const LogLevel *, string message)> LogCallbackFunction;
 
+/** Type of deleter for sample data handed over to a packet */
+typedef function<void(void *)> PacketDataDeleter;
+
+/** Type of function receiving the output of an output module */
+typedef function<void(const uint8_t *data, size_t length)> OutputWriteFunction;
+
 /** Resource reader delegate. */
 class SR_API ResourceReader
 {
@@ -282,11 +289,47 @@ public:
 	/** Create a logic packet. */
 	shared_ptr<Packet> create_logic_packet(
 		void *data_pointer, size_t data_length, unsigned int unit_size);
+	/** Create a logic packet which takes ownership of its data.
+	 * @param data_pointer Sample data.
+	 * @param data_length Length of the sample data in bytes.
+	 * @param unit_size Size of each sample in bytes.
+	 * @param deleter Called with data_pointer once the packet is gone. */
+	shared_ptr<Packet> create_logic_packet(
+		void *data_pointer, size_t data_length, unsigned int unit_size,
+		PacketDataDeleter deleter);
+	/** Create a logic packet which takes ownership of its data.
+	 * @param data Sample data, moved into the packet.
+	 * @param unit_size Size of each sample in bytes. */
+	shared_ptr<Packet> create_logic_packet(
+		vector<uint8_t> data, unsigned int unit_size);
 	/** Create an analog packet. */
 	shared_ptr<Packet> create_analog_packet(
 		vector<shared_ptr<Channel> > channels,
 		const float *data_pointer, unsigned int num_samples, const Quantity *mq,
 		const Unit *unit, vector<const QuantityFlag *> mqflags);
+	/** Create an analog packet in any sample encoding which takes
+	 * ownership of its data.
+	 * @param channels Channels the samples belong to.
+	 * @param data_pointer Sample data.
+	 * @param num_samples Number of samples.
+	 * @param unitsize Size of each sample in bytes.
+	 * @param is_signed Samples use a signed data type.
+	 * @param is_float Samples use a floating point data type.
+	 * @param is_bigendian Samples are stored in big-endian order.
+	 * @param scale Factor to multiply raw values with.
+	 * @param offset Offset to add to scaled values.
+	 * @param mq Measured quantity.
+	 * @param unit Unit of the scaled values.
+	 * @param mqflags Measurement flags.
+	 * @param deleter Called with data_pointer once the packet is gone. */
+	shared_ptr<Packet> create_analog_packet(
+		vector<shared_ptr<Channel> > channels,
+		void *data_pointer, unsigned int num_samples,
+		unsigned int unitsize, bool is_signed, bool is_float,
+		bool is_bigendian, pair<int64_t, uint64_t> scale,
+		pair<int64_t, uint64_t> offset, const Quantity *mq,
+		const Unit *unit, vector<const QuantityFlag *> mqflags,
+		PacketDataDeleter deleter);
 	/** Load a saved session.
 	 * @param filename File name string. */
 	shared_ptr<Session> load_session(string filename);
@@ -299,6 +342,13 @@ public:
 	/** Open an input stream based on header data.
 	 * @param header Initial data from stream. */
 	shared_ptr<Input> open_stream(string header);
+	/** Create a converter from input files to another format.
+	 * @param output_format Format to write.
+	 * @param options Mapping of (option name, value) pairs for the
+	 * output format. */
+	shared_ptr<Converter> create_converter(
+		shared_ptr<OutputFormat> output_format,
+		map<string, Glib::VariantBase> options = map<string, Glib::VariantBase>());
 	map<string, string> serials(shared_ptr<Driver> driver) const;
 private:
 	struct sr_context *_structure;
@@ -310,6 +360,7 @@ private:
 	Context();
 	~Context();
 	friend class Session;
+	friend class Converter;
 	friend class Driver;
 	friend struct std::default_delete<Context>;
 };
@@ -330,6 +381,14 @@ public:
 	/** Enumerate available values for the given configuration key.
 	 * @param key ConfigKey to enumerate values for. */
 	Glib::VariantContainerBase config_list(const ConfigKey *key) const;
+	/** Read configuration for several keys in one transaction.
+	 * @param keys ConfigKeys to read. */
+	map<const ConfigKey *, Glib::VariantBase> config_get_multi(
+		const vector<const ConfigKey *> &keys) const;
+	/** Set configuration for several keys in one transaction.
+	 * @param values (ConfigKey, value) pairs to set, in this order. */
+	void config_set_multi(
+		const vector<pair<const ConfigKey *, Glib::VariantBase>> &values);
 	/** Enumerate configuration capabilities for the given configuration key.
 	 * @param key ConfigKey to enumerate capabilities for. */
 	set<const Capability *> config_capabilities(const ConfigKey *key) const;
@@ -442,6 +501,11 @@ class SR_API UserDevice :
 public:
 	/** Add a new channel to this device. */
 	shared_ptr<Channel> add_channel(unsigned int index, const ChannelType *type, string name);
+	/** Send a packet from this device into the session it was added to.
+	 * The packet passes through the session's transforms, outputs and
+	 * callbacks without being copied.
+	 * @param packet Packet to send. */
+	void send(shared_ptr<Packet> packet);
 private:
 	UserDevice(string vendor, string model, string version);
 	~UserDevice();
@@ -591,6 +655,29 @@ private:
 	friend class Session;
 };
 
+/** Statistics of one stage of a session's data pipeline */
+struct SR_API SessionStats
+{
+	/** Type of the stage, see enum sr_stats_stage. */
+	int stage;
+	/** Registration ID of the stage, unique within the session. */
+	unsigned int id;
+	/** Name of the stage, see struct sr_session_stats. */
+	string name;
+	/** Number of packets received, by packet type. */
+	map<const PacketType *, uint64_t> packets;
+	/** Number of payload bytes in logic and analog packets received. */
+	uint64_t bytes;
+	/** Number of invocations. */
+	uint64_t calls;
+	/** Total time spent in the stage, in microseconds. */
+	uint64_t total_us;
+	/** Longest invocation, in microseconds. */
+	uint64_t max_us;
+	/** Latency histogram, see struct sr_session_stats. */
+	vector<uint64_t> latency;
+};
+
 /** A virtual device associated with a stored session */
 class SR_API SessionDevice :
 	public ParentOwned<SessionDevice, Session>,
@@ -640,6 +727,12 @@ public:
 	void set_trigger(shared_ptr<Trigger> trigger);
 	/** Get filename this session was loaded from. */
 	string filename() const;
+	/** Enable or disable collection of pipeline statistics. */
+	void set_stats_enabled(bool enabled);
+	/** Discard the pipeline statistics collected so far. */
+	void reset_stats();
+	/** Get the pipeline statistics, one entry per stage. */
+	vector<SessionStats> stats();
 private:
 	explicit Session(shared_ptr<Context> context);
 	Session(shared_ptr<Context> context, string filename);
@@ -675,6 +768,8 @@ private:
 	const struct sr_datafeed_packet *_structure;
 	shared_ptr<Device> _device;
 	unique_ptr<PacketPayload> _payload;
+	/* Frees the structure and data of packets created by the user. */
+	function<void()> _release;
 
 	friend class Session;
 	friend class Output;
@@ -684,6 +779,7 @@ private:
 	friend class Logic;
 	friend class Analog;
 	friend class Context;
+	friend class UserDevice;
 	friend struct std::default_delete<Packet>;
 };
 
@@ -740,7 +836,11 @@ private:
 	friend class Packet;
 };
 
-/** Payload of a datafeed packet with logic data */
+/** Payload of a datafeed packet with logic data
+ *
+ * Planar and run-length encoded logic data is delivered in this
+ * sample-major form as well, as the session converts it for datafeed
+ * callbacks which are not registered for planar data. */
 class SR_API Logic :
 	public ParentOwned<Logic, Packet>,
 	public PacketPayload
@@ -752,6 +852,8 @@ public:
 	size_t data_length() const;
 	/* Size of each sample in bytes. */
 	unsigned int unit_size() const;
+	/** Enabled logic channels of the device which sent this packet. */
+	vector<shared_ptr<Channel> > channels();
 private:
 	explicit Logic(const struct sr_datafeed_logic *structure);
 	~Logic();
@@ -892,6 +994,7 @@ private:
 	const struct sr_input_module *_structure;
 
 	friend class Context;
+	friend class Converter;
 	friend class InputDevice;
 	friend struct std::default_delete<InputFormat>;
 };
@@ -1003,6 +1106,7 @@ private:
 	const struct sr_output_module *_structure;
 
 	friend class Context;
+	friend class Converter;
 	friend class Output;
 	friend struct std::default_delete<OutputFormat>;
 };
@@ -1014,6 +1118,12 @@ public:
 	/** Update output with data from the given packet.
 	 * @param packet Packet to handle. */
 	string receive(shared_ptr<Packet> packet);
+	/** Update output with data from the given packet, passing the
+	 * output to a function without copying it.
+	 * @param packet Packet to handle.
+	 * @param write Called with the output, if there is any. The data
+	 * is only valid during the call. */
+	void receive(shared_ptr<Packet> packet, OutputWriteFunction write);
 private:
 	Output(shared_ptr<OutputFormat> format, shared_ptr<Device> device);
 	Output(shared_ptr<OutputFormat> format,
@@ -1026,11 +1136,50 @@ private:
 	const shared_ptr<OutputFormat> _format;
 	const shared_ptr<Device> _device;
 	const map<string, Glib::VariantBase> _options;
+	struct sr_output_sink *_sink;
 
 	friend class OutputFormat;
 	friend struct std::default_delete<Output>;
 };
 
+/** A converter from input files to another format, which works without
+ * a session */
+class SR_API Converter : public UserOwned<Converter>
+{
+public:
+	/** Set the format of the input files. Without an input format, the
+	 * format of each file is detected.
+	 * @param format Input format.
+	 * @param options Mapping of (option name, value) pairs. */
+	void set_input_format(shared_ptr<InputFormat> format,
+		map<string, Glib::VariantBase> options = map<string, Glib::VariantBase>());
+	/** Set the number of files which are converted in parallel.
+	 * @param num_workers Number of worker threads. */
+	void set_workers(unsigned int num_workers);
+	/** Convert a file.
+	 * @param input_file Name of the file to read.
+	 * @param output_file Name of the file to write. */
+	void convert(string input_file, string output_file);
+	/** Convert several files in parallel.
+	 * @param input_files Names of the files to read.
+	 * @param output_files Names of the files to write, one for each
+	 * input file. */
+	void convert(vector<string> input_files, vector<string> output_files);
+private:
+	Converter(shared_ptr<Context> context,
+		shared_ptr<OutputFormat> output_format,
+		map<string, Glib::VariantBase> options);
+	~Converter();
+
+	struct sr_convert *_structure;
+	shared_ptr<Context> _context;
+	shared_ptr<OutputFormat> _output_format;
+	shared_ptr<InputFormat> _input_format;
+
+	friend class Context;
+	friend struct std::default_delete<Converter>;
+};
+
 /** Base class for objects which wrap an enumeration value from libsigrok */
 template <class Class, typename Enum> class SR_API EnumValue
 {
@@ -528,24 +528,142 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
     }
 }
 
-/* Return NumPy array from Analog::data(). */
+%{
+static void packet_view_release(PyObject *capsule)
+{
+    delete static_cast<std::shared_ptr<sigrok::Packet> *>(
+        PyCapsule_GetPointer(capsule, nullptr));
+}
+
+/*
+ * Wrap packet data in a read-only NumPy array without copying it. The
+ * array's base object holds a reference to the packet, so the data
+ * stays valid as long as the array does. Payloads that don't belong
+ * to a packet are copied instead.
+ */
+static PyObject *packet_data_view(std::shared_ptr<sigrok::Packet> packet,
+    int nd, npy_intp *dims, PyArray_Descr *descr, void *data)
+{
+    PyObject *array, *capsule;
+
+    array = PyArray_NewFromDescr(&PyArray_Type, descr, nd, dims,
+        nullptr, data, NPY_ARRAY_C_CONTIGUOUS, nullptr);
+    if (!array)
+        return nullptr;
+
+    if (!packet) {
+        PyObject *copy = PyArray_NewCopy((PyArrayObject *)array, NPY_CORDER);
+        Py_DECREF(array);
+        return copy;
+    }
+
+    capsule = PyCapsule_New(new std::shared_ptr<sigrok::Packet>(packet),
+        nullptr, packet_view_release);
+    if (!capsule || PyArray_SetBaseObject((PyArrayObject *)array, capsule) < 0) {
+        Py_XDECREF(capsule);
+        Py_DECREF(array);
+        return nullptr;
+    }
+
+    return array;
+}
+%}
+
+/* Return NumPy arrays viewing the data of Analog packets. */
 %extend sigrok::Analog
 {
-    PyObject * _data()
+    PyObject * _raw_data()
     {
-        int nd = 2;
         npy_intp dims[2];
         dims[0] = $self->channels().size();
         dims[1] = $self->num_samples();
-        int typenum = NPY_FLOAT;
-        void *data = $self->data_pointer();
-        return PyArray_SimpleNewFromData(nd, dims, typenum, data);
+        int typenum;
+        switch ($self->unitsize()) {
+        case 1:
+            typenum = $self->is_signed() ? NPY_INT8 : NPY_UINT8;
+            break;
+        case 2:
+            typenum = $self->is_signed() ? NPY_INT16 : NPY_UINT16;
+            break;
+        case 4:
+            typenum = $self->is_float() ? NPY_FLOAT32 :
+                $self->is_signed() ? NPY_INT32 : NPY_UINT32;
+            break;
+        case 8:
+            typenum = $self->is_float() ? NPY_FLOAT64 :
+                $self->is_signed() ? NPY_INT64 : NPY_UINT64;
+            break;
+        default:
+            typenum = NPY_NOTYPE;
+            break;
+        }
+        if (typenum == NPY_NOTYPE || ($self->is_float()
+                && typenum != NPY_FLOAT32 && typenum != NPY_FLOAT64)) {
+            PyErr_Format(PyExc_ValueError,
+                "Unsupported analog encoding: %s of %u bytes",
+                $self->is_float() ? "float" : "integer", $self->unitsize());
+            return nullptr;
+        }
+        PyArray_Descr *native = PyArray_DescrFromType(typenum);
+        PyArray_Descr *descr = PyArray_DescrNewByteorder(native,
+            $self->is_bigendian() ? NPY_BIG : NPY_LITTLE);
+        Py_DECREF(native);
+        return packet_data_view($self->parent(), 2, dims, descr,
+            $self->data_pointer());
     }
 
 %pythoncode
 {
+    def _data(self):
+        raw = self._raw_data()
+        scale = self.scale()
+        offset = self.offset()
+        if (self.is_float() and raw.dtype.isnative and raw.itemsize == 4
+                and scale.numerator() == scale.denominator()
+                and offset.numerator() == 0):
+            return raw
+        data = raw.astype('float32')
+        data *= scale.numerator() / float(scale.denominator())
+        data += offset.numerator() / float(offset.denominator())
+        return data
+
+    raw_data = property(_raw_data)
     data = property(_data)
 }
 }
 
+/* Return NumPy arrays viewing the data of Logic packets. */
+%extend sigrok::Logic
+{
+    PyObject * _packed_data()
+    {
+        npy_intp dims[2];
+        dims[1] = $self->unit_size();
+        dims[0] = dims[1] ? $self->data_length() / dims[1] : 0;
+        return packet_data_view($self->parent(), 2, dims,
+            PyArray_DescrFromType(NPY_UINT8), $self->data_pointer());
+    }
+
+%pythoncode
+{
+    def _channel_data(self):
+        import numpy
+        bits = numpy.unpackbits(self._packed_data(), axis=1,
+            bitorder='little')
+        channels = self.channels
+        if not channels:
+            # Without a device, every bit of a sample is a channel.
+            return bits.T
+        # Channels sample into the bit of their index.
+        indices = [channel.index for channel in channels]
+        if max(indices) >= bits.shape[1]:
+            raise ValueError("Channel %d doesn't fit samples of %d bytes"
+                % (max(indices), self.unit_size()))
+        return bits[:, indices].T
+
+    data = property(_packed_data)
+    channel_data = property(_channel_data)
+}
+}
+
 %include "doc_end.i"
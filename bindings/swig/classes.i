@@ -71,6 +71,7 @@ template< class T > class enable_shared_from_this;
 %shared_ptr(sigrok::Option);
 %shared_ptr(sigrok::OutputFormat);
 %shared_ptr(sigrok::Output);
+%shared_ptr(sigrok::Converter);
 %shared_ptr(sigrok::Trigger);
 %shared_ptr(sigrok::TriggerStage);
 %shared_ptr(sigrok::TriggerMatch);
@@ -204,6 +205,9 @@ typedef std::map<const sigrok::ConfigKey *, Glib::VariantBase>
 
 %attributemap(Meta, map_ConfigKey_Variant, config, config);
 
+%attributevector(Logic,
+    std::vector<std::shared_ptr<sigrok::Channel> >, channels, channels);
+
 %attributevector(Analog,
     std::vector<std::shared_ptr<sigrok::Channel> >, channels, channels);
 %attribute(sigrok::Analog, int, num_samples, num_samples);
@@ -168,6 +168,10 @@ enum sr_packettype {
 	SR_DF_FRAME_END,
 	/** Payload is struct sr_datafeed_analog. */
 	SR_DF_ANALOG,
+	/** Payload is struct sr_datafeed_logic_rle. */
+	SR_DF_LOGIC_RLE,
+	/** Payload is struct sr_datafeed_logic_planar. */
+	SR_DF_LOGIC_PLANAR,
 
 	/* Update datafeed_dump() (session.c) upon changes! */
 };
@@ -496,6 +500,59 @@ struct sr_datafeed_logic {
 	void *data;
 };
 
+/**
+ * Run-length encoded logic datafeed payload for type SR_DF_LOGIC_RLE.
+ *
+ * Run i consists of lengths[i] consecutive samples which all have the
+ * value at values + i * unitsize. The sample layout is the same as in
+ * struct sr_datafeed_logic.
+ *
+ * Datafeed callbacks only receive packets of this type if they were
+ * registered using sr_session_datafeed_callback_add_rle(). All other
+ * callbacks receive the expanded samples as SR_DF_LOGIC packets.
+ *
+ * @since 0.6.0
+ */
+struct sr_datafeed_logic_rle {
+	/** Number of runs. */
+	uint64_t num_runs;
+	/** Size of one sample value in bytes. */
+	uint16_t unitsize;
+	/** Values of the runs, num_runs * unitsize bytes. */
+	void *values;
+	/** Lengths of the runs in samples, num_runs entries. */
+	uint64_t *lengths;
+};
+
+/**
+ * Planar logic datafeed payload for type SR_DF_LOGIC_PLANAR.
+ *
+ * Holds one packed bitstream per channel instead of one unitsize wide
+ * value per sample: bit (i % 8) of byte (i / 8) of a plane is sample i
+ * of that channel. Plane c carries the channel which would be bit c of
+ * the samples in the equivalent struct sr_datafeed_logic.
+ *
+ * Datafeed callbacks only receive packets of this type if they were
+ * registered using sr_session_datafeed_callback_add_planar(). All other
+ * callbacks receive the samples converted to an SR_DF_LOGIC packet, see
+ * sr_logic_planar_to_samples().
+ *
+ * @since 0.6.0
+ */
+struct sr_datafeed_logic_planar {
+	/** Number of samples per channel. */
+	uint64_t num_samples;
+	/** Size of one sample in the equivalent SR_DF_LOGIC packet. */
+	uint16_t unitsize;
+	/** Number of entries in planes, at most unitsize * 8. */
+	uint16_t num_planes;
+	/**
+	 * The planes, (num_samples + 7) / 8 bytes each. An entry is NULL
+	 * if the channel has no data, all its samples then read as 0.
+	 */
+	void **planes;
+};
+
 /** Analog datafeed payload for type SR_DF_ANALOG. */
 struct sr_datafeed_analog {
 	void *data;
@@ -538,6 +595,64 @@ struct sr_analog_spec {
 	int8_t spec_digits;
 };
 
+/** Type of a session pipeline stage, sr_session_stats.stage. */
+enum sr_stats_stage {
+	/** A transform module. */
+	SR_STATS_TRANSFORM = 10000,
+	/** A datafeed callback. */
+	SR_STATS_DATAFEED_CALLBACK,
+	/** An event source, i.e. a driver's receive callback. */
+	SR_STATS_EVENT_SOURCE,
+	/**
+	 * The USB transfers of a streaming acquisition. Counts transferred
+	 * bytes, and the time from submission to completion of transfers.
+	 */
+	SR_STATS_USB_TRANSFER,
+};
+
+/** Number of packet types counted in sr_session_stats.packets. */
+#define SR_STATS_PACKET_TYPES (SR_DF_LOGIC_PLANAR - SR_DF_HEADER + 1)
+/** Number of buckets in sr_session_stats.latency. */
+#define SR_STATS_LATENCY_BUCKETS 24
+
+/**
+ * Statistics of one stage of a session's data pipeline.
+ *
+ * @see sr_session_stats_enable(), sr_session_stats_get().
+ * @since 0.6.0
+ */
+struct sr_session_stats {
+	/** Type of the stage, see enum sr_stats_stage. */
+	int stage;
+	/**
+	 * Registration ID of the stage, unique within the session. A stage
+	 * which gets removed and added again has a new ID.
+	 */
+	unsigned int id;
+	/**
+	 * Name of the stage. The transform module's ID for transforms,
+	 * otherwise the kind of stage ("datafeed", "fd", "timer", "usb"),
+	 * followed by the address of the callback function if any.
+	 */
+	char *name;
+	/** Number of packets received, indexed by type - SR_DF_HEADER. */
+	uint64_t packets[SR_STATS_PACKET_TYPES];
+	/** Number of payload bytes in logic and analog packets received. */
+	uint64_t bytes;
+	/** Number of invocations. */
+	uint64_t calls;
+	/** Total time spent in the stage, in microseconds. */
+	uint64_t total_us;
+	/** Longest invocation, in microseconds. */
+	uint64_t max_us;
+	/**
+	 * Latency histogram. Bucket 0 counts invocations which took less
+	 * than 1us, bucket n those which took 2^(n-1) to 2^n - 1 us. The
+	 * last bucket also counts all longer invocations.
+	 */
+	uint64_t latency[SR_STATS_LATENCY_BUCKETS];
+};
+
 /** Generic option struct used by various subsystems. */
 struct sr_option {
 	/* Short name suitable for commandline usage, [a-z0-9-]. */
@@ -575,12 +690,24 @@ struct sr_resource {
 enum sr_output_flag {
 	/** If set, this output module writes the output itself. */
 	SR_OUTPUT_INTERNAL_IO_HANDLING = 0x01,
+	/**
+	 * If set, this output module handles SR_DF_LOGIC_RLE packets.
+	 * Otherwise sr_output_send() expands them to SR_DF_LOGIC packets.
+	 */
+	SR_OUTPUT_LOGIC_RLE = 0x02,
+	/**
+	 * If set, this output module handles SR_DF_LOGIC_PLANAR packets.
+	 * Otherwise sr_output_send() converts them to SR_DF_LOGIC packets.
+	 */
+	SR_OUTPUT_LOGIC_PLANAR = 0x04,
 };
 
+struct sr_convert;
 struct sr_input;
 struct sr_input_module;
 struct sr_output;
 struct sr_output_module;
+struct sr_output_sink;
 struct sr_transform;
 struct sr_transform_module;
 
@@ -995,6 +1122,20 @@ enum sr_configkey {
 	 */
 	SR_CONF_EXTERNAL_CLOCK_SOURCE,
 
+	/**
+	 * Maximum number of readings per channel to collect into one
+	 * analog packet. 1 sends every reading as soon as it arrives.
+	 * @arg type: uint64
+	 */
+	SR_CONF_BATCH_SIZE,
+
+	/**
+	 * Maximum time in ms a reading may be held back to fill a batch
+	 * of SR_CONF_BATCH_SIZE readings. 0 means no limit.
+	 * @arg type: uint64
+	 */
+	SR_CONF_BATCH_LATENCY,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 
 	/*--- Special stuff -------------------------------------------------*/
@@ -1174,6 +1315,21 @@ struct sr_dev_driver {
 	/* Dynamic */
 	/** Device driver context, considered private. Initialized by init(). */
 	void *context;
+
+	/* Added after the above, which keep their offsets. */
+	/** Query several configuration keys in one transaction. Optional,
+	 *  the data of each struct sr_config is NULL on entry and must be
+	 *  filled with a floating reference for each key that was read.
+	 *  @see sr_config_get_multi().
+	 */
+	int (*config_get_multi) (GSList *configs,
+			const struct sr_dev_inst *sdi,
+			const struct sr_channel_group *cg);
+	/** Set several configuration keys in one transaction. Optional.
+	 *  @see sr_config_set_multi(). */
+	int (*config_set_multi) (GSList *configs,
+			const struct sr_dev_inst *sdi,
+			const struct sr_channel_group *cg);
 };
 
 /** Serial port descriptor. */
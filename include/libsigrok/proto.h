@@ -58,6 +58,24 @@ SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
 		uint64_t count);
 
+/*--- convert.c -------------------------------------------------------------*/
+
+SR_API int sr_convert_new(struct sr_context *ctx, struct sr_convert **conv);
+SR_API int sr_convert_set_input(struct sr_convert *conv,
+		const struct sr_input_module *imod, GHashTable *options);
+SR_API int sr_convert_set_output(struct sr_convert *conv,
+		const struct sr_output_module *omod, GHashTable *options);
+SR_API int sr_convert_add_transform(struct sr_convert *conv,
+		const struct sr_transform_module *tmod, GHashTable *options);
+SR_API int sr_convert_set_workers(struct sr_convert *conv,
+		unsigned int num_workers);
+SR_API int sr_convert_file(const struct sr_convert *conv,
+		const char *infile, const char *outfile);
+SR_API int sr_convert_files(const struct sr_convert *conv,
+		const char *const *infiles, const char *const *outfiles,
+		size_t count);
+SR_API int sr_convert_free(struct sr_convert *conv);
+
 /*--- log.c -----------------------------------------------------------------*/
 
 typedef int (*sr_log_callback)(void *cb_data, int loglevel,
@@ -96,6 +114,8 @@ SR_API GSList *sr_dev_inst_channel_groups_get(const struct sr_dev_inst *sdi);
 SR_API struct sr_dev_inst *sr_dev_inst_user_new(const char *vendor,
 		const char *model, const char *version);
 SR_API int sr_dev_inst_channel_add(struct sr_dev_inst *sdi, int index, int type, const char *name);
+SR_API int sr_dev_inst_user_send(struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
 
 /*--- hwdriver.c ------------------------------------------------------------*/
 
@@ -112,6 +132,13 @@ SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
 		uint32_t key, GVariant *data);
 SR_API int sr_config_commit(const struct sr_dev_inst *sdi);
+SR_API int sr_config_get_multi(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		GSList *configs);
+SR_API int sr_config_set_multi(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		GSList *configs);
 SR_API int sr_config_list(const struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
@@ -144,6 +171,12 @@ SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger
 SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session);
 SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 		sr_datafeed_callback cb, void *cb_data);
+SR_API int sr_session_datafeed_callback_add_rle(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data);
+SR_API int sr_session_datafeed_callback_add_planar(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data);
+SR_API void sr_logic_planar_to_samples(
+		const struct sr_datafeed_logic_planar *planar, void *data);
 
 /* Session control */
 SR_API int sr_session_start(struct sr_session *session);
@@ -153,6 +186,15 @@ SR_API int sr_session_is_running(struct sr_session *session);
 SR_API int sr_session_stopped_callback_set(struct sr_session *session,
 		sr_session_stopped_callback cb, void *cb_data);
 
+/* Pipeline statistics */
+SR_API int sr_session_stats_enable(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_stats_reset(struct sr_session *session);
+SR_API int sr_session_stats_get(struct sr_session *session, GSList **stats);
+SR_API void sr_session_stats_free(GSList *stats);
+SR_API int sr_session_reactor_enable(struct sr_session *session,
+		gboolean enable);
+
 /*--- input/input.c ---------------------------------------------------------*/
 
 SR_API const struct sr_input_module **sr_input_list(void);
@@ -193,8 +235,25 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 		const char *filename);
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out);
+SR_API int sr_output_send_to(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		struct sr_output_sink *sink);
 SR_API int sr_output_free(const struct sr_output *o);
 
+typedef int (*sr_output_sink_callback)(const uint8_t *data, size_t length,
+		void *cb_data);
+
+SR_API struct sr_output_sink *sr_output_sink_new_fd(int fd);
+SR_API struct sr_output_sink *sr_output_sink_new_file(FILE *file);
+SR_API struct sr_output_sink *sr_output_sink_new_callback(
+		sr_output_sink_callback cb, void *cb_data);
+SR_API struct sr_output_sink *sr_output_sink_new_arena(void);
+SR_API const uint8_t *sr_output_sink_arena_data(
+		const struct sr_output_sink *sink, size_t *length);
+SR_API void sr_output_sink_arena_reset(struct sr_output_sink *sink);
+SR_API int sr_output_sink_flush(struct sr_output_sink *sink);
+SR_API int sr_output_sink_free(struct sr_output_sink *sink);
+
 /*--- transform/transform.c -------------------------------------------------*/
 
 SR_API const struct sr_transform_module **sr_transform_list(void);
@@ -208,6 +267,20 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 		GHashTable *params, const struct sr_dev_inst *sdi);
 SR_API int sr_transform_free(const struct sr_transform *t);
 
+/*--- transform/overview.c --------------------------------------------------*/
+
+SR_API int sr_transform_overview_level(const struct sr_transform *t,
+		const struct sr_channel *ch, unsigned int level,
+		uint64_t *block_samples, uint64_t *num_blocks);
+SR_API unsigned int sr_transform_overview_unitsize(const struct sr_transform *t);
+SR_API int sr_transform_overview_logic(const struct sr_transform *t,
+		unsigned int level, uint64_t first, uint64_t count,
+		uint8_t *or_bits, uint8_t *and_bits, uint64_t *transitions);
+SR_API int sr_transform_overview_analog(const struct sr_transform *t,
+		const struct sr_channel *ch, unsigned int level,
+		uint64_t first, uint64_t count,
+		float *min, float *max, float *mean);
+
 /*--- trigger.c -------------------------------------------------------------*/
 
 SR_API struct sr_trigger *sr_trigger_new(const char *name);
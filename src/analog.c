@@ -154,6 +154,149 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 	return SR_OK;
 }
 
+/**
+ * Initialize an analog batch.
+ *
+ * @param batch The batch to initialize.
+ * @param channels The channel list of the sent packets.
+ * @param free_channels Whether sr_analog_batch_clear() frees the list
+ *                      (but not the channels).
+ * @param max_values Maximum number of readings per packet. 0 or 1 send
+ *                   each reading in a packet of its own.
+ * @param latency_ms Maximum time a reading is held back, 0 for no limit.
+ *
+ * @private
+ */
+SR_PRIV void sr_analog_batch_init(struct sr_analog_batch *batch,
+		GSList *channels, gboolean free_channels, size_t max_values,
+		uint64_t latency_ms)
+{
+	memset(batch, 0, sizeof(*batch));
+	batch->channels = channels;
+	batch->free_channels = free_channels;
+	batch->max_values = MAX(max_values, 1);
+	batch->values = g_malloc(batch->max_values * sizeof(float));
+	batch->latency_us = latency_ms * 1000;
+}
+
+/* Whether a reading can be sent in the same packet as the pending ones. */
+static gboolean analog_batch_matches(const struct sr_analog_batch *batch,
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_analog_meaning *meaning;
+
+	meaning = analog->meaning;
+
+	return meaning->mq == batch->meaning.mq
+		&& meaning->unit == batch->meaning.unit
+		&& meaning->mqflags == batch->meaning.mqflags
+		&& analog->encoding->digits == batch->encoding.digits
+		&& analog->spec->spec_digits == batch->spec.spec_digits;
+}
+
+/**
+ * Add a reading to an analog batch.
+ *
+ * Sends the pending readings first if the reading's format differs from
+ * theirs, and sends the batch once it is full or its deadline has passed.
+ *
+ * @param sdi The device instance to send the packets for.
+ * @param batch The batch to use.
+ * @param analog The reading's format. Only the encoding, meaning (except
+ *               for the channels) and spec are used.
+ * @param value The reading.
+ *
+ * @private
+ */
+SR_PRIV int sr_analog_batch_add(const struct sr_dev_inst *sdi,
+		struct sr_analog_batch *batch,
+		const struct sr_datafeed_analog *analog, float value)
+{
+	int ret;
+
+	if (batch->num_values && !analog_batch_matches(batch, analog)) {
+		if ((ret = sr_analog_batch_flush(sdi, batch)) != SR_OK)
+			return ret;
+	}
+
+	if (!batch->num_values) {
+		batch->encoding = *analog->encoding;
+		batch->meaning = *analog->meaning;
+		batch->meaning.channels = batch->channels;
+		batch->spec = *analog->spec;
+		if (batch->latency_us)
+			batch->deadline = g_get_monotonic_time() + batch->latency_us;
+	}
+	batch->values[batch->num_values++] = value;
+
+	if (batch->num_values == batch->max_values)
+		return sr_analog_batch_flush(sdi, batch);
+
+	return sr_analog_batch_check(sdi, batch);
+}
+
+/**
+ * Send the pending readings of a batch if its deadline has passed.
+ *
+ * Drivers should call this periodically, e.g. from their receive
+ * callback, also when there is no new data.
+ *
+ * @private
+ */
+SR_PRIV int sr_analog_batch_check(const struct sr_dev_inst *sdi,
+		struct sr_analog_batch *batch)
+{
+	if (!batch->num_values || !batch->latency_us)
+		return SR_OK;
+	if (g_get_monotonic_time() < batch->deadline)
+		return SR_OK;
+
+	return sr_analog_batch_flush(sdi, batch);
+}
+
+/**
+ * Send the pending readings of a batch, if any.
+ *
+ * @private
+ */
+SR_PRIV int sr_analog_batch_flush(const struct sr_dev_inst *sdi,
+		struct sr_analog_batch *batch)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	int ret;
+
+	if (!batch->num_values)
+		return SR_OK;
+
+	analog.data = batch->values;
+	analog.num_samples = batch->num_values;
+	analog.encoding = &batch->encoding;
+	analog.meaning = &batch->meaning;
+	analog.spec = &batch->spec;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	ret = sr_session_send(sdi, &packet);
+	batch->num_values = 0;
+
+	return ret;
+}
+
+/**
+ * Free the resources of an analog batch. Pending readings are dropped.
+ *
+ * @private
+ */
+SR_PRIV void sr_analog_batch_clear(struct sr_analog_batch *batch)
+{
+	g_free(batch->values);
+	batch->values = NULL;
+	if (batch->free_channels)
+		g_slist_free(batch->channels);
+	batch->channels = NULL;
+	batch->num_values = 0;
+}
+
 /**
  * Convert an analog datafeed payload to an array of floats.
  *
@@ -592,6 +592,11 @@ SR_API int sr_init(struct sr_context **ctx)
 		ret = SR_ERR;
 		goto done;
 	}
+	if ((ret = sr_usb_recorder_init(context)) != SR_OK) {
+		libusb_exit(context->libusb_ctx);
+		goto done;
+	}
+	sr_usb_event_thread_init(context);
 #endif
 	sr_resource_set_hooks(context, NULL, NULL, NULL, NULL);
 
@@ -622,12 +627,15 @@ SR_API int sr_exit(struct sr_context *ctx)
 	}
 
 	sr_hw_cleanup_all(ctx);
+	sr_input_scan_cache_clear();
 
 #ifdef _WIN32
 	WSACleanup();
 #endif
 
 #ifdef HAVE_LIBUSB_1_0
+	sr_usb_event_thread_cleanup(ctx);
+	sr_usb_recorder_cleanup(ctx);
 	libusb_exit(ctx->libusb_ctx);
 #endif
 
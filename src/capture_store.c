@@ -0,0 +1,399 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Segmented sample storage for whole captures, which spills to disk.
+ * @internal
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "capture-store"
+
+/*
+ * Size of a segment in bytes. Segments hold a whole number of samples,
+ * so they may use a little less. File backed segments start at multiples
+ * of this size in the file, which keeps their offsets page aligned.
+ */
+#define SEGMENT_SIZE		(16 * 1024 * 1024)
+
+/*
+ * Initial size of the first segment in bytes. It grows up to a whole
+ * segment as samples are added, so small captures stay small.
+ */
+#define FIRST_SEGMENT_SIZE	(64 * 1024)
+
+/* Memory budget for segments on the heap, if none was specified. */
+#define DEFAULT_MEM_BUDGET	(256 * 1024 * 1024)
+
+struct capture_segment {
+	uint8_t *data;
+	/* Bytes allocated, less than a segment while the first one grows. */
+	size_t size;
+	/* Whether the segment is mapped from the backing file. */
+	gboolean mapped;
+};
+
+struct sr_capture_store {
+	unsigned int unitsize;
+	/* Number of samples per segment. */
+	uint64_t segment_samples;
+	/* Number of samples in the store. */
+	uint64_t num_samples;
+	/* Bytes of segments which may be, and are, allocated on the heap. */
+	uint64_t mem_budget;
+	uint64_t mem_used;
+	/* Array of struct capture_segment. */
+	GArray *segments;
+	/* Backing file for segments beyond the budget, -1 if none yet. */
+	int fd;
+	/* Number of segments in the backing file. */
+	uint64_t file_segments;
+};
+
+/**
+ * Create a capture store.
+ *
+ * Segments of the store get allocated on the heap up to the memory
+ * budget, and are mapped from an anonymous temporary file beyond it.
+ * On platforms without mmap() all segments are allocated on the heap.
+ *
+ * @param unitsize Size of a sample in bytes.
+ * @param mem_budget Bytes of samples to keep on the heap, or 0 for the
+ *                   default budget.
+ *
+ * @return The new store, or NULL if unitsize is 0.
+ */
+SR_PRIV struct sr_capture_store *sr_capture_store_new(unsigned int unitsize,
+		uint64_t mem_budget)
+{
+	struct sr_capture_store *store;
+
+	if (!unitsize || unitsize > SEGMENT_SIZE)
+		return NULL;
+
+	store = g_malloc0(sizeof(*store));
+	store->unitsize = unitsize;
+	store->segment_samples = SEGMENT_SIZE / unitsize;
+	store->mem_budget = mem_budget ? mem_budget : DEFAULT_MEM_BUDGET;
+	store->segments = g_array_new(FALSE, TRUE,
+			sizeof(struct capture_segment));
+	store->fd = -1;
+
+	return store;
+}
+
+#ifdef HAVE_SYS_MMAN_H
+static uint8_t *segment_map(struct sr_capture_store *store)
+{
+	gchar *path;
+	GError *error;
+	off_t offset;
+	void *data;
+
+	if (store->fd < 0) {
+		error = NULL;
+		store->fd = g_file_open_tmp("libsigrok-capture-XXXXXX",
+				&path, &error);
+		if (store->fd < 0) {
+			sr_err("Failed to create capture file: %s.",
+				error->message);
+			g_error_free(error);
+			return NULL;
+		}
+		/* The file only lives as long as it is open. */
+		g_unlink(path);
+		g_free(path);
+		sr_info("Capture exceeds the memory budget, using a file.");
+	}
+
+	offset = (off_t)store->file_segments * SEGMENT_SIZE;
+	if (ftruncate(store->fd, offset + SEGMENT_SIZE) < 0) {
+		sr_err("Failed to grow capture file: %s.", g_strerror(errno));
+		return NULL;
+	}
+	data = mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+			store->fd, offset);
+	if (data == MAP_FAILED) {
+		sr_err("Failed to map capture file: %s.", g_strerror(errno));
+		return NULL;
+	}
+	store->file_segments++;
+
+	return data;
+}
+#endif
+
+/* Allocate a segment, or grow it, to hold at least size bytes. */
+static int segment_grow(struct sr_capture_store *store,
+		struct capture_segment *seg, size_t size)
+{
+	uint8_t *data;
+	size_t full, new_size;
+
+	if (seg->size >= size)
+		return SR_OK;
+
+	full = store->segment_samples * store->unitsize;
+	new_size = full;
+	if (store->segments->len == 1) {
+		/* Double the first segment, so appending stays cheap. */
+		new_size = MAX(seg->size * 2, FIRST_SEGMENT_SIZE);
+		new_size = MIN(MAX(new_size, size), full);
+	}
+
+	data = NULL;
+	if (store->mem_used - seg->size + new_size <= store->mem_budget)
+		data = g_try_realloc(seg->data, new_size);
+	if (data) {
+		memset(data + seg->size, 0, new_size - seg->size);
+		store->mem_used += new_size - seg->size;
+		seg->data = data;
+		seg->size = new_size;
+		return SR_OK;
+	}
+#ifdef HAVE_SYS_MMAN_H
+	if ((data = segment_map(store))) {
+		/* A segment outgrowing the budget moves to the file. */
+		if (seg->size)
+			memcpy(data, seg->data, seg->size);
+		g_free(seg->data);
+		store->mem_used -= seg->size;
+		seg->data = data;
+		seg->size = full;
+		seg->mapped = TRUE;
+		return SR_OK;
+	}
+#endif
+	sr_err("Failed to allocate capture segment.");
+
+	return SR_ERR_MALLOC;
+}
+
+/* Make sure segments exist for the first num_samples samples. */
+static int segments_alloc(struct sr_capture_store *store, uint64_t num_samples)
+{
+	struct capture_segment seg;
+	uint64_t i, count;
+	int ret;
+
+	/* Segments before the last one are complete. */
+	i = store->segments->len ? store->segments->len - 1 : 0;
+	for (; i * store->segment_samples < num_samples; i++) {
+		if (i == store->segments->len) {
+			memset(&seg, 0, sizeof(seg));
+			g_array_append_val(store->segments, seg);
+		}
+		count = MIN(num_samples - i * store->segment_samples,
+			store->segment_samples);
+		ret = segment_grow(store, &g_array_index(store->segments,
+			struct capture_segment, i), count * store->unitsize);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Free a capture store, and all of its samples.
+ *
+ * @param store The store. Can be NULL.
+ */
+SR_PRIV void sr_capture_store_free(struct sr_capture_store *store)
+{
+	struct capture_segment *seg;
+	unsigned int i;
+
+	if (!store)
+		return;
+
+	for (i = 0; i < store->segments->len; i++) {
+		seg = &g_array_index(store->segments, struct capture_segment, i);
+#ifdef HAVE_SYS_MMAN_H
+		if (seg->mapped) {
+			munmap(seg->data, SEGMENT_SIZE);
+			continue;
+		}
+#endif
+		g_free(seg->data);
+	}
+	g_array_free(store->segments, TRUE);
+	if (store->fd >= 0)
+		close(store->fd);
+	g_free(store);
+}
+
+/**
+ * Get the number of samples in a capture store.
+ *
+ * @param store The store. Must not be NULL.
+ *
+ * @return The number of samples.
+ */
+SR_PRIV uint64_t sr_capture_store_samples(const struct sr_capture_store *store)
+{
+	return store->num_samples;
+}
+
+/**
+ * Set the number of samples in a capture store.
+ *
+ * Samples added this way are all zero, unless they were stored before
+ * the store was made shorter. This allows filling the store in any
+ * order, through sr_capture_store_get().
+ *
+ * @param store The store. Must not be NULL.
+ * @param num_samples The new number of samples.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_MALLOC Not enough memory or disk space.
+ */
+SR_PRIV int sr_capture_store_set_length(struct sr_capture_store *store,
+		uint64_t num_samples)
+{
+	int ret;
+
+	if ((ret = segments_alloc(store, num_samples)) != SR_OK)
+		return ret;
+	store->num_samples = num_samples;
+
+	return SR_OK;
+}
+
+/**
+ * Get direct access to samples in a capture store.
+ *
+ * The samples can be read and modified through the returned pointer,
+ * until the store next grows.
+ * Since samples are stored in segments, the returned range may be
+ * shorter than requested, in which case the rest has to be accessed
+ * with another call.
+ *
+ * @param store The store. Must not be NULL.
+ * @param start Index of the first sample.
+ * @param count Number of samples requested. Upon return, the number of
+ *              samples which are accessible through the returned
+ *              pointer. Must not be NULL.
+ *
+ * @return Pointer to the sample at index start, or NULL if start is
+ *         beyond the end of the store.
+ */
+SR_PRIV uint8_t *sr_capture_store_get(struct sr_capture_store *store,
+		uint64_t start, uint64_t *count)
+{
+	struct capture_segment *seg;
+	uint64_t offset;
+
+	if (start >= store->num_samples) {
+		*count = 0;
+		return NULL;
+	}
+
+	seg = &g_array_index(store->segments, struct capture_segment,
+			start / store->segment_samples);
+	offset = start % store->segment_samples;
+	*count = MIN(*count, store->segment_samples - offset);
+	*count = MIN(*count, store->num_samples - start);
+
+	return seg->data + offset * store->unitsize;
+}
+
+/**
+ * Append samples to a capture store.
+ *
+ * @param store The store. Must not be NULL.
+ * @param data The samples. Must not be NULL.
+ * @param num_samples Number of samples.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_MALLOC Not enough memory or disk space.
+ */
+SR_PRIV int sr_capture_store_append(struct sr_capture_store *store,
+		const void *data, uint64_t num_samples)
+{
+	const uint8_t *src;
+	uint8_t *dst;
+	uint64_t pos, count;
+	int ret;
+
+	pos = store->num_samples;
+	ret = sr_capture_store_set_length(store, pos + num_samples);
+	if (ret != SR_OK)
+		return ret;
+
+	src = data;
+	while (num_samples) {
+		count = num_samples;
+		dst = sr_capture_store_get(store, pos, &count);
+		memcpy(dst, src, count * store->unitsize);
+		src += count * store->unitsize;
+		pos += count;
+		num_samples -= count;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Send samples from a capture store to the session, as SR_DF_LOGIC
+ * packets.
+ *
+ * @param store The store. Must not be NULL.
+ * @param sdi The device instance to send the packets for.
+ * @param start Index of the first sample.
+ * @param num_samples Number of samples.
+ *
+ * @retval SR_OK Success.
+ * @retval other Error code returned by sr_session_send().
+ */
+SR_PRIV int sr_capture_store_send_logic(struct sr_capture_store *store,
+		const struct sr_dev_inst *sdi, uint64_t start,
+		uint64_t num_samples)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	uint64_t done, count;
+	int ret;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = store->unitsize;
+	for (done = 0; done < num_samples; done += count) {
+		count = num_samples - done;
+		logic.data = sr_capture_store_get(store, start + done, &count);
+		if (!logic.data)
+			break;
+		logic.length = count * store->unitsize;
+		if ((ret = sr_session_send(sdi, &packet)) != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
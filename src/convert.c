@@ -0,0 +1,744 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "convert"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Converting files from one format to another.
+ */
+
+/**
+ * @defgroup grp_convert Conversion
+ *
+ * Converting files from one format to another.
+ *
+ * A converter connects an input module to an output module, optionally
+ * running transform modules in between, without a session main loop.
+ * Reading the input file and writing the output file are done on their
+ * own threads, so that they overlap with parsing and formatting.
+ * Several files can be converted in parallel.
+ *
+ * @{
+ */
+
+/* Size of the blocks which get read from the input file. */
+#define CONVERT_CHUNK_SIZE	(1024 * 1024)
+/* Number of blocks in flight between the pipeline stages. */
+#define CONVERT_QUEUE_DEPTH	4
+
+struct convert_transform {
+	const struct sr_transform_module *tmod;
+	GHashTable *options;
+};
+
+struct sr_convert {
+	struct sr_context *ctx;
+	const struct sr_input_module *imod;
+	GHashTable *in_options;
+	const struct sr_output_module *omod;
+	GHashTable *out_options;
+	/* List of struct convert_transform pointers. */
+	GSList *transforms;
+	unsigned int num_workers;
+};
+
+/*
+ * A bounded queue of buffers between two pipeline stages. The producer
+ * takes empty buffers from 'free' and blocks when all of them are in
+ * flight. An empty buffer in 'full' signals the end of the stream.
+ */
+struct convert_queue {
+	GAsyncQueue *free;
+	GAsyncQueue *full;
+};
+
+/* State of the conversion of one file. */
+struct convert_job {
+	const struct sr_convert *conv;
+	const char *outfile;
+	struct sr_session *session;
+	const struct sr_output *output;
+	struct sr_output_sink *sink;
+	FILE *in_file;
+	FILE *out_file;
+	struct convert_queue read_queue;
+	struct convert_queue write_queue;
+	GThread *writer;
+	/* Set if the session was loaded from a session file. */
+	gboolean loaded;
+	/* Error from the datafeed callback. */
+	int ret;
+	/* Set to make the reader thread stop early. */
+	gint abort;
+	gint read_error;
+	gint write_error;
+};
+
+/* A file to convert, as queued to the worker pool. */
+struct convert_item {
+	const char *infile;
+	const char *outfile;
+	int ret;
+};
+
+static void convert_queue_init(struct convert_queue *queue)
+{
+	int i;
+
+	queue->free = g_async_queue_new();
+	queue->full = g_async_queue_new();
+	for (i = 0; i < CONVERT_QUEUE_DEPTH; i++)
+		g_async_queue_push(queue->free, g_string_sized_new(0));
+}
+
+/* All buffers must have been returned to the 'free' queue. */
+static void convert_queue_clear(struct convert_queue *queue)
+{
+	GString *buf;
+
+	if (!queue->free)
+		return;
+	while ((buf = g_async_queue_try_pop(queue->free)))
+		g_string_free(buf, TRUE);
+	g_async_queue_unref(queue->free);
+	g_async_queue_unref(queue->full);
+}
+
+static gpointer convert_read_thread(gpointer data)
+{
+	struct convert_job *job;
+	GString *buf;
+	size_t len;
+
+	job = data;
+	do {
+		buf = g_async_queue_pop(job->read_queue.free);
+		len = 0;
+		if (!g_atomic_int_get(&job->abort)) {
+			g_string_set_size(buf, CONVERT_CHUNK_SIZE);
+			len = fread(buf->str, 1, CONVERT_CHUNK_SIZE, job->in_file);
+			if (ferror(job->in_file)) {
+				sr_err("Failed to read input: %s.",
+					g_strerror(errno));
+				g_atomic_int_set(&job->read_error, 1);
+				len = 0;
+			}
+		}
+		g_string_set_size(buf, len);
+		g_async_queue_push(job->read_queue.full, buf);
+	} while (len);
+
+	return NULL;
+}
+
+static gpointer convert_write_thread(gpointer data)
+{
+	struct convert_job *job;
+	GString *buf;
+
+	job = data;
+	while ((buf = g_async_queue_pop(job->write_queue.full))->len) {
+		if (!g_atomic_int_get(&job->write_error) &&
+				fwrite(buf->str, 1, buf->len, job->out_file) != buf->len) {
+			sr_err("Failed to write output: %s.", g_strerror(errno));
+			g_atomic_int_set(&job->write_error, 1);
+		}
+		g_async_queue_push(job->write_queue.free, buf);
+	}
+	g_async_queue_push(job->write_queue.free, buf);
+
+	return NULL;
+}
+
+/* Output sink callback, hands the output to the writer thread. */
+static int convert_write(const uint8_t *data, size_t length, void *cb_data)
+{
+	struct convert_job *job;
+	GString *buf;
+
+	job = cb_data;
+	if (g_atomic_int_get(&job->write_error))
+		return SR_ERR_IO;
+
+	buf = g_async_queue_pop(job->write_queue.free);
+	g_string_truncate(buf, 0);
+	g_string_append_len(buf, (const char *)data, length);
+	g_async_queue_push(job->write_queue.full, buf);
+
+	return SR_OK;
+}
+
+static void convert_datafeed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct convert_job *job;
+
+	(void)sdi;
+
+	job = cb_data;
+	if (job->ret != SR_OK)
+		return;
+	job->ret = sr_output_send_to(job->output, packet, job->sink);
+	if (job->ret != SR_OK && job->loaded)
+		sr_session_stop(job->session);
+}
+
+/* Connect a device instance to the transforms and the output. */
+static int convert_setup(struct convert_job *job, struct sr_dev_inst *sdi)
+{
+	const struct sr_convert *conv;
+	const struct convert_transform *ct;
+	GSList *l;
+
+	conv = job->conv;
+	for (l = conv->transforms; l; l = l->next) {
+		ct = l->data;
+		if (!sr_transform_new(ct->tmod, ct->options, sdi)) {
+			sr_err("Failed to set up transform module '%s'.",
+				ct->tmod->id);
+			return SR_ERR;
+		}
+	}
+
+	job->output = sr_output_new(conv->omod, conv->out_options, sdi,
+			job->outfile);
+	if (!job->output) {
+		sr_err("Failed to set up output module '%s'.", conv->omod->id);
+		return SR_ERR;
+	}
+
+	return sr_session_datafeed_callback_add(job->session,
+			convert_datafeed, job);
+}
+
+/*
+ * Connect the input's device instance to the transforms and the output,
+ * as soon as the input module has made it available.
+ */
+static int convert_connect(struct convert_job *job, const struct sr_input *in)
+{
+	struct sr_dev_inst *sdi;
+	int ret;
+
+	sdi = sr_input_dev_inst_get(in);
+	if (!sdi)
+		return SR_OK;
+
+	if ((ret = sr_session_dev_add(job->session, sdi)) != SR_OK)
+		return ret;
+
+	return convert_setup(job, sdi);
+}
+
+/* Open the output file, and start the writer thread if needed. */
+static int convert_output_open(struct convert_job *job)
+{
+	const struct sr_convert *conv;
+
+	conv = job->conv;
+
+	/* Modules with internal I/O handling write to the file themselves. */
+	if (sr_output_test_flag(conv->omod, SR_OUTPUT_INTERNAL_IO_HANDLING)) {
+		job->sink = sr_output_sink_new_arena();
+		return SR_OK;
+	}
+
+	job->out_file = g_fopen(job->outfile, "wb");
+	if (!job->out_file) {
+		sr_err("Failed to open %s: %s", job->outfile,
+			g_strerror(errno));
+		return SR_ERR;
+	}
+	job->sink = sr_output_sink_new_callback(convert_write, job);
+	convert_queue_init(&job->write_queue);
+	job->writer = g_thread_new("sr-convert-write",
+			convert_write_thread, job);
+
+	return SR_OK;
+}
+
+/* Flush the output, stop the writer thread, and close the output file. */
+static int convert_output_close(struct convert_job *job, int ret)
+{
+	GString *buf;
+
+	if (job->writer) {
+		if (sr_output_sink_flush(job->sink) != SR_OK && ret == SR_OK)
+			ret = SR_ERR_IO;
+		buf = g_async_queue_pop(job->write_queue.free);
+		g_string_truncate(buf, 0);
+		g_async_queue_push(job->write_queue.full, buf);
+		g_thread_join(job->writer);
+		job->writer = NULL;
+		if (g_atomic_int_get(&job->write_error) && ret == SR_OK)
+			ret = SR_ERR_IO;
+	}
+	if (job->out_file && fclose(job->out_file) != 0 && ret == SR_OK) {
+		sr_err("Failed to write %s: %s", job->outfile,
+			g_strerror(errno));
+		ret = SR_ERR_IO;
+	}
+	job->out_file = NULL;
+
+	return ret;
+}
+
+static void convert_job_cleanup(struct convert_job *job)
+{
+	GSList *l;
+
+	if (job->session) {
+		for (l = job->session->transforms; l; l = l->next)
+			sr_transform_free(l->data);
+		g_slist_free(job->session->transforms);
+		job->session->transforms = NULL;
+	}
+	if (job->output)
+		sr_output_free(job->output);
+	if (job->session)
+		sr_session_destroy(job->session);
+	if (job->sink)
+		sr_output_sink_free(job->sink);
+	if (job->in_file)
+		fclose(job->in_file);
+	convert_queue_clear(&job->read_queue);
+	convert_queue_clear(&job->write_queue);
+}
+
+/*
+ * Convert a sigrok session file. There is no input module for these,
+ * so the session file driver plays it back in a session of its own,
+ * with its own main context on this thread.
+ */
+static int convert_session_file(const struct sr_convert *conv,
+		const char *infile, const char *outfile)
+{
+	struct convert_job job;
+	GMainContext *main_context;
+	GSList *devices;
+	int ret;
+
+	memset(&job, 0, sizeof(job));
+	job.conv = conv;
+	job.outfile = outfile;
+	job.loaded = TRUE;
+
+	main_context = g_main_context_new();
+	g_main_context_push_thread_default(main_context);
+
+	devices = NULL;
+	if ((ret = sr_session_load(conv->ctx, infile, &job.session)) != SR_OK)
+		sr_err("Failed to load %s.", infile);
+	else
+		sr_session_dev_list(job.session, &devices);
+	if (ret == SR_OK && !devices) {
+		sr_err("No data in %s.", infile);
+		ret = SR_ERR_DATA;
+	}
+
+	if (ret == SR_OK)
+		ret = convert_output_open(&job);
+	if (ret == SR_OK)
+		ret = convert_setup(&job, devices->data);
+	if (ret == SR_OK)
+		ret = sr_session_start(job.session);
+	if (ret == SR_OK)
+		ret = sr_session_run(job.session);
+	if (ret == SR_OK)
+		ret = job.ret;
+	g_slist_free(devices);
+
+	ret = convert_output_close(&job, ret);
+	convert_job_cleanup(&job);
+
+	g_main_context_pop_thread_default(main_context);
+	g_main_context_unref(main_context);
+
+	return ret;
+}
+
+static int convert_file(const struct sr_convert *conv,
+		const char *infile, const char *outfile)
+{
+	struct convert_job job;
+	const struct sr_input *in;
+	GThread *reader;
+	GString *buf;
+	size_t len;
+	int ret;
+
+	if (!conv->imod && sr_sessionfile_check(infile) == SR_OK)
+		return convert_session_file(conv, infile, outfile);
+
+	memset(&job, 0, sizeof(job));
+	job.conv = conv;
+	job.outfile = outfile;
+
+	in = NULL;
+	if (conv->imod)
+		in = sr_input_new(conv->imod, conv->in_options);
+	else
+		sr_input_scan_file(infile, &in);
+	if (!in) {
+		sr_err("Failed to set up an input module for %s.", infile);
+		return SR_ERR;
+	}
+
+	job.in_file = g_fopen(infile, "rb");
+	if (!job.in_file) {
+		sr_err("Failed to open %s: %s", infile, g_strerror(errno));
+		sr_input_free(in);
+		return SR_ERR;
+	}
+
+	if (convert_output_open(&job) != SR_OK) {
+		convert_job_cleanup(&job);
+		sr_input_free(in);
+		return SR_ERR;
+	}
+
+	sr_session_new(conv->ctx, &job.session);
+	convert_queue_init(&job.read_queue);
+	reader = g_thread_new("sr-convert-read", convert_read_thread, &job);
+
+	/*
+	 * Feed the input module until the reader thread signals the end
+	 * of the file. After an error, keep taking buffers from the queue
+	 * until the reader thread has noticed the abort request.
+	 */
+	ret = SR_OK;
+	do {
+		buf = g_async_queue_pop(job.read_queue.full);
+		len = buf->len;
+		if (len && ret == SR_OK) {
+			ret = sr_input_send(in, buf);
+			if (ret == SR_OK && !job.output)
+				ret = convert_connect(&job, in);
+			if (ret == SR_OK)
+				ret = job.ret;
+			if (ret != SR_OK)
+				g_atomic_int_set(&job.abort, 1);
+		}
+		g_async_queue_push(job.read_queue.free, buf);
+	} while (len);
+	g_thread_join(reader);
+
+	if (ret == SR_OK && g_atomic_int_get(&job.read_error))
+		ret = SR_ERR_IO;
+	if (ret == SR_OK)
+		ret = sr_input_end(in);
+	if (ret == SR_OK && !job.output) {
+		sr_err("No data in %s.", infile);
+		ret = SR_ERR_DATA;
+	}
+	if (ret == SR_OK)
+		ret = job.ret;
+
+	ret = convert_output_close(&job, ret);
+
+	convert_job_cleanup(&job);
+	sr_input_free(in);
+
+	return ret;
+}
+
+static void convert_pool_func(gpointer data, gpointer user_data)
+{
+	struct convert_item *item;
+
+	item = data;
+	item->ret = convert_file(user_data, item->infile, item->outfile);
+}
+
+/**
+ * Create a new converter.
+ *
+ * The converter needs an output module set with sr_convert_set_output()
+ * before it can be used.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param conv Pointer where the new converter is stored. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_convert_new(struct sr_context *ctx, struct sr_convert **conv)
+{
+	if (!ctx || !conv)
+		return SR_ERR_ARG;
+
+	*conv = g_malloc0(sizeof(struct sr_convert));
+	(*conv)->ctx = ctx;
+	(*conv)->num_workers = 1;
+
+	return SR_OK;
+}
+
+/**
+ * Set the input module of a converter.
+ *
+ * Without an input module, the format of each file is detected with
+ * sr_input_scan_file(). Sigrok session files, which no input module
+ * reads, are then played back through sr_session_load() instead.
+ *
+ * @param conv The converter. Must not be NULL.
+ * @param imod The input module, or NULL to detect the format.
+ * @param options A hash table of GVariant options for the input module,
+ *                keyed by option ID. Can be NULL. The converter keeps
+ *                a reference to the hash table.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_convert_set_input(struct sr_convert *conv,
+		const struct sr_input_module *imod, GHashTable *options)
+{
+	if (!conv)
+		return SR_ERR_ARG;
+
+	if (conv->in_options)
+		g_hash_table_unref(conv->in_options);
+	conv->imod = imod;
+	conv->in_options = options ? g_hash_table_ref(options) : NULL;
+
+	return SR_OK;
+}
+
+/**
+ * Set the output module of a converter.
+ *
+ * @param conv The converter. Must not be NULL.
+ * @param omod The output module. Must not be NULL.
+ * @param options A hash table of GVariant options for the output module,
+ *                keyed by option ID. Can be NULL. The converter keeps
+ *                a reference to the hash table.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_convert_set_output(struct sr_convert *conv,
+		const struct sr_output_module *omod, GHashTable *options)
+{
+	if (!conv || !omod)
+		return SR_ERR_ARG;
+
+	if (conv->out_options)
+		g_hash_table_unref(conv->out_options);
+	conv->omod = omod;
+	conv->out_options = options ? g_hash_table_ref(options) : NULL;
+
+	return SR_OK;
+}
+
+/**
+ * Add a transform module to a converter.
+ *
+ * Transform modules run in the order in which they were added.
+ *
+ * @param conv The converter. Must not be NULL.
+ * @param tmod The transform module. Must not be NULL.
+ * @param options A hash table of GVariant options for the transform
+ *                module, keyed by option ID. Can be NULL. The converter
+ *                keeps a reference to the hash table.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_convert_add_transform(struct sr_convert *conv,
+		const struct sr_transform_module *tmod, GHashTable *options)
+{
+	struct convert_transform *ct;
+
+	if (!conv || !tmod)
+		return SR_ERR_ARG;
+
+	ct = g_malloc(sizeof(*ct));
+	ct->tmod = tmod;
+	ct->options = options ? g_hash_table_ref(options) : NULL;
+	conv->transforms = g_slist_append(conv->transforms, ct);
+
+	return SR_OK;
+}
+
+/**
+ * Set the number of files which sr_convert_files() converts in parallel.
+ *
+ * @param conv The converter. Must not be NULL.
+ * @param num_workers The number of worker threads, at least 1.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_convert_set_workers(struct sr_convert *conv,
+		unsigned int num_workers)
+{
+	if (!conv || !num_workers)
+		return SR_ERR_ARG;
+
+	conv->num_workers = num_workers;
+
+	return SR_OK;
+}
+
+/**
+ * Convert a file.
+ *
+ * @param conv The converter. Must not be NULL.
+ * @param infile The name of the file to read. Must not be NULL.
+ * @param outfile The name of the file to write. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO Reading or writing a file failed.
+ * @retval other Error code returned by a module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_convert_file(const struct sr_convert *conv,
+		const char *infile, const char *outfile)
+{
+	if (!conv || !conv->omod || !infile || !outfile)
+		return SR_ERR_ARG;
+
+	return convert_file(conv, infile, outfile);
+}
+
+/**
+ * Convert several files, in parallel.
+ *
+ * Up to the number of files set with sr_convert_set_workers() are
+ * converted at the same time. All files are processed, even if the
+ * conversion of one of them fails.
+ *
+ * @param conv The converter. Must not be NULL.
+ * @param infiles The names of the files to read. Must not be NULL.
+ * @param outfiles The names of the files to write, one for each file in
+ *                 infiles. Must not be NULL.
+ * @param count The number of files.
+ *
+ * @retval SR_OK All files were converted.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other The error of the first file which failed to convert.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_convert_files(const struct sr_convert *conv,
+		const char *const *infiles, const char *const *outfiles,
+		size_t count)
+{
+	struct convert_item *items;
+	GThreadPool *pool;
+	GError *error;
+	size_t i;
+	int ret;
+
+	if (!conv || !conv->omod || !infiles || !outfiles)
+		return SR_ERR_ARG;
+
+	items = g_malloc0(count * sizeof(*items));
+	for (i = 0; i < count; i++) {
+		items[i].infile = infiles[i];
+		items[i].outfile = outfiles[i];
+		items[i].ret = SR_ERR_ARG;
+	}
+
+	error = NULL;
+	pool = g_thread_pool_new(convert_pool_func, (gpointer)conv,
+			conv->num_workers, FALSE, &error);
+	if (!pool) {
+		sr_err("Failed to create worker threads: %s.", error->message);
+		g_error_free(error);
+		g_free(items);
+		return SR_ERR;
+	}
+	for (i = 0; i < count; i++)
+		g_thread_pool_push(pool, &items[i], NULL);
+	g_thread_pool_free(pool, FALSE, TRUE);
+
+	ret = SR_OK;
+	for (i = 0; i < count; i++) {
+		if (items[i].ret == SR_OK)
+			continue;
+		sr_err("Failed to convert %s: %s.", items[i].infile,
+			sr_strerror(items[i].ret));
+		if (ret == SR_OK)
+			ret = items[i].ret;
+	}
+	g_free(items);
+
+	return ret;
+}
+
+static void convert_transform_free(void *data)
+{
+	struct convert_transform *ct;
+
+	ct = data;
+	if (ct->options)
+		g_hash_table_unref(ct->options);
+	g_free(ct);
+}
+
+/**
+ * Free a converter.
+ *
+ * @param conv The converter. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_convert_free(struct sr_convert *conv)
+{
+	if (!conv)
+		return SR_ERR_ARG;
+
+	if (conv->in_options)
+		g_hash_table_unref(conv->in_options);
+	if (conv->out_options)
+		g_hash_table_unref(conv->out_options);
+	g_slist_free_full(conv->transforms, convert_transform_free);
+	g_free(conv);
+
+	return SR_OK;
+}
+
+/** @} */
@@ -346,6 +346,38 @@ SR_API int sr_dev_inst_channel_add(struct sr_dev_inst *sdi, int index, int type,
 	return SR_OK;
 }
 
+/**
+ * Send a datafeed packet from a user device into its session.
+ *
+ * The packet runs through the session's transforms and datafeed
+ * callbacks before this function returns. Nothing keeps a reference
+ * to the packet or its payload after that, so the caller may free or
+ * reuse both as soon as this returns.
+ *
+ * @param[in] sdi The user device instance the packet originates from.
+ *                Must have been added to a session.
+ * @param[in] packet The packet to send. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the device is not part of a
+ *                    session.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_dev_inst_user_send(struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	if (!sdi || sdi->inst_type != SR_INST_USER || !packet)
+		return SR_ERR_ARG;
+
+	if (!sdi->session) {
+		sr_err("%s: device is not part of a session.", __func__);
+		return SR_ERR_ARG;
+	}
+
+	return sr_session_send(sdi, packet);
+}
+
 /**
  * Free device instance struct created by sr_dev_inst().
  *
@@ -387,6 +419,7 @@ SR_PRIV void sr_dev_inst_free(struct sr_dev_inst *sdi)
 	g_free(sdi->version);
 	g_free(sdi->serial_num);
 	g_free(sdi->connection_id);
+	sr_config_cache_free(sdi);
 	g_free(sdi);
 }
 
@@ -589,6 +622,9 @@ SR_API int sr_dev_open(struct sr_dev_inst *sdi)
 
 	sr_dbg("%s: Opening device instance.", sdi->driver->name);
 
+	/* Settings may have changed while the device was closed. */
+	sr_config_cache_clear(sdi);
+
 	ret = sdi->driver->dev_open(sdi);
 
 	if (ret == SR_OK)
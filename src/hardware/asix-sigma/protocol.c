@@ -729,49 +729,98 @@ static uint16_t sigma_dram_cluster_data(struct sigma_dram_cluster *cl, int idx)
 }
 
 /*
- * Deinterlace sample data that was retrieved at 100MHz samplerate.
- * One 16bit item contains two samples of 8bits each. The bits of
- * multiple samples are interleaved.
+ * Lookup tables to deinterlace sample data that was retrieved at 100MHz
+ * and 200MHz samplerates. One 16bit item contains two samples of 8bits
+ * each, or four samples of 4bits each. The bits of multiple samples are
+ * interleaved. The tables are indexed by the low and the high byte of
+ * the item, and hold the bits which that byte contributes to all of the
+ * item's samples, already at their place in consecutive little endian
+ * 16bit samples. Deinterlacing an item takes two lookups and an OR.
  */
-static uint16_t sigma_deinterlace_100mhz_data(uint16_t indata, int idx)
+static uint32_t deinterlace_100mhz_lo[256], deinterlace_100mhz_hi[256];
+static uint64_t deinterlace_200mhz_lo[256], deinterlace_200mhz_hi[256];
+
+SR_PRIV void sigma_init_deinterlace_luts(void)
 {
-	uint16_t outdata;
-
-	indata >>= idx;
-	outdata = 0;
-	outdata |= (indata >> (0 * 2 - 0)) & (1 << 0);
-	outdata |= (indata >> (1 * 2 - 1)) & (1 << 1);
-	outdata |= (indata >> (2 * 2 - 2)) & (1 << 2);
-	outdata |= (indata >> (3 * 2 - 3)) & (1 << 3);
-	outdata |= (indata >> (4 * 2 - 4)) & (1 << 4);
-	outdata |= (indata >> (5 * 2 - 5)) & (1 << 5);
-	outdata |= (indata >> (6 * 2 - 6)) & (1 << 6);
-	outdata |= (indata >> (7 * 2 - 7)) & (1 << 7);
-	return outdata;
+	static gsize initialized = 0;
+	unsigned int b, bit, idx;
+
+	if (!g_once_init_enter(&initialized))
+		return;
+
+	for (b = 0; b < 256; b++) {
+		for (bit = 0; bit < 8; bit++) {
+			if (!(b & (1 << bit)))
+				continue;
+			/* 100MHz: Bit (2 * n + idx) is bit n of sample idx. */
+			idx = bit % 2;
+			deinterlace_100mhz_lo[b] |=
+				(uint32_t)1 << (16 * idx + bit / 2);
+			deinterlace_100mhz_hi[b] |=
+				(uint32_t)1 << (16 * idx + bit / 2 + 4);
+			/* 200MHz: Bit (4 * n + idx) is bit n of sample idx. */
+			idx = bit % 4;
+			deinterlace_200mhz_lo[b] |=
+				(uint64_t)1 << (16 * idx + bit / 4);
+			deinterlace_200mhz_hi[b] |=
+				(uint64_t)1 << (16 * idx + bit / 4 + 2);
+		}
+	}
+
+	g_once_init_leave(&initialized, 1);
 }
 
-/*
- * Deinterlace sample data that was retrieved at 200MHz samplerate.
- * One 16bit item contains four samples of 4bits each. The bits of
- * multiple samples are interleaved.
- */
-static uint16_t sigma_deinterlace_200mhz_data(uint16_t indata, int idx)
+/* Deinterlace an item of 100MHz data to two 16bit samples. */
+SR_PRIV uint32_t sigma_deinterlace_100mhz(uint16_t item16)
 {
-	uint16_t outdata;
-
-	indata >>= idx;
-	outdata = 0;
-	outdata |= (indata >> (0 * 4 - 0)) & (1 << 0);
-	outdata |= (indata >> (1 * 4 - 1)) & (1 << 1);
-	outdata |= (indata >> (2 * 4 - 2)) & (1 << 2);
-	outdata |= (indata >> (3 * 4 - 3)) & (1 << 3);
-	return outdata;
+	return deinterlace_100mhz_lo[item16 & 0xff]
+		| deinterlace_100mhz_hi[item16 >> 8];
 }
 
-static void store_sr_sample(uint8_t *samples, int idx, uint16_t data)
+/* Deinterlace an item of 200MHz data to four 16bit samples. */
+SR_PRIV uint64_t sigma_deinterlace_200mhz(uint16_t item16)
 {
-	samples[2 * idx + 0] = (data >> 0) & 0xff;
-	samples[2 * idx + 1] = (data >> 8) & 0xff;
+	return deinterlace_200mhz_lo[item16 & 0xff]
+		| deinterlace_200mhz_hi[item16 >> 8];
+}
+
+/*
+ * Decode the events of a DRAM cluster to 16bit samples. Cope with memory
+ * layouts that vary with the samplerate. Returns the number of samples
+ * which were written to the buffer.
+ */
+static size_t sigma_decode_events(struct sigma_dram_cluster *dram_cluster,
+				  unsigned int events_in_cluster,
+				  uint64_t samplerate, uint8_t *samples)
+{
+	uint16_t item16;
+	uint64_t data;
+	unsigned int i;
+
+	if (samplerate == SR_MHZ(200)) {
+		for (i = 0; i < events_in_cluster; i++) {
+			item16 = sigma_dram_cluster_data(dram_cluster, i);
+			data = sigma_deinterlace_200mhz(item16);
+			WL32(&samples[8 * i + 0], data);
+			WL32(&samples[8 * i + 4], data >> 32);
+		}
+		return 4 * events_in_cluster;
+	}
+
+	if (samplerate == SR_MHZ(100)) {
+		for (i = 0; i < events_in_cluster; i++) {
+			item16 = sigma_dram_cluster_data(dram_cluster, i);
+			data = sigma_deinterlace_100mhz(item16);
+			WL32(&samples[4 * i], data);
+		}
+		return 2 * events_in_cluster;
+	}
+
+	for (i = 0; i < events_in_cluster; i++) {
+		item16 = sigma_dram_cluster_data(dram_cluster, i);
+		WL16(&samples[2 * i], item16);
+	}
+	return events_in_cluster;
 }
 
 /*
@@ -784,10 +833,26 @@ static void sigma_session_send(struct sr_dev_inst *sdi,
 {
 	struct dev_context *devc;
 	struct sr_datafeed_logic *logic;
-	uint64_t send_now;
+	struct sr_datafeed_logic_rle *rle;
+	uint64_t send_now, i;
 
 	devc = sdi->priv;
-	if (devc->limit_samples) {
+	if (devc->limit_samples && packet->type == SR_DF_LOGIC_RLE) {
+		rle = (void *)packet->payload;
+		send_now = 0;
+		for (i = 0; i < rle->num_runs; i++) {
+			if (devc->sent_samples + send_now + rle->lengths[i] >
+					devc->limit_samples) {
+				rle->lengths[i] = devc->limit_samples -
+					devc->sent_samples - send_now;
+				rle->num_runs = rle->lengths[i] ? i + 1 : i;
+			}
+			send_now += rle->lengths[i];
+		}
+		if (!send_now)
+			return;
+		devc->sent_samples += send_now;
+	} else if (devc->limit_samples) {
 		logic = (void *)packet->payload;
 		send_now = logic->length / logic->unitsize;
 		if (devc->sent_samples + send_now > devc->limit_samples) {
@@ -803,11 +868,51 @@ static void sigma_session_send(struct sr_dev_inst *sdi,
 }
 
 /*
- * This size translates to: event count (1K events per cluster), times
- * the sample width (unitsize, 16bits per event), times the maximum
- * number of samples per event.
+ * Size of the buffer which collects the decoded samples of consecutive
+ * DRAM clusters, in samples of 16bits each. And the maximum number of
+ * samples that one cluster decodes to (7 events, 4 samples per event).
  */
-#define SAMPLES_BUFFER_SIZE	(1024 * 2 * 4)
+#define SAMPLES_BUFFER_SIZE	(64 * 1024)
+#define SAMPLES_PER_CLUSTER_MAX	(EVENTS_PER_CLUSTER * 4)
+
+/* Send the collected samples to the session. */
+static void sigma_flush_samples(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+	struct sigma_state *ss = &devc->state;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+
+	if (!ss->sample_count)
+		return;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.length = ss->sample_count * 2;
+	logic.unitsize = 2;
+	logic.data = ss->samples;
+	sigma_session_send(sdi, &packet);
+
+	ss->sample_count = 0;
+}
+
+/* Send a run of identical samples to the session. */
+static void sigma_send_run(struct sr_dev_inst *sdi, uint16_t value,
+			   uint64_t length)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	uint8_t value_bytes[2];
+
+	WL16(value_bytes, value);
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+	rle.num_runs = 1;
+	rle.unitsize = 2;
+	rle.values = value_bytes;
+	rle.lengths = &length;
+	sigma_session_send(sdi, &packet);
+}
 
 static void sigma_decode_dram_cluster(struct sigma_dram_cluster *dram_cluster,
 				      unsigned int events_in_cluster,
@@ -817,82 +922,44 @@ static void sigma_decode_dram_cluster(struct sigma_dram_cluster *dram_cluster,
 	struct dev_context *devc = sdi->priv;
 	struct sigma_state *ss = &devc->state;
 	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
-	uint16_t tsdiff, ts, sample, item16;
-	uint8_t samples[SAMPLES_BUFFER_SIZE];
-	uint8_t *send_ptr;
-	size_t send_count, trig_count;
-	unsigned int i;
-	int j;
+	uint16_t tsdiff, ts, sample;
+	uint8_t *samples;
+	size_t count, trig_count;
+	int trigger_offset;
 
 	ts = sigma_dram_cluster_ts(dram_cluster);
 	tsdiff = ts - ss->lastts;
 	ss->lastts = ts + EVENTS_PER_CLUSTER;
 
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = 2;
-	logic.data = samples;
-
 	/*
 	 * If this cluster is not adjacent to the previously received
 	 * cluster, then send the appropriate number of samples with the
 	 * previous values to the sigrok session. This "decodes RLE".
+	 * Since constant data is sent, a single run covers the gap
+	 * regardless of the number of samples per event.
 	 */
-	for (ts = 0; ts < tsdiff; ts++) {
-		i = ts % 1024;
-		store_sr_sample(samples, i, ss->lastsample);
-
-		/*
-		 * If we have 1024 samples ready or we're at the
-		 * end of submitting the padding samples, submit
-		 * the packet to Sigrok. Since constant data is
-		 * sent, duplication of data for rates above 50MHz
-		 * is simple.
-		 */
-		if ((i == 1023) || (ts == tsdiff - 1)) {
-			logic.length = (i + 1) * logic.unitsize;
-			for (j = 0; j < devc->samples_per_event; j++)
-				sigma_session_send(sdi, &packet);
-		}
+	if (tsdiff) {
+		sigma_flush_samples(sdi);
+		sigma_send_run(sdi, ss->lastsample,
+			(uint64_t)tsdiff * devc->samples_per_event);
 	}
 
 	/*
-	 * Parse the samples in current cluster and prepare them
-	 * to be submitted to Sigrok. Cope with memory layouts that
-	 * vary with the samplerate.
+	 * Append the samples in current cluster to the ones which are
+	 * not yet sent to the session.
 	 */
-	send_ptr = &samples[0];
-	send_count = 0;
-	sample = 0;
-	for (i = 0; i < events_in_cluster; i++) {
-		item16 = sigma_dram_cluster_data(dram_cluster, i);
-		if (devc->cur_samplerate == SR_MHZ(200)) {
-			sample = sigma_deinterlace_200mhz_data(item16, 0);
-			store_sr_sample(samples, send_count++, sample);
-			sample = sigma_deinterlace_200mhz_data(item16, 1);
-			store_sr_sample(samples, send_count++, sample);
-			sample = sigma_deinterlace_200mhz_data(item16, 2);
-			store_sr_sample(samples, send_count++, sample);
-			sample = sigma_deinterlace_200mhz_data(item16, 3);
-			store_sr_sample(samples, send_count++, sample);
-		} else if (devc->cur_samplerate == SR_MHZ(100)) {
-			sample = sigma_deinterlace_100mhz_data(item16, 0);
-			store_sr_sample(samples, send_count++, sample);
-			sample = sigma_deinterlace_100mhz_data(item16, 1);
-			store_sr_sample(samples, send_count++, sample);
-		} else {
-			sample = item16;
-			store_sr_sample(samples, send_count++, sample);
-		}
-	}
+	if (ss->sample_count + SAMPLES_PER_CLUSTER_MAX > SAMPLES_BUFFER_SIZE)
+		sigma_flush_samples(sdi);
+	samples = &ss->samples[2 * ss->sample_count];
+	count = sigma_decode_events(dram_cluster, events_in_cluster,
+				    devc->cur_samplerate, samples);
+	sample = RL16(&samples[2 * (count - 1)]);
 
 	/*
 	 * If a trigger position applies, then provide the datafeed with
 	 * the first part of data up to that position, then send the
 	 * trigger marker.
 	 */
-	int trigger_offset = 0;
 	if (triggered) {
 		/*
 		 * Trigger is not always accurate to sample because of
@@ -902,34 +969,23 @@ static void sigma_decode_dram_cluster(struct sigma_dram_cluster *dram_cluster,
 		 */
 		trigger_offset = get_trigger_offset(samples,
 					ss->lastsample, &devc->trigger);
+		trig_count = trigger_offset * devc->samples_per_event;
+		trig_count = MIN(trig_count, count);
 
-		if (trigger_offset > 0) {
-			trig_count = trigger_offset * devc->samples_per_event;
-			packet.type = SR_DF_LOGIC;
-			logic.length = trig_count * logic.unitsize;
-			sigma_session_send(sdi, &packet);
-			send_ptr += trig_count * logic.unitsize;
-			send_count -= trig_count;
-		}
+		ss->sample_count += trig_count;
+		sigma_flush_samples(sdi);
+		count -= trig_count;
+		memmove(ss->samples, &samples[2 * trig_count], 2 * count);
 
 		/* Only send trigger if explicitly enabled. */
 		if (devc->use_triggers) {
 			packet.type = SR_DF_TRIGGER;
+			packet.payload = NULL;
 			sr_session_send(sdi, &packet);
 		}
 	}
 
-	/*
-	 * Send the data after the trigger, or all of the received data
-	 * if no trigger position applies.
-	 */
-	if (send_count) {
-		packet.type = SR_DF_LOGIC;
-		logic.length = send_count * logic.unitsize;
-		logic.data = send_ptr;
-		sigma_session_send(sdi, &packet);
-	}
-
+	ss->sample_count += count;
 	ss->lastsample = sample;
 }
 
@@ -992,29 +1048,137 @@ static int decode_chunk_ts(struct sigma_dram_line *dram_line,
 	return SR_OK;
 }
 
-static int download_capture(struct sr_dev_inst *sdi)
+/* State shared between download_capture() and the download thread. */
+struct sigma_downloader {
+	struct dev_context *devc;
+	/* Blocks which are ready for download, and ready for decoding. */
+	GAsyncQueue *free_blocks;
+	GAsyncQueue *full_blocks;
+	uint32_t first_line;
+	uint32_t lines_total;
+};
+
+/*
+ * Retrieve blocks of "DRAM lines" from the hardware, while
+ * download_capture() decodes the previous blocks and sends their
+ * samples to the session. An empty block terminates the download.
+ */
+static gpointer sigma_download_thread(gpointer data)
 {
 	const uint32_t chunks_per_read = 32;
 
-	struct dev_context *devc;
-	struct sigma_dram_line *dram_line;
+	struct sigma_downloader *dl;
+	struct sigma_dl_block *block;
 	int bufsz;
+	uint32_t i, dl_lines_curr, dl_lines_done, dl_line;
+
+	dl = data;
+
+	dl_lines_done = 0;
+	while (dl->lines_total > dl_lines_done) {
+		block = g_async_queue_pop(dl->free_blocks);
+		block->first = dl_lines_done;
+		block->count = MIN(DL_LINES_PER_BLOCK,
+				   dl->lines_total - dl_lines_done);
+
+		for (i = 0; i < block->count; i += dl_lines_curr) {
+			/* We can download only up-to 32 DRAM lines in one go! */
+			dl_lines_curr = MIN(chunks_per_read, block->count - i);
+
+			dl_line = dl->first_line + dl_lines_done + i;
+			dl_line %= 0x8000;
+			bufsz = sigma_read_dram(dl_line, dl_lines_curr,
+					(uint8_t *)&block->lines[i], dl->devc);
+			/* TODO: Check bufsz. For now, just avoid compiler warnings. */
+			(void)bufsz;
+		}
+
+		dl_lines_done += block->count;
+		g_async_queue_push(dl->full_blocks, block);
+	}
+
+	block = g_async_queue_pop(dl->free_blocks);
+	block->count = 0;
+	g_async_queue_push(dl->full_blocks, block);
+
+	return NULL;
+}
+
+/* Decode a downloaded block of "DRAM lines". */
+static void sigma_decode_block(struct sr_dev_inst *sdi,
+			       struct sigma_dl_block *block,
+			       uint32_t lines_total,
+			       uint32_t events_in_last_line,
+			       uint32_t trg_line, uint32_t trg_event)
+{
+	struct dev_context *devc;
+	uint32_t i, line, events_in_line, trigger_event;
+
+	devc = sdi->priv;
+
+	for (i = 0; i < block->count; i++) {
+		line = block->first + i;
+
+		/* The first DRAM line has the initial timestamp. */
+		if (line == 0) {
+			devc->state.lastts = sigma_dram_cluster_ts(
+				&block->lines[i].cluster[0]);
+			devc->state.lastsample = 0;
+		}
+
+		/* The last "DRAM line" can be only partially full. */
+		events_in_line = 64 * 7;
+		if (line == lines_total - 1)
+			events_in_line = events_in_last_line;
+
+		/* Test if the trigger happened on this line. */
+		trigger_event = ~0;
+		if (line == trg_line)
+			trigger_event = trg_event;
+
+		decode_chunk_ts(&block->lines[i], events_in_line,
+				trigger_event, sdi);
+	}
+}
+
+static int download_capture(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sigma_downloader dl;
+	struct sigma_dl_block *blocks[DL_BLOCKS], *block;
+	GThread *thread;
 	uint32_t stoppos, triggerpos;
 	uint8_t modestatus;
 	uint32_t i;
-	uint32_t dl_lines_total, dl_lines_curr, dl_lines_done;
-	uint32_t dl_first_line, dl_line;
-	uint32_t dl_events_in_line;
 	uint32_t trg_line, trg_event;
 
 	devc = sdi->priv;
-	dl_events_in_line = 64 * 7;
-	trg_line = ~0;
-	trg_event = ~0;
 
-	dram_line = g_try_malloc0(chunks_per_read * sizeof(*dram_line));
-	if (!dram_line)
+	sigma_init_deinterlace_luts();
+
+	memset(blocks, 0, sizeof(blocks));
+	for (i = 0; i < DL_BLOCKS; i++) {
+		blocks[i] = g_try_malloc(sizeof(*blocks[i]));
+		if (!blocks[i])
+			break;
+	}
+	devc->state.samples = g_try_malloc(2 * SAMPLES_BUFFER_SIZE);
+	devc->state.sample_count = 0;
+	if (i < DL_BLOCKS || !devc->state.samples) {
+		for (i = 0; i < DL_BLOCKS; i++)
+			g_free(blocks[i]);
+		g_free(devc->state.samples);
+		devc->state.samples = NULL;
 		return FALSE;
+	}
+
+	dl.devc = devc;
+	dl.free_blocks = g_async_queue_new();
+	dl.full_blocks = g_async_queue_new();
+	for (i = 0; i < DL_BLOCKS; i++)
+		g_async_queue_push(dl.free_blocks, blocks[i]);
+	trg_line = ~0;
+	trg_event = ~0;
 
 	sr_info("Downloading sample data.");
 	devc->state.state = SIGMA_DOWNLOAD;
@@ -1056,49 +1220,35 @@ static int download_capture(struct sr_dev_inst *sdi)
 	 * that case, we skip it and start reading from the next line. The
 	 * circular buffer has 32K lines (0x8000).
 	 */
-	dl_lines_total = (stoppos >> 9) + 1;
+	dl.lines_total = (stoppos >> 9) + 1;
 	if (modestatus & RMR_ROUND) {
-		dl_first_line = dl_lines_total + 1;
-		dl_lines_total = 0x8000 - 2;
+		dl.first_line = dl.lines_total + 1;
+		dl.lines_total = 0x8000 - 2;
 	} else {
-		dl_first_line = 0;
+		dl.first_line = 0;
 	}
-	dl_lines_done = 0;
-	while (dl_lines_total > dl_lines_done) {
-		/* We can download only up-to 32 DRAM lines in one go! */
-		dl_lines_curr = MIN(chunks_per_read, dl_lines_total - dl_lines_done);
-
-		dl_line = dl_first_line + dl_lines_done;
-		dl_line %= 0x8000;
-		bufsz = sigma_read_dram(dl_line, dl_lines_curr,
-					(uint8_t *)dram_line, devc);
-		/* TODO: Check bufsz. For now, just avoid compiler warnings. */
-		(void)bufsz;
-
-		/* This is the first DRAM line, so find the initial timestamp. */
-		if (dl_lines_done == 0) {
-			devc->state.lastts =
-				sigma_dram_cluster_ts(&dram_line[0].cluster[0]);
-			devc->state.lastsample = 0;
-		}
-
-		for (i = 0; i < dl_lines_curr; i++) {
-			uint32_t trigger_event = ~0;
-			/* The last "DRAM line" can be only partially full. */
-			if (dl_lines_done + i == dl_lines_total - 1)
-				dl_events_in_line = stoppos & 0x1ff;
 
-			/* Test if the trigger happened on this line. */
-			if (dl_lines_done + i == trg_line)
-				trigger_event = trg_event;
-
-			decode_chunk_ts(dram_line + i, dl_events_in_line,
-					trigger_event, sdi);
-		}
-
-		dl_lines_done += dl_lines_curr;
+	/*
+	 * Download on a separate thread, so that the download of the next
+	 * block of DRAM lines overlaps with the decoding of the current
+	 * one. The queues hand the blocks back and forth. Decoding stays
+	 * on this thread, which is the only one to send to the session.
+	 */
+	thread = g_thread_new("sigma-download", sigma_download_thread, &dl);
+	while ((block = g_async_queue_pop(dl.full_blocks))->count) {
+		sigma_decode_block(sdi, block, dl.lines_total,
+				   stoppos & 0x1ff, trg_line, trg_event);
+		g_async_queue_push(dl.free_blocks, block);
 	}
-	g_free(dram_line);
+	g_thread_join(thread);
+	sigma_flush_samples(sdi);
+
+	g_async_queue_unref(dl.free_blocks);
+	g_async_queue_unref(dl.full_blocks);
+	for (i = 0; i < DL_BLOCKS; i++)
+		g_free(blocks[i]);
+	g_free(devc->state.samples);
+	devc->state.samples = NULL;
 
 	std_session_send_df_end(sdi);
 
@@ -158,6 +158,23 @@ struct sigma_dram_line {
 	struct sigma_dram_cluster	cluster[64];
 };
 
+/*
+ * Number of "DRAM lines" which get downloaded in one block, and number
+ * of blocks in flight. A separate thread downloads the next blocks while
+ * the session thread decodes one.
+ */
+#define DL_LINES_PER_BLOCK	128
+#define DL_BLOCKS		3
+
+/* A block of downloaded "DRAM lines", handed to the session thread. */
+struct sigma_dl_block {
+	struct sigma_dram_line	lines[DL_LINES_PER_BLOCK];
+	/* Index of the first line within the download. */
+	uint32_t		first;
+	/* Number of lines in the block, 0 terminates the download. */
+	uint32_t		count;
+};
+
 struct clockselect_50 {
 	uint8_t async;
 	uint8_t fraction;
@@ -251,6 +268,9 @@ struct sigma_state {
 	} state;
 	uint16_t lastts;
 	uint16_t lastsample;
+	/* Decoded samples (16bits each) not yet sent to the session. */
+	uint8_t *samples;
+	size_t sample_count;
 };
 
 struct dev_context {
@@ -283,5 +303,8 @@ SR_PRIV int sigma_set_samplerate(const struct sr_dev_inst *sdi, uint64_t sampler
 SR_PRIV int sigma_convert_trigger(const struct sr_dev_inst *sdi);
 SR_PRIV int sigma_receive_data(int fd, int revents, void *cb_data);
 SR_PRIV int sigma_build_basic_trigger(struct triggerlut *lut, struct dev_context *devc);
+SR_PRIV void sigma_init_deinterlace_luts(void);
+SR_PRIV uint32_t sigma_deinterlace_100mhz(uint16_t item16);
+SR_PRIV uint64_t sigma_deinterlace_200mhz(uint16_t item16);
 
 #endif
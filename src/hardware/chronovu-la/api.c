@@ -73,14 +73,13 @@ static int add_device(int model, struct libusb_device_descriptor *des,
 	devc->cur_samplerate = 0; /* Set later (different for LA8/LA16). */
 	devc->limit_msec = 0;
 	devc->limit_samples = 0;
-	memset(devc->mangled_buf, 0, BS);
 	devc->final_buf = NULL;
 	devc->trigger_pattern = 0x0000; /* Irrelevant, see trigger_mask. */
 	devc->trigger_mask = 0x0000; /* All channels: "don't care". */
 	devc->trigger_edgemask = 0x0000; /* All channels: "state triggered". */
 	devc->trigger_found = 0;
 	devc->done = 0;
-	devc->block_counter = 0;
+	devc->bytes_received = 0;
 	devc->divcount = 0;
 	devc->usb_vid = des->idVendor;
 	devc->usb_pid = des->idProduct;
@@ -370,9 +369,9 @@ static int config_list(uint32_t key, GVariant **data,
 
 static int receive_data(int fd, int revents, void *cb_data)
 {
-	int i, ret;
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
+	struct timeval tv;
 
 	(void)fd;
 	(void)revents;
@@ -392,34 +391,18 @@ static int receive_data(int fd, int revents, void *cb_data)
 		return FALSE;
 	}
 
-	/* Get one block of data. */
-	if ((ret = cv_read_block(devc)) < 0) {
-		sr_err("Failed to read data block: %d.", ret);
-		sr_dev_acquisition_stop(sdi);
-		return FALSE;
-	}
+	/* Transfers complete from libftdi's own libusb context. */
+	tv.tv_sec = tv.tv_usec = 0;
+	libusb_handle_events_timeout_completed(devc->ftdic->usb_ctx, &tv, NULL);
 
-	/* We need to get exactly NUM_BLOCKS blocks (i.e. 8MB) of data. */
-	if (devc->block_counter != (NUM_BLOCKS - 1)) {
-		devc->block_counter++;
-		return TRUE;
+	/* Give up if the trigger does not match in time. */
+	if (!devc->acq_aborted && devc->bytes_received == 0
+			&& g_get_monotonic_time() > devc->done) {
+		sr_err("Trigger timed out.");
+		devc->reset_needed = TRUE;
+		cv_abort_acquisition(sdi);
 	}
 
-	sr_dbg("Sampling finished, sending data to session bus now.");
-
-	/*
-	 * All data was received and demangled, send it to the session bus.
-	 *
-	 * Note: Due to the method how data is spread across the 8MByte of
-	 * SDRAM, we can _not_ send it to the session bus in a streaming
-	 * manner while we receive it. We have to receive and de-mangle the
-	 * full 8MByte first, only then the whole buffer contains valid data.
-	 */
-	for (i = 0; i < NUM_BLOCKS; i++)
-		cv_send_block_to_session_bus(sdi, i);
-
-	sr_dev_acquisition_stop(sdi);
-
 	return TRUE;
 }
 
@@ -479,19 +462,19 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	/* Time when we should be done (for detecting trigger timeouts). */
 	devc->done = (devc->divcount + 1) * devc->prof->trigger_constant +
 			g_get_monotonic_time() + (10 * G_TIME_SPAN_SECOND);
-	devc->block_counter = 0;
 	devc->trigger_found = 0;
 
-	/* Hook up a dummy handler to receive data from the device. */
-	sr_session_source_add(sdi->session, -1, 0, 0, receive_data, (void *)sdi);
+	/* Handle the completions of the transfers kept in flight. */
+	sr_session_source_add(sdi->session, -1, 0, POLL_INTERVAL_MS,
+			receive_data, (void *)sdi);
 
-	return SR_OK;
+	return cv_start_transfers(sdi);
 }
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
-	sr_session_source_remove(sdi->session, -1);
-	std_session_send_df_end(sdi);
+	/* The end packet follows once all transfers are back. */
+	cv_abort_acquisition(sdi);
 
 	return SR_OK;
 }
@@ -342,59 +342,220 @@ SR_PRIV int cv_set_samplerate(const struct sr_dev_inst *sdi, uint64_t samplerate
 	return SR_OK;
 }
 
-/**
- * Get a block of data from the device.
- *
- * @param devc The struct containing private per-device-instance data. Must not
- *             be NULL. devc->ftdic must not be NULL either.
- *
- * @return SR_OK upon success, or SR_ERR upon errors.
+/* De-mangle downloaded SDRAM contents into the final buffer. */
+static void demangle(struct dev_context *devc, const uint8_t *buf,
+		int byte_offset, int length)
+{
+	int i, offset, m, mi, p, q, index;
+
+	for (i = 0; i < length; i++) {
+		offset = byte_offset + i;
+		m = offset / (1024 * 1024);
+		mi = m * (1024 * 1024);
+		if (devc->prof->model == CHRONOVU_LA8) {
+			p = offset & (1 << 0);
+			index = m * 2 + ((offset - mi) / 2) * 16;
+			index += (devc->divcount == 0) ? p : (1 - p);
+		} else {
+			p = offset & (1 << 0);
+			q = offset & (1 << 1);
+			index = m * 4 + ((offset - mi) / 4) * 32;
+			index += q + (1 - p);
+		}
+		devc->final_buf[index] = buf[i];
+	}
+}
+
+/*
+ * Every USB packet from the FTDI chip starts with two modem status
+ * bytes. Drop them, moving the data together within the buffer.
  */
-SR_PRIV int cv_read_block(struct dev_context *devc)
+static int strip_modem_status(uint8_t *buf, int length, int packet_size)
 {
-	int i, byte_offset, m, mi, p, q, index, bytes_read;
-	gint64 now;
+	int src, dst, n;
+
+	dst = 0;
+	for (src = 0; src < length; src += packet_size) {
+		n = MIN(packet_size, length - src) - 2;
+		if (n <= 0)
+			continue;
+		memmove(buf + dst, buf + src + 2, n);
+		dst += n;
+	}
 
-	/* Note: Caller checked that devc and devc->ftdic != NULL. */
+	return dst;
+}
+
+static void finish_acquisition(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
 
-	sr_spew("Reading block %d.", devc->block_counter);
+	devc = sdi->priv;
 
-	bytes_read = cv_read(devc, devc->mangled_buf, BS);
+	sr_session_source_remove(sdi->session, -1);
+	if (devc->reset_needed)
+		(void) reset_device(devc); /* Ignore errors. */
+	std_session_send_df_end(sdi);
+}
 
-	/* If first block read got 0 bytes, retry until success or timeout. */
-	if ((bytes_read == 0) && (devc->block_counter == 0)) {
-		do {
-			sr_spew("Reading block 0 (again).");
-			/* Note: If bytes_read < 0 cv_read() will log errors. */
-			bytes_read = cv_read(devc, devc->mangled_buf, BS);
-			now = g_get_monotonic_time();
-		} while ((devc->done > now) && (bytes_read == 0));
+static void free_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	unsigned int i;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	g_free(transfer->buffer);
+	transfer->buffer = NULL;
+	libusb_free_transfer(transfer);
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfers[i] == transfer) {
+			devc->transfers[i] = NULL;
+			break;
+		}
 	}
 
-	/* Check if block read was successful or a timeout occurred. */
-	if (bytes_read != BS) {
-		sr_err("Trigger timed out. Bytes read: %d.", bytes_read);
-		(void) reset_device(devc); /* Ignore errors. */
-		return SR_ERR;
+	devc->submitted_transfers--;
+	if (devc->submitted_transfers == 0)
+		finish_acquisition(sdi);
+}
+
+SR_PRIV void cv_abort_acquisition(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int i;
+
+	devc = sdi->priv;
+
+	if (devc->acq_aborted)
+		return;
+	devc->acq_aborted = TRUE;
+
+	for (i = NUM_TRANSFERS - 1; i >= 0; i--) {
+		if (devc->transfers[i])
+			libusb_cancel_transfer(devc->transfers[i]);
 	}
 
-	/* De-mangle the data. */
-	sr_spew("Demangling block %d.", devc->block_counter);
-	byte_offset = devc->block_counter * BS;
-	m = byte_offset / (1024 * 1024);
-	mi = m * (1024 * 1024);
-	for (i = 0; i < BS; i++) {
-		if (devc->prof->model == CHRONOVU_LA8) {
-			p = i & (1 << 0);
-			index = m * 2 + (((byte_offset + i) - mi) / 2) * 16;
-			index += (devc->divcount == 0) ? p : (1 - p);
-		} else {
-			p = i & (1 << 0);
-			q = i & (1 << 1);
-			index = m * 4 + (((byte_offset + i) - mi) / 4) * 32;
-			index += q + (1 - p);
+	if (devc->submitted_transfers == 0)
+		finish_acquisition(sdi);
+}
+
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	int i, length, ret;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	/*
+	 * If acquisition has already ended, just free any queued up
+	 * transfer that come in.
+	 */
+	if (devc->acq_aborted) {
+		free_transfer(transfer);
+		return;
+	}
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
+		break;
+	default:
+		sr_err("Failed to read data: %s.",
+		       libusb_error_name(transfer->status));
+		devc->reset_needed = TRUE;
+		cv_abort_acquisition(sdi);
+		free_transfer(transfer);
+		return;
+	}
+
+	/* De-mangle straight from the transfer's buffer. */
+	length = strip_modem_status(transfer->buffer, transfer->actual_length,
+		devc->ftdic->max_packet_size);
+	length = MIN(length, SDRAM_SIZE - devc->bytes_received);
+	if (length > 0) {
+		sr_spew("Demangling %d bytes at %d.", length,
+			devc->bytes_received);
+		demangle(devc, transfer->buffer, devc->bytes_received, length);
+		devc->bytes_received += length;
+	}
+
+	/* We need to get exactly NUM_BLOCKS blocks (i.e. 8MB) of data. */
+	if (devc->bytes_received == SDRAM_SIZE) {
+		sr_dbg("Sampling finished, sending data to session bus now.");
+
+		/*
+		 * All data was received and demangled, send it to the
+		 * session bus.
+		 *
+		 * Note: Due to the method how data is spread across the
+		 * 8MByte of SDRAM, we can _not_ send it to the session bus
+		 * in a streaming manner while we receive it. We have to
+		 * receive and de-mangle the full 8MByte first, only then
+		 * the whole buffer contains valid data.
+		 */
+		for (i = 0; i < NUM_BLOCKS; i++)
+			cv_send_block_to_session_bus(sdi, i);
+
+		cv_abort_acquisition(sdi);
+		free_transfer(transfer);
+		return;
+	}
+
+	if ((ret = libusb_submit_transfer(transfer)) < 0) {
+		sr_err("Failed to resubmit transfer: %s.",
+		       libusb_error_name(ret));
+		devc->reset_needed = TRUE;
+		cv_abort_acquisition(sdi);
+		free_transfer(transfer);
+	}
+}
+
+/**
+ * Start downloading the SDRAM contents, with several transfers in flight.
+ *
+ * The first data only arrives once the trigger matched. Until then, the
+ * transfers complete with nothing but modem status bytes.
+ */
+SR_PRIV int cv_start_transfers(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct ftdi_context *ftdic;
+	struct libusb_transfer *transfer;
+	unsigned char *buf;
+	int i, ret;
+
+	devc = sdi->priv;
+	ftdic = devc->ftdic;
+
+	devc->acq_aborted = FALSE;
+	devc->reset_needed = FALSE;
+	devc->bytes_received = 0;
+	devc->submitted_transfers = 0;
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		buf = g_malloc(TRANSFER_SIZE);
+		transfer = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfer, ftdic->usb_dev,
+				ftdic->out_ep, buf, TRANSFER_SIZE,
+				receive_transfer, (void *)sdi,
+				ftdic->usb_read_timeout);
+		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+			sr_err("Failed to submit transfer: %s.",
+			       libusb_error_name(ret));
+			libusb_free_transfer(transfer);
+			g_free(buf);
+			devc->reset_needed = TRUE;
+			cv_abort_acquisition((struct sr_dev_inst *)sdi);
+			return SR_ERR;
 		}
-		devc->final_buf[index] = devc->mangled_buf[i];
+		devc->transfers[i] = transfer;
+		devc->submitted_transfers++;
 	}
 
 	return SR_OK;
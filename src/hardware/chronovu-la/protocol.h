@@ -36,6 +36,13 @@
 #define BS				4096 /* Block size */
 #define NUM_BLOCKS			2048 /* Number of blocks */
 
+/* Transfers in flight during the download, and their size. */
+#define NUM_TRANSFERS			4
+#define TRANSFER_SIZE			(16 * BS)
+
+/* Interval at which transfer completions are handled [ms]. */
+#define POLL_INTERVAL_MS		10
+
 enum {
 	CHRONOVU_LA8,
 	CHRONOVU_LA16,
@@ -58,12 +65,6 @@ struct dev_context {
 	uint64_t limit_msec;
 	uint64_t limit_samples;
 
-	/**
-	 * A buffer containing some (mangled) samples from the device.
-	 * Format: Pretty mangled-up (due to hardware reasons), see code.
-	 */
-	uint8_t mangled_buf[BS];
-
 	/**
 	 * An 8MB buffer where we'll store the de-mangled samples.
 	 * LA8: Each sample is 1 byte, MSB is channel 7, LSB is channel 0.
@@ -100,8 +101,16 @@ struct dev_context {
 	/** Used for keeping track how much time has passed. */
 	gint64 done;
 
-	/** Counter/index for the data block to be read. */
-	int block_counter;
+	/** Number of (mangled) SDRAM bytes downloaded so far. */
+	int bytes_received;
+
+	/** Transfers in flight during the download. */
+	struct libusb_transfer *transfers[NUM_TRANSFERS];
+	int submitted_transfers;
+	gboolean acq_aborted;
+
+	/** Whether the device needs a reset once the transfers are back. */
+	gboolean reset_needed;
 
 	/** The divcount value (determines the sample period). */
 	uint8_t divcount;
@@ -122,7 +131,8 @@ SR_PRIV uint8_t cv_samplerate_to_divcount(const struct sr_dev_inst *sdi,
 SR_PRIV int cv_write(struct dev_context *devc, uint8_t *buf, int size);
 SR_PRIV int cv_convert_trigger(const struct sr_dev_inst *sdi);
 SR_PRIV int cv_set_samplerate(const struct sr_dev_inst *sdi, uint64_t samplerate);
-SR_PRIV int cv_read_block(struct dev_context *devc);
+SR_PRIV int cv_start_transfers(const struct sr_dev_inst *sdi);
+SR_PRIV void cv_abort_acquisition(struct sr_dev_inst *sdi);
 SR_PRIV void cv_send_block_to_session_bus(const struct sr_dev_inst *sdi, int block);
 
 #endif
@@ -685,6 +685,9 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 	devc->num_transfers = 0;
 	g_free(devc->transfers);
 	g_free(devc->deinterleave_buffer);
+	g_free(devc->planes_buffer);
+	sr_usb_stream_free(devc->stream);
+	devc->stream = NULL;
 }
 
 static void free_transfer(struct libusb_transfer *transfer)
@@ -714,8 +717,15 @@ static void free_transfer(struct libusb_transfer *transfer)
 
 static void resubmit_transfer(struct libusb_transfer *transfer)
 {
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
 	int ret;
 
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	transfer->timeout = sr_usb_stream_timeout(devc->stream);
+	sr_usb_stream_submitted(devc->stream, transfer);
 	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
 		return;
 
@@ -724,30 +734,58 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 
 }
 
-static void deinterleave_buffer(const uint8_t *src, size_t length,
-	uint16_t *dst_ptr, size_t channel_count, uint16_t channel_mask)
+/*
+ * The DSLogic emits 64-bit words in a round-robin over the enabled
+ * channels, bit n of each word holding sample n of that channel. Those
+ * words already are LSB-first bit planes, so they only have to be
+ * gathered per channel, a word at a time.
+ */
+static void gather_planes(const struct sr_dev_inst *sdi,
+	const uint8_t *src, size_t length, uint8_t *planes_buf,
+	void **planes)
 {
-	uint16_t sample;
-
-	for (const uint64_t *src_ptr = (uint64_t*)src;
-		src_ptr < (uint64_t*)(src + length);
-		src_ptr += channel_count) {
-		for (int bit = 0; bit != 64; bit++) {
-			const uint64_t *word_ptr = src_ptr;
-			sample = 0;
-			for (unsigned int channel = 0; channel != 16;
-				channel++) {
-				const uint16_t m = channel_mask >> channel;
-				if (!m)
-					break;
-				if ((m & 1) && ((*word_ptr++ >> bit) & UINT64_C(1)))
-					sample |= 1 << channel;
-			}
-			*dst_ptr++ = sample;
+	const size_t channel_count = enabled_channel_count(sdi);
+	const size_t plane_size = length / channel_count;
+	const uint8_t *src_ptr;
+	size_t channel, offset;
+
+	memset(planes, 0, NUM_CHANNELS * sizeof(*planes));
+	channel = 0;
+	for (const GSList *l = sdi->channels; l; l = l->next) {
+		const struct sr_channel *const probe = l->data;
+		if (!probe->enabled || probe->index >= NUM_CHANNELS)
+			continue;
+		planes[probe->index] = planes_buf + channel++ * plane_size;
+	}
+
+	src_ptr = src;
+	for (offset = 0; offset < plane_size; offset += DSLOGIC_ATOMIC_BYTES) {
+		for (channel = 0; channel < channel_count; channel++) {
+			memcpy(planes_buf + channel * plane_size + offset,
+				src_ptr, DSLOGIC_ATOMIC_BYTES);
+			src_ptr += DSLOGIC_ATOMIC_BYTES;
 		}
 	}
 }
 
+static void send_planes(struct sr_dev_inst *sdi,
+	void **planes, size_t sample_count)
+{
+	const struct sr_datafeed_logic_planar planar = {
+		.num_samples = sample_count,
+		.unitsize = sizeof(uint16_t),
+		.num_planes = NUM_CHANNELS,
+		.planes = planes
+	};
+
+	const struct sr_datafeed_packet packet = {
+		.type = SR_DF_LOGIC_PLANAR,
+		.payload = &planar
+	};
+
+	sr_session_send(sdi, &packet);
+}
+
 static void send_data(struct sr_dev_inst *sdi,
 	uint16_t *data, size_t sample_count)
 {
@@ -765,18 +803,22 @@ static void send_data(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
+static int submit_transfers(const struct sr_dev_inst *sdi);
+
 static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *const sdi = transfer->user_data;
 	struct dev_context *const devc = sdi->priv;
 	const size_t channel_count = enabled_channel_count(sdi);
-	const uint16_t channel_mask = enabled_channel_mask(sdi);
 	const unsigned int cur_sample_count = DSLOGIC_ATOMIC_SAMPLES *
 		transfer->actual_length /
 		(DSLOGIC_ATOMIC_BYTES * channel_count);
 
 	gboolean packet_has_error = FALSE;
+	gboolean retire = FALSE;
 	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_planar planar;
+	void *planes[NUM_CHANNELS];
 	unsigned int num_samples;
 	int trigger_offset;
 
@@ -792,6 +834,10 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	sr_dbg("receive_transfer(): status %s received %d bytes.",
 		libusb_error_name(transfer->status), transfer->actual_length);
 
+	/* Fewer transfers in flight may suffice again. */
+	if (!sr_usb_stream_completed(devc->stream, transfer))
+		retire = TRUE;
+
 	/* Save incoming transfer before reusing the transfer struct. */
 
 	switch (transfer->status) {
@@ -830,21 +876,10 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		else
 			num_samples = cur_sample_count;
 
-		/**
-		 * The DSLogic emits sample data as sequences of 64-bit sample words
-		 * in a round-robin i.e. 64-bits from channel 0, 64-bits from channel 1
-		 * etc. for each of the enabled channels, then looping back to the
-		 * channel.
-		 *
-		 * Because sigrok's internal representation is bit-interleaved channels
-		 * we must recast the data.
-		 *
-		 * Hopefully in future it will be possible to pass the data on as-is.
-		 */
 		if (transfer->actual_length % (DSLOGIC_ATOMIC_BYTES * channel_count) != 0)
 			sr_err("Invalid transfer length!");
-		deinterleave_buffer(transfer->buffer, transfer->actual_length,
-			devc->deinterleave_buffer, channel_count, channel_mask);
+		gather_planes(sdi, transfer->buffer, transfer->actual_length,
+			devc->planes_buffer, planes);
 
 		/* Send the incoming transfer to the session bus. */
 		if (devc->trigger_pos > devc->sent_samples
@@ -852,20 +887,29 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 			/* DSLogic trigger in this block. Send trigger position. */
 			trigger_offset = devc->trigger_pos - devc->sent_samples;
 			/* Pre-trigger samples. */
-			send_data(sdi, devc->deinterleave_buffer, trigger_offset);
+			send_planes(sdi, planes, trigger_offset);
 			devc->sent_samples += trigger_offset;
 			/* Trigger position. */
 			devc->trigger_pos = 0;
 			packet.type = SR_DF_TRIGGER;
 			packet.payload = NULL;
 			sr_session_send(sdi, &packet);
-			/* Post trigger samples. */
+			/*
+			 * Post trigger samples. Planes must start on a byte
+			 * boundary, so this one block goes out sample-major.
+			 */
+			planar.num_samples = num_samples;
+			planar.unitsize = sizeof(uint16_t);
+			planar.num_planes = NUM_CHANNELS;
+			planar.planes = planes;
+			sr_logic_planar_to_samples(&planar,
+				devc->deinterleave_buffer);
 			num_samples -= trigger_offset;
 			send_data(sdi, devc->deinterleave_buffer
 				+ trigger_offset, num_samples);
 			devc->sent_samples += num_samples;
 		} else {
-			send_data(sdi, devc->deinterleave_buffer, num_samples);
+			send_planes(sdi, planes, num_samples);
 			devc->sent_samples += num_samples;
 		}
 	}
@@ -873,8 +917,13 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples) {
 		abort_acquisition(devc);
 		free_transfer(transfer);
-	} else
+	} else if (retire) {
+		free_transfer(transfer);
+	} else {
 		resubmit_transfer(transfer);
+		/* The queue may have to be deepened. */
+		submit_transfers(sdi);
+	}
 }
 
 static int receive_data(int fd, int revents, void *cb_data)
@@ -908,51 +957,89 @@ static size_t to_bytes_per_ms(const struct sr_dev_inst *sdi)
 	return 35000000 / (1000 * 10);
 }
 
-static size_t get_buffer_size(const struct sr_dev_inst *sdi)
+static struct sr_usb_stream *stream_new(const struct sr_dev_inst *sdi)
 {
+	struct sr_usb_stream_config config;
+
 	/*
-	 * The buffer should be large enough to hold 10ms of data and
-	 * a multiple of the size of a data atom.
+	 * Transfers should be large enough to hold 10ms of data and a
+	 * multiple of the size of a data atom. Those in flight should be
+	 * able to hold about 100ms of data.
 	 */
-	const size_t block_size = enabled_channel_count(sdi) * 512;
-	const size_t s = 10 * to_bytes_per_ms(sdi);
-	if (!block_size)
-		return s;
-	return ((s + block_size - 1) / block_size) * block_size;
+	config.bytes_per_ms = to_bytes_per_ms(sdi);
+	config.transfer_ms = 10;
+	config.block_size = enabled_channel_count(sdi) * 512;
+	config.min_size = config.block_size;
+	config.max_size = MAX_TRANSFER_SIZE;
+	config.queue_ms = 100;
+	config.min_transfers = 1;
+	config.max_transfers = MAX_SIMUL_TRANSFERS;
+	config.adaptive = TRUE;
+
+	return sr_usb_stream_new(&config, sdi->session);
 }
 
-static unsigned int get_number_of_transfers(const struct sr_dev_inst *sdi)
+/* Submit as many new transfers as the stream wants in flight. */
+static int submit_transfers(const struct sr_dev_inst *sdi)
 {
-	/* Total buffer size should be able to hold about 100ms of data. */
-	const unsigned int s = get_buffer_size(sdi);
-	const unsigned int n = (100 * to_bytes_per_ms(sdi) + s - 1) / s;
-	return (n > NUM_SIMUL_TRANSFERS) ? NUM_SIMUL_TRANSFERS : n;
-}
+	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
+	struct libusb_transfer *transfer;
+	unsigned int i, wanted, timeout;
+	unsigned char *buf;
+	size_t size;
+	int ret;
 
-static unsigned int get_timeout(const struct sr_dev_inst *sdi)
-{
-	const size_t total_size = get_buffer_size(sdi) *
-		get_number_of_transfers(sdi);
-	const unsigned int timeout = total_size / to_bytes_per_ms(sdi);
-	return timeout + timeout / 4; /* Leave a headroom of 25% percent. */
+	devc = sdi->priv;
+	usb = sdi->conn;
+
+	size = sr_usb_stream_buffer_size(devc->stream);
+	timeout = sr_usb_stream_timeout(devc->stream);
+	wanted = sr_usb_stream_wanted(devc->stream);
+
+	for (i = 0; i < devc->num_transfers && wanted > 0; i++) {
+		if (devc->acq_aborted)
+			break;
+		if (devc->transfers[i])
+			continue;
+		if (!(buf = g_try_malloc(size))) {
+			sr_err("USB transfer buffer malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		transfer = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfer, usb->devhdl,
+				6 | LIBUSB_ENDPOINT_IN, buf, size,
+				receive_transfer, (void *)sdi, timeout);
+		sr_spew("submitting transfer: %d", i);
+		sr_usb_stream_submitted(devc->stream, transfer);
+		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+			sr_err("Failed to submit transfer: %s.",
+			       libusb_error_name(ret));
+			libusb_free_transfer(transfer);
+			g_free(buf);
+			abort_acquisition(devc);
+			return SR_ERR;
+		}
+		devc->transfers[i] = transfer;
+		devc->submitted_transfers++;
+		wanted--;
+	}
+
+	return SR_OK;
 }
 
 static int start_transfers(const struct sr_dev_inst *sdi)
 {
 	const size_t channel_count = enabled_channel_count(sdi);
-	const size_t size = get_buffer_size(sdi);
-	const unsigned int num_transfers = get_number_of_transfers(sdi);
-	const unsigned int timeout = get_timeout(sdi);
 
 	struct dev_context *devc;
-	struct sr_usb_dev_inst *usb;
-	struct libusb_transfer *transfer;
-	unsigned int i;
+	unsigned int num_transfers;
+	size_t size;
 	int ret;
-	unsigned char *buf;
 
 	devc = sdi->priv;
-	usb = sdi->conn;
+	size = sr_usb_stream_buffer_size(devc->stream);
+	num_transfers = sr_usb_stream_max_transfers(devc->stream);
 
 	devc->sent_samples = 0;
 	devc->acq_aborted = FALSE;
@@ -974,29 +1061,18 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 		return SR_ERR_MALLOC;
 	}
 
-	devc->num_transfers = num_transfers;
-	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				6 | LIBUSB_ENDPOINT_IN, buf, size,
-				receive_transfer, (void *)sdi, timeout);
-		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
-			abort_acquisition(devc);
-			return SR_ERR;
-		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
+	devc->planes_buffer = g_try_malloc(size);
+	if (!devc->planes_buffer) {
+		sr_err("Planes buffer malloc failed.");
+		g_free(devc->deinterleave_buffer);
+		devc->deinterleave_buffer = NULL;
+		return SR_ERR_MALLOC;
 	}
 
+	devc->num_transfers = num_transfers;
+	if ((ret = submit_transfers(sdi)) != SR_OK)
+		return ret;
+
 	std_session_send_df_header(sdi);
 
 	return SR_OK;
@@ -1017,6 +1093,8 @@ static void LIBUSB_CALL trigger_receive(struct libusb_transfer *transfer)
 		usb_source_remove(sdi->session, devc->ctx);
 		devc->num_transfers = 0;
 		g_free(devc->transfers);
+		sr_usb_stream_free(devc->stream);
+		devc->stream = NULL;
 	} else if (transfer->status == LIBUSB_TRANSFER_COMPLETED
 			&& transfer->actual_length == sizeof(struct dslogic_trigger_pos)) {
 		tpos = (struct dslogic_trigger_pos *)transfer->buffer;
@@ -1031,14 +1109,13 @@ static void LIBUSB_CALL trigger_receive(struct libusb_transfer *transfer)
 
 SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 {
-	const unsigned int timeout = get_timeout(sdi);
-
 	struct sr_dev_driver *di;
 	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
 	struct dslogic_trigger_pos *tpos;
 	struct libusb_transfer *transfer;
+	unsigned int timeout;
 	int ret;
 
 	di = sdi->driver;
@@ -1046,6 +1123,10 @@ SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 	devc = sdi->priv;
 	usb = sdi->conn;
 
+	sr_usb_stream_free(devc->stream);
+	devc->stream = stream_new(sdi);
+	timeout = sr_usb_stream_timeout(devc->stream);
+
 	devc->ctx = drvc->sr_ctx;
 	devc->sent_samples = 0;
 	devc->empty_transfer_count = 0;
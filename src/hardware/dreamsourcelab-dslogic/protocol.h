@@ -37,6 +37,8 @@
 #define MAX_RENUM_DELAY_MS	3000
 #define NUM_SIMUL_TRANSFERS	32
 #define MAX_EMPTY_TRANSFERS	(NUM_SIMUL_TRANSFERS * 2)
+#define MAX_SIMUL_TRANSFERS	(NUM_SIMUL_TRANSFERS * 4)
+#define MAX_TRANSFER_SIZE	(4 * 1024 * 1024)
 
 #define NUM_CHANNELS		16
 #define NUM_TRIGGER_STAGES	16
@@ -131,8 +133,10 @@ struct dev_context {
 	unsigned int num_transfers;
 	struct libusb_transfer **transfers;
 	struct sr_context *ctx;
+	struct sr_usb_stream *stream;
 
 	uint16_t *deinterleave_buffer;
+	uint8_t *planes_buffer;
 
 	uint16_t mode;
 	uint32_t trigger_pos;
@@ -100,9 +100,6 @@ static void scan_device(struct ftdi_context *ftdic,
 
 	devc = g_malloc0(sizeof(struct dev_context));
 
-	/* Allocate memory for the incoming data. */
-	devc->data_buf = g_malloc0(DATA_BUF_SIZE);
-
 	devc->desc = desc;
 
 	vendor = g_malloc(32);
@@ -144,7 +141,6 @@ err_free_strings:
 	g_free(vendor);
 	g_free(model);
 	g_free(serial_num);
-	g_free(devc->data_buf);
 	g_free(devc);
 }
 
@@ -227,16 +223,6 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	return std_scan_complete(di, devices);
 }
 
-static void clear_helper(struct dev_context *devc)
-{
-	g_free(devc->data_buf);
-}
-
-static int dev_clear(const struct sr_dev_driver *di)
-{
-	return std_dev_clear_with_callback(di, (std_dev_clear_callback)clear_helper);
-}
-
 static int dev_open(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
@@ -394,22 +380,20 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	/* Properly reset internal variables before every new acquisition. */
 	devc->samples_sent = 0;
-	devc->bytes_received = 0;
 
 	std_session_send_df_header(sdi);
 
-	/* Hook up a dummy handler to receive data from the device. */
-	sr_session_source_add(sdi->session, -1, G_IO_IN, 0,
+	/* Handle the completions of the transfers kept in flight. */
+	sr_session_source_add(sdi->session, -1, 0, POLL_INTERVAL_MS,
 			      ftdi_la_receive_data, (void *)sdi);
 
-	return SR_OK;
+	return ftdi_la_start_transfers(sdi);
 }
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
-	sr_session_source_remove(sdi->session, -1);
-
-	std_session_send_df_end(sdi);
+	/* The end packet follows once all transfers are back. */
+	ftdi_la_abort_acquisition(sdi);
 
 	return SR_OK;
 }
@@ -422,7 +406,7 @@ static struct sr_dev_driver ftdi_la_driver_info = {
 	.cleanup = std_cleanup,
 	.scan = scan,
 	.dev_list = std_dev_list,
-	.dev_clear = dev_clear,
+	.dev_clear = std_dev_clear,
 	.config_get = config_get,
 	.config_set = config_set,
 	.config_list = config_list,
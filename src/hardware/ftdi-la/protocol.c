@@ -19,9 +19,11 @@
 
 #include <config.h>
 #include <ftdi.h>
+#include <libusb.h>
 #include "protocol.h"
 
-static void send_samples(struct sr_dev_inst *sdi, uint64_t samples_to_send)
+static void send_samples(struct sr_dev_inst *sdi, uint8_t *data,
+		uint64_t samples_to_send)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
@@ -35,11 +37,10 @@ static void send_samples(struct sr_dev_inst *sdi, uint64_t samples_to_send)
 	packet.payload = &logic;
 	logic.length = samples_to_send;
 	logic.unitsize = 1;
-	logic.data = devc->data_buf;
+	logic.data = data;
 	sr_session_send(sdi, &packet);
 
 	devc->samples_sent += samples_to_send;
-	devc->bytes_received -= samples_to_send;
 }
 
 SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc)
@@ -56,12 +57,175 @@ SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc)
 	return SR_OK;
 }
 
-SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
+/*
+ * Every USB packet from the FTDI chip starts with two modem status
+ * bytes. Drop them, moving the samples together within the buffer.
+ */
+static int strip_modem_status(uint8_t *buf, int length, int packet_size)
+{
+	int src, dst, n;
+
+	dst = 0;
+	for (src = 0; src < length; src += packet_size) {
+		n = MIN(packet_size, length - src) - 2;
+		if (n <= 0)
+			continue;
+		memmove(buf + dst, buf + src + 2, n);
+		dst += n;
+	}
+
+	return dst;
+}
+
+static void finish_acquisition(struct sr_dev_inst *sdi)
+{
+	sr_session_source_remove(sdi->session, -1);
+	std_session_send_df_end(sdi);
+}
+
+static void free_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	unsigned int i;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	g_free(transfer->buffer);
+	transfer->buffer = NULL;
+	libusb_free_transfer(transfer);
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfers[i] == transfer) {
+			devc->transfers[i] = NULL;
+			break;
+		}
+	}
+
+	devc->submitted_transfers--;
+	if (devc->submitted_transfers == 0)
+		finish_acquisition(sdi);
+}
+
+SR_PRIV void ftdi_la_abort_acquisition(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int i;
+
+	devc = sdi->priv;
+
+	if (devc->acq_aborted)
+		return;
+	devc->acq_aborted = TRUE;
+
+	for (i = NUM_TRANSFERS - 1; i >= 0; i--) {
+		if (devc->transfers[i])
+			libusb_cancel_transfer(devc->transfers[i]);
+	}
+
+	if (devc->submitted_transfers == 0)
+		finish_acquisition(sdi);
+}
+
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	int bytes_read;
 	uint64_t n;
+	int length, ret;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	/*
+	 * If acquisition has already ended, just free any queued up
+	 * transfer that come in.
+	 */
+	if (devc->acq_aborted) {
+		free_transfer(transfer);
+		return;
+	}
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
+		break;
+	default:
+		sr_err("Failed to read FTDI data: %s.",
+		       libusb_error_name(transfer->status));
+		ftdi_la_abort_acquisition(sdi);
+		free_transfer(transfer);
+		return;
+	}
+
+	/* Send the samples right from the transfer's buffer. */
+	length = strip_modem_status(transfer->buffer, transfer->actual_length,
+		devc->ftdic->max_packet_size);
+	if (length > 0) {
+		n = devc->samples_sent + length;
+		if (devc->limit_samples && (n >= devc->limit_samples)) {
+			send_samples(sdi, transfer->buffer,
+				devc->limit_samples - devc->samples_sent);
+			sr_info("Requested number of samples reached.");
+			ftdi_la_abort_acquisition(sdi);
+			free_transfer(transfer);
+			return;
+		}
+		send_samples(sdi, transfer->buffer, length);
+	}
+
+	if ((ret = libusb_submit_transfer(transfer)) < 0) {
+		sr_err("Failed to resubmit transfer: %s.",
+		       libusb_error_name(ret));
+		ftdi_la_abort_acquisition(sdi);
+		free_transfer(transfer);
+	}
+}
+
+SR_PRIV int ftdi_la_start_transfers(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct ftdi_context *ftdic;
+	struct libusb_transfer *transfer;
+	unsigned char *buf;
+	int i, ret, size;
+
+	devc = sdi->priv;
+	ftdic = devc->ftdic;
+
+	devc->acq_aborted = FALSE;
+	devc->submitted_transfers = 0;
+
+	/* Whole packets, so that only the last one may be short. */
+	size = TRANSFER_SIZE - TRANSFER_SIZE % ftdic->max_packet_size;
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		buf = g_malloc(size);
+		transfer = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfer, ftdic->usb_dev,
+				ftdic->out_ep, buf, size, receive_transfer,
+				(void *)sdi, ftdic->usb_read_timeout);
+		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+			sr_err("Failed to submit transfer: %s.",
+			       libusb_error_name(ret));
+			libusb_free_transfer(transfer);
+			g_free(buf);
+			ftdi_la_abort_acquisition((struct sr_dev_inst *)sdi);
+			return SR_ERR;
+		}
+		devc->transfers[i] = transfer;
+		devc->submitted_transfers++;
+	}
+
+	return SR_OK;
+}
+
+SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct timeval tv;
 
 	(void)fd;
 	(void)revents;
@@ -70,36 +234,12 @@ SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 		return TRUE;
 	if (!(devc = sdi->priv))
 		return TRUE;
-	if (!(revents == G_IO_IN || revents == 0))
-		return TRUE;
 	if (!devc->ftdic)
 		return TRUE;
 
-	/* Get a block of data. */
-	bytes_read = ftdi_read_data(devc->ftdic, devc->data_buf, DATA_BUF_SIZE);
-	if (bytes_read < 0) {
-		sr_err("Failed to read FTDI data (%d): %s.",
-		       bytes_read, ftdi_get_error_string(devc->ftdic));
-		sr_dev_acquisition_stop(sdi);
-		return FALSE;
-	}
-	if (bytes_read == 0) {
-		sr_spew("Received 0 bytes, nothing to do.");
-		return TRUE;
-	}
-	sr_spew("Got some data.");
-	devc->bytes_received += bytes_read;
-
-	n = devc->samples_sent + devc->bytes_received;
-
-	if (devc->limit_samples && (n >= devc->limit_samples)) {
-		send_samples(sdi, devc->limit_samples - devc->samples_sent);
-		sr_info("Requested number of samples reached.");
-		sr_dev_acquisition_stop(sdi);
-		return TRUE;
-	} else {
-		send_samples(sdi, devc->bytes_received);
-	}
+	/* Transfers complete from libftdi's own libusb context. */
+	tv.tv_sec = tv.tv_usec = 0;
+	libusb_handle_events_timeout_completed(devc->ftdic->usb_ctx, &tv, NULL);
 
 	return TRUE;
 }
@@ -27,7 +27,12 @@
 
 #define LOG_PREFIX "ftdi-la"
 
-#define DATA_BUF_SIZE (16 * 1024)
+/* Transfers in flight, and their size. */
+#define NUM_TRANSFERS 8
+#define TRANSFER_SIZE (64 * 1024)
+
+/* Interval at which transfer completions are handled [ms]. */
+#define POLL_INTERVAL_MS 10
 
 struct ftdi_chip_desc {
 	uint16_t vendor;
@@ -43,12 +48,16 @@ struct dev_context {
 	uint64_t limit_samples;
 	uint32_t cur_samplerate;
 
-	unsigned char *data_buf;
 	uint64_t samples_sent;
-	uint64_t bytes_received;
+
+	struct libusb_transfer *transfers[NUM_TRANSFERS];
+	int submitted_transfers;
+	gboolean acq_aborted;
 };
 
 SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc);
+SR_PRIV int ftdi_la_start_transfers(const struct sr_dev_inst *sdi);
+SR_PRIV void ftdi_la_abort_acquisition(struct sr_dev_inst *sdi);
 SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data);
 
 #endif
@@ -40,12 +40,15 @@ struct cmd_start_acquisition {
 
 #define USB_TIMEOUT 100
 
-static int command_get_fw_version(libusb_device_handle *devhdl,
-				  struct version_info *vi)
+/* Session stall the USB event thread's spare buffers bridge [ms]. */
+#define HANDOFF_MS 500
+
+static int command_get_fw_version(struct sr_context *ctx,
+		libusb_device_handle *devhdl, struct version_info *vi)
 {
 	int ret;
 
-	ret = libusb_control_transfer(devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(ctx, devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 		LIBUSB_ENDPOINT_IN, CMD_GET_FW_VERSION, 0x0000, 0x0000,
 		(unsigned char *)vi, sizeof(struct version_info), USB_TIMEOUT);
 
@@ -58,13 +61,14 @@ static int command_get_fw_version(libusb_device_handle *devhdl,
 	return SR_OK;
 }
 
-static int command_get_revid_version(struct sr_dev_inst *sdi, uint8_t *revid)
+static int command_get_revid_version(struct sr_context *ctx,
+		struct sr_dev_inst *sdi, uint8_t *revid)
 {
 	struct sr_usb_dev_inst *usb = sdi->conn;
 	libusb_device_handle *devhdl = usb->devhdl;
 	int ret;
 
-	ret = libusb_control_transfer(devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(ctx, devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 		LIBUSB_ENDPOINT_IN, CMD_GET_REVID_VERSION, 0x0000, 0x0000,
 		revid, 1, USB_TIMEOUT);
 
@@ -127,8 +131,8 @@ static int command_start_acquisition(const struct sr_dev_inst *sdi)
 	cmd.flags |= (g_slist_length(devc->enabled_analog_channels) > 0) ? CMD_START_FLAGS_CLK_CTL2 : 0;
 
 	/* Send the control message. */
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
-			LIBUSB_ENDPOINT_OUT, CMD_START, 0x0000, 0x0000,
+	ret = sr_usb_control_transfer(devc->ctx, usb->devhdl,
+			LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT, CMD_START, 0x0000, 0x0000,
 			(unsigned char *)&cmd, sizeof(cmd), USB_TIMEOUT);
 	if (ret < 0) {
 		sr_err("Unable to send start command: %s.",
@@ -155,7 +159,9 @@ SR_PRIV int fx2lafw_dev_open(struct sr_dev_inst *sdi, struct sr_dev_driver *di)
 	devc = sdi->priv;
 	usb = sdi->conn;
 
-	device_count = libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	/* Events of the device may be handled on the USB event thread. */
+	device_count = libusb_get_device_list(
+		sr_usb_handoff_context(drvc->sr_ctx), &devlist);
 	if (device_count < 0) {
 		sr_err("Failed to get device list: %s.",
 		       libusb_error_name(device_count));
@@ -207,13 +213,13 @@ SR_PRIV int fx2lafw_dev_open(struct sr_dev_inst *sdi, struct sr_dev_driver *di)
 			}
 		}
 
-		ret = command_get_fw_version(usb->devhdl, &vi);
+		ret = command_get_fw_version(drvc->sr_ctx, usb->devhdl, &vi);
 		if (ret != SR_OK) {
 			sr_err("Failed to get firmware version.");
 			break;
 		}
 
-		ret = command_get_revid_version(sdi, &revid);
+		ret = command_get_revid_version(drvc->sr_ctx, sdi, &revid);
 		if (ret != SR_OK) {
 			sr_err("Failed to get REVID.");
 			break;
@@ -257,7 +263,7 @@ SR_PRIV struct dev_context *fx2lafw_dev_new(void)
 	devc->profile = NULL;
 	devc->fw_updated = 0;
 	devc->cur_samplerate = 0;
-	devc->limit_samples = 0;
+	sr_sw_limits_init(&devc->limits);
 	devc->capture_ratio = 0;
 	devc->sample_wide = FALSE;
 	devc->stl = NULL;
@@ -269,11 +275,11 @@ SR_PRIV void fx2lafw_abort_acquisition(struct dev_context *devc)
 {
 	int i;
 
-	devc->acq_aborted = TRUE;
+	g_atomic_int_set(&devc->acq_aborted, TRUE);
 
 	for (i = devc->num_transfers - 1; i >= 0; i--) {
 		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
+			sr_usb_cancel_transfer(devc->ctx, devc->transfers[i]);
 	}
 }
 
@@ -285,7 +291,14 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 
 	std_session_send_df_end(sdi);
 
-	usb_source_remove(sdi->session, devc->ctx);
+	if (devc->handoff)
+		sr_usb_handoff_source_remove(sdi->session, devc->handoff);
+	else
+		usb_source_remove(sdi->session, devc->ctx);
+	sr_usb_handoff_free(devc->handoff);
+	devc->handoff = NULL;
+	sr_usb_stream_free(devc->stream);
+	devc->stream = NULL;
 
 	devc->num_transfers = 0;
 	g_free(devc->transfers);
@@ -329,9 +342,16 @@ static void free_transfer(struct libusb_transfer *transfer)
 
 static void resubmit_transfer(struct libusb_transfer *transfer)
 {
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
 	int ret;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	transfer->timeout = sr_usb_stream_timeout(devc->stream);
+	sr_usb_stream_submitted(devc->stream, transfer);
+	if ((ret = sr_usb_submit_transfer(devc->ctx, transfer)) == LIBUSB_SUCCESS)
 		return;
 
 	sr_err("%s: %s", __func__, libusb_error_name(ret));
@@ -408,14 +428,100 @@ static void la_send_data_proc(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
-static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer);
+
+/* Submit as many new transfers as the stream wants in flight. */
+static int submit_transfers(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
+	struct libusb_transfer *transfer;
+	unsigned int i, wanted, timeout;
+	unsigned char *buf;
+	size_t size;
+	int ret;
+
+	devc = sdi->priv;
+	usb = sdi->conn;
+
+	size = sr_usb_stream_buffer_size(devc->stream);
+	timeout = sr_usb_stream_timeout(devc->stream);
+	wanted = sr_usb_stream_wanted(devc->stream);
+
+	for (i = 0; i < devc->num_transfers && wanted > 0; i++) {
+		if (devc->acq_aborted)
+			break;
+		if (devc->transfers[i])
+			continue;
+		if (!(buf = g_try_malloc(size))) {
+			sr_err("USB transfer buffer malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		transfer = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfer, usb->devhdl,
+				2 | LIBUSB_ENDPOINT_IN, buf, size,
+				receive_transfer, (void *)sdi, timeout);
+		sr_spew("submitting transfer: %d", i);
+		sr_usb_stream_submitted(devc->stream, transfer);
+		if ((ret = sr_usb_submit_transfer(devc->ctx, transfer)) != 0) {
+			sr_err("Failed to submit transfer: %s.",
+			       libusb_error_name(ret));
+			libusb_free_transfer(transfer);
+			g_free(buf);
+			fx2lafw_abort_acquisition(devc);
+			return SR_ERR;
+		}
+		devc->transfers[i] = transfer;
+		devc->submitted_transfers++;
+		wanted--;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Send received data to the session bus. Returns TRUE once a limit is
+ * reached. The session clips the data at the limits.
+ */
+static gboolean handle_data(struct sr_dev_inst *sdi, uint8_t **buffer,
+		int length, int buffer_size)
+{
+	struct dev_context *devc;
+	int trigger_offset, unitsize;
+
+	devc = sdi->priv;
+
+	unitsize = devc->sample_wide ? 2 : 1;
+
+	if (devc->trigger_fired) {
+		/* Send the incoming transfer to the session bus. */
+		devc->send_data_proc(sdi, *buffer, length, unitsize);
+	} else {
+		/*
+		 * The soft trigger keeps this transfer's buffer for the
+		 * pre-trigger window (instead of copying it), and hands
+		 * out another one to resubmit the transfer with.
+		 */
+		trigger_offset = soft_trigger_logic_check_retain(devc->stl,
+			buffer, length, buffer_size, NULL);
+		if (trigger_offset > -1) {
+			devc->send_data_proc(sdi, *buffer
+					+ trigger_offset * unitsize,
+					length - trigger_offset * unitsize,
+					unitsize);
+			devc->trigger_fired = TRUE;
+		}
+	}
+
+	return sr_sw_limits_check(&devc->limits);
+}
+
+static void handle_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	gboolean packet_has_error = FALSE;
-	unsigned int num_samples;
-	int trigger_offset, cur_sample_count, unitsize;
-	int pre_trigger_samples;
+	gboolean retire = FALSE;
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
@@ -432,9 +538,9 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	sr_dbg("receive_transfer(): status %s received %d bytes.",
 		libusb_error_name(transfer->status), transfer->actual_length);
 
-	/* Save incoming transfer before reusing the transfer struct. */
-	unitsize = devc->sample_wide ? 2 : 1;
-	cur_sample_count = transfer->actual_length / unitsize;
+	/* Fewer transfers in flight may suffice again. */
+	if (!sr_usb_stream_completed(devc->stream, transfer))
+		retire = TRUE;
 
 	switch (transfer->status) {
 	case LIBUSB_TRANSFER_NO_DEVICE:
@@ -465,44 +571,57 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	} else {
 		devc->empty_transfer_count = 0;
 	}
-	if (devc->trigger_fired) {
-		if (!devc->limit_samples || devc->sent_samples < devc->limit_samples) {
-			/* Send the incoming transfer to the session bus. */
-			if (devc->limit_samples && devc->sent_samples + cur_sample_count > devc->limit_samples)
-				num_samples = devc->limit_samples - devc->sent_samples;
-			else
-				num_samples = cur_sample_count;
-
-			devc->send_data_proc(sdi, (uint8_t *)transfer->buffer,
-				num_samples * unitsize, unitsize);
-			devc->sent_samples += num_samples;
-		}
-	} else {
-		trigger_offset = soft_trigger_logic_check(devc->stl,
-			transfer->buffer, transfer->actual_length, &pre_trigger_samples);
-		if (trigger_offset > -1) {
-			devc->sent_samples += pre_trigger_samples;
-			num_samples = cur_sample_count - trigger_offset;
-			if (devc->limit_samples &&
-					num_samples > devc->limit_samples - devc->sent_samples)
-				num_samples = devc->limit_samples - devc->sent_samples;
+	if (handle_data(sdi, &transfer->buffer, transfer->actual_length,
+			transfer->length)) {
+		fx2lafw_abort_acquisition(devc);
+		free_transfer(transfer);
+		return;
+	}
 
-			devc->send_data_proc(sdi, (uint8_t *)transfer->buffer
-					+ trigger_offset * unitsize,
-					num_samples * unitsize, unitsize);
-			devc->sent_samples += num_samples;
+	if (retire) {
+		free_transfer(transfer);
+		return;
+	}
+	resubmit_transfer(transfer);
+	/* The queue may have to be deepened. */
+	submit_transfers(sdi);
+}
 
-			devc->trigger_fired = TRUE;
-		}
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	if (!devc->handoff) {
+		handle_transfer(transfer);
+		return;
 	}
 
-	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples) {
-		fx2lafw_abort_acquisition(devc);
-		free_transfer(transfer);
-	} else
-		resubmit_transfer(transfer);
+	/*
+	 * On the USB event thread, only hand data over and resubmit right
+	 * away. Everything else is left to the session thread.
+	 */
+	if (!g_atomic_int_get(&devc->acq_aborted)
+			&& transfer->status == LIBUSB_TRANSFER_COMPLETED
+			&& transfer->actual_length > 0) {
+		/* The queue depth is fixed in this mode. */
+		sr_usb_stream_completed(devc->stream, transfer);
+		sr_usb_handoff_push(devc->handoff, transfer);
+		sr_usb_stream_submitted(devc->stream, transfer);
+		if (sr_usb_submit_transfer(devc->ctx, transfer) == 0)
+			return;
+		/* Have the session thread retry, the data is passed on. */
+		transfer->actual_length = 0;
+		sr_usb_handoff_defer(devc->handoff, transfer);
+		return;
+	}
+	sr_usb_handoff_defer(devc->handoff, transfer);
 }
 
+
 static int configure_channels(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
@@ -542,52 +661,77 @@ static unsigned int to_bytes_per_ms(unsigned int samplerate)
 	return samplerate / 1000;
 }
 
-static size_t get_buffer_size(struct dev_context *devc)
+static struct sr_usb_stream *stream_new(const struct sr_dev_inst *sdi,
+		gboolean adaptive)
 {
-	size_t s;
+	struct dev_context *devc;
+	struct sr_usb_stream_config config;
+
+	devc = sdi->priv;
 
 	/*
-	 * The buffer should be large enough to hold 10ms of data and
-	 * a multiple of 512.
+	 * Transfers should be large enough to hold 10ms of data and a
+	 * multiple of 512. Those in flight should be able to hold about
+	 * 500ms of data.
 	 */
-	s = 10 * to_bytes_per_ms(devc->cur_samplerate);
-	return (s + 511) & ~511;
+	config.bytes_per_ms = to_bytes_per_ms(devc->cur_samplerate);
+	config.transfer_ms = 10;
+	config.block_size = 512;
+	config.min_size = 512;
+	config.max_size = MAX_TRANSFER_SIZE;
+	config.queue_ms = 500;
+	config.min_transfers = 1;
+	config.max_transfers = MAX_SIMUL_TRANSFERS;
+	config.adaptive = adaptive;
+
+	return sr_usb_stream_new(&config, sdi->session);
 }
 
-static unsigned int get_number_of_transfers(struct dev_context *devc)
+/* Collect what the USB event thread handed over. */
+static void receive_handoff(struct sr_dev_inst *sdi)
 {
-	unsigned int n;
-
-	/* Total buffer size should be able to hold about 500ms of data. */
-	n = (500 * to_bytes_per_ms(devc->cur_samplerate) /
-		get_buffer_size(devc));
-
-	if (n > NUM_SIMUL_TRANSFERS)
-		return NUM_SIMUL_TRANSFERS;
-
-	return n;
-}
+	struct dev_context *devc;
+	struct sr_usb_handoff_entry entry;
+	int size;
 
-static unsigned int get_timeout(struct dev_context *devc)
-{
-	size_t total_size;
-	unsigned int timeout;
+	devc = sdi->priv;
+	size = sr_usb_stream_buffer_size(devc->stream);
 
-	total_size = get_buffer_size(devc) *
-			get_number_of_transfers(devc);
-	timeout = total_size / to_bytes_per_ms(devc->cur_samplerate);
-	return timeout + timeout / 4; /* Leave a headroom of 25% percent. */
+	while (devc->handoff && sr_usb_handoff_pop(devc->handoff, &entry)) {
+		if (entry.transfer) {
+			/* May end the acquisition, and free the handoff. */
+			handle_transfer(entry.transfer);
+			continue;
+		}
+		if (entry.dropped > 0)
+			sr_warn("Dropped %" PRIu64 " bytes, the session did "
+				"not keep up.", entry.dropped);
+		devc->empty_transfer_count = 0;
+		if (!devc->acq_aborted && handle_data(sdi, &entry.data,
+				entry.length, size))
+			fx2lafw_abort_acquisition(devc);
+		sr_usb_handoff_release(devc->handoff, entry.data);
+	}
 }
 
 static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct timeval tv;
+	struct sr_dev_inst *sdi;
 	struct drv_context *drvc;
+	struct dev_context *devc;
 
 	(void)fd;
 	(void)revents;
 
-	drvc = (struct drv_context *)cb_data;
+	sdi = cb_data;
+	drvc = sdi->driver->context;
+	devc = sdi->priv;
+
+	if (devc->handoff) {
+		receive_handoff(sdi);
+		return TRUE;
+	}
 
 	tv.tv_sec = tv.tv_usec = 0;
 	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
@@ -598,25 +742,20 @@ static int receive_data(int fd, int revents, void *cb_data)
 static int start_transfers(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
-	struct sr_usb_dev_inst *usb;
 	struct sr_trigger *trigger;
-	struct libusb_transfer *transfer;
-	unsigned int i, num_transfers;
-	int timeout, ret;
-	unsigned char *buf;
-	size_t size;
+	unsigned int num_transfers;
+	int ret;
 
 	devc = sdi->priv;
-	usb = sdi->conn;
 
-	devc->sent_samples = 0;
+	sr_sw_limits_session_start(&devc->limits, (struct sr_dev_inst *)sdi);
 	devc->acq_aborted = FALSE;
 	devc->empty_transfer_count = 0;
 
 	if ((trigger = sr_session_trigger_get(sdi->session))) {
 		int pre_trigger_samples = 0;
-		if (devc->limit_samples > 0)
-			pre_trigger_samples = (devc->capture_ratio * devc->limit_samples) / 100;
+		if (devc->limits.limit_samples > 0)
+			pre_trigger_samples = (devc->capture_ratio * devc->limits.limit_samples) / 100;
 		devc->stl = soft_trigger_logic_new(sdi, trigger, pre_trigger_samples);
 		if (!devc->stl)
 			return SR_ERR_MALLOC;
@@ -624,9 +763,7 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	} else
 		devc->trigger_fired = TRUE;
 
-	num_transfers = get_number_of_transfers(devc);
-
-	size = get_buffer_size(devc);
+	num_transfers = sr_usb_stream_max_transfers(devc->stream);
 	devc->submitted_transfers = 0;
 
 	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
@@ -634,30 +771,10 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 		sr_err("USB transfers malloc failed.");
 		return SR_ERR_MALLOC;
 	}
-
-	timeout = get_timeout(devc);
 	devc->num_transfers = num_transfers;
-	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				2 | LIBUSB_ENDPOINT_IN, buf, size,
-				receive_transfer, (void *)sdi, timeout);
-		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
-			fx2lafw_abort_acquisition(devc);
-			return SR_ERR;
-		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
-	}
+
+	if ((ret = submit_transfers(sdi)) != SR_OK)
+		return ret;
 
 	/*
 	 * If this device has analog channels and at least one of them is
@@ -687,7 +804,6 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 	devc = sdi->priv;
 
 	devc->ctx = drvc->sr_ctx;
-	devc->sent_samples = 0;
 	devc->empty_transfer_count = 0;
 	devc->acq_aborted = FALSE;
 
@@ -696,10 +812,26 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
-	timeout = get_timeout(devc);
-	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
+	/*
+	 * Optionally handle USB events on a dedicated thread, with spare
+	 * buffers to bridge session stalls of about HANDOFF_MS. These
+	 * take the place of a queue adapting its depth.
+	 */
+	devc->stream = stream_new(sdi, !devc->ctx->usb_event_thread);
+	size = sr_usb_stream_buffer_size(devc->stream);
+	devc->handoff = sr_usb_handoff_new(devc->ctx,
+		sr_usb_stream_max_transfers(devc->stream),
+		HANDOFF_MS * to_bytes_per_ms(devc->cur_samplerate) / size + 1,
+		size);
+
+	timeout = sr_usb_stream_timeout(devc->stream);
+	if (devc->handoff)
+		sr_usb_handoff_source_add(sdi->session, devc->handoff,
+			timeout, receive_data, (void *)sdi);
+	else
+		usb_source_add(sdi->session, devc->ctx, timeout,
+			receive_data, (void *)sdi);
 
-	size = get_buffer_size(devc);
 	/* Prepare for analog sampling. */
 	if (g_slist_length(devc->enabled_analog_channels) > 0) {
 		/* We need a buffer half the size of a transfer. */
@@ -38,6 +38,8 @@
 #define MAX_RENUM_DELAY_MS	3000
 #define NUM_SIMUL_TRANSFERS	32
 #define MAX_EMPTY_TRANSFERS	(NUM_SIMUL_TRANSFERS * 2)
+#define MAX_SIMUL_TRANSFERS	(NUM_SIMUL_TRANSFERS * 4)
+#define MAX_TRANSFER_SIZE	(1024 * 1024)
 
 #define NUM_CHANNELS		16
 
@@ -102,21 +104,22 @@ struct dev_context {
 	int num_samplerates;
 
 	uint64_t cur_samplerate;
-	uint64_t limit_samples;
+	struct sr_sw_limits limits;
 	uint64_t capture_ratio;
 
 	gboolean trigger_fired;
-	gboolean acq_aborted;
+	gint acq_aborted;
 	gboolean sample_wide;
 	struct soft_trigger_logic *stl;
 
-	unsigned int sent_samples;
 	int submitted_transfers;
 	int empty_transfer_count;
 
 	unsigned int num_transfers;
 	struct libusb_transfer **transfers;
 	struct sr_context *ctx;
+	struct sr_usb_handoff *handoff;
+	struct sr_usb_stream *stream;
 	void (*send_data_proc)(struct sr_dev_inst *sdi,
 		uint8_t *data, size_t length, size_t sample_width);
 	uint8_t *logic_buffer;
@@ -36,6 +36,8 @@ static const uint32_t devopts[] = {
 	SR_CONF_CONTINUOUS,
 	SR_CONF_LIMIT_SAMPLES | SR_CONF_SET,
 	SR_CONF_LIMIT_MSEC | SR_CONF_SET,
+	SR_CONF_BATCH_SIZE | SR_CONF_SET,
+	SR_CONF_BATCH_LATENCY | SR_CONF_SET,
 };
 
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
@@ -101,6 +103,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	sdi->model = g_strdup(scale->device);
 	devc = g_malloc0(sizeof(struct dev_context));
 	sr_sw_limits_init(&devc->limits);
+	devc->batch_size = 1;
 	sdi->inst_type = SR_INST_SERIAL;
 	sdi->conn = serial;
 	sdi->priv = devc;
@@ -122,7 +125,20 @@ static int config_set(uint32_t key, GVariant *data,
 
 	devc = sdi->priv;
 
-	return sr_sw_limits_config_set(&devc->limits, key, data);
+	switch (key) {
+	case SR_CONF_BATCH_SIZE:
+		if (g_variant_get_uint64(data) < 1)
+			return SR_ERR_ARG;
+		devc->batch_size = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_BATCH_LATENCY:
+		devc->batch_latency = g_variant_get_uint64(data);
+		break;
+	default:
+		return sr_sw_limits_config_set(&devc->limits, key, data);
+	}
+
+	return SR_OK;
 }
 
 static int config_list(uint32_t key, GVariant **data,
@@ -133,9 +149,11 @@ static int config_list(uint32_t key, GVariant **data,
 
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
+	struct scale_info *scale;
 	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
 
+	scale = (struct scale_info *)sdi->driver;
 	devc = sdi->priv;
 	serial = sdi->conn;
 
@@ -144,6 +162,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	/* Device replies with "A00\r\n" (OK) or "E01\r\n" (Error). Ignore. */
 
+	devc->info = g_malloc(scale->info_size);
+	sr_analog_batch_init(&devc->batch, sdi->channels, FALSE,
+		devc->batch_size, devc->batch_latency);
+
 	sr_sw_limits_acquisition_start(&devc->limits);
 	std_session_send_df_header(sdi);
 
@@ -153,6 +175,21 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+static int dev_acquisition_stop(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	/* Send what is still pending before the end of the stream. */
+	sr_analog_batch_flush(sdi, &devc->batch);
+	sr_analog_batch_clear(&devc->batch);
+	g_free(devc->info);
+	devc->info = NULL;
+
+	return std_serial_dev_acquisition_stop(sdi);
+}
+
 #define SCALE(ID, CHIPSET, VENDOR, MODEL, CONN, BAUDRATE, PACKETSIZE, \
 			VALID, PARSE) \
 	&((struct scale_info) { \
@@ -171,7 +208,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 			.dev_open = std_serial_dev_open, \
 			.dev_close = std_serial_dev_close, \
 			.dev_acquisition_start = dev_acquisition_start, \
-			.dev_acquisition_stop = std_serial_dev_acquisition_stop, \
+			.dev_acquisition_stop = dev_acquisition_stop, \
 			.context = NULL, \
 		}, \
 		VENDOR, MODEL, CONN, BAUDRATE, PACKETSIZE, \
@@ -26,12 +26,10 @@
 #include "libsigrok-internal.h"
 #include "protocol.h"
 
-static void handle_packet(const uint8_t *buf, struct sr_dev_inst *sdi,
-			  void *info)
+static void handle_packet(const uint8_t *buf, struct sr_dev_inst *sdi)
 {
 	struct scale_info *scale;
 	float floatval;
-	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
@@ -49,19 +47,17 @@ static void handle_packet(const uint8_t *buf, struct sr_dev_inst *sdi,
 	analog.num_samples = 1;
 	analog.meaning->mq = 0;
 
-	scale->packet_parse(buf, &floatval, &analog, info);
+	scale->packet_parse(buf, &floatval, &analog, devc->info);
 	analog.data = &floatval;
 
 	if (analog.meaning->mq != 0) {
 		/* Got a measurement. */
-		packet.type = SR_DF_ANALOG;
-		packet.payload = &analog;
-		sr_session_send(sdi, &packet);
+		sr_analog_batch_add(sdi, &devc->batch, &analog, floatval);
 		sr_sw_limits_update_samples_read(&devc->limits, 1);
 	}
 }
 
-static void handle_new_data(struct sr_dev_inst *sdi, void *info)
+static void handle_new_data(struct sr_dev_inst *sdi)
 {
 	struct scale_info *scale;
 	struct dev_context *devc;
@@ -88,7 +84,7 @@ static void handle_new_data(struct sr_dev_inst *sdi, void *info)
 	offset = 0;
 	while ((devc->buflen - offset) >= scale->packet_size) {
 		if (scale->packet_valid(devc->buf + offset)) {
-			handle_packet(devc->buf + offset, sdi, info);
+			handle_packet(devc->buf + offset, sdi);
 			offset += scale->packet_size;
 		} else {
 			offset++;
@@ -105,8 +101,6 @@ SR_PRIV int kern_scale_receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	struct scale_info *scale;
-	void *info;
 
 	(void)fd;
 
@@ -116,15 +110,13 @@ SR_PRIV int kern_scale_receive_data(int fd, int revents, void *cb_data)
 	if (!(devc = sdi->priv))
 		return TRUE;
 
-	scale = (struct scale_info *)sdi->driver;
-
 	if (revents == G_IO_IN) {
 		/* Serial data arrived. */
-		info = g_malloc(scale->info_size);
-		handle_new_data(sdi, info);
-		g_free(info);
+		handle_new_data(sdi);
 	}
 
+	sr_analog_batch_check(sdi, &devc->batch);
+
 	if (sr_sw_limits_check(&devc->limits))
 		sr_dev_acquisition_stop(sdi);
 
@@ -52,6 +52,15 @@ struct dev_context {
 	uint8_t buf[SCALE_BUFSIZE];
 	int bufoffset;
 	int buflen;
+
+	/** Readings per packet, see SR_CONF_BATCH_SIZE. */
+	uint64_t batch_size;
+	/** Maximum batching delay [ms], see SR_CONF_BATCH_LATENCY. */
+	uint64_t batch_latency;
+
+	/** Used only during acquisition. */
+	struct sr_analog_batch batch;
+	void *info;
 };
 
 SR_PRIV int kern_scale_receive_data(int fd, int revents, void *cb_data);
@@ -325,24 +325,139 @@ SR_PRIV int ols_set_samplerate(const struct sr_dev_inst *sdi,
 SR_PRIV void abort_acquisition(const struct sr_dev_inst *sdi)
 {
 	struct sr_serial_dev_inst *serial;
+	struct dev_context *devc;
 
 	serial = sdi->conn;
 	serial_source_remove(sdi->session, serial);
 
+	devc = sdi->priv;
+	sr_capture_store_free(devc->sample_store);
+	devc->sample_store = NULL;
+
 	std_session_send_df_end(sdi);
 }
 
+/*
+ * Fill count samples at dst with copies of the 4-byte sample, doubling
+ * the size of each memcpy() to keep long RLE runs cheap.
+ */
+static void fill_samples(unsigned char *dst, const unsigned char *sample,
+		uint64_t count)
+{
+	size_t done, total, size;
+
+	total = (size_t)count * 4;
+	if (!total)
+		return;
+
+	memcpy(dst, sample, 4);
+	for (done = 4; done < total; done += size) {
+		size = MIN(done, total - done);
+		memcpy(dst + done, dst, size);
+	}
+}
+
+/*
+ * Fill count samples of the sample store from index pos on with copies
+ * of the 4-byte sample. The range may span several store segments.
+ */
+static void store_fill_samples(struct sr_capture_store *store, uint64_t pos,
+		const unsigned char *sample, uint64_t count)
+{
+	uint8_t *dst;
+	uint64_t n;
+
+	while (count) {
+		n = count;
+		dst = sr_capture_store_get(store, pos, &n);
+		if (!dst)
+			return;
+		fill_samples(dst, sample, n);
+		pos += n;
+		count -= n;
+	}
+}
+
+/*
+ * Store a complete sample (in devc->sample) into the sample buffer, or
+ * keep it as the RLE count which applies to the next sample.
+ */
+static void store_sample(struct dev_context *devc, int num_ols_changrp,
+		const int *byte_map)
+{
+	uint32_t sample;
+	int i;
+
+	devc->cnt_samples++;
+	devc->cnt_samples_rle++;
+
+	/*
+	 * Got a full sample. Convert from the OLS's little-endian
+	 * sample to the local format.
+	 */
+	sample = devc->sample[0] | (devc->sample[1] << 8) \
+			| (devc->sample[2] << 16) | (devc->sample[3] << 24);
+	if (devc->flag_reg & FLAG_RLE) {
+		/*
+		 * In RLE mode the high bit of the sample is the
+		 * "count" flag, meaning this sample is the number
+		 * of times the previous sample occurred.
+		 */
+		if (devc->sample[num_ols_changrp - 1] & 0x80) {
+			/* Clear the high bit. */
+			sample &= ~(0x80 << (num_ols_changrp - 1) * 8);
+			devc->rle_count = sample;
+			devc->cnt_samples_rle += devc->rle_count;
+			return;
+		}
+	}
+	devc->num_samples += devc->rle_count + 1;
+	if (devc->num_samples > devc->limit_samples) {
+		/* Save us from overrunning the buffer. */
+		devc->rle_count -= devc->num_samples - devc->limit_samples;
+		devc->num_samples = devc->limit_samples;
+	}
+
+	if (num_ols_changrp < 4) {
+		/*
+		 * Some channel groups may have been turned
+		 * off, to speed up transfer between the
+		 * hardware and the PC. Expand that here before
+		 * submitting it over the session bus --
+		 * whatever is listening on the bus will be
+		 * expecting a full 32-bit sample, based on
+		 * the number of channels.
+		 */
+		memset(devc->tmp_sample, 0, 4);
+		for (i = 0; i < num_ols_changrp; i++) {
+			if (byte_map[i] >= 0)
+				devc->tmp_sample[byte_map[i]] = devc->sample[i];
+		}
+		memcpy(devc->sample, devc->tmp_sample, 4);
+	}
+
+	/*
+	 * the OLS sends its sample buffer backwards.
+	 * store it in reverse order here, so we can dump
+	 * this on the session bus later.
+	 */
+	store_fill_samples(devc->sample_store,
+			devc->limit_samples - devc->num_samples,
+			devc->sample, devc->rle_count + 1);
+	memset(devc->sample, 0, 4);
+	devc->rle_count = 0;
+}
+
 SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 {
 	struct dev_context *devc;
 	struct sr_dev_inst *sdi;
 	struct sr_serial_dev_inst *serial;
 	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
-	uint32_t sample;
-	int num_ols_changrp, offset, j;
+	uint64_t first;
+	int num_ols_changrp, byte_map[4], len, pos, j;
 	unsigned int i;
-	unsigned char byte;
+	unsigned char buf[4096];
 
 	(void)fd;
 
@@ -356,13 +471,17 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 	}
 
 	if (devc->num_transfers++ == 0) {
-		devc->raw_sample_buf = g_try_malloc(devc->limit_samples * 4);
-		if (!devc->raw_sample_buf) {
-			sr_err("Sample buffer malloc failed.");
+		/*
+		 * The whole capture has to be kept until it is complete,
+		 * since the OLS sends it backwards. Large captures spill
+		 * from memory to a file.
+		 */
+		devc->sample_store = sr_capture_store_new(4, 0);
+		if (!devc->sample_store || sr_capture_store_set_length(
+				devc->sample_store, devc->limit_samples) != SR_OK) {
+			sr_err("Sample buffer allocation failed.");
 			return FALSE;
 		}
-		/* fill with 1010... for debugging */
-		memset(devc->raw_sample_buf, 0x82, devc->limit_samples * 4);
 	}
 
 	num_ols_changrp = 0;
@@ -372,92 +491,39 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 		}
 	}
 
+	/*
+	 * Map the received bytes of a sample to their channel group:
+	 * enabled groups take the next byte, and in demux mode groups
+	 * 2 & 3 get added to 0 & 1.
+	 */
+	for (j = 0; j < 4; j++)
+		byte_map[j] = -1;
+	j = 0;
+	for (i = 0; i < 4; i++) {
+		if (((devc->flag_reg >> 2) & (1 << i)) == 0)
+			byte_map[j++] = i;
+		else if (devc->flag_reg & FLAG_DEMUX && (i > 2))
+			byte_map[j++] = i - 2;
+	}
+
 	if (revents == G_IO_IN && devc->num_samples < devc->limit_samples) {
-		if (serial_read_nonblocking(serial, &byte, 1) != 1)
+		/* Drain everything that is available, then decode it. */
+		len = serial_read_nonblocking(serial, buf, sizeof(buf));
+		if (len <= 0)
 			return FALSE;
-		devc->cnt_bytes++;
-
-		/* Ignore it if we've read enough. */
-		if (devc->num_samples >= devc->limit_samples)
-			return TRUE;
+		devc->cnt_bytes += len;
 
-		devc->sample[devc->num_bytes++] = byte;
-		sr_spew("Received byte 0x%.2x.", byte);
-		if (devc->num_bytes == num_ols_changrp) {
-			devc->cnt_samples++;
-			devc->cnt_samples_rle++;
-			/*
-			 * Got a full sample. Convert from the OLS's little-endian
-			 * sample to the local format.
-			 */
-			sample = devc->sample[0] | (devc->sample[1] << 8) \
-					| (devc->sample[2] << 16) | (devc->sample[3] << 24);
-			sr_dbg("Received sample 0x%.*x.", devc->num_bytes * 2, sample);
-			if (devc->flag_reg & FLAG_RLE) {
-				/*
-				 * In RLE mode the high bit of the sample is the
-				 * "count" flag, meaning this sample is the number
-				 * of times the previous sample occurred.
-				 */
-				if (devc->sample[devc->num_bytes - 1] & 0x80) {
-					/* Clear the high bit. */
-					sample &= ~(0x80 << (devc->num_bytes - 1) * 8);
-					devc->rle_count = sample;
-					devc->cnt_samples_rle += devc->rle_count;
-					sr_dbg("RLE count: %u.", devc->rle_count);
-					devc->num_bytes = 0;
-					return TRUE;
-				}
-			}
-			devc->num_samples += devc->rle_count + 1;
-			if (devc->num_samples > devc->limit_samples) {
-				/* Save us from overrunning the buffer. */
-				devc->rle_count -= devc->num_samples - devc->limit_samples;
-				devc->num_samples = devc->limit_samples;
-			}
+		for (pos = 0; pos < len; pos++) {
+			/* Ignore it if we've read enough. */
+			if (devc->num_samples >= devc->limit_samples)
+				break;
 
-			if (num_ols_changrp < 4) {
-				/*
-				 * Some channel groups may have been turned
-				 * off, to speed up transfer between the
-				 * hardware and the PC. Expand that here before
-				 * submitting it over the session bus --
-				 * whatever is listening on the bus will be
-				 * expecting a full 32-bit sample, based on
-				 * the number of channels.
-				 */
-				j = 0;
-				memset(devc->tmp_sample, 0, 4);
-				for (i = 0; i < 4; i++) {
-					if (((devc->flag_reg >> 2) & (1 << i)) == 0) {
-						/*
-						 * This channel group was
-						 * enabled, copy from received
-						 * sample.
-						 */
-						devc->tmp_sample[i] = devc->sample[j++];
-					} else if (devc->flag_reg & FLAG_DEMUX && (i > 2)) {
-						/* group 2 & 3 get added to 0 & 1 */
-						devc->tmp_sample[i - 2] = devc->sample[j++];
-					}
-				}
-				memcpy(devc->sample, devc->tmp_sample, 4);
-				sr_spew("Expanded sample: 0x%.8x.", sample);
-			}
+			devc->sample[devc->num_bytes++] = buf[pos];
+			if (devc->num_bytes < num_ols_changrp)
+				continue;
 
-			/*
-			 * the OLS sends its sample buffer backwards.
-			 * store it in reverse order here, so we can dump
-			 * this on the session bus later.
-			 */
-			offset = (devc->limit_samples - devc->num_samples) * 4;
-			for (i = 0; i <= devc->rle_count; i++) {
-				memcpy(devc->raw_sample_buf + offset + (i * 4),
-				       devc->sample, 4);
-			}
-			memset(devc->sample, 0, 4);
 			devc->num_bytes = 0;
-			devc->rle_count = 0;
+			store_sample(devc, num_ols_changrp, byte_map);
 		}
 	} else {
 		/*
@@ -468,6 +534,7 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 		sr_dbg("Received %d bytes, %d samples, %d decompressed samples.",
 				devc->cnt_bytes, devc->cnt_samples,
 				devc->cnt_samples_rle);
+		first = devc->limit_samples - devc->num_samples;
 		if (devc->trigger_at != -1) {
 			/*
 			 * A trigger was set up, so we need to tell the frontend
@@ -475,38 +542,24 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 			 */
 			if (devc->trigger_at > 0) {
 				/* There are pre-trigger samples, send those first. */
-				packet.type = SR_DF_LOGIC;
-				packet.payload = &logic;
-				logic.length = devc->trigger_at * 4;
-				logic.unitsize = 4;
-				logic.data = devc->raw_sample_buf +
-					(devc->limit_samples - devc->num_samples) * 4;
-				sr_session_send(sdi, &packet);
+				sr_capture_store_send_logic(devc->sample_store, sdi,
+					first, devc->trigger_at);
 			}
 
 			/* Send the trigger. */
 			packet.type = SR_DF_TRIGGER;
+			packet.payload = NULL;
 			sr_session_send(sdi, &packet);
 
 			/* Send post-trigger samples. */
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
-			logic.length = (devc->num_samples * 4) - (devc->trigger_at * 4);
-			logic.unitsize = 4;
-			logic.data = devc->raw_sample_buf + devc->trigger_at * 4 +
-				(devc->limit_samples - devc->num_samples) * 4;
-			sr_session_send(sdi, &packet);
+			sr_capture_store_send_logic(devc->sample_store, sdi,
+				first + devc->trigger_at,
+				devc->num_samples - devc->trigger_at);
 		} else {
 			/* no trigger was used */
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
-			logic.length = devc->num_samples * 4;
-			logic.unitsize = 4;
-			logic.data = devc->raw_sample_buf +
-				(devc->limit_samples - devc->num_samples) * 4;
-			sr_session_send(sdi, &packet);
+			sr_capture_store_send_logic(devc->sample_store, sdi,
+				first, devc->num_samples);
 		}
-		g_free(devc->raw_sample_buf);
 
 		serial_flush(serial);
 		abort_acquisition(sdi);
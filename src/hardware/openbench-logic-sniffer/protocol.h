@@ -93,7 +93,7 @@ struct dev_context {
 	unsigned int rle_count;
 	unsigned char sample[4];
 	unsigned char tmp_sample[4];
-	unsigned char *raw_sample_buf;
+	struct sr_capture_store *sample_store;
 };
 
 SR_PRIV extern const char *ols_channel_names[];
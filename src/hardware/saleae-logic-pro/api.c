@@ -409,6 +409,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	usb = sdi->conn;
 
 	devc->conv_buffer = g_malloc(CONV_BUFFER_SIZE);
+	saleae_logic_pro_planes_init(sdi);
 
 	devc->num_transfers = BUF_COUNT;
 	devc->transfers = g_malloc0(sizeof(*devc->transfers) * BUF_COUNT);
@@ -578,6 +578,7 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 			continue;
 
 		mask = 1 << c->index;
+		devc->dig_channel_indices[devc->dig_channel_cnt] = c->index;
 		devc->dig_channel_masks[devc->dig_channel_cnt++] = mask;
 		devc->dig_channel_mask |= mask;
 
@@ -795,7 +796,7 @@ SR_PRIV int saleae_logic_pro_start(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc = sdi->priv;
 
-	devc->conv_size = 0;
+	devc->conv_batches = 0;
 	devc->batch_index = 0;
 
 	write_reg(sdi, 0x00, 0x01);
@@ -824,62 +825,83 @@ SR_PRIV int saleae_logic_pro_stop(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static void saleae_logic_pro_send_data(const struct sr_dev_inst *sdi,
-				      void *data, size_t length, size_t unitsize)
+/* Point the planes of the enabled channels into the conversion buffer. */
+SR_PRIV void saleae_logic_pro_planes_init(const struct sr_dev_inst *sdi)
 {
-	const struct sr_datafeed_logic logic = {
-		.length = length,
-		.unitsize = unitsize,
-		.data = data
+	struct dev_context *devc = sdi->priv;
+	unsigned int i, index;
+
+	memset(devc->conv_planes, 0, sizeof(devc->conv_planes));
+	for (i = 0; i < devc->dig_channel_cnt; i++) {
+		index = devc->dig_channel_indices[i];
+		devc->conv_planes[index] = devc->conv_buffer
+			+ index * CONV_PLANE_SIZE;
+	}
+}
+
+static void saleae_logic_pro_send_data(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+
+	const struct sr_datafeed_logic_planar planar = {
+		.num_samples = devc->conv_batches * 32,
+		.unitsize = 2,
+		.num_planes = NUM_CHANNELS,
+		.planes = devc->conv_planes,
 	};
 
 	const struct sr_datafeed_packet packet = {
-		.type = SR_DF_LOGIC,
-		.payload = &logic
+		.type = SR_DF_LOGIC_PLANAR,
+		.payload = &planar
 	};
 
-	sr_session_send(sdi, &packet);
+	if (planar.num_samples)
+		sr_session_send(sdi, &packet);
+}
+
+/* Reverse the bit order, the device sends the first sample in the MSB. */
+static inline uint32_t reverse_bits(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+	x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+
+	return (x >> 16) | (x << 16);
 }
 
 /*
  * One batch from the device consists of 32 samples per active digital channel.
  * This stream of batches is packed into USB packets with 16384 bytes each.
+ *
+ * The samples of a channel are already bit-planar, so each word of a batch
+ * is appended to its channel's plane as is, just in LSB-first order.
  */
 static void saleae_logic_pro_convert_data(const struct sr_dev_inst *sdi,
-					 const uint32_t *src, size_t srccnt)
+					 const uint8_t *src, size_t srccnt)
 {
 	struct dev_context *devc = sdi->priv;
-	uint8_t *dst = devc->conv_buffer;
-	uint32_t samples;
-	uint16_t channel_mask;
-	unsigned int sample_index, batch_index;
-	uint16_t *dst_batch;
-
-	/* Copy partial batch to the beginning. */
-	memcpy(dst, dst + devc->conv_size, CONV_BATCH_SIZE);
+	unsigned int batch_index;
+	uint8_t *plane;
+
+	/* Move the partial batch to the beginning. */
+	for (batch_index = 0; batch_index < devc->batch_index; batch_index++) {
+		plane = devc->conv_planes[devc->dig_channel_indices[batch_index]];
+		memcpy(plane, plane + devc->conv_batches * 4, 4);
+	}
 	/* Reset converted size. */
-	devc->conv_size = 0;
+	devc->conv_batches = 0;
 
 	batch_index = devc->batch_index;
 	while (srccnt--) {
-		samples = *src++;
-		dst_batch = (uint16_t*)dst;
-
-		/* First index of the batch. */
-		if (batch_index == 0)
-			memset(dst, 0, CONV_BATCH_SIZE);
-
-		/* Convert one channel. */
-		channel_mask = devc->dig_channel_masks[batch_index];
-		for (sample_index = 0; sample_index <= 31; sample_index++)
-			if ((samples >> (31 - sample_index)) & 1)
-				dst_batch[sample_index] |= channel_mask;
+		plane = devc->conv_planes[devc->dig_channel_indices[batch_index]];
+		WL32(plane + devc->conv_batches * 4, reverse_bits(RL32(src)));
+		src += 4;
 
 		/* Last index of the batch. */
 		if (++batch_index == devc->dig_channel_cnt) {
-			devc->conv_size += CONV_BATCH_SIZE;
+			devc->conv_batches++;
 			batch_index = 0;
-			dst += CONV_BATCH_SIZE;
 		}
 	}
 	devc->batch_index = batch_index;
@@ -888,7 +910,6 @@ static void saleae_logic_pro_convert_data(const struct sr_dev_inst *sdi,
 SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *transfer)
 {
 	const struct sr_dev_inst *sdi = transfer->user_data;
-	struct dev_context *devc = sdi->priv;
 	int ret;
 
 	switch (transfer->status) {
@@ -903,8 +924,8 @@ SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *t
 		return;
 	}
 
-	saleae_logic_pro_convert_data(sdi, (uint32_t*)transfer->buffer, 16 * 1024 / 4);
-	saleae_logic_pro_send_data(sdi, devc->conv_buffer, devc->conv_size, 2);
+	saleae_logic_pro_convert_data(sdi, transfer->buffer, 16 * 1024 / 4);
+	saleae_logic_pro_send_data(sdi);
 
 	if ((ret = libusb_submit_transfer(transfer)) != LIBUSB_SUCCESS)
 		sr_dbg("FIXME resubmit failed");
@@ -27,19 +27,20 @@
 
 #define LOG_PREFIX "saleae-logic-pro"
 
-/* 16 channels * 32 samples */
-#define CONV_BATCH_SIZE (2 * 32)
+#define NUM_CHANNELS 16
 
 /*
- * One packet + one partial conversion: Worst case is only one active
- * channel converted to 2 bytes per sample, with 8 * 16384 samples per packet.
+ * One packet + one partial batch per channel plane: Worst case is only
+ * one active channel, with all 16384 bytes of a packet in its plane.
  */
-#define CONV_BUFFER_SIZE (2 * 8 * 16384 + CONV_BATCH_SIZE)
+#define CONV_PLANE_SIZE (16384 + 4)
+#define CONV_BUFFER_SIZE (NUM_CHANNELS * CONV_PLANE_SIZE)
 
 struct dev_context {
 	unsigned int dig_channel_cnt;
 	uint16_t dig_channel_mask;
-	uint16_t dig_channel_masks[16];
+	uint16_t dig_channel_masks[NUM_CHANNELS];
+	uint8_t dig_channel_indices[NUM_CHANNELS];
 	uint64_t dig_samplerate;
 
 	uint32_t lfsr;
@@ -48,13 +49,17 @@ struct dev_context {
 	unsigned int submitted_transfers;
 	struct libusb_transfer **transfers;
 
+	/* One bit-plane per channel, NULL for disabled channels. */
 	uint8_t *conv_buffer;
-	unsigned int conv_size;
+	void *conv_planes[NUM_CHANNELS];
+	/* Number of complete batches in the planes. */
+	unsigned int conv_batches;
 	unsigned int batch_index;
 };
 
 SR_PRIV int saleae_logic_pro_init(const struct sr_dev_inst *sdi);
 SR_PRIV int saleae_logic_pro_prepare(const struct sr_dev_inst *sdi);
+SR_PRIV void saleae_logic_pro_planes_init(const struct sr_dev_inst *sdi);
 SR_PRIV int saleae_logic_pro_start(const struct sr_dev_inst *sdi);
 SR_PRIV int saleae_logic_pro_stop(const struct sr_dev_inst *sdi);
 SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *transfer);
@@ -577,17 +577,7 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 		channel_bit = 1 << (ch->index);
 
 		devc->cur_channels |= channel_bit;
-
-#ifdef WORDS_BIGENDIAN
-		/*
-		 * Output logic data should be stored in little endian format.
-		 * To speed things up during conversion, do the switcharoo
-		 * here instead.
-		 */
-		channel_bit = 1 << (ch->index ^ 8);
-#endif
-
-		devc->channel_masks[devc->num_channels++] = channel_bit;
+		devc->channel_indices[devc->num_channels++] = ch->index;
 	}
 
 	return SR_OK;
@@ -646,7 +636,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	devc->sent_samples = 0;
 	devc->empty_transfer_count = 0;
 	devc->cur_channel = 0;
-	memset(devc->channel_data, 0, sizeof(devc->channel_data));
+	devc->plane_groups = 0;
 
 	if ((trigger = sr_session_trigger_get(sdi->session))) {
 		int pre_trigger_samples = 0;
@@ -666,10 +656,16 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	devc->submitted_transfers = 0;
 
 	devc->convbuffer_size = convsize;
-	if (!(devc->convbuffer = g_try_malloc(convsize))) {
+	devc->plane_size = convsize / 16;
+	if (!(devc->convbuffer = g_try_malloc(convsize + 16 * devc->plane_size))) {
 		sr_err("Conversion buffer malloc failed.");
 		return SR_ERR_MALLOC;
 	}
+	memset(devc->planes, 0, sizeof(devc->planes));
+	for (i = 0; i < devc->num_channels; i++) {
+		devc->planes[devc->channel_indices[i]] = devc->convbuffer
+			+ convsize + devc->channel_indices[i] * devc->plane_size;
+	}
 
 	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
 	if (!devc->transfers) {
@@ -804,46 +804,57 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 	sr_err("%s: %s", __func__, libusb_error_name(ret));
 }
 
+/* Reverse the bit order, the device sends the first sample in the MSB. */
+static inline uint16_t reverse_bits(uint16_t x)
+{
+	x = ((x >> 1) & 0x5555) | ((x & 0x5555) << 1);
+	x = ((x >> 2) & 0x3333) | ((x & 0x3333) << 2);
+	x = ((x >> 4) & 0x0f0f) | ((x & 0x0f0f) << 4);
+
+	return (x >> 8) | (x << 8);
+}
+
+/*
+ * The device sends groups of 16 samples per enabled channel, which are
+ * already bit-planar. Append each word to its channel's plane, keeping a
+ * partial group at the end for the next transfer.
+ */
 static size_t convert_sample_data(struct dev_context *devc,
-		uint8_t *dest, size_t destcnt, const uint8_t *src, size_t srccnt)
+		const uint8_t *src, size_t srccnt)
 {
-	uint16_t *channel_data;
-	int i, cur_channel;
-	size_t ret = 0;
-	uint16_t sample, channel_mask;
+	uint8_t *plane;
+	int cur_channel;
+	size_t groups;
 
 	srccnt /= 2;
 
-	channel_data = devc->channel_data;
-	cur_channel = devc->cur_channel;
+	/* Move the partial group to the beginning. */
+	for (cur_channel = 0; cur_channel < devc->cur_channel; cur_channel++) {
+		plane = devc->planes[devc->channel_indices[cur_channel]];
+		memcpy(plane, plane + devc->plane_groups * 2, 2);
+	}
 
+	groups = 0;
+	cur_channel = devc->cur_channel;
 	while (srccnt--) {
-		sample = src[0] | (src[1] << 8);
+		if ((groups + 1) * 2 > devc->plane_size) {
+			sr_err("Conversion buffer too small!");
+			break;
+		}
+		plane = devc->planes[devc->channel_indices[cur_channel]];
+		WL16(plane + groups * 2, reverse_bits(RL16(src)));
 		src += 2;
 
-		channel_mask = devc->channel_masks[cur_channel];
-
-		for (i = 15; i >= 0; --i, sample >>= 1)
-			if (sample & 1)
-				channel_data[i] |= channel_mask;
-
 		if (++cur_channel == devc->num_channels) {
 			cur_channel = 0;
-			if (destcnt < 16 * 2) {
-				sr_err("Conversion buffer too small!");
-				break;
-			}
-			memcpy(dest, channel_data, 16 * 2);
-			memset(channel_data, 0, 16 * 2);
-			dest += 16 * 2;
-			ret += 16;
-			destcnt -= 16 * 2;
+			groups++;
 		}
 	}
 
 	devc->cur_channel = cur_channel;
+	devc->plane_groups = groups;
 
-	return ret;
+	return groups * 16;
 }
 
 SR_PRIV void LIBUSB_CALL logic16_receive_transfer(struct libusb_transfer *transfer)
@@ -851,6 +862,7 @@ SR_PRIV void LIBUSB_CALL logic16_receive_transfer(struct libusb_transfer *transf
 	gboolean packet_has_error = FALSE;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
+	struct sr_datafeed_logic_planar planar;
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	size_t new_samples, num_samples;
@@ -910,8 +922,8 @@ SR_PRIV void LIBUSB_CALL logic16_receive_transfer(struct libusb_transfer *transf
 		devc->empty_transfer_count = 0;
 	}
 
-	new_samples = convert_sample_data(devc, devc->convbuffer,
-			devc->convbuffer_size, transfer->buffer, transfer->actual_length);
+	new_samples = convert_sample_data(devc, transfer->buffer,
+			transfer->actual_length);
 
 	if (new_samples <= 0) {
 		resubmit_transfer(transfer);
@@ -919,19 +931,23 @@ SR_PRIV void LIBUSB_CALL logic16_receive_transfer(struct libusb_transfer *transf
 	}
 
 	/* At least one new sample. */
+	planar.unitsize = 2;
+	planar.num_planes = 16;
+	planar.planes = devc->planes;
 	if (devc->trigger_fired) {
 		/* Send the incoming transfer to the session bus. */
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
+		packet.type = SR_DF_LOGIC_PLANAR;
+		packet.payload = &planar;
 		if (devc->limit_samples &&
 				new_samples > devc->limit_samples - devc->sent_samples)
 			new_samples = devc->limit_samples - devc->sent_samples;
-		logic.length = new_samples * 2;
-		logic.unitsize = 2;
-		logic.data = devc->convbuffer;
+		planar.num_samples = new_samples;
 		sr_session_send(sdi, &packet);
 		devc->sent_samples += new_samples;
 	} else {
+		/* The soft trigger needs sample-major data. */
+		planar.num_samples = new_samples;
+		sr_logic_planar_to_samples(&planar, devc->convbuffer);
 		trigger_offset = soft_trigger_logic_check(devc->stl,
 				devc->convbuffer, new_samples * 2, &pre_trigger_samples);
 		if (trigger_offset > -1) {
@@ -79,10 +79,17 @@ struct dev_context {
 	int empty_transfer_count;
 	int num_channels;
 	int cur_channel;
-	uint16_t channel_masks[16];
-	uint16_t channel_data[16];
+	uint8_t channel_indices[16];
+	/*
+	 * Sample-major samples for the soft trigger, followed by one
+	 * bit-plane of plane_size bytes per channel.
+	 */
 	uint8_t *convbuffer;
 	size_t convbuffer_size;
+	void *planes[16];
+	size_t plane_size;
+	/* Number of complete 16 sample groups in the planes. */
+	size_t plane_groups;
 	struct soft_trigger_logic *stl;
 	gboolean trigger_fired;
 
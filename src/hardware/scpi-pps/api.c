@@ -36,6 +36,22 @@ static const uint32_t drvopts[] = {
 	SR_CONF_POWER_SUPPLY,
 };
 
+/*
+ * Settings which only change through config_set() while the front panel
+ * is locked out. Output state and measurements are left alone, since the
+ * protection circuitry can change those at any time.
+ */
+static const uint32_t cached_opts[] = {
+	SR_CONF_VOLTAGE_TARGET,
+	SR_CONF_CURRENT_LIMIT,
+	SR_CONF_OUTPUT_FREQUENCY_TARGET,
+	SR_CONF_OVER_VOLTAGE_PROTECTION_ENABLED,
+	SR_CONF_OVER_VOLTAGE_PROTECTION_THRESHOLD,
+	SR_CONF_OVER_CURRENT_PROTECTION_ENABLED,
+	SR_CONF_OVER_CURRENT_PROTECTION_THRESHOLD,
+	SR_CONF_OVER_TEMPERATURE_PROTECTION,
+};
+
 static const struct pps_channel_instance pci[] = {
 	{ SR_MQ_VOLTAGE, SCPI_CMD_GET_MEAS_VOLTAGE, "V" },
 	{ SR_MQ_CURRENT, SCPI_CMD_GET_MEAS_CURRENT, "I" },
@@ -258,6 +274,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 
 	devc = sdi->priv;
 	sr_scpi_cmd(sdi, devc->device->commands, 0, NULL, SCPI_CMD_REMOTE);
+	if (sr_scpi_cmd_get(devc->device->commands, SCPI_CMD_REMOTE))
+		sr_config_cache_enable(sdi, ARRAY_AND_SIZE(cached_opts));
 	devc->beeper_was_set = FALSE;
 	if (sr_scpi_cmd_resp(sdi, devc->device->commands, 0, NULL,
 			&beeper, G_VARIANT_TYPE_BOOLEAN, SCPI_CMD_BEEPER) == SR_OK) {
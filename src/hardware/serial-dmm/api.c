@@ -42,6 +42,8 @@ static const uint32_t devopts[] = {
 	SR_CONF_CONTINUOUS,
 	SR_CONF_LIMIT_SAMPLES | SR_CONF_SET,
 	SR_CONF_LIMIT_MSEC | SR_CONF_SET,
+	SR_CONF_BATCH_SIZE | SR_CONF_SET,
+	SR_CONF_BATCH_LATENCY | SR_CONF_SET,
 };
 
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
@@ -130,6 +132,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	sdi->model = g_strdup(dmm->device);
 	devc = g_malloc0(sizeof(struct dev_context));
 	sr_sw_limits_init(&devc->limits);
+	devc->batch_size = 1;
 	sdi->inst_type = SR_INST_SERIAL;
 	sdi->conn = serial;
 	sdi->priv = devc;
@@ -157,7 +160,20 @@ static int config_set(uint32_t key, GVariant *data,
 
 	devc = sdi->priv;
 
-	return sr_sw_limits_config_set(&devc->limits, key, data);
+	switch (key) {
+	case SR_CONF_BATCH_SIZE:
+		if (g_variant_get_uint64(data) < 1)
+			return SR_ERR_ARG;
+		devc->batch_size = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_BATCH_LATENCY:
+		devc->batch_latency = g_variant_get_uint64(data);
+		break;
+	default:
+		return sr_sw_limits_config_set(&devc->limits, key, data);
+	}
+
+	return SR_OK;
 }
 
 static int config_list(uint32_t key, GVariant **data,
@@ -168,11 +184,23 @@ static int config_list(uint32_t key, GVariant **data,
 
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
+	struct dmm_info *dmm;
 	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
+	size_t ch_idx;
 
+	dmm = (struct dmm_info *)sdi->driver;
 	devc = sdi->priv;
 
+	/* Set up the per-reading state once, not for every packet. */
+	devc->info = g_malloc(dmm->info_size);
+	devc->batches = g_malloc0(dmm->channel_count * sizeof(*devc->batches));
+	for (ch_idx = 0; ch_idx < dmm->channel_count; ch_idx++) {
+		sr_analog_batch_init(&devc->batches[ch_idx],
+			g_slist_append(NULL, g_slist_nth_data(sdi->channels, ch_idx)),
+			TRUE, devc->batch_size, devc->batch_latency);
+	}
+
 	sr_sw_limits_acquisition_start(&devc->limits);
 	std_session_send_df_header(sdi);
 
@@ -183,6 +211,14 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+static int dev_acquisition_stop(struct sr_dev_inst *sdi)
+{
+	/* Send what is still pending before the end of the stream. */
+	serial_dmm_batches_free(sdi);
+
+	return std_serial_dev_acquisition_stop(sdi);
+}
+
 #define DMM(ID, CHIPSET, VENDOR, MODEL, CONN, BAUDRATE, PACKETSIZE, TIMEOUT, \
 			DELAY, REQUEST, VALID, PARSE, DETAILS) \
 	&((struct dmm_info) { \
@@ -201,7 +237,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 			.dev_open = std_serial_dev_open, \
 			.dev_close = std_serial_dev_close, \
 			.dev_acquisition_start = dev_acquisition_start, \
-			.dev_acquisition_stop = std_serial_dev_acquisition_stop, \
+			.dev_acquisition_stop = dev_acquisition_stop, \
 			.context = NULL, \
 		}, \
 		VENDOR, MODEL, CONN, BAUDRATE, PACKETSIZE, TIMEOUT, DELAY, \
@@ -38,12 +38,10 @@ static void log_dmm_packet(const uint8_t *buf)
 	       buf[21], buf[22]);
 }
 
-static void handle_packet(const uint8_t *buf, struct sr_dev_inst *sdi,
-			  void *info)
+static void handle_packet(const uint8_t *buf, struct sr_dev_inst *sdi)
 {
 	struct dmm_info *dmm;
 	float floatval;
-	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
@@ -58,28 +56,26 @@ static void handle_packet(const uint8_t *buf, struct sr_dev_inst *sdi,
 	devc = sdi->priv;
 
 	sent_sample = FALSE;
-	memset(info, 0, dmm->info_size);
+	memset(devc->info, 0, dmm->info_size);
 	for (ch_idx = 0; ch_idx < dmm->channel_count; ch_idx++) {
 		/* Note: digits/spec_digits will be overridden by the DMM parsers. */
 		sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
 
-		analog.meaning->channels =
-			g_slist_append(NULL, g_slist_nth_data(sdi->channels, ch_idx));
+		analog.meaning->channels = devc->batches[ch_idx].channels;
 		analog.num_samples = 1;
 		analog.meaning->mq = 0;
 
-		dmm->packet_parse(buf, &floatval, &analog, info);
+		dmm->packet_parse(buf, &floatval, &analog, devc->info);
 		analog.data = &floatval;
 
 		/* If this DMM needs additional handling, call the resp. function. */
 		if (dmm->dmm_details)
-			dmm->dmm_details(&analog, info);
+			dmm->dmm_details(&analog, devc->info);
 
 		if (analog.meaning->mq != 0) {
 			/* Got a measurement. */
-			packet.type = SR_DF_ANALOG;
-			packet.payload = &analog;
-			sr_session_send(sdi, &packet);
+			sr_analog_batch_add(sdi, &devc->batches[ch_idx],
+				&analog, floatval);
 			sent_sample = TRUE;
 		}
 	}
@@ -89,6 +85,29 @@ static void handle_packet(const uint8_t *buf, struct sr_dev_inst *sdi,
 	}
 }
 
+/** Send the pending readings, and free the per-channel batches. */
+SR_PRIV void serial_dmm_batches_free(const struct sr_dev_inst *sdi)
+{
+	struct dmm_info *dmm;
+	struct dev_context *devc;
+	size_t ch_idx;
+
+	dmm = (struct dmm_info *)sdi->driver;
+	devc = sdi->priv;
+
+	if (!devc->batches)
+		return;
+
+	for (ch_idx = 0; ch_idx < dmm->channel_count; ch_idx++) {
+		sr_analog_batch_flush(sdi, &devc->batches[ch_idx]);
+		sr_analog_batch_clear(&devc->batches[ch_idx]);
+	}
+	g_free(devc->batches);
+	devc->batches = NULL;
+	g_free(devc->info);
+	devc->info = NULL;
+}
+
 /** Request packet, if required. */
 SR_PRIV int req_packet(struct sr_dev_inst *sdi)
 {
@@ -123,7 +142,7 @@ SR_PRIV int req_packet(struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static void handle_new_data(struct sr_dev_inst *sdi, void *info)
+static void handle_new_data(struct sr_dev_inst *sdi)
 {
 	struct dmm_info *dmm;
 	struct dev_context *devc;
@@ -150,7 +169,7 @@ static void handle_new_data(struct sr_dev_inst *sdi, void *info)
 	offset = 0;
 	while ((devc->buflen - offset) >= dmm->packet_size) {
 		if (dmm->packet_valid(devc->buf + offset)) {
-			handle_packet(devc->buf + offset, sdi, info);
+			handle_packet(devc->buf + offset, sdi);
 			offset += dmm->packet_size;
 
 			/* Request next packet, if required. */
@@ -176,7 +195,7 @@ int receive_data(int fd, int revents, void *cb_data)
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct dmm_info *dmm;
-	void *info;
+	size_t ch_idx;
 
 	(void)fd;
 
@@ -190,15 +209,16 @@ int receive_data(int fd, int revents, void *cb_data)
 
 	if (revents == G_IO_IN) {
 		/* Serial data arrived. */
-		info = g_malloc(dmm->info_size);
-		handle_new_data(sdi, info);
-		g_free(info);
+		handle_new_data(sdi);
 	} else {
 		/* Timeout; send another packet request if DMM needs it. */
 		if (dmm->packet_request && (req_packet(sdi) < 0))
 			return FALSE;
 	}
 
+	for (ch_idx = 0; ch_idx < dmm->channel_count; ch_idx++)
+		sr_analog_batch_check(sdi, &devc->batches[ch_idx]);
+
 	if (sr_sw_limits_check(&devc->limits))
 		sr_dev_acquisition_stop(sdi);
 
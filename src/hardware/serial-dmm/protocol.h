@@ -74,9 +74,20 @@ struct dev_context {
 	 * Used only if device needs polling.
 	 */
 	int64_t req_next_at;
+
+	/** Readings per packet and channel, see SR_CONF_BATCH_SIZE. */
+	uint64_t batch_size;
+	/** Maximum batching delay [ms], see SR_CONF_BATCH_LATENCY. */
+	uint64_t batch_latency;
+
+	/** One batch per channel. Used only during acquisition. */
+	struct sr_analog_batch *batches;
+	/** Chipset info struct. Used only during acquisition. */
+	void *info;
 };
 
 SR_PRIV int req_packet(struct sr_dev_inst *sdi);
 SR_PRIV int receive_data(int fd, int revents, void *cb_data);
+SR_PRIV void serial_dmm_batches_free(const struct sr_dev_inst *sdi);
 
 #endif
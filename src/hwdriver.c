@@ -183,6 +183,10 @@ static struct sr_key_info sr_key_info_config[] = {
 		"Trigger level", NULL},
 	{SR_CONF_EXTERNAL_CLOCK_SOURCE, SR_T_STRING, "external_clock_source",
 		"External clock source", NULL},
+	{SR_CONF_BATCH_SIZE, SR_T_UINT64, "batch_size",
+		"Batch size", NULL},
+	{SR_CONF_BATCH_LATENCY, SR_T_UINT64, "batch_latency",
+		"Batch latency", NULL},
 
 	/* Special stuff */
 	{SR_CONF_SESSIONFILE, SR_T_STRING, "sessionfile",
@@ -636,6 +640,197 @@ SR_PRIV int sr_dev_acquisition_stop(struct sr_dev_inst *sdi)
 	return sdi->driver->dev_acquisition_stop(sdi);
 }
 
+/*
+ * Per-device config cache.
+ *
+ * Drivers whose config_get() costs a device round trip can opt in with
+ * sr_config_cache_enable(), naming the keys whose value only changes
+ * through config_set(). While the device is open, sr_config_get() then
+ * serves those keys from the cache, and check_key() reuses the device's
+ * SR_CONF_DEVICE_OPTIONS list instead of asking the driver every time.
+ *
+ * Any successful set or commit drops the whole cache, since changing
+ * one setting may well change others. Drivers which learn about changes
+ * made behind their back (front panel, protection trips) call
+ * sr_config_cache_invalidate() or sr_config_cache_clear().
+ */
+struct sr_config_cache {
+	GMutex lock;
+	/* Keys the driver declared cacheable. */
+	GHashTable *keys;
+	/* struct config_cache_key -> GVariant. */
+	GHashTable *values;
+};
+
+struct config_cache_key {
+	const struct sr_channel_group *cg;
+	uint32_t key;
+	unsigned int op;
+};
+
+static guint config_cache_key_hash(gconstpointer p)
+{
+	const struct config_cache_key *k = p;
+
+	return g_direct_hash(k->cg) ^ (k->key * 31) ^ k->op;
+}
+
+static gboolean config_cache_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct config_cache_key *ka = a, *kb = b;
+
+	return ka->cg == kb->cg && ka->key == kb->key && ka->op == kb->op;
+}
+
+static struct sr_config_cache *config_cache_get(const struct sr_dev_inst *sdi)
+{
+	if (!sdi || !sdi->config_cache || sdi->status != SR_ST_ACTIVE)
+		return NULL;
+
+	return sdi->config_cache;
+}
+
+/* Return a new reference to the cached value, or NULL. */
+static GVariant *config_cache_lookup(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, unsigned int op)
+{
+	struct sr_config_cache *cache;
+	struct config_cache_key k;
+	GVariant *data;
+
+	if (!(cache = config_cache_get(sdi)))
+		return NULL;
+	if (op == SR_CONF_GET && !g_hash_table_contains(cache->keys,
+			GUINT_TO_POINTER(key)))
+		return NULL;
+
+	k.cg = cg;
+	k.key = key;
+	k.op = op;
+	g_mutex_lock(&cache->lock);
+	if ((data = g_hash_table_lookup(cache->values, &k)))
+		g_variant_ref(data);
+	g_mutex_unlock(&cache->lock);
+
+	return data;
+}
+
+static void config_cache_store(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, unsigned int op,
+		GVariant *data)
+{
+	struct sr_config_cache *cache;
+	struct config_cache_key *k;
+
+	if (!(cache = config_cache_get(sdi)))
+		return;
+	if (op == SR_CONF_GET && !g_hash_table_contains(cache->keys,
+			GUINT_TO_POINTER(key)))
+		return;
+
+	k = g_malloc(sizeof(*k));
+	k->cg = cg;
+	k->key = key;
+	k->op = op;
+	g_mutex_lock(&cache->lock);
+	g_hash_table_replace(cache->values, k, g_variant_ref(data));
+	g_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Enable the config cache for a device instance.
+ *
+ * @param sdi The device instance. Must not be NULL.
+ * @param keys The SR_CONF_* keys whose values may be served from the
+ *             cache. Capability bits are ignored.
+ * @param num_keys Number of entries in keys.
+ *
+ * @private
+ */
+SR_PRIV void sr_config_cache_enable(struct sr_dev_inst *sdi,
+		const uint32_t *keys, size_t num_keys)
+{
+	struct sr_config_cache *cache;
+	size_t i;
+
+	if (!sdi)
+		return;
+
+	if (!(cache = sdi->config_cache)) {
+		cache = g_malloc0(sizeof(*cache));
+		g_mutex_init(&cache->lock);
+		cache->keys = g_hash_table_new(g_direct_hash, g_direct_equal);
+		cache->values = g_hash_table_new_full(config_cache_key_hash,
+			config_cache_key_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+		sdi->config_cache = cache;
+	}
+
+	for (i = 0; i < num_keys; i++)
+		g_hash_table_add(cache->keys,
+			GUINT_TO_POINTER(keys[i] & SR_CONF_MASK));
+}
+
+/**
+ * Drop the cached value of a single key.
+ *
+ * @param sdi The device instance.
+ * @param cg The channel group the value belongs to, or NULL.
+ * @param key The SR_CONF_* key.
+ *
+ * @private
+ */
+SR_PRIV void sr_config_cache_invalidate(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key)
+{
+	struct sr_config_cache *cache;
+	struct config_cache_key k;
+
+	if (!sdi || !(cache = sdi->config_cache))
+		return;
+
+	k.cg = cg;
+	k.key = key;
+	k.op = SR_CONF_GET;
+	g_mutex_lock(&cache->lock);
+	g_hash_table_remove(cache->values, &k);
+	g_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Drop all cached values of a device instance.
+ *
+ * @param sdi The device instance.
+ *
+ * @private
+ */
+SR_PRIV void sr_config_cache_clear(const struct sr_dev_inst *sdi)
+{
+	struct sr_config_cache *cache;
+
+	if (!sdi || !(cache = sdi->config_cache))
+		return;
+
+	g_mutex_lock(&cache->lock);
+	g_hash_table_remove_all(cache->values);
+	g_mutex_unlock(&cache->lock);
+}
+
+/** @private */
+SR_PRIV void sr_config_cache_free(struct sr_dev_inst *sdi)
+{
+	struct sr_config_cache *cache;
+
+	if (!sdi || !(cache = sdi->config_cache))
+		return;
+
+	g_hash_table_destroy(cache->values);
+	g_hash_table_destroy(cache->keys);
+	g_mutex_clear(&cache->lock);
+	g_free(cache);
+	sdi->config_cache = NULL;
+}
+
 static void log_key(const struct sr_dev_inst *sdi,
 	const struct sr_channel_group *cg, uint32_t key, unsigned int op,
 	GVariant *data)
@@ -648,6 +843,10 @@ static void log_key(const struct sr_dev_inst *sdi,
 	if (key == SR_CONF_DEVICE_OPTIONS)
 		return;
 
+	/* Don't pay for printing the value when nobody will see it. */
+	if (sr_log_loglevel_get() < SR_LOG_SPEW)
+		return;
+
 	opstr = op == SR_CONF_GET ? "get" : op == SR_CONF_SET ? "set" : "list";
 	srci = sr_key_info_get(SR_KEY_CONFIG, key);
 
@@ -658,13 +857,33 @@ static void log_key(const struct sr_dev_inst *sdi,
 	g_free(tmp_str);
 }
 
-static int check_key(const struct sr_dev_driver *driver,
-		const struct sr_dev_inst *sdi, const struct sr_channel_group *cg,
-		uint32_t key, unsigned int op, GVariant *data)
+/*
+ * Fetch the SR_CONF_DEVICE_OPTIONS list check_key() validates against,
+ * from the config cache if the device has one.
+ */
+static GVariant *device_options_get(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	GVariant *gvar_opts;
+
+	if ((gvar_opts = config_cache_lookup(sdi, cg,
+			SR_CONF_DEVICE_OPTIONS, SR_CONF_LIST)))
+		return gvar_opts;
+
+	if (sr_config_list(driver, sdi, cg, SR_CONF_DEVICE_OPTIONS, &gvar_opts) != SR_OK)
+		return NULL;
+	config_cache_store(sdi, cg, SR_CONF_DEVICE_OPTIONS, SR_CONF_LIST,
+		gvar_opts);
+
+	return gvar_opts;
+}
+
+static int check_key_opts(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key,
+		unsigned int op, GVariant *data, GVariant *gvar_opts)
 {
 	const struct sr_key_info *srci;
 	gsize num_opts, i;
-	GVariant *gvar_opts;
 	const uint32_t *opts;
 	uint32_t pub_opt;
 	const char *suffix;
@@ -706,7 +925,7 @@ static int check_key(const struct sr_dev_driver *driver,
 		break;
 	}
 
-	if (sr_config_list(driver, sdi, cg, SR_CONF_DEVICE_OPTIONS, &gvar_opts) != SR_OK) {
+	if (!gvar_opts) {
 		/* Driver publishes no options. */
 		sr_err("No options available%s.", suffix);
 		return SR_ERR_ARG;
@@ -719,7 +938,6 @@ static int check_key(const struct sr_dev_driver *driver,
 			break;
 		}
 	}
-	g_variant_unref(gvar_opts);
 	if (!pub_opt) {
 		sr_err("Option '%s' not available%s.", srci->id, suffix);
 		return SR_ERR_ARG;
@@ -733,6 +951,21 @@ static int check_key(const struct sr_dev_driver *driver,
 	return SR_OK;
 }
 
+static int check_key(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi, const struct sr_channel_group *cg,
+		uint32_t key, unsigned int op, GVariant *data)
+{
+	GVariant *gvar_opts;
+	int ret;
+
+	gvar_opts = device_options_get(driver, sdi, cg);
+	ret = check_key_opts(sdi, cg, key, op, data, gvar_opts);
+	if (gvar_opts)
+		g_variant_unref(gvar_opts);
+
+	return ret;
+}
+
 /**
  * Query value of a configuration key at the given driver or device instance.
  *
@@ -779,11 +1012,17 @@ SR_API int sr_config_get(const struct sr_dev_driver *driver,
 		return SR_ERR;
 	}
 
+	if ((*data = config_cache_lookup(sdi, cg, key, SR_CONF_GET))) {
+		log_key(sdi, cg, key, SR_CONF_GET, *data);
+		return SR_OK;
+	}
+
 	if ((ret = driver->config_get(key, data, sdi, cg)) == SR_OK) {
 		log_key(sdi, cg, key, SR_CONF_GET, *data);
 		/* Got a floating reference from the driver. Sink it here,
 		 * caller will need to unref when done with it. */
 		g_variant_ref_sink(*data);
+		config_cache_store(sdi, cg, key, SR_CONF_GET, *data);
 	}
 
 	if (ret == SR_ERR_CHANNEL_GROUP)
@@ -834,6 +1073,8 @@ SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 	else if ((ret = sr_variant_type_check(key, data)) == SR_OK) {
 		log_key(sdi, cg, key, SR_CONF_SET, data);
 		ret = sdi->driver->config_set(key, data, sdi, cg);
+		/* Setting one key may affect others, start over. */
+		sr_config_cache_clear(sdi);
 	}
 
 	g_variant_unref(data);
@@ -866,8 +1107,188 @@ SR_API int sr_config_commit(const struct sr_dev_inst *sdi)
 		sr_err("%s: Device instance not active, can't commit config.",
 			sdi->driver->name);
 		ret = SR_ERR_DEV_CLOSED;
-	} else
+	} else {
 		ret = sdi->driver->config_commit(sdi);
+		sr_config_cache_clear(sdi);
+	}
+
+	return ret;
+}
+
+/**
+ * Query the values of several configuration keys in one go.
+ *
+ * This is equivalent to calling sr_config_get() for each key, but the
+ * keys are validated against a single SR_CONF_DEVICE_OPTIONS list, and
+ * drivers which implement config_get_multi() get to fetch all of them
+ * in a single transaction with the device.
+ *
+ * @param[in] driver The sr_dev_driver struct to query. Must not be NULL.
+ * @param[in] sdi (optional) The device instance, see sr_config_get().
+ * @param[in] cg The channel group on the device, or NULL.
+ * @param[in,out] configs List of struct sr_config. Each entry's key selects
+ *                what to query, its data must be NULL on entry. On return,
+ *                data holds the value of every key that could be read.
+ *                The caller is given ownership of these GVariants; keys
+ *                which could not be read keep a NULL data field.
+ *
+ * @retval SR_OK All keys were read.
+ * @retval other The error code of the first key that could not be read,
+ *         see sr_config_get(). The remaining keys are still attempted.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_get_multi(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		GSList *configs)
+{
+	struct sr_config *src;
+	GVariant *gvar_opts;
+	GSList *l, *pending;
+	int ret, r;
+
+	if (!driver || !configs)
+		return SR_ERR;
+
+	if (!driver->config_get)
+		return SR_ERR_ARG;
+
+	if (sdi && !sdi->priv) {
+		sr_err("Can't get config (sdi != NULL, sdi->priv == NULL).");
+		return SR_ERR;
+	}
+
+	ret = SR_OK;
+	pending = NULL;
+	gvar_opts = device_options_get(driver, sdi, cg);
+	for (l = configs; l; l = l->next) {
+		src = l->data;
+		if (src->data) {
+			sr_err("%s: Config data must be NULL on entry.", __func__);
+			ret = (ret == SR_OK) ? SR_ERR_ARG : ret;
+			continue;
+		}
+		if (check_key_opts(sdi, cg, src->key, SR_CONF_GET, NULL,
+				gvar_opts) != SR_OK) {
+			ret = (ret == SR_OK) ? SR_ERR_ARG : ret;
+			continue;
+		}
+		if ((src->data = config_cache_lookup(sdi, cg, src->key,
+				SR_CONF_GET)))
+			continue;
+		pending = g_slist_append(pending, src);
+	}
+	if (gvar_opts)
+		g_variant_unref(gvar_opts);
+
+	if (pending && driver->config_get_multi) {
+		r = driver->config_get_multi(pending, sdi, cg);
+		ret = (ret == SR_OK) ? r : ret;
+	} else {
+		for (l = pending; l; l = l->next) {
+			src = l->data;
+			r = driver->config_get(src->key, &src->data, sdi, cg);
+			if (r != SR_OK)
+				src->data = NULL;
+			ret = (ret == SR_OK) ? r : ret;
+		}
+	}
+
+	for (l = pending; l; l = l->next) {
+		src = l->data;
+		if (!src->data)
+			continue;
+		log_key(sdi, cg, src->key, SR_CONF_GET, src->data);
+		g_variant_ref_sink(src->data);
+		config_cache_store(sdi, cg, src->key, SR_CONF_GET, src->data);
+	}
+	g_slist_free(pending);
+
+	if (ret == SR_ERR_CHANNEL_GROUP)
+		sr_err("%s: No channel group specified.",
+			(sdi) ? sdi->driver->name : "unknown");
+
+	return ret;
+}
+
+/**
+ * Set the values of several configuration keys in one go.
+ *
+ * All keys and values are validated before any of them is applied, so
+ * an invalid entry leaves the device untouched. Drivers which implement
+ * config_set_multi() apply the whole list in a single transaction, the
+ * others see one config_set() call per entry, in list order.
+ *
+ * @param[in] sdi The device instance. Must not be NULL. sdi->driver and
+ *                sdi->priv must not be NULL either.
+ * @param[in] cg The channel group on the device, or NULL.
+ * @param[in] configs List of struct sr_config holding the keys and their
+ *                new values. The caller keeps ownership of the list and
+ *                the GVariants in it.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG A key or value was rejected, nothing was set.
+ * @retval other The error code of the first key that failed to apply,
+ *         see sr_config_set(). Later keys are not applied.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_set_multi(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		GSList *configs)
+{
+	struct sr_config *src;
+	GVariant *gvar_opts;
+	GSList *l;
+	int ret;
+
+	if (!sdi || !sdi->driver || !sdi->priv || !configs)
+		return SR_ERR;
+
+	if (!sdi->driver->config_set)
+		return SR_ERR_ARG;
+
+	if (sdi->status != SR_ST_ACTIVE) {
+		sr_err("%s: Device instance not active, can't set config.",
+			sdi->driver->name);
+		return SR_ERR_DEV_CLOSED;
+	}
+
+	ret = SR_OK;
+	gvar_opts = device_options_get(sdi->driver, sdi, cg);
+	for (l = configs; l && ret == SR_OK; l = l->next) {
+		src = l->data;
+		if (!src->data)
+			ret = SR_ERR;
+		else if (check_key_opts(sdi, cg, src->key, SR_CONF_SET,
+				src->data, gvar_opts) != SR_OK)
+			ret = SR_ERR_ARG;
+		else
+			ret = sr_variant_type_check(src->key, src->data);
+	}
+	if (gvar_opts)
+		g_variant_unref(gvar_opts);
+	if (ret != SR_OK)
+		return ret;
+
+	for (l = configs; l; l = l->next) {
+		src = l->data;
+		log_key(sdi, cg, src->key, SR_CONF_SET, src->data);
+	}
+
+	if (sdi->driver->config_set_multi) {
+		ret = sdi->driver->config_set_multi(configs, sdi, cg);
+	} else {
+		for (l = configs; l && ret == SR_OK; l = l->next) {
+			src = l->data;
+			ret = sdi->driver->config_set(src->key, src->data, sdi, cg);
+		}
+	}
+	sr_config_cache_clear(sdi);
+
+	if (ret == SR_ERR_CHANNEL_GROUP)
+		sr_err("%s: No channel group specified.", sdi->driver->name);
 
 	return ret;
 }
@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <glib.h>
@@ -31,6 +32,11 @@
 
 #define CHUNK_SIZE	(4 * 1024 * 1024)
 
+/* Amount of data which file format detection checks first. */
+#define SCAN_CHUNK_SIZE	(64 * 1024)
+/* Maximum number of cached file format detection results. */
+#define SCAN_CACHE_SIZE	256
+
 /**
  * @file
  *
@@ -177,6 +183,13 @@ SR_API const struct sr_input_module *sr_input_find(char *id)
 	return NULL;
 }
 
+/*
+ * Serialises the modules' lazy set-up of their option defaults with
+ * sr_input_options_free() releasing them, as instances may be created
+ * on several threads at once.
+ */
+static GMutex options_lock;
+
 /**
  * Returns a NULL-terminated array of struct sr_option, or NULL if the
  * module takes no options.
@@ -194,7 +207,9 @@ SR_API const struct sr_option **sr_input_options_get(const struct sr_input_modul
 	if (!imod || !imod->options)
 		return NULL;
 
+	g_mutex_lock(&options_lock);
 	mod_opts = imod->options();
+	g_mutex_unlock(&options_lock);
 
 	for (size = 0; mod_opts[size].id; size++)
 		;
@@ -220,6 +235,7 @@ SR_API void sr_input_options_free(const struct sr_option **options)
 	if (!options)
 		return;
 
+	g_mutex_lock(&options_lock);
 	for (i = 0; options[i]; i++) {
 		if (options[i]->def) {
 			g_variant_unref(options[i]->def);
@@ -231,6 +247,7 @@ SR_API void sr_input_options_free(const struct sr_option **options)
 			((struct sr_option *)options[i])->values = NULL;
 		}
 	}
+	g_mutex_unlock(&options_lock);
 	g_free(options);
 }
 
@@ -265,6 +282,7 @@ SR_API struct sr_input *sr_input_new(const struct sr_input_module *imod,
 	new_opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
 			(GDestroyNotify)g_variant_unref);
 	if (imod->options) {
+		g_mutex_lock(&options_lock);
 		mod_opts = imod->options();
 		for (i = 0; mod_opts[i].id; i++) {
 			if (options && g_hash_table_lookup_extended(options,
@@ -274,6 +292,7 @@ SR_API struct sr_input *sr_input_new(const struct sr_input_module *imod,
 				if (!g_variant_is_of_type(value, gvt)) {
 					sr_err("Invalid type for '%s' option.",
 						(char *)key);
+					g_mutex_unlock(&options_lock);
 					g_free(in);
 					return NULL;
 				}
@@ -285,6 +304,7 @@ SR_API struct sr_input *sr_input_new(const struct sr_input_module *imod,
 						g_variant_ref(mod_opts[i].def));
 			}
 		}
+		g_mutex_unlock(&options_lock);
 
 		/* Make sure no invalid options were given. */
 		if (options) {
@@ -336,41 +356,36 @@ static gboolean check_required_metadata(const uint8_t *metadata, uint8_t *avail)
 	return TRUE;
 }
 
-/**
- * Try to find an input module that can parse the given buffer.
- *
- * The buffer must contain enough of the beginning of the file for
- * the input modules to find a match. This is format-dependent. When
- * magic strings get checked, 128 bytes normally could be enough. Note
- * that some formats try to parse larger header sections, and benefit
- * from seeing a larger scope.
- *
- * If an input module is found, an instance is created into *in.
- * Otherwise, *in contains NULL. When multiple input moduless claim
- * support for the format, the one with highest confidence takes
- * precedence. Applications will see at most one input module spec.
- *
- * If an instance is created, it has the given buffer used for scanning
- * already submitted to it, to be processed before more data is sent.
- * This allows a frontend to submit an initial chunk of a non-seekable
- * stream, such as stdin, without having to keep it around and submit
- * it again later.
- *
+/* Returns TRUE if any of the module's meta items is available. */
+static gboolean check_any_metadata(const uint8_t *metadata, uint8_t *avail)
+{
+	int m, a;
+	uint8_t item;
+
+	for (m = 0; metadata[m]; m++) {
+		item = metadata[m] & ~SR_INPUT_META_REQUIRED;
+		for (a = 0; avail[a]; a++) {
+			if (avail[a] == item)
+				return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Let all input modules which can work with the available metadata
+ * check the input. Returns the module which claims support for the
+ * format with the highest confidence, or NULL if none does.
  */
-SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
+static const struct sr_input_module *match_modules(GHashTable *meta,
+		uint8_t *avail_metadata)
 {
 	const struct sr_input_module *imod, *best_imod;
-	GHashTable *meta;
-	unsigned int m, i;
 	unsigned int conf, best_conf;
+	unsigned int i;
 	int ret;
-	uint8_t mitem, avail_metadata[8];
-
-	/* No more metadata to be had from a buffer. */
-	avail_metadata[0] = SR_INPUT_META_HEADER;
-	avail_metadata[1] = 0;
 
-	*in = NULL;
 	best_imod = NULL;
 	best_conf = ~0;
 	for (i = 0; input_module_list[i]; i++) {
@@ -383,40 +398,68 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 		if (!check_required_metadata(imod->metadata, avail_metadata))
 			/* Cannot satisfy this module's requirements. */
 			continue;
-
-		meta = g_hash_table_new(NULL, NULL);
-		for (m = 0; m < sizeof(imod->metadata); m++) {
-			mitem = imod->metadata[m] & ~SR_INPUT_META_REQUIRED;
-			if (mitem == SR_INPUT_META_HEADER)
-				g_hash_table_insert(meta, GINT_TO_POINTER(mitem), buf);
-		}
-		if (g_hash_table_size(meta) == 0) {
+		if (!check_any_metadata(imod->metadata, avail_metadata))
 			/* No metadata for this module, so nothing to match. */
-			g_hash_table_destroy(meta);
 			continue;
-		}
-		sr_spew("Trying module %s.", imod->id);
+
+		sr_dbg("Trying module %s.", imod->id);
+
 		ret = imod->format_match(meta, &conf);
-		g_hash_table_destroy(meta);
-		if (ret == SR_ERR_DATA) {
-			/* Module recognized this buffer, but cannot handle it. */
-			continue;
-		} else if (ret == SR_ERR) {
+		if (ret == SR_ERR) {
 			/* Module didn't recognize this buffer. */
 			continue;
 		} else if (ret != SR_OK) {
-			/* Can be SR_ERR_NA. */
+			/* Module recognized this buffer, but cannot handle it. */
 			continue;
 		}
-
 		/* Found a matching module. */
-		sr_spew("Module %s matched, confidence %u.", imod->id, conf);
+		sr_dbg("Module %s matched, confidence %u.", imod->id, conf);
 		if (conf >= best_conf)
 			continue;
 		best_imod = imod;
 		best_conf = conf;
 	}
 
+	return best_imod;
+}
+
+/**
+ * Try to find an input module that can parse the given buffer.
+ *
+ * The buffer must contain enough of the beginning of the file for
+ * the input modules to find a match. This is format-dependent. When
+ * magic strings get checked, 128 bytes normally could be enough. Note
+ * that some formats try to parse larger header sections, and benefit
+ * from seeing a larger scope.
+ *
+ * If an input module is found, an instance is created into *in.
+ * Otherwise, *in contains NULL. When multiple input moduless claim
+ * support for the format, the one with highest confidence takes
+ * precedence. Applications will see at most one input module spec.
+ *
+ * If an instance is created, it has the given buffer used for scanning
+ * already submitted to it, to be processed before more data is sent.
+ * This allows a frontend to submit an initial chunk of a non-seekable
+ * stream, such as stdin, without having to keep it around and submit
+ * it again later.
+ *
+ */
+SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
+{
+	const struct sr_input_module *best_imod;
+	GHashTable *meta;
+	uint8_t avail_metadata[8];
+
+	/* No more metadata to be had from a buffer. */
+	avail_metadata[0] = SR_INPUT_META_HEADER;
+	avail_metadata[1] = 0;
+
+	*in = NULL;
+	meta = g_hash_table_new(NULL, NULL);
+	g_hash_table_insert(meta, GINT_TO_POINTER(SR_INPUT_META_HEADER), buf);
+	best_imod = match_modules(meta, avail_metadata);
+	g_hash_table_destroy(meta);
+
 	if (best_imod) {
 		*in = sr_input_new(best_imod, NULL);
 		g_string_insert_len((*in)->buf, 0, buf->str, buf->len);
@@ -426,6 +469,130 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 	return SR_ERR;
 }
 
+/*
+ * Cache of file format detection results. Files which get scanned again
+ * with unchanged modification time and size are not read another time.
+ * Negative results are cached as well. Entries are keyed on the file's
+ * canonical absolute path, so that relative names don't hit the entry
+ * of another working directory, and all names of a file share one.
+ */
+struct scan_cache_entry {
+	gint64 mtime_sec;
+	gint64 mtime_nsec;
+	gint64 size;
+	const struct sr_input_module *imod;
+};
+
+static GMutex scan_cache_lock;
+static GHashTable *scan_cache;
+
+/* Modification time, in ns where available, so rewrites are noticed. */
+static void scan_cache_mtime(const GStatBuf *st, gint64 *sec, gint64 *nsec)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	*sec = st->st_mtim.tv_sec;
+	*nsec = st->st_mtim.tv_nsec;
+#else
+	*sec = st->st_mtime;
+	*nsec = 0;
+#endif
+}
+
+/* Canonical absolute path of a file, resolving symlinks where possible. */
+static char *scan_cache_key(const char *filename)
+{
+	char *path, *key;
+
+#ifdef HAVE_REALPATH
+	if ((path = realpath(filename, NULL))) {
+		key = g_strdup(path);
+		free(path);
+		return key;
+	}
+#endif
+#if GLIB_CHECK_VERSION(2, 58, 0)
+	(void)path;
+	key = g_canonicalize_filename(filename, NULL);
+#else
+	if (g_path_is_absolute(filename))
+		return g_strdup(filename);
+	path = g_get_current_dir();
+	key = g_build_filename(path, filename, NULL);
+	g_free(path);
+#endif
+
+	return key;
+}
+
+static gboolean scan_cache_lookup(const char *filename, const GStatBuf *st,
+		const struct sr_input_module **imod)
+{
+	struct scan_cache_entry *entry;
+	gint64 sec, nsec;
+	gboolean found;
+	char *key;
+
+	scan_cache_mtime(st, &sec, &nsec);
+	key = scan_cache_key(filename);
+	found = FALSE;
+	g_mutex_lock(&scan_cache_lock);
+	entry = scan_cache ? g_hash_table_lookup(scan_cache, key) : NULL;
+	if (entry && entry->mtime_sec == sec && entry->mtime_nsec == nsec
+			&& entry->size == st->st_size) {
+		*imod = entry->imod;
+		found = TRUE;
+	}
+	g_mutex_unlock(&scan_cache_lock);
+	g_free(key);
+
+	return found;
+}
+
+static void scan_cache_store(const char *filename, const GStatBuf *st,
+		const struct sr_input_module *imod)
+{
+	struct scan_cache_entry *entry;
+
+	entry = g_malloc(sizeof(*entry));
+	scan_cache_mtime(st, &entry->mtime_sec, &entry->mtime_nsec);
+	entry->size = st->st_size;
+	entry->imod = imod;
+
+	g_mutex_lock(&scan_cache_lock);
+	if (!scan_cache)
+		scan_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, g_free);
+	if (g_hash_table_size(scan_cache) >= SCAN_CACHE_SIZE)
+		g_hash_table_remove_all(scan_cache);
+	g_hash_table_replace(scan_cache, scan_cache_key(filename), entry);
+	g_mutex_unlock(&scan_cache_lock);
+}
+
+/** Drop all cached file format detection results. */
+SR_PRIV void sr_input_scan_cache_clear(void)
+{
+	g_mutex_lock(&scan_cache_lock);
+	if (scan_cache)
+		g_hash_table_destroy(scan_cache);
+	scan_cache = NULL;
+	g_mutex_unlock(&scan_cache_lock);
+}
+
+/* Append up to len bytes from the stream to the header. */
+static int read_header(FILE *stream, GString *header, size_t len)
+{
+	size_t pos, count;
+
+	pos = header->len;
+	g_string_set_size(header, pos + len);
+	count = fread(header->str + pos, 1, len, stream);
+	g_string_set_size(header, pos + count);
+	if (ferror(stream))
+		return SR_ERR_IO;
+
+	return SR_OK;
+}
+
 /**
  * Try to find an input module that can parse the given file.
  *
@@ -434,18 +601,22 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
  * support for the format, the one with highest confidence takes
  * precedence. Applications will see at most one input module spec.
  *
+ * Only the start of the file is checked first. More of the file is
+ * read only when no module recognized the start. The result is kept
+ * for later scans of the same file, under any name of it, as long as
+ * the file's modification time and size remain unchanged.
+ *
  */
 SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 {
 	int64_t filesize;
 	FILE *stream;
-	const struct sr_input_module *imod, *best_imod;
+	const struct sr_input_module *best_imod;
 	GHashTable *meta;
 	GString *header;
-	size_t count;
-	unsigned int midx, i;
-	unsigned int conf, best_conf;
-	int ret;
+	GStatBuf st;
+	gboolean have_stat;
+	unsigned int midx;
 	uint8_t avail_metadata[8];
 
 	*in = NULL;
@@ -454,6 +625,14 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 		sr_err("Invalid filename.");
 		return SR_ERR_ARG;
 	}
+	have_stat = g_stat(filename, &st) == 0;
+	if (have_stat && scan_cache_lookup(filename, &st, &best_imod)) {
+		sr_dbg("Using cached scan result for %s.", filename);
+		if (!best_imod)
+			return SR_ERR;
+		*in = sr_input_new(best_imod, NULL);
+		return SR_OK;
+	}
 	stream = g_fopen(filename, "rb");
 	if (!stream) {
 		sr_err("Failed to open %s: %s", filename, g_strerror(errno));
@@ -466,16 +645,14 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 		fclose(stream);
 		return SR_ERR;
 	}
-	header = g_string_sized_new(CHUNK_SIZE);
-	count = fread(header->str, 1, header->allocated_len - 1, stream);
-	if (count < 1 || ferror(stream)) {
+	header = g_string_sized_new(SCAN_CHUNK_SIZE);
+	if (read_header(stream, header, SCAN_CHUNK_SIZE) != SR_OK
+			|| header->len < 1) {
 		sr_err("Failed to read %s: %s", filename, g_strerror(errno));
 		fclose(stream);
 		g_string_free(header, TRUE);
 		return SR_ERR;
 	}
-	fclose(stream);
-	g_string_set_size(header, count);
 
 	meta = g_hash_table_new(NULL, NULL);
 	g_hash_table_insert(meta, GINT_TO_POINTER(SR_INPUT_META_FILENAME),
@@ -491,39 +668,28 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 	avail_metadata[midx] = 0;
 	/* TODO: MIME type */
 
-	best_imod = NULL;
-	best_conf = ~0;
-	for (i = 0; input_module_list[i]; i++) {
-		imod = input_module_list[i];
-		if (!imod->metadata[0]) {
-			/* Module has no metadata for matching so will take
-			 * any input. No point in letting it try to match. */
-			continue;
-		}
-		if (!check_required_metadata(imod->metadata, avail_metadata))
-			/* Cannot satisfy this module's requirements. */
-			continue;
-
-		sr_dbg("Trying module %s.", imod->id);
+	best_imod = match_modules(meta, avail_metadata);
 
-		ret = imod->format_match(meta, &conf);
-		if (ret == SR_ERR) {
-			/* Module didn't recognize this buffer. */
-			continue;
-		} else if (ret != SR_OK) {
-			/* Module recognized this buffer, but cannot handle it. */
-			continue;
-		}
-		/* Found a matching module. */
-		sr_dbg("Module %s matched, confidence %u.", imod->id, conf);
-		if (conf >= best_conf)
-			continue;
-		best_imod = imod;
-		best_conf = conf;
+	/*
+	 * Some formats need to see larger header sections. Give those
+	 * another chance with more of the file when the start of it was
+	 * not recognized.
+	 */
+	if (!best_imod && header->len == SCAN_CHUNK_SIZE &&
+			read_header(stream, header,
+				CHUNK_SIZE - SCAN_CHUNK_SIZE) == SR_OK &&
+			header->len > SCAN_CHUNK_SIZE) {
+		sr_dbg("Rescanning with %zu bytes of %s.",
+			header->len, filename);
+		best_imod = match_modules(meta, avail_metadata);
 	}
+	fclose(stream);
 	g_hash_table_destroy(meta);
 	g_string_free(header, TRUE);
 
+	if (have_stat)
+		scan_cache_store(filename, &st, best_imod);
+
 	if (best_imod) {
 		*in = sr_input_new(best_imod, NULL);
 		return SR_OK;
@@ -1032,14 +1032,17 @@ static int prepare_session_feed(struct sr_input *in)
 static int format_match(GHashTable *metadata, unsigned int *confidence)
 {
 	GString *buf, *tmpbuf;
+	const char *eol;
 	int rc;
 	gchar *version, *build;
 
-	/* Get a copy of the start of the file's content. */
+	/* Get a copy of the file's first line. */
 	buf = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_HEADER));
 	if (!buf || !buf->str)
 		return SR_ERR_ARG;
-	tmpbuf = g_string_new_len(buf->str, buf->len);
+	eol = memchr(buf->str, '\n', buf->len);
+	tmpbuf = g_string_new_len(buf->str,
+		eol ? (gssize)(eol - buf->str) : (gssize)buf->len);
 	if (!tmpbuf || !tmpbuf->str)
 		return SR_ERR_MALLOC;
 
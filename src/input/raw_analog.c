@@ -258,11 +258,6 @@ static void cleanup(struct sr_input *in)
 {
 	g_free(in->priv);
 	in->priv = NULL;
-
-	g_variant_unref(options[0].def);
-	g_variant_unref(options[1].def);
-	g_variant_unref(options[2].def);
-	g_slist_free_full(options[2].values, (GDestroyNotify)g_variant_unref);
 }
 
 static int reset(struct sr_input *in)
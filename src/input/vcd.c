@@ -67,7 +67,8 @@
 
 #define LOG_PREFIX "input/vcd"
 
-#define CHUNK_SIZE (4 * 1024 * 1024)
+/* Maximum number of sample runs per SR_DF_LOGIC_RLE packet. */
+#define CHUNK_RUNS (64 * 1024)
 
 struct context {
 	gboolean started;
@@ -82,8 +83,9 @@ struct context {
 	gboolean skip_until_end;
 	GSList *channels;
 	size_t bytes_per_sample;
-	size_t samples_in_buffer;
-	uint8_t *buffer;
+	size_t runs_in_buffer;
+	uint8_t *values;
+	uint64_t *lengths;
 	uint8_t *current_levels;
 };
 
@@ -92,18 +94,11 @@ struct vcd_channel {
 	gchar *identifier;
 };
 
-/*
- * Reads a single VCD section from input file and parses it to name/contents.
- * e.g. $timescale 1ps $end => "timescale" "1ps"
- */
-static gboolean parse_section(GString *buf, gchar **name, gchar **contents)
+/* Return the position after a UTF8 BOM and initial white-space. */
+static unsigned int skip_bom_and_space(const GString *buf)
 {
-	GString *sname, *scontent;
-	gboolean status;
 	unsigned int pos;
 
-	*name = *contents = NULL;
-	status = FALSE;
 	pos = 0;
 
 	/* Skip UTF8 BOM */
@@ -114,6 +109,23 @@ static gboolean parse_section(GString *buf, gchar **name, gchar **contents)
 	while (pos < buf->len && g_ascii_isspace(buf->str[pos]))
 		pos++;
 
+	return pos;
+}
+
+/*
+ * Reads a single VCD section from input file and parses it to name/contents.
+ * e.g. $timescale 1ps $end => "timescale" "1ps"
+ */
+static gboolean parse_section(GString *buf, gchar **name, gchar **contents)
+{
+	GString *sname, *scontent;
+	gboolean status;
+	unsigned int pos;
+
+	*name = *contents = NULL;
+	status = FALSE;
+	pos = skip_bom_and_space(buf);
+
 	/* Section tag should start with $. */
 	if (buf->str[pos++] != '$')
 		return FALSE;
@@ -259,6 +271,8 @@ static gboolean parse_header(const struct sr_input *in, GString *buf)
 	 */
 	inc->bytes_per_sample = (inc->channelcount + 7) / 8;
 	inc->current_levels = g_malloc0(inc->bytes_per_sample);
+	inc->values = g_malloc(CHUNK_RUNS * inc->bytes_per_sample);
+	inc->lengths = g_malloc(CHUNK_RUNS * sizeof(uint64_t));
 
 	inc->got_header = status;
 
@@ -272,6 +286,13 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	gchar *name, *contents;
 
 	buf = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_HEADER));
+
+	/*
+	 * Reject input which does not start with a section tag before
+	 * taking a copy of the header.
+	 */
+	if (buf->str[skip_bom_and_space(buf)] != '$')
+		return SR_ERR;
 	tmpbuf = g_string_new_len(buf->str, buf->len);
 
 	/*
@@ -290,58 +311,57 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	return SR_OK;
 }
 
-/* Send all accumulated bytes from inc->buffer. */
+/* Send all accumulated sample runs. */
 static void send_buffer(const struct sr_input *in)
 {
 	struct context *inc;
 	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
+	struct sr_datafeed_logic_rle rle;
 
 	inc = in->priv;
 
-	if (inc->samples_in_buffer == 0)
+	if (inc->runs_in_buffer == 0)
 		return;
 
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = inc->bytes_per_sample;
-	logic.data = inc->buffer;
-	logic.length = inc->bytes_per_sample * inc->samples_in_buffer;
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+	rle.num_runs = inc->runs_in_buffer;
+	rle.unitsize = inc->bytes_per_sample;
+	rle.values = inc->values;
+	rle.lengths = inc->lengths;
 	sr_session_send(in->sdi, &packet);
-	inc->samples_in_buffer = 0;
+	inc->runs_in_buffer = 0;
 }
 
 /*
- * Add N copies of the current sample to buffer.
+ * Add N copies of the current sample to buffer, as a run of samples.
  * When the buffer fills up, automatically send it.
  */
 static void add_samples(const struct sr_input *in, size_t count)
 {
 	struct context *inc;
-	size_t samples_per_chunk;
-	size_t space_left, i;
 	uint8_t *p;
 
 	inc = in->priv;
-	samples_per_chunk = CHUNK_SIZE / inc->bytes_per_sample;
 
-	while (count) {
-		space_left = samples_per_chunk - inc->samples_in_buffer;
-
-		if (space_left > count)
-			space_left = count;
+	if (count == 0)
+		return;
 
-		p = inc->buffer + inc->samples_in_buffer * inc->bytes_per_sample;
-		for (i = 0; i < space_left; i++) {
-			memcpy(p, inc->current_levels, inc->bytes_per_sample);
-			p += inc->bytes_per_sample;
-			inc->samples_in_buffer++;
-			count--;
+	/* Extend the last run if the levels didn't change since. */
+	if (inc->runs_in_buffer > 0) {
+		p = inc->values + (inc->runs_in_buffer - 1) * inc->bytes_per_sample;
+		if (!memcmp(p, inc->current_levels, inc->bytes_per_sample)) {
+			inc->lengths[inc->runs_in_buffer - 1] += count;
+			return;
 		}
-
-		if (inc->samples_in_buffer == samples_per_chunk)
-			send_buffer(in);
 	}
+
+	if (inc->runs_in_buffer == CHUNK_RUNS)
+		send_buffer(in);
+
+	p = inc->values + inc->runs_in_buffer * inc->bytes_per_sample;
+	memcpy(p, inc->current_levels, inc->bytes_per_sample);
+	inc->lengths[inc->runs_in_buffer++] = count;
 }
 
 /* Set the channel level depending on the identifier and parsed value. */
@@ -506,8 +526,6 @@ static int init(struct sr_input *in, GHashTable *options)
 	in->sdi = g_malloc0(sizeof(struct sr_dev_inst));
 	in->priv = inc;
 
-	inc->buffer = g_malloc(CHUNK_SIZE);
-
 	return SR_OK;
 }
 
@@ -615,8 +633,10 @@ static void cleanup(struct sr_input *in)
 
 	inc = in->priv;
 	g_slist_free_full(inc->channels, free_channel);
-	g_free(inc->buffer);
-	inc->buffer = NULL;
+	g_free(inc->values);
+	inc->values = NULL;
+	g_free(inc->lengths);
+	inc->lengths = NULL;
 	g_free(inc->current_levels);
 	inc->current_levels = NULL;
 }
@@ -52,6 +52,9 @@ struct context {
 	int unitsize;
 	gboolean found_data;
 	gboolean create_channels;
+	/* Conversion buffer for one chunk, kept across chunks. */
+	float *fdata;
+	size_t fdata_size;
 };
 
 static int parse_wav_header(GString *buf, struct context *inc)
@@ -189,6 +192,43 @@ static int find_data_chunk(GString *buf, int initial_offset)
 	return offset;
 }
 
+/*
+ * Convert interleaved little-endian samples to interleaved floats. One
+ * loop per sample format keeps the format dispatch out of the inner loop.
+ */
+static void pcm_to_float(const struct context *inc, const uint8_t *s,
+		float *d, size_t count)
+{
+	size_t i;
+
+	if (inc->fmt_code == WAVE_FORMAT_IEEE_FLOAT_) {
+		/* BINARY32 float */
+#ifdef WORDS_BIGENDIAN
+		for (i = 0; i < count; i++)
+			d[i] = RLFL(s + i * 4);
+#else
+		memcpy(d, s, count * sizeof(float));
+#endif
+		return;
+	}
+
+	switch (inc->unitsize) {
+	case 1:
+		/* 8-bit PCM samples are unsigned. */
+		for (i = 0; i < count; i++)
+			d[i] = s[i] / (float)255;
+		break;
+	case 2:
+		for (i = 0; i < count; i++)
+			d[i] = RL16S(s + i * 2) / (float)INT16_MAX;
+		break;
+	case 4:
+		for (i = 0; i < count; i++)
+			d[i] = RL32S(s + i * 4) / (float)INT32_MAX;
+		break;
+	}
+}
+
 static void send_chunk(const struct sr_input *in, int offset, int num_samples)
 {
 	struct sr_datafeed_packet packet;
@@ -197,57 +237,30 @@ static void send_chunk(const struct sr_input *in, int offset, int num_samples)
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
 	struct context *inc;
-	float *fdata;
-	int total_samples, samplenum;
-	char *s, *d;
+	size_t total_samples;
 
 	inc = in->priv;
 
-	total_samples = num_samples * inc->num_channels;
-	fdata = g_malloc0(total_samples * sizeof(float));
-	s = in->buf->str + offset;
-	d = (char *)fdata;
-
-	for (samplenum = 0; samplenum < total_samples; samplenum++) {
-		if (inc->fmt_code == WAVE_FORMAT_PCM_) {
-			switch (inc->unitsize) {
-			case 1:
-				/* 8-bit PCM samples are unsigned. */
-				fdata[samplenum] = *(uint8_t*)(s) / (float)255;
-				break;
-			case 2:
-				fdata[samplenum] = RL16S(s) / (float)INT16_MAX;
-				break;
-			case 4:
-				fdata[samplenum] = RL32S(s) / (float)INT32_MAX;
-				break;
-			}
-		} else {
-			/* BINARY32 float */
-#ifdef WORDS_BIGENDIAN
-			int i;
-			for (i = 0; i < inc->unitsize; i++)
-				d[i] = s[inc->unitsize - 1 - i];
-#else
-			memcpy(d, s, inc->unitsize);
-#endif
-		}
-		s += inc->unitsize;
-		d += inc->unitsize;
+	total_samples = (size_t)num_samples * inc->num_channels;
+	if (total_samples > inc->fdata_size) {
+		g_free(inc->fdata);
+		inc->fdata = g_malloc(total_samples * sizeof(float));
+		inc->fdata_size = total_samples;
 	}
+	pcm_to_float(inc, (const uint8_t *)in->buf->str + offset,
+		inc->fdata, total_samples);
 
 	/* TODO: Use proper 'digits' value for this device (and its modes). */
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
 	packet.type = SR_DF_ANALOG;
 	packet.payload = &analog;
 	analog.num_samples = num_samples;
-	analog.data = fdata;
+	analog.data = inc->fdata;
 	analog.meaning->channels = in->sdi->channels;
 	analog.meaning->mq = 0;
 	analog.meaning->mqflags = 0;
 	analog.meaning->unit = 0;
 	sr_session_send(in->sdi, &packet);
-	g_free(fdata);
 }
 
 static int process_buffer(struct sr_input *in)
@@ -376,8 +389,19 @@ static int end(struct sr_input *in)
 	return ret;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->fdata);
+	inc->fdata = NULL;
+	inc->fdata_size = 0;
+}
+
 static int reset(struct sr_input *in)
 {
+	cleanup(in);
 	memset(in->priv, 0, sizeof(struct context));
 
 	/*
@@ -401,4 +425,5 @@ SR_PRIV struct sr_input_module input_wav = {
 	.receive = receive,
 	.end = end,
 	.reset = reset,
+	.cleanup = cleanup,
 };
@@ -340,6 +340,8 @@ struct sr_context {
 	struct sr_dev_driver **driver_list;
 #ifdef HAVE_LIBUSB_1_0
 	libusb_context *libusb_ctx;
+	struct sr_usb_recorder *usb_recorder;
+	struct sr_usb_event_thread *usb_event_thread;
 #endif
 	sr_resource_open_callback resource_open_cb;
 	sr_resource_close_callback resource_close_cb;
@@ -528,6 +530,41 @@ struct sr_output {
 	 * there, and only flush it when it reaches a certain size.
 	 */
 	void *priv;
+
+	/** Samples converted from SR_DF_LOGIC_PLANAR, reused per packet. */
+	uint8_t *planar_buf;
+	uint64_t planar_bufsize;
+};
+
+/** Type of the destination an output sink writes to. */
+enum sr_output_sink_type {
+	SR_OUTPUT_SINK_FD,
+	SR_OUTPUT_SINK_FILE,
+	SR_OUTPUT_SINK_CALLBACK,
+	SR_OUTPUT_SINK_ARENA,
+	SR_OUTPUT_SINK_GSTRING,
+};
+
+/**
+ * Destination for the output of an output module.
+ *
+ * Writes are collected in a buffer and handed on in large blocks,
+ * except for FILE streams which buffer themselves. An arena keeps
+ * everything in memory until it is reset, a GString sink appends to
+ * a caller-provided string.
+ */
+struct sr_output_sink {
+	enum sr_output_sink_type type;
+	int fd;
+	FILE *file;
+	sr_output_sink_callback cb;
+	void *cb_data;
+	GString *str;
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+	/** First error seen while writing, reported by later calls. */
+	int error;
 };
 
 /** Output module driver. */
@@ -610,6 +647,23 @@ struct sr_output_module {
 	int (*receive) (const struct sr_output *o,
 			const struct sr_datafeed_packet *packet, GString **out);
 
+	/**
+	 * Like receive(), but the module writes its output directly into
+	 * <code>sink</code> using sr_output_sink_write() and friends.
+	 * Modules implement either this or receive(). sr_output_send()
+	 * collects the output of sink-based modules into a GString.
+	 *
+	 * @param o Pointer to the respective 'struct sr_output'.
+	 * @param packet The complete packet.
+	 * @param sink Where to write the output to.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_sink) (const struct sr_output *o,
+			const struct sr_datafeed_packet *packet,
+			struct sr_output_sink *sink);
+
 	/**
 	 * This function is called after the caller is finished using
 	 * the output module, and can be used to free any internal
@@ -637,6 +691,9 @@ struct sr_transform {
 	 * state between calls into its callback functions.
 	 */
 	void *priv;
+
+	/** Registration ID for the session's pipeline statistics. */
+	unsigned int stats_id;
 };
 
 struct sr_transform_module {
@@ -684,6 +741,10 @@ struct sr_transform_module {
 	 * It can either return (in packet_out) a pointer to another packet
 	 * (possibly the exact same packet it got as input), or NULL.
 	 *
+	 * Logic data may arrive as SR_DF_LOGIC, as run-length encoded
+	 * SR_DF_LOGIC_RLE or as planar SR_DF_LOGIC_PLANAR packets, modules
+	 * must handle all of them.
+	 *
 	 * @param t Pointer to the respective 'struct sr_transform'.
 	 * @param packet_in Pointer to a datafeed packet.
 	 * @param packet_out Pointer to the resulting datafeed packet after
@@ -718,6 +779,38 @@ struct sr_usb_dev_inst {
 	/** libusb device handle */
 	struct libusb_device_handle *devhdl;
 };
+
+/** Bounds of adaptive streaming transfers, see sr_usb_stream_new(). */
+struct sr_usb_stream_config {
+	/** Expected data rate, in bytes per ms. */
+	uint64_t bytes_per_ms;
+	/** Amount of data per transfer, in ms. */
+	unsigned int transfer_ms;
+	/** Transfer sizes are a multiple of this, in bytes. */
+	size_t block_size;
+	/** Bounds of the transfer size, in bytes. */
+	size_t min_size;
+	size_t max_size;
+	/** Amount of data to keep in flight at least, in ms. */
+	unsigned int queue_ms;
+	/** Bounds of the number of transfers in flight. */
+	unsigned int min_transfers;
+	unsigned int max_transfers;
+	/** Whether to adapt the number of transfers in flight. */
+	gboolean adaptive;
+};
+
+/** An entry handed over from the USB event thread. */
+struct sr_usb_handoff_entry {
+	/** Filled buffer, or NULL for a deferred transfer. */
+	uint8_t *data;
+	/** Number of bytes in the buffer. */
+	int length;
+	/** Deferred transfer, or NULL for a filled buffer. */
+	struct libusb_transfer *transfer;
+	/** Number of bytes dropped right before this buffer. */
+	uint64_t dropped;
+};
 #endif
 
 #ifdef HAVE_LIBSERIALPORT
@@ -813,6 +906,10 @@ struct sr_dev_inst {
 	void *priv;
 	/** Session to which this device is currently assigned. */
 	struct sr_session *session;
+	/** Config cache, see sr_config_cache_enable(). */
+	struct sr_config_cache *config_cache;
+	/** Limits applied by sr_session_send(), see sr_sw_limits_session_start(). */
+	struct sr_sw_limits *sw_limits;
 };
 
 /* Generic device instances */
@@ -845,6 +942,12 @@ SR_PRIV struct sr_config *sr_config_new(uint32_t key, GVariant *data);
 SR_PRIV void sr_config_free(struct sr_config *src);
 SR_PRIV int sr_dev_acquisition_start(struct sr_dev_inst *sdi);
 SR_PRIV int sr_dev_acquisition_stop(struct sr_dev_inst *sdi);
+SR_PRIV void sr_config_cache_enable(struct sr_dev_inst *sdi,
+		const uint32_t *keys, size_t num_keys);
+SR_PRIV void sr_config_cache_invalidate(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key);
+SR_PRIV void sr_config_cache_clear(const struct sr_dev_inst *sdi);
+SR_PRIV void sr_config_cache_free(struct sr_dev_inst *sdi);
 
 /*--- session.c -------------------------------------------------------------*/
 
@@ -878,6 +981,27 @@ struct sr_session {
 	unsigned int stop_check_id;
 	/** Whether the session has been started. */
 	gboolean running;
+
+	/**
+	 * Whether pipeline statistics are collected. Accessed atomically,
+	 * as it is read by the threads which send packets.
+	 */
+	gint stats_enabled;
+	/** Mutex protecting the pipeline statistics. */
+	GMutex stats_mutex;
+	/** List of struct session_stats pointers, one per pipeline stage. */
+	GSList *stats;
+	/** Last registration ID handed out by sr_session_stats_id_new(). */
+	gint stats_last_id;
+
+	/** Whether new fd event sources are driven by the I/O reactor. */
+	gboolean reactor_enabled;
+	/** The I/O reactor event source, if any fd sources use it. */
+	GSource *reactor;
+
+	/** Samples converted from SR_DF_LOGIC_PLANAR, reused per packet. */
+	uint8_t *planar_buf;
+	uint64_t planar_bufsize;
 };
 
 SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
@@ -904,6 +1028,9 @@ SR_PRIV int sr_session_source_remove_pollfd(struct sr_session *session,
 SR_PRIV int sr_session_source_remove_channel(struct sr_session *session,
 		GIOChannel *channel);
 
+SR_PRIV unsigned int sr_session_stats_id_new(struct sr_session *session);
+SR_PRIV void sr_session_stats_usb_transfer(struct sr_session *session,
+		unsigned int id, uint64_t bytes, int64_t submit_us);
 SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet);
 SR_PRIV int sr_sessionfile_check(const char *filename);
@@ -913,6 +1040,22 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		struct sr_datafeed_packet **copy);
 SR_PRIV void sr_packet_free(struct sr_datafeed_packet *packet);
 
+/** Expands SR_DF_LOGIC_RLE payloads into chunks of plain samples. */
+struct sr_logic_rle_expander {
+	const struct sr_datafeed_logic_rle *rle;
+	/* Current run, and number of its samples already expanded. */
+	uint64_t run;
+	uint64_t done;
+	uint8_t *buf;
+	uint64_t bufsize;
+};
+
+SR_PRIV void sr_logic_rle_expander_init(struct sr_logic_rle_expander *exp,
+		const struct sr_datafeed_logic_rle *rle);
+SR_PRIV gboolean sr_logic_rle_expander_next(struct sr_logic_rle_expander *exp,
+		struct sr_datafeed_logic *logic);
+SR_PRIV void sr_logic_rle_expander_clear(struct sr_logic_rle_expander *exp);
+
 /*--- session_file.c --------------------------------------------------------*/
 
 #if !HAVE_ZIP_DISCARD
@@ -924,6 +1067,34 @@ SR_PRIV void sr_zip_discard(struct zip *archive);
 SR_PRIV GKeyFile *sr_sessionfile_read_metadata(struct zip *archive,
 			const struct zip_stat *entry);
 
+/*--- input/input.c --------------------------------------------------------*/
+
+SR_PRIV void sr_input_scan_cache_clear(void);
+
+/*--- output/output.c ------------------------------------------------------*/
+
+SR_PRIV void sr_output_sink_init_gstring(struct sr_output_sink *sink,
+		GString *str);
+SR_PRIV int sr_output_sink_write(struct sr_output_sink *sink,
+		const void *data, size_t length);
+SR_PRIV int sr_output_sink_printf(struct sr_output_sink *sink,
+		const char *format, ...) G_GNUC_PRINTF(2, 3);
+SR_PRIV uint8_t *sr_output_sink_reserve(struct sr_output_sink *sink,
+		size_t length);
+SR_PRIV void sr_output_sink_commit(struct sr_output_sink *sink,
+		size_t length);
+SR_PRIV uint8_t sr_output_logic_gather(const uint8_t *samples,
+		unsigned int unitsize, unsigned int index, unsigned int count);
+
+/*--- transform/overview.c --------------------------------------------------*/
+
+SR_PRIV const struct sr_transform *sr_transform_overview_find(
+		const struct sr_dev_inst *sdi);
+SR_PRIV GByteArray *sr_transform_overview_save(const struct sr_transform *t,
+		const struct sr_channel *ch);
+SR_PRIV int sr_transform_overview_load(const struct sr_transform *t,
+		const struct sr_channel *ch, const uint8_t *data, size_t len);
+
 /*--- analog.c --------------------------------------------------------------*/
 
 SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
@@ -932,6 +1103,42 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
                            struct sr_analog_spec *spec,
                            int digits);
 
+/**
+ * Collects single readings into multi-sample analog packets.
+ *
+ * Readings are held back until max_values are pending, the format of
+ * a reading differs from the pending ones, or the latency deadline
+ * has passed.
+ */
+struct sr_analog_batch {
+	/* Channel list of the sent packets. */
+	GSList *channels;
+	gboolean free_channels;
+	float *values;
+	size_t num_values;
+	size_t max_values;
+	/* Maximum time [us] a reading is held back, 0 for no limit. */
+	int64_t latency_us;
+	/* Monotonic time [us] by which the pending values must be sent. */
+	int64_t deadline;
+	/* Format of the pending values. */
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+};
+
+SR_PRIV void sr_analog_batch_init(struct sr_analog_batch *batch,
+		GSList *channels, gboolean free_channels, size_t max_values,
+		uint64_t latency_ms);
+SR_PRIV int sr_analog_batch_add(const struct sr_dev_inst *sdi,
+		struct sr_analog_batch *batch,
+		const struct sr_datafeed_analog *analog, float value);
+SR_PRIV int sr_analog_batch_check(const struct sr_dev_inst *sdi,
+		struct sr_analog_batch *batch);
+SR_PRIV int sr_analog_batch_flush(const struct sr_dev_inst *sdi,
+		struct sr_analog_batch *batch);
+SR_PRIV void sr_analog_batch_clear(struct sr_analog_batch *batch);
+
 /*--- std.c -----------------------------------------------------------------*/
 
 typedef int (*dev_close_callback)(struct sr_dev_inst *sdi);
@@ -1036,6 +1243,10 @@ struct soft_trigger_logic {
 	uint8_t *pre_trigger_head;
 	int pre_trigger_size;
 	int pre_trigger_fill;
+	/* Buffers retained by soft_trigger_logic_check_retain(). */
+	GQueue pre_trigger_chunks;
+	int pre_trigger_retained;
+	GSList *spare_buffers;
 };
 
 SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
@@ -1044,6 +1255,8 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *st);
 SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *st, uint8_t *buf,
 		int len, int *pre_trigger_samples);
+SR_PRIV int soft_trigger_logic_check_retain(struct soft_trigger_logic *st,
+		uint8_t **buf, int len, int bufsize, int *pre_trigger_samples);
 
 /*--- hardware/serial.c -----------------------------------------------------*/
 
@@ -1111,6 +1324,47 @@ SR_PRIV int usb_source_remove(struct sr_session *session, struct sr_context *ctx
 SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len);
 SR_PRIV gboolean usb_match_manuf_prod(libusb_device *dev,
 		const char *manufacturer, const char *product);
+SR_PRIV int sr_usb_recorder_init(struct sr_context *ctx);
+SR_PRIV void sr_usb_recorder_cleanup(struct sr_context *ctx);
+SR_PRIV int sr_usb_control_transfer(struct sr_context *ctx,
+		libusb_device_handle *hdl, uint8_t request_type, uint8_t request,
+		uint16_t value, uint16_t index, unsigned char *data,
+		uint16_t length, unsigned int timeout);
+SR_PRIV int sr_usb_submit_transfer(struct sr_context *ctx,
+		struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_cancel_transfer(struct sr_context *ctx,
+		struct libusb_transfer *transfer);
+SR_PRIV void sr_usb_event_thread_init(struct sr_context *ctx);
+SR_PRIV void sr_usb_event_thread_cleanup(struct sr_context *ctx);
+SR_PRIV libusb_context *sr_usb_handoff_context(struct sr_context *ctx);
+SR_PRIV struct sr_usb_handoff *sr_usb_handoff_new(struct sr_context *ctx,
+		unsigned int num_transfers, unsigned int num_buffers,
+		size_t buffer_size);
+SR_PRIV void sr_usb_handoff_free(struct sr_usb_handoff *h);
+SR_PRIV gboolean sr_usb_handoff_push(struct sr_usb_handoff *h,
+		struct libusb_transfer *transfer);
+SR_PRIV void sr_usb_handoff_defer(struct sr_usb_handoff *h,
+		struct libusb_transfer *transfer);
+SR_PRIV gboolean sr_usb_handoff_pop(struct sr_usb_handoff *h,
+		struct sr_usb_handoff_entry *entry);
+SR_PRIV void sr_usb_handoff_release(struct sr_usb_handoff *h, uint8_t *buf);
+SR_PRIV int sr_usb_handoff_source_add(struct sr_session *session,
+		struct sr_usb_handoff *h, int timeout,
+		sr_receive_data_callback cb, void *cb_data);
+SR_PRIV int sr_usb_handoff_source_remove(struct sr_session *session,
+		struct sr_usb_handoff *h);
+SR_PRIV struct sr_usb_stream *sr_usb_stream_new(
+		const struct sr_usb_stream_config *config,
+		struct sr_session *session);
+SR_PRIV void sr_usb_stream_free(struct sr_usb_stream *s);
+SR_PRIV size_t sr_usb_stream_buffer_size(struct sr_usb_stream *s);
+SR_PRIV unsigned int sr_usb_stream_max_transfers(struct sr_usb_stream *s);
+SR_PRIV unsigned int sr_usb_stream_timeout(struct sr_usb_stream *s);
+SR_PRIV void sr_usb_stream_submitted(struct sr_usb_stream *s,
+		struct libusb_transfer *transfer);
+SR_PRIV gboolean sr_usb_stream_completed(struct sr_usb_stream *s,
+		struct libusb_transfer *transfer);
+SR_PRIV unsigned int sr_usb_stream_wanted(struct sr_usb_stream *s);
 #endif
 
 
@@ -1465,6 +1719,10 @@ struct sr_sw_limits {
 	uint64_t limit_msec;
 	uint64_t samples_read;
 	uint64_t start_time;
+	/* Samples passed by sr_session_send(), see sr_sw_limits_session_start(). */
+	uint64_t logic_sent;
+	/* Samples per analog channel (struct sr_channel *), as uint64_t *. */
+	GHashTable *analog_sent;
 };
 
 SR_PRIV int sr_sw_limits_config_get(struct sr_sw_limits *limits, uint32_t key,
@@ -1473,8 +1731,32 @@ SR_PRIV int sr_sw_limits_config_set(struct sr_sw_limits *limits, uint32_t key,
 	GVariant *data);
 SR_PRIV void sr_sw_limits_acquisition_start(struct sr_sw_limits *limits);
 SR_PRIV gboolean sr_sw_limits_check(struct sr_sw_limits *limits);
+SR_PRIV void sr_sw_limits_session_start(struct sr_sw_limits *limits,
+	struct sr_dev_inst *sdi);
+SR_PRIV void sr_sw_limits_session_end(struct sr_dev_inst *sdi);
+SR_PRIV uint64_t sr_sw_limits_session_clip(struct sr_sw_limits *limits,
+	uint64_t samples);
+SR_PRIV uint64_t sr_sw_limits_session_clip_analog(struct sr_sw_limits *limits,
+	GSList *channels, uint64_t samples);
 SR_PRIV void sr_sw_limits_update_samples_read(struct sr_sw_limits *limits,
 	uint64_t samples_read);
 SR_PRIV void sr_sw_limits_init(struct sr_sw_limits *limits);
 
+/*--- capture_store.c -------------------------------------------------------*/
+
+struct sr_capture_store;
+
+SR_PRIV struct sr_capture_store *sr_capture_store_new(unsigned int unitsize,
+	uint64_t mem_budget);
+SR_PRIV void sr_capture_store_free(struct sr_capture_store *store);
+SR_PRIV uint64_t sr_capture_store_samples(const struct sr_capture_store *store);
+SR_PRIV int sr_capture_store_set_length(struct sr_capture_store *store,
+	uint64_t num_samples);
+SR_PRIV uint8_t *sr_capture_store_get(struct sr_capture_store *store,
+	uint64_t start, uint64_t *count);
+SR_PRIV int sr_capture_store_append(struct sr_capture_store *store,
+	const void *data, uint64_t num_samples);
+SR_PRIV int sr_capture_store_send_logic(struct sr_capture_store *store,
+	const struct sr_dev_inst *sdi, uint64_t start, uint64_t num_samples);
+
 #endif
@@ -27,19 +27,17 @@
 #define LOG_PREFIX "output/binary"
 
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+		struct sr_output_sink *sink)
 {
 	const struct sr_datafeed_logic *logic;
 
 	(void)o;
 
-	*out = NULL;
 	if (packet->type != SR_DF_LOGIC)
 		return SR_OK;
 	logic = packet->payload;
-	*out = g_string_new_len(logic->data, logic->length);
 
-	return SR_OK;
+	return sr_output_sink_write(sink, logic->data, logic->length);
 }
 
 SR_PRIV struct sr_output_module output_binary = {
@@ -49,5 +47,5 @@ SR_PRIV struct sr_output_module output_binary = {
 	.exts = NULL,
 	.flags = 0,
 	.options = NULL,
-	.receive = receive,
+	.receive_sink = receive,
 };
@@ -35,9 +35,14 @@ struct context {
 	int trigger;
 	uint64_t samplerate;
 	int *channel_index;
-	char **channel_names;
 	gboolean header_done;
-	GString **lines;
+	/* One line buffer per channel, each starting with the channel name. */
+	char *lines;
+	size_t line_size;
+	size_t *prefix_len;
+	size_t *line_len;
+	/* Characters for the bits of a byte, first sample first. */
+	char chars[256][8];
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -45,7 +50,8 @@ static int init(struct sr_output *o, GHashTable *options)
 	struct context *ctx;
 	struct sr_channel *ch;
 	GSList *l;
-	unsigned int i, j;
+	size_t prefix_max;
+	unsigned int i, j, k;
 
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
@@ -53,8 +59,12 @@ static int init(struct sr_output *o, GHashTable *options)
 	ctx = g_malloc0(sizeof(struct context));
 	o->priv = ctx;
 	ctx->trigger = -1;
+	/* Without a width, all samples go on a single line. */
 	ctx->spl = g_variant_get_uint32(g_hash_table_lookup(options, "width"));
+	if (ctx->spl < 0)
+		ctx->spl = 0;
 
+	prefix_max = 0;
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 		if (ch->type != SR_CHANNEL_LOGIC)
@@ -62,10 +72,14 @@ static int init(struct sr_output *o, GHashTable *options)
 		if (!ch->enabled)
 			continue;
 		ctx->num_enabled_channels++;
+		prefix_max = MAX(prefix_max, strlen(ch->name) + 1);
 	}
 	ctx->channel_index = g_malloc(sizeof(int) * ctx->num_enabled_channels);
-	ctx->channel_names = g_malloc(sizeof(char *) * ctx->num_enabled_channels);
-	ctx->lines = g_malloc(sizeof(GString *) * ctx->num_enabled_channels);
+	ctx->prefix_len = g_malloc(sizeof(size_t) * ctx->num_enabled_channels);
+	ctx->line_len = g_malloc(sizeof(size_t) * ctx->num_enabled_channels);
+	/* Name, one character per bit, a space per byte and the newline. */
+	ctx->line_size = prefix_max + ctx->spl + ctx->spl / 8 + 1;
+	ctx->lines = g_malloc(ctx->line_size * ctx->num_enabled_channels);
 
 	j = 0;
 	for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
@@ -75,12 +89,17 @@ static int init(struct sr_output *o, GHashTable *options)
 		if (!ch->enabled)
 			continue;
 		ctx->channel_index[j] = ch->index;
-		ctx->channel_names[j] = ch->name;
-		ctx->lines[j] = g_string_sized_new(80);
-		g_string_printf(ctx->lines[j], "%s:", ch->name);
+		ctx->prefix_len[j] = g_snprintf(ctx->lines + j * ctx->line_size,
+			ctx->line_size, "%s:", ch->name);
+		ctx->line_len[j] = ctx->prefix_len[j];
 		j++;
 	}
 
+	for (i = 0; i < 256; i++) {
+		for (k = 0; k < 8; k++)
+			ctx->chars[i][k] = (i & (1 << k)) ? '1' : '0';
+	}
+
 	return SR_OK;
 }
 
@@ -116,19 +135,90 @@ static GString *gen_header(const struct sr_output *o)
 	return header;
 }
 
+/* Make room for more characters on all lines, which have no width. */
+static void grow_lines(struct context *ctx, size_t more)
+{
+	char *lines;
+	size_t size;
+	unsigned int j;
+
+	size = 0;
+	for (j = 0; j < ctx->num_enabled_channels; j++)
+		size = MAX(size, ctx->line_len[j] + more + 1);
+	if (size <= ctx->line_size)
+		return;
+	size = MAX(size, ctx->line_size * 2);
+
+	lines = g_malloc(size * ctx->num_enabled_channels);
+	for (j = 0; j < ctx->num_enabled_channels; j++)
+		memcpy(lines + j * size, ctx->lines + j * ctx->line_size,
+			ctx->line_len[j]);
+	g_free(ctx->lines);
+	ctx->lines = lines;
+	ctx->line_size = size;
+}
+
+/* Append the bits of a run of samples to all line buffers. */
+static void append_samples(struct context *ctx, const uint8_t *data,
+		unsigned int unitsize, unsigned int count)
+{
+	const uint8_t *sample;
+	char *line;
+	size_t len;
+	unsigned int j, n, left, pos;
+	uint8_t bits;
+
+	if (!ctx->spl)
+		grow_lines(ctx, count + count / 8 + 1);
+
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		line = ctx->lines + j * ctx->line_size;
+		len = ctx->line_len[j];
+		pos = ctx->spl_cnt;
+		sample = data;
+		for (left = count; left; left -= n) {
+			/* Stop at each byte boundary of the line. */
+			n = MIN(left, 8 - (pos & 7));
+			bits = sr_output_logic_gather(sample, unitsize,
+				ctx->channel_index[j], n);
+			memcpy(line + len, ctx->chars[bits], n);
+			len += n;
+			pos += n;
+			sample += n * unitsize;
+			/* Add a space every 8th bit. */
+			if ((pos & 7) == 0 && pos != (unsigned int)ctx->spl)
+				line[len++] = ' ';
+		}
+		ctx->line_len[j] = len;
+	}
+}
+
+static void flush_lines(struct context *ctx, struct sr_output_sink *sink)
+{
+	char *line;
+	unsigned int j;
+
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		line = ctx->lines + j * ctx->line_size;
+		line[ctx->line_len[j]] = '\n';
+		sr_output_sink_write(sink, line, ctx->line_len[j] + 1);
+		ctx->line_len[j] = ctx->prefix_len[j];
+	}
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+		struct sr_output_sink *sink)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	struct context *ctx;
 	GSList *l;
-	int idx, offset;
-	uint64_t i, j;
-	gchar *p, c;
+	GString *header;
+	const uint8_t *data;
+	int offset;
+	uint64_t num_samples, count;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -149,64 +239,55 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_LOGIC:
 		if (!ctx->header_done) {
-			*out = gen_header(o);
+			header = gen_header(o);
+			sr_output_sink_write(sink, header->str, header->len);
+			g_string_free(header, TRUE);
 			ctx->header_done = TRUE;
-		} else
-			*out = g_string_sized_new(512);
+		}
 
 		logic = packet->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			ctx->spl_cnt++;
-			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				p = logic->data + i + idx / 8;
-				c = (*p & (1 << (idx % 8))) ? '1' : '0';
-				g_string_append_c(ctx->lines[j], c);
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j == ctx->num_enabled_channels - 1 && ctx->trigger > -1) {
-						/*
-						 * Sample data lines have one character per bit,
-						 * plus one separator per byte. Align trigger marker
-						 * to this layout.
-						 */
-						offset = ctx->trigger + ctx->trigger / 8;
-						g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
-						ctx->trigger = -1;
-					}
-					g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
-				} else if ((ctx->spl_cnt & 7) == 0) {
-					/* Add a space every 8th bit. */
-					g_string_append_c(ctx->lines[j], ' ');
-				}
+		if (!logic->unitsize)
+			break;
+		data = logic->data;
+		num_samples = logic->length / logic->unitsize;
+		while (num_samples) {
+			count = num_samples;
+			if (ctx->spl)
+				count = MIN(count, (uint64_t)(ctx->spl - ctx->spl_cnt));
+			append_samples(ctx, data, logic->unitsize, count);
+			ctx->spl_cnt += count;
+			data += count * logic->unitsize;
+			num_samples -= count;
+			if (!ctx->spl || ctx->spl_cnt < ctx->spl)
+				continue;
+			flush_lines(ctx, sink);
+			if (ctx->trigger > -1) {
+				/*
+				 * Sample data lines have one character per bit,
+				 * plus one separator per byte. Align trigger marker
+				 * to this layout.
+				 */
+				offset = ctx->trigger + ctx->trigger / 8;
+				sr_output_sink_printf(sink, "T:%*s^ %d\n", offset, "", ctx->trigger);
+				ctx->trigger = -1;
 			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
-				ctx->spl_cnt = 0;
+			ctx->spl_cnt = 0;
 		}
 		break;
 	case SR_DF_END:
 		if (ctx->spl_cnt) {
 			/* Line buffers need flushing. */
-			*out = g_string_sized_new(512);
-			for (i = 0; i < ctx->num_enabled_channels; i++) {
-				g_string_append_len(*out, ctx->lines[i]->str, ctx->lines[i]->len);
-				g_string_append_c(*out, '\n');
-			}
+			flush_lines(ctx, sink);
 		}
 		break;
 	}
 
-	return SR_OK;
+	return sink->error;
 }
 
 static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
-	unsigned int i;
 
 	if (!o)
 		return SR_ERR_ARG;
@@ -215,9 +296,8 @@ static int cleanup(struct sr_output *o)
 		return SR_OK;
 
 	g_free(ctx->channel_index);
-	g_free(ctx->channel_names);
-	for (i = 0; i < ctx->num_enabled_channels; i++)
-		g_string_free(ctx->lines[i], TRUE);
+	g_free(ctx->prefix_len);
+	g_free(ctx->line_len);
 	g_free(ctx->lines);
 	g_free(ctx);
 	o->priv = NULL;
@@ -248,6 +328,6 @@ SR_PRIV struct sr_output_module output_bits = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_sink = receive,
 	.cleanup = cleanup,
 };
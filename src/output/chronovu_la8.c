@@ -31,9 +31,10 @@ struct context {
 	unsigned int num_enabled_channels;
 	gboolean triggered;
 	uint64_t samplerate;
-	uint64_t samplecount;
 	int *channel_index;
-	GString *pretrig_buf;
+	unsigned int unitsize;
+	/* Samples before the trigger, created with the first logic packet. */
+	struct sr_capture_store *pretrig;
 };
 
 /**
@@ -99,21 +100,46 @@ static int init(struct sr_output *o, GHashTable *options)
 		ctx->num_enabled_channels++;
 	}
 	ctx->channel_index = g_malloc(sizeof(int) * ctx->num_enabled_channels);
-	ctx->pretrig_buf = g_string_sized_new(1024);
 
 	return SR_OK;
 }
 
+/* Write the trigger point, followed by the pre-trigger samples. */
+static void flush_pretrig(struct context *ctx, struct sr_output_sink *sink,
+		uint64_t trigger_point)
+{
+	const uint8_t *data;
+	uint64_t num_samples, pos, count;
+	uint8_t c[4];
+
+	/* Four bytes (little endian) for the trigger point. */
+	c[0] = trigger_point & 0xff;
+	c[1] = (trigger_point >> 8) & 0xff;
+	c[2] = (trigger_point >> 16) & 0xff;
+	c[3] = (trigger_point >> 24) & 0xff;
+	sr_output_sink_write(sink, c, 4);
+
+	num_samples = ctx->pretrig ? sr_capture_store_samples(ctx->pretrig) : 0;
+
+	for (pos = 0; pos < num_samples; pos += count) {
+		count = num_samples - pos;
+		data = sr_capture_store_get(ctx->pretrig, pos, &count);
+		sr_output_sink_write(sink, data, count * ctx->unitsize);
+	}
+	sr_capture_store_free(ctx->pretrig);
+	ctx->pretrig = NULL;
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+		struct sr_output_sink *sink)
 {
 	const struct sr_datafeed_logic *logic;
 	struct context *ctx;
 	GVariant *gvar;
 	uint64_t samplerate;
-	gchar c[4];
+	uint8_t c;
+	int ret;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -128,42 +154,42 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			g_variant_unref(gvar);
 		} else
 			samplerate = 0;
-		c[0] = samplerate_to_divcount(samplerate);
-		*out = g_string_new_len(c, 1);
+		c = samplerate_to_divcount(samplerate);
+		sr_output_sink_write(sink, &c, 1);
 		ctx->triggered = FALSE;
 		break;
 	case SR_DF_TRIGGER:
-		/* Four bytes (little endian) for the trigger point. */
-		c[0] = ctx->samplecount & 0xff;
-		c[1] = (ctx->samplecount >> 8) & 0xff;
-		c[2] = (ctx->samplecount >> 16) & 0xff;
-		c[3] = (ctx->samplecount >> 24) & 0xff;
-		*out = g_string_new_len(c, 4);
-		/* Flush the pre-trigger buffer. */
-		if (ctx->pretrig_buf->len)
-			g_string_append_len(*out, ctx->pretrig_buf->str,
-					ctx->pretrig_buf->len);
+		if (!ctx->triggered)
+			flush_pretrig(ctx, sink, ctx->pretrig ?
+				sr_capture_store_samples(ctx->pretrig) : 0);
 		ctx->triggered = TRUE;
 		break;
 	case SR_DF_LOGIC:
 		logic = packet->payload;
-		if (!ctx->triggered)
-			g_string_append_len(ctx->pretrig_buf, logic->data, logic->length);
-		else
-			*out = g_string_new_len(logic->data, logic->length);
-		ctx->samplecount += logic->length / logic->unitsize;
+		if (ctx->triggered) {
+			sr_output_sink_write(sink, logic->data, logic->length);
+			break;
+		}
+		if (!ctx->pretrig) {
+			ctx->pretrig = sr_capture_store_new(logic->unitsize, 0);
+			if (!ctx->pretrig)
+				return SR_ERR_ARG;
+			ctx->unitsize = logic->unitsize;
+		}
+		ret = sr_capture_store_append(ctx->pretrig, logic->data,
+				logic->length / logic->unitsize);
+		if (ret != SR_OK)
+			return ret;
 		break;
 	case SR_DF_END:
-		if (!ctx->triggered && ctx->pretrig_buf->len) {
-			/* We never got a trigger, submit an empty one. */
-			*out = g_string_sized_new(ctx->pretrig_buf->len + 4);
-			g_string_append_len(*out, "\x00\x00\x00\x00", 4);
-			g_string_append_len(*out, ctx->pretrig_buf->str, ctx->pretrig_buf->len);
-		}
+		/* If we never got a trigger, submit an empty one. */
+		if (!ctx->triggered && ctx->pretrig
+				&& sr_capture_store_samples(ctx->pretrig))
+			flush_pretrig(ctx, sink, 0);
 		break;
 	}
 
-	return SR_OK;
+	return sink->error;
 }
 
 static int cleanup(struct sr_output *o)
@@ -175,7 +201,7 @@ static int cleanup(struct sr_output *o)
 
 	if (o->priv) {
 		ctx = o->priv;
-		g_string_free(ctx->pretrig_buf, TRUE);
+		sr_capture_store_free(ctx->pretrig);
 		g_free(ctx->channel_index);
 		g_free(o->priv);
 		o->priv = NULL;
@@ -192,6 +218,6 @@ SR_PRIV struct sr_output_module output_chronovu_la8 = {
 	.flags = 0,
 	.options = NULL,
 	.init = init,
-	.receive = receive,
+	.receive_sink = receive,
 	.cleanup = cleanup,
 };
@@ -18,7 +18,11 @@
  */
 
 #include <config.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -46,8 +50,15 @@
  * into libsigrok, instead of storing and then transferring the whole buffer,
  * can thus generate output live.
  *
- * Output modules generate a newly allocated GString. The caller is then
- * expected to free this with g_string_free() when finished with it.
+ * sr_output_send() returns the output for each packet in a newly allocated
+ * GString. The caller is then expected to free this with g_string_free()
+ * when finished with it.
+ *
+ * Alternatively, sr_output_send_to() writes the output into an output
+ * sink, which collects it in a buffer and passes it on in large blocks
+ * to a file descriptor, a FILE stream, a callback, or keeps it in a
+ * memory arena. Modules which support sinks write into them directly,
+ * so no per-packet GString gets built.
  *
  * @{
  */
@@ -187,6 +198,13 @@ SR_API const struct sr_output_module *sr_output_find(char *id)
 	return NULL;
 }
 
+/*
+ * Serialises the modules' lazy set-up of their option defaults with
+ * sr_output_options_free() releasing them, as instances may be created
+ * on several threads at once.
+ */
+static GMutex options_lock;
+
 /**
  * Returns a NULL-terminated array of struct sr_option, or NULL if the
  * module takes no options.
@@ -204,7 +222,9 @@ SR_API const struct sr_option **sr_output_options_get(const struct sr_output_mod
 	if (!omod || !omod->options)
 		return NULL;
 
+	g_mutex_lock(&options_lock);
 	mod_opts = omod->options();
+	g_mutex_unlock(&options_lock);
 
 	for (size = 0; mod_opts[size].id; size++)
 		;
@@ -230,6 +250,7 @@ SR_API void sr_output_options_free(const struct sr_option **options)
 	if (!options)
 		return;
 
+	g_mutex_lock(&options_lock);
 	for (i = 0; options[i]; i++) {
 		if (options[i]->def) {
 			g_variant_unref(options[i]->def);
@@ -241,6 +262,7 @@ SR_API void sr_output_options_free(const struct sr_option **options)
 			((struct sr_option *)options[i])->values = NULL;
 		}
 	}
+	g_mutex_unlock(&options_lock);
 	g_free(options);
 }
 
@@ -273,10 +295,13 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	op->module = omod;
 	op->sdi = sdi;
 	op->filename = g_strdup(filename);
+	op->planar_buf = NULL;
+	op->planar_bufsize = 0;
 
 	new_opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
 			(GDestroyNotify)g_variant_unref);
 	if (omod->options) {
+		g_mutex_lock(&options_lock);
 		mod_opts = omod->options();
 		for (i = 0; mod_opts[i].id; i++) {
 			if (options && g_hash_table_lookup_extended(options,
@@ -286,6 +311,7 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 				if (!g_variant_is_of_type(value, gvt)) {
 					sr_err("Invalid type for '%s' option.",
 						(char *)key);
+					g_mutex_unlock(&options_lock);
 					g_free(op);
 					return NULL;
 				}
@@ -297,6 +323,7 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 						g_variant_ref(mod_opts[i].def));
 			}
 		}
+		g_mutex_unlock(&options_lock);
 
 		/* Make sure no invalid options were given. */
 		if (options) {
@@ -323,18 +350,179 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	return op;
 }
 
+/* Pass a packet to the module, whichever way it produces its output. */
+static int module_receive(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		struct sr_output_sink *sink)
+{
+	GString *out;
+	int ret;
+
+	if (o->module->receive_sink)
+		return o->module->receive_sink(o, packet, sink);
+
+	out = NULL;
+	ret = o->module->receive(o, packet, &out);
+	if (out) {
+		if (ret == SR_OK)
+			ret = sr_output_sink_write(sink, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+
+	return ret;
+}
+
+/* Pass an SR_DF_LOGIC_RLE packet to a module which doesn't handle it. */
+static int output_send_expanded(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		struct sr_output_sink *sink)
+{
+	struct sr_logic_rle_expander exp;
+	struct sr_datafeed_packet expanded;
+	struct sr_datafeed_logic logic;
+	int ret;
+
+	expanded.type = SR_DF_LOGIC;
+	expanded.payload = &logic;
+	ret = SR_OK;
+	sr_logic_rle_expander_init(&exp, packet->payload);
+	while (sr_logic_rle_expander_next(&exp, &logic)) {
+		if ((ret = module_receive(o, &expanded, sink)) != SR_OK)
+			break;
+	}
+	sr_logic_rle_expander_clear(&exp);
+
+	return ret;
+}
+
+/* Pass an SR_DF_LOGIC_PLANAR packet to a module which doesn't handle it. */
+static int output_send_converted(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		struct sr_output_sink *sink)
+{
+	struct sr_output *op;
+	const struct sr_datafeed_logic_planar *planar;
+	struct sr_datafeed_packet converted;
+	struct sr_datafeed_logic logic;
+	uint64_t size;
+
+	op = (struct sr_output *)o;
+	planar = packet->payload;
+	size = planar->num_samples * planar->unitsize;
+	if (size > op->planar_bufsize) {
+		g_free(op->planar_buf);
+		op->planar_buf = g_malloc(size);
+		op->planar_bufsize = size;
+	}
+	sr_logic_planar_to_samples(planar, op->planar_buf);
+
+	logic.length = size;
+	logic.unitsize = planar->unitsize;
+	logic.data = op->planar_buf;
+	converted.type = SR_DF_LOGIC;
+	converted.payload = &logic;
+
+	return module_receive(o, &converted, sink);
+}
+
+/* Whether a packet has to be converted before the module can take it. */
+static gboolean needs_conversion(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet)
+{
+	if (packet->type == SR_DF_LOGIC_RLE)
+		return !(o->module->flags & SR_OUTPUT_LOGIC_RLE);
+	if (packet->type == SR_DF_LOGIC_PLANAR)
+		return !(o->module->flags & SR_OUTPUT_LOGIC_PLANAR);
+
+	return FALSE;
+}
+
+static int output_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		struct sr_output_sink *sink)
+{
+	if (needs_conversion(o, packet)) {
+		if (packet->type == SR_DF_LOGIC_RLE)
+			return output_send_expanded(o, packet, sink);
+		return output_send_converted(o, packet, sink);
+	}
+
+	return module_receive(o, packet, sink);
+}
+
 /**
  * Send a packet to the specified output instance.
  *
  * The instance's output is returned as a newly allocated GString,
- * which must be freed by the caller.
+ * which must be freed by the caller. If the packet generated no output,
+ * <code>out</code> is set to NULL.
+ *
+ * SR_DF_LOGIC_RLE packets are expanded to SR_DF_LOGIC packets, unless
+ * the output module has the SR_OUTPUT_LOGIC_RLE flag set. Likewise,
+ * SR_DF_LOGIC_PLANAR packets are converted unless the module has the
+ * SR_OUTPUT_LOGIC_PLANAR flag set.
+ *
+ * @see sr_output_send_to()
  *
  * @since 0.4.0
  */
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out)
 {
-	return o->module->receive(o, packet, out);
+	struct sr_output_sink sink;
+	GString *str;
+	int ret;
+
+	if (o->module->receive && !needs_conversion(o, packet))
+		return o->module->receive(o, packet, out);
+
+	*out = NULL;
+	str = g_string_new(NULL);
+	sr_output_sink_init_gstring(&sink, str);
+	ret = output_send(o, packet, &sink);
+	if (ret == SR_OK && str->len)
+		*out = str;
+	else
+		g_string_free(str, TRUE);
+
+	return ret;
+}
+
+/**
+ * Send a packet to the specified output instance, writing the output
+ * into a sink.
+ *
+ * Packets are converted as described for sr_output_send(). The sink is
+ * flushed after an SR_DF_END packet; before that, output may remain
+ * buffered until sr_output_sink_flush() is called.
+ *
+ * @param o The output instance. Must not be NULL.
+ * @param packet The packet to send. Must not be NULL.
+ * @param sink Where to write the output. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO Writing to the sink failed, now or earlier.
+ * @retval other Error code returned by the output module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_send_to(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		struct sr_output_sink *sink)
+{
+	int ret;
+
+	if (!o || !packet || !sink)
+		return SR_ERR_ARG;
+
+	ret = output_send(o, packet, sink);
+	if (ret == SR_OK && packet->type == SR_DF_END)
+		ret = sr_output_sink_flush(sink);
+	if (ret == SR_OK)
+		ret = sink->error;
+
+	return ret;
 }
 
 /**
@@ -352,10 +540,434 @@ SR_API int sr_output_free(const struct sr_output *o)
 	ret = SR_OK;
 	if (o->module->cleanup)
 		ret = o->module->cleanup((struct sr_output *)o);
+	g_free(o->planar_buf);
 	g_free((char *)o->filename);
 	g_free((gpointer)o);
 
 	return ret;
 }
 
+/** Buffer size of sinks which pass their output on in blocks. */
+#define SINK_BUFSIZE (64 * 1024)
+
+static struct sr_output_sink *sink_new(enum sr_output_sink_type type)
+{
+	struct sr_output_sink *sink;
+
+	sink = g_malloc0(sizeof(*sink));
+	sink->type = type;
+	sink->fd = -1;
+	if (type == SR_OUTPUT_SINK_FD || type == SR_OUTPUT_SINK_CALLBACK) {
+		sink->size = SINK_BUFSIZE;
+		sink->buf = g_malloc(sink->size);
+	}
+
+	return sink;
+}
+
+/* Pass data on to the destination of an FD or callback sink. */
+static int sink_emit(struct sr_output_sink *sink,
+		const uint8_t *data, size_t length)
+{
+	ssize_t ret;
+
+	if (sink->error)
+		return sink->error;
+
+	if (sink->type == SR_OUTPUT_SINK_CALLBACK) {
+		if (length && sink->cb(data, length, sink->cb_data) != SR_OK)
+			sink->error = SR_ERR_IO;
+		return sink->error;
+	}
+
+	while (length > 0) {
+		ret = write(sink->fd, data, length);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			sr_err("Failed to write output: %s.", g_strerror(errno));
+			sink->error = SR_ERR_IO;
+			break;
+		}
+		data += ret;
+		length -= ret;
+	}
+
+	return sink->error;
+}
+
+/* Make room for at least the given number of bytes in the buffer. */
+static void sink_grow(struct sr_output_sink *sink, size_t length)
+{
+	if (sink->size - sink->len >= length)
+		return;
+	sink->size = MAX(sink->len + length, sink->size * 2);
+	sink->buf = g_realloc(sink->buf, sink->size);
+}
+
+/** @private */
+SR_PRIV void sr_output_sink_init_gstring(struct sr_output_sink *sink,
+		GString *str)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->type = SR_OUTPUT_SINK_GSTRING;
+	sink->fd = -1;
+	sink->str = str;
+}
+
+/**
+ * Write data to an output sink.
+ *
+ * @private
+ */
+SR_PRIV int sr_output_sink_write(struct sr_output_sink *sink,
+		const void *data, size_t length)
+{
+	if (sink->error)
+		return sink->error;
+
+	switch (sink->type) {
+	case SR_OUTPUT_SINK_GSTRING:
+		g_string_append_len(sink->str, data, length);
+		break;
+	case SR_OUTPUT_SINK_ARENA:
+		sink_grow(sink, length);
+		memcpy(sink->buf + sink->len, data, length);
+		sink->len += length;
+		break;
+	case SR_OUTPUT_SINK_FILE:
+		if (fwrite(data, 1, length, sink->file) != length) {
+			sr_err("Failed to write output: %s.", g_strerror(errno));
+			sink->error = SR_ERR_IO;
+		}
+		break;
+	default:
+		if (sink->len + length > sink->size) {
+			sink_emit(sink, sink->buf, sink->len);
+			sink->len = 0;
+		}
+		/* Large blocks bypass the buffer. */
+		if (length >= sink->size)
+			return sink_emit(sink, data, length);
+		memcpy(sink->buf + sink->len, data, length);
+		sink->len += length;
+		break;
+	}
+
+	return sink->error;
+}
+
+/**
+ * Write formatted text to an output sink.
+ *
+ * @private
+ */
+SR_PRIV int sr_output_sink_printf(struct sr_output_sink *sink,
+		const char *format, ...)
+{
+	va_list args;
+	uint8_t *p;
+	size_t avail;
+	int len;
+
+	avail = 256;
+	p = sr_output_sink_reserve(sink, avail);
+	va_start(args, format);
+	len = g_vsnprintf((char *)p, avail, format, args);
+	va_end(args);
+	if (len < 0)
+		return SR_ERR_ARG;
+	if ((size_t)len >= avail) {
+		avail = len + 1;
+		p = sr_output_sink_reserve(sink, avail);
+		va_start(args, format);
+		g_vsnprintf((char *)p, avail, format, args);
+		va_end(args);
+	}
+	sr_output_sink_commit(sink, len);
+
+	return sink->error;
+}
+
+/**
+ * Get space in an output sink to format output into directly.
+ *
+ * The returned memory holds at least <code>length</code> bytes and stays
+ * valid until the next call on the sink. Call sr_output_sink_commit()
+ * with the number of bytes actually used.
+ *
+ * @private
+ */
+SR_PRIV uint8_t *sr_output_sink_reserve(struct sr_output_sink *sink,
+		size_t length)
+{
+	switch (sink->type) {
+	case SR_OUTPUT_SINK_GSTRING:
+		g_string_set_size(sink->str, sink->str->len + length);
+		sink->str->len -= length;
+		return (uint8_t *)sink->str->str + sink->str->len;
+	case SR_OUTPUT_SINK_FILE:
+		/* The FILE buffers itself, stage the data at the start. */
+		sink->len = 0;
+		sink_grow(sink, length);
+		return sink->buf;
+	case SR_OUTPUT_SINK_ARENA:
+		break;
+	default:
+		if (sink->size - sink->len < length) {
+			sink_emit(sink, sink->buf, sink->len);
+			sink->len = 0;
+		}
+		break;
+	}
+	sink_grow(sink, length);
+
+	return sink->buf + sink->len;
+}
+
+/**
+ * Account for data written into space from sr_output_sink_reserve().
+ *
+ * @private
+ */
+SR_PRIV void sr_output_sink_commit(struct sr_output_sink *sink,
+		size_t length)
+{
+	switch (sink->type) {
+	case SR_OUTPUT_SINK_GSTRING:
+		g_string_set_size(sink->str, sink->str->len + length);
+		break;
+	case SR_OUTPUT_SINK_FILE:
+		sr_output_sink_write(sink, sink->buf, length);
+		break;
+	default:
+		sink->len += length;
+		break;
+	}
+}
+
+/**
+ * Create an output sink which writes to a file descriptor.
+ *
+ * Output is collected and written in large blocks. The descriptor is
+ * not closed when the sink is freed.
+ *
+ * @param fd The file descriptor to write to.
+ *
+ * @return The new sink, or NULL if fd is invalid.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_output_sink *sr_output_sink_new_fd(int fd)
+{
+	struct sr_output_sink *sink;
+
+	if (fd < 0)
+		return NULL;
+
+	sink = sink_new(SR_OUTPUT_SINK_FD);
+	sink->fd = fd;
+
+	return sink;
+}
+
+/**
+ * Create an output sink which writes to a stdio stream.
+ *
+ * The stream does its own buffering. It is flushed, but not closed
+ * when the sink is freed.
+ *
+ * @param file The stream to write to. Must not be NULL.
+ *
+ * @return The new sink, or NULL if file is NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_output_sink *sr_output_sink_new_file(FILE *file)
+{
+	struct sr_output_sink *sink;
+
+	if (!file)
+		return NULL;
+
+	sink = sink_new(SR_OUTPUT_SINK_FILE);
+	sink->file = file;
+
+	return sink;
+}
+
+/**
+ * Create an output sink which passes its output to a callback.
+ *
+ * Output is collected in a buffer, which the callback gets to see once
+ * it is full, when the sink is flushed, or when a single write exceeds
+ * it. The data is only valid during the callback. If the callback
+ * returns anything but SR_OK, the sink fails all further writes with
+ * SR_ERR_IO.
+ *
+ * @param cb The callback. Must not be NULL.
+ * @param cb_data Opaque pointer passed to the callback.
+ *
+ * @return The new sink, or NULL if cb is NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_output_sink *sr_output_sink_new_callback(
+		sr_output_sink_callback cb, void *cb_data)
+{
+	struct sr_output_sink *sink;
+
+	if (!cb)
+		return NULL;
+
+	sink = sink_new(SR_OUTPUT_SINK_CALLBACK);
+	sink->cb = cb;
+	sink->cb_data = cb_data;
+
+	return sink;
+}
+
+/**
+ * Create an output sink which keeps its output in memory.
+ *
+ * The memory is reused after sr_output_sink_arena_reset(), so a
+ * frontend can pick up the output of each packet without any
+ * allocation once the arena has grown large enough.
+ *
+ * @return The new sink.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_output_sink *sr_output_sink_new_arena(void)
+{
+	return sink_new(SR_OUTPUT_SINK_ARENA);
+}
+
+/**
+ * Get the data collected in a memory arena sink.
+ *
+ * @param sink The sink. Must not be NULL.
+ * @param length Where to store the number of bytes collected. Must not
+ *               be NULL.
+ *
+ * @return The collected data, valid until the next call on the sink.
+ *         NULL if the sink is not an arena or holds no data.
+ *
+ * @since 0.6.0
+ */
+SR_API const uint8_t *sr_output_sink_arena_data(
+		const struct sr_output_sink *sink, size_t *length)
+{
+	*length = 0;
+	if (!sink || sink->type != SR_OUTPUT_SINK_ARENA || !sink->len)
+		return NULL;
+	*length = sink->len;
+
+	return sink->buf;
+}
+
+/**
+ * Discard the data collected in a memory arena sink, keeping the memory
+ * for reuse.
+ *
+ * @param sink The sink. Must not be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_output_sink_arena_reset(struct sr_output_sink *sink)
+{
+	if (sink && sink->type == SR_OUTPUT_SINK_ARENA)
+		sink->len = 0;
+}
+
+/**
+ * Write out any output an output sink still holds in its buffer.
+ *
+ * @param sink The sink. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO Writing failed, now or earlier.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_sink_flush(struct sr_output_sink *sink)
+{
+	if (!sink)
+		return SR_ERR_ARG;
+
+	switch (sink->type) {
+	case SR_OUTPUT_SINK_FD:
+	case SR_OUTPUT_SINK_CALLBACK:
+		sink_emit(sink, sink->buf, sink->len);
+		sink->len = 0;
+		break;
+	case SR_OUTPUT_SINK_FILE:
+		if (!sink->error && fflush(sink->file) != 0) {
+			sr_err("Failed to write output: %s.", g_strerror(errno));
+			sink->error = SR_ERR_IO;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return sink->error;
+}
+
+/**
+ * Flush and free an output sink.
+ *
+ * The file descriptor or stream the sink writes to is not closed.
+ *
+ * @param sink The sink to free. If NULL, nothing happens.
+ *
+ * @return The result of flushing the sink.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_sink_free(struct sr_output_sink *sink)
+{
+	int ret;
+
+	if (!sink)
+		return SR_OK;
+
+	ret = sr_output_sink_flush(sink);
+	g_free(sink->buf);
+	g_free(sink);
+
+	return ret;
+}
+
+/**
+ * Collect the bits of one channel from up to eight consecutive samples.
+ *
+ * The bytes holding the channel are picked from each sample and the
+ * channel's bit is extracted from all of them at once.
+ *
+ * @param samples The first sample.
+ * @param unitsize Size of a sample in bytes.
+ * @param index Bit position of the channel within a sample.
+ * @param count Number of samples, at most 8.
+ *
+ * @return The channel's bits, the first sample in bit 0.
+ *
+ * @private
+ */
+SR_PRIV uint8_t sr_output_logic_gather(const uint8_t *samples,
+		unsigned int unitsize, unsigned int index, unsigned int count)
+{
+	uint64_t x;
+	unsigned int k;
+
+	samples += index / 8;
+	x = 0;
+	for (k = 0; k < count; k++)
+		x |= (uint64_t)samples[k * unitsize] << (8 * k);
+	x = (x >> (index % 8)) & 0x0101010101010101ULL;
+
+	return (x * 0x0102040810204080ULL) >> 56;
+}
+
 /** @} */
@@ -31,6 +31,7 @@
 
 struct out_context {
 	gboolean zip_created;
+	gboolean has_logic;
 	uint64_t samplerate;
 	char *filename;
 	gint first_analog_index;
@@ -129,6 +130,7 @@ static int zip_create(const struct sr_output *o)
 
 	/* Only set capturefile and probes if we will actually save logic data. */
 	if (enabled_logic_channels > 0) {
+		outc->has_logic = TRUE;
 		g_key_file_set_string(meta, devgroup, "capturefile", "logic-1");
 		g_key_file_set_integer(meta, devgroup, "total probes", logic_channels);
 	}
@@ -409,6 +411,118 @@ err_zip_discard:
 	return SR_ERR;
 }
 
+/*
+ * Add a stored overview pyramid to the archive. The buffer must be kept
+ * until the archive is closed, so it's added to the list.
+ */
+static int zip_add_pyramid(struct zip *archive, const char *name,
+		GByteArray *buf, GSList **bufs)
+{
+	struct zip_source *src;
+
+	*bufs = g_slist_prepend(*bufs, buf);
+	src = zip_source_buffer(archive, buf->data, buf->len, FALSE);
+	if (zip_add(archive, name, src) < 0) {
+		sr_err("Failed to add '%s': %s", name, zip_strerror(archive));
+		zip_source_free(src);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Store the overview pyramids of the device's overview transform, if it
+ * has one: "overview-logic-1" for the logic data, and for every analog
+ * channel "overview-analog-1-<n>", numbered like its samples. The
+ * "overview version" metadata key gives the format of these members.
+ * Older readers ignore both.
+ */
+static int zip_append_overview(const struct sr_output *o)
+{
+	struct out_context *outc;
+	const struct sr_transform *t;
+	struct sr_channel *ch;
+	struct zip *archive;
+	struct zip_source *metasrc;
+	struct zip_stat zs;
+	GKeyFile *kf;
+	GSList *bufs, *l;
+	GByteArray *buf;
+	char *name, *metabuf;
+	gsize metalen;
+	unsigned int i;
+	int ret;
+
+	outc = o->priv;
+	if (!(t = sr_transform_overview_find(o->sdi)))
+		return SR_OK;
+
+	if (!(archive = zip_open(outc->filename, 0, NULL)))
+		return SR_ERR;
+
+	bufs = NULL;
+	metabuf = NULL;
+	if (outc->has_logic && (buf = sr_transform_overview_save(t, NULL))) {
+		if (zip_add_pyramid(archive, "overview-logic-1", buf,
+				&bufs) != SR_OK)
+			goto err_zip_discard;
+	}
+	for (i = 0; outc->analog_index_map[i] != -1; i++) {
+		for (l = o->sdi->channels; l; l = l->next) {
+			ch = l->data;
+			if (ch->type == SR_CHANNEL_ANALOG
+					&& ch->index == outc->analog_index_map[i])
+				break;
+		}
+		if (!l || !(buf = sr_transform_overview_save(t, ch)))
+			continue;
+		name = g_strdup_printf("overview-analog-1-%u",
+			outc->first_analog_index + i);
+		ret = zip_add_pyramid(archive, name, buf, &bufs);
+		g_free(name);
+		if (ret != SR_OK)
+			goto err_zip_discard;
+	}
+	if (!bufs) {
+		zip_discard(archive);
+		return SR_OK;
+	}
+
+	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
+		sr_err("Failed to open metadata: %s", zip_strerror(archive));
+		goto err_zip_discard;
+	}
+	if (!(kf = sr_sessionfile_read_metadata(archive, &zs)))
+		goto err_zip_discard;
+	g_key_file_set_integer(kf, "device 1", "overview version", 1);
+	metabuf = g_key_file_to_data(kf, &metalen, NULL);
+	g_key_file_free(kf);
+	metasrc = zip_source_buffer(archive, metabuf, metalen, FALSE);
+	if (zip_replace(archive, zs.index, metasrc) < 0) {
+		sr_err("Failed to replace metadata: %s", zip_strerror(archive));
+		zip_source_free(metasrc);
+		goto err_zip_discard;
+	}
+	if (zip_close(archive) < 0) {
+		sr_err("Error saving session file: %s", zip_strerror(archive));
+		goto err_zip_discard;
+	}
+	ret = SR_OK;
+	goto out;
+
+err_zip_discard:
+	zip_discard(archive);
+	ret = SR_ERR;
+out:
+	for (l = bufs; l; l = l->next)
+		g_byte_array_free(l->data, TRUE);
+	g_slist_free(bufs);
+	g_free(metabuf);
+
+	return ret;
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -457,6 +571,10 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		if (ret != SR_OK)
 			return ret;
 		break;
+	case SR_DF_END:
+		if (outc->zip_created)
+			return zip_append_overview(o);
+		break;
 	}
 
 	return SR_OK;
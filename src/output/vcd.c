@@ -152,20 +152,90 @@ static GString *gen_header(const struct sr_output *o)
 	return header;
 }
 
+/* Output the changes of a sample against the previous one. */
+static void write_changes(struct context *ctx, struct sr_output_sink *sink,
+		const uint8_t *sample, uint16_t unitsize)
+{
+	int p, curbit, prevbit, index;
+	gboolean timestamp_written;
+	char change[3];
+
+	timestamp_written = FALSE;
+
+	for (p = 0; p < ctx->num_enabled_channels; p++) {
+		/*
+		 * TODO Check whether the mapping from
+		 * data image positions to channel numbers
+		 * is required. Experiments suggest that
+		 * the data image "is dense", and packs
+		 * bits of enabled channels, and leaves no
+		 * room for positions of disabled channels.
+		 */
+		/* index = ctx->channel_index[p]; */
+		index = p;
+
+		curbit = ((unsigned)sample[index / 8]
+				>> (index % 8)) & 1;
+		prevbit = ((unsigned)ctx->prevsample[index / 8]
+				>> (index % 8)) & 1;
+
+		/* VCD only contains deltas/changes of signals. */
+		if (prevbit == curbit && ctx->samplecount > 0)
+			continue;
+
+		/* Output timestamp of subsequent signal changes. */
+		if (!timestamp_written)
+			sr_output_sink_printf(sink, "#%.0f",
+				(double)ctx->samplecount /
+					ctx->samplerate * ctx->period);
+
+		/* Output which signal changed to which value. */
+		change[0] = ' ';
+		change[1] = '0' + curbit;
+		change[2] = '!' + p;
+		sr_output_sink_write(sink, change, sizeof(change));
+
+		timestamp_written = TRUE;
+	}
+
+	if (timestamp_written)
+		sr_output_sink_write(sink, "\n", 1);
+
+	memcpy(ctx->prevsample, sample, unitsize);
+}
+
+static void start_chunk(const struct sr_output *o,
+		struct sr_output_sink *sink, uint16_t unitsize)
+{
+	struct context *ctx;
+	GString *header;
+
+	ctx = o->priv;
+
+	if (!ctx->header_done) {
+		header = gen_header(o);
+		sr_output_sink_write(sink, header->str, header->len);
+		g_string_free(header, TRUE);
+		ctx->header_done = TRUE;
+	}
+
+	if (!ctx->prevsample) {
+		/* Can't allocate this until we know the stream's unitsize. */
+		ctx->prevsample = g_malloc0(unitsize);
+	}
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+		struct sr_output_sink *sink)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	unsigned int i;
-	int p, curbit, prevbit, index;
-	uint8_t *sample;
-	gboolean timestamp_written;
+	uint64_t i;
 
-	*out = NULL;
 	if (!o || !o->priv)
 		return SR_ERR_BUG;
 	ctx = o->priv;
@@ -182,74 +252,36 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_LOGIC:
 		logic = packet->payload;
+		start_chunk(o, sink, logic->unitsize);
 
-		if (!ctx->header_done) {
-			*out = gen_header(o);
-			ctx->header_done = TRUE;
-		} else {
-			*out = g_string_sized_new(512);
-		}
-
-		if (!ctx->prevsample) {
-			/* Can't allocate this until we know the stream's unitsize. */
-			ctx->prevsample = g_malloc0(logic->unitsize);
+		for (i = 0; i + logic->unitsize <= logic->length; i += logic->unitsize) {
+			write_changes(ctx, sink, (uint8_t *)logic->data + i,
+				logic->unitsize);
+			ctx->samplecount++;
 		}
+		break;
+	case SR_DF_LOGIC_RLE:
+		/* Only the first sample of each run can hold changes. */
+		rle = packet->payload;
+		start_chunk(o, sink, rle->unitsize);
 
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			sample = logic->data + i;
-			timestamp_written = FALSE;
-
-			for (p = 0; p < ctx->num_enabled_channels; p++) {
-				/*
-				 * TODO Check whether the mapping from
-				 * data image positions to channel numbers
-				 * is required. Experiments suggest that
-				 * the data image "is dense", and packs
-				 * bits of enabled channels, and leaves no
-				 * room for positions of disabled channels.
-				 */
-				/* index = ctx->channel_index[p]; */
-				index = p;
-
-				curbit = ((unsigned)sample[index / 8]
-						>> (index % 8)) & 1;
-				prevbit = ((unsigned)ctx->prevsample[index / 8]
-						>> (index % 8)) & 1;
-
-				/* VCD only contains deltas/changes of signals. */
-				if (prevbit == curbit && ctx->samplecount > 0)
-					continue;
-
-				/* Output timestamp of subsequent signal changes. */
-				if (!timestamp_written)
-					g_string_append_printf(*out, "#%.0f",
-						(double)ctx->samplecount /
-							ctx->samplerate * ctx->period);
-
-				/* Output which signal changed to which value. */
-				g_string_append_c(*out, ' ');
-				g_string_append_c(*out, '0' + curbit);
-				g_string_append_c(*out, '!' + p);
-
-				timestamp_written = TRUE;
-			}
-
-			if (timestamp_written)
-				g_string_append_c(*out, '\n');
-
-			ctx->samplecount++;
-			memcpy(ctx->prevsample, sample, logic->unitsize);
+		for (i = 0; i < rle->num_runs; i++) {
+			if (!rle->lengths[i])
+				continue;
+			write_changes(ctx, sink,
+				(uint8_t *)rle->values + i * rle->unitsize,
+				rle->unitsize);
+			ctx->samplecount += rle->lengths[i];
 		}
 		break;
 	case SR_DF_END:
 		/* Write final timestamp as length indicator. */
-		*out = g_string_sized_new(512);
-		g_string_printf(*out, "#%.0f\n",
+		sr_output_sink_printf(sink, "#%.0f\n",
 				(double)ctx->samplecount / ctx->samplerate * ctx->period);
 		break;
 	}
 
-	return SR_OK;
+	return sink->error;
 }
 
 static int cleanup(struct sr_output *o)
@@ -272,9 +304,9 @@ struct sr_output_module output_vcd = {
 	.name = "VCD",
 	.desc = "Value Change Dump data",
 	.exts = (const char*[]){"vcd", NULL},
-	.flags = 0,
+	.flags = SR_OUTPUT_LOGIC_RLE,
 	.options = NULL,
 	.init = init,
-	.receive = receive,
+	.receive_sink = receive,
 	.cleanup = cleanup,
 };
@@ -18,7 +18,9 @@
  */
 
 #include <config.h>
+#include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -27,63 +29,123 @@
 /* Minimum/maximum number of samples per channel to put in a data chunk */
 #define MIN_DATA_CHUNK_SAMPLES 10
 
+/* Size of the header gen_header() writes, and where the sizes live. */
+#define HEADER_SIZE		46
+#define RIFF_SIZE_OFFSET	4
+#define DATA_SIZE_OFFSET	42
+
 struct out_context {
 	double scale;
 	gboolean header_done;
 	uint64_t samplerate;
 	int num_channels;
 	GSList *channels;
-	int chanbuf_size;
-	int *chanbuf_used;
-	uint8_t **chanbuf;
+	/*
+	 * Interleaved output frames, 4 bytes per channel. Packets may only
+	 * carry some of the channels, so each channel tracks how many of
+	 * the frames it has filled in; the frames all channels filled are
+	 * ready to be written out.
+	 */
+	uint8_t *frames;
+	size_t frames_size;
+	size_t *chanbuf_used;
+	/* Per-packet scratch space, kept across packets. */
 	float *fdata;
+	size_t fdata_size;
+	int *chan_idx;
+	/* Write to this file descriptor instead of returning GStrings. */
+	int fd;
+	uint64_t data_bytes;
 };
 
-static int realloc_chanbufs(const struct sr_output *o, int size)
+static int write_fd(struct out_context *outc, const void *buf, size_t len)
 {
-	struct out_context *outc;
-	int i;
-
-	outc = o->priv;
-	for (i = 0; i < outc->num_channels; i++) {
-		if (!(outc->chanbuf[i] = g_try_realloc(outc->chanbuf[i], sizeof(float) * size))) {
-			sr_err("Unable to allocate enough output buffer memory.");
-			return SR_ERR;
+	const uint8_t *p;
+	ssize_t ret;
+
+	p = buf;
+	while (len > 0) {
+		ret = write(outc->fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			sr_err("Failed to write output: %s.", g_strerror(errno));
+			return SR_ERR_IO;
 		}
-		outc->chanbuf_used[i] = 0;
+		p += ret;
+		len -= ret;
 	}
-	outc->chanbuf_size = size;
 
 	return SR_OK;
 }
 
-static int flush_chanbufs(const struct sr_output *o, GString *out)
+/* Make room for at least the given number of frames. */
+static int grow_frames(struct out_context *outc, size_t num_frames)
 {
-	struct out_context *outc;
-	int num_samples, i, j;
-	char *buf, *bufp;
+	uint8_t *frames;
 
-	outc = o->priv;
+	if (num_frames <= outc->frames_size)
+		return SR_OK;
 
-	/* Any one of them will do. */
-	num_samples = outc->chanbuf_used[0];
-	if (!(buf = g_try_malloc(4 * num_samples * outc->num_channels))) {
-		sr_err("Unable to allocate enough interleaved output buffer memory.");
-		return SR_ERR;
+	num_frames = MAX(num_frames, outc->frames_size * 2);
+	if (!(frames = g_try_realloc(outc->frames,
+			num_frames * outc->num_channels * 4))) {
+		sr_err("Unable to allocate enough output buffer memory.");
+		return SR_ERR_MALLOC;
 	}
+	outc->frames = frames;
+	outc->frames_size = num_frames;
 
-	bufp = buf;
-	for (i = 0; i < num_samples; i++) {
-		for (j = 0; j < outc->num_channels; j++) {
-			memcpy(bufp, outc->chanbuf[j] + i * 4, 4);
-			bufp += 4;
-		}
+	return SR_OK;
+}
+
+/*
+ * Returns the number of frames all channels have filled in, and the
+ * highest number of frames any channel has filled in.
+ */
+static size_t complete_frames(const struct out_context *outc, size_t *max)
+{
+	size_t min;
+	int i;
+
+	if (outc->num_channels == 0)
+		return *max = 0;
+
+	min = *max = outc->chanbuf_used[0];
+	for (i = 1; i < outc->num_channels; i++) {
+		min = MIN(min, outc->chanbuf_used[i]);
+		*max = MAX(*max, outc->chanbuf_used[i]);
 	}
-	g_string_append_len(out, buf, 4 * num_samples * outc->num_channels);
-	g_free(buf);
 
+	return min;
+}
+
+static int flush_frames(const struct sr_output *o, size_t num_frames,
+		size_t max_frames, GString *out)
+{
+	struct out_context *outc;
+	size_t frame_size;
+	int i, ret;
+
+	outc = o->priv;
+	frame_size = outc->num_channels * 4;
+
+	if (outc->fd >= 0) {
+		if ((ret = write_fd(outc, outc->frames,
+				num_frames * frame_size)) != SR_OK)
+			return ret;
+	} else {
+		g_string_append_len(out, (const char *)outc->frames,
+			num_frames * frame_size);
+	}
+	outc->data_bytes += num_frames * frame_size;
+
+	/* Keep frames only some of the channels have filled in so far. */
+	if (max_frames > num_frames)
+		memmove(outc->frames, outc->frames + num_frames * frame_size,
+			(max_frames - num_frames) * frame_size);
 	for (i = 0; i < outc->num_channels; i++)
-		outc->chanbuf_used[i] = 0;
+		outc->chanbuf_used[i] -= num_frames;
 
 	return SR_OK;
 }
@@ -108,11 +170,12 @@ static int init(struct sr_output *o, GHashTable *options)
 		outc->num_channels++;
 	}
 
-	outc->chanbuf = g_malloc0(sizeof(float *) * outc->num_channels);
-	outc->chanbuf_used = g_malloc0(sizeof(int) * outc->num_channels);
+	outc->chanbuf_used = g_malloc0(sizeof(size_t) * outc->num_channels);
+	outc->chan_idx = g_malloc0(sizeof(int) * outc->num_channels);
+	outc->fd = g_variant_get_int32(g_hash_table_lookup(options, "fd"));
 
 	/* Start off the interleaved buffer with 100 samples/channel. */
-	realloc_chanbufs(o, 100);
+	grow_frames(outc, 100);
 
 	return SR_OK;
 }
@@ -182,55 +245,80 @@ static GString *gen_header(const struct sr_output *o)
 }
 
 /*
- * Stores the float in little-endian BINARY32 IEEE-754 2008 format.
+ * Scale the packet's floats and store them as little-endian BINARY32
+ * IEEE-754 2008 values into the interleaved frame buffer, in one pass.
  */
-static void float_to_le(uint8_t *buf, float value)
+static void interleave(struct out_context *outc, const float *data,
+		int num_samples, int num_channels)
 {
-	uint8_t *old;
-
-	old = (uint8_t *)&value;
-#ifdef WORDS_BIGENDIAN
-	buf[0] = old[3];
-	buf[1] = old[2];
-	buf[2] = old[1];
-	buf[3] = old[0];
-#else
-	buf[0] = old[0];
-	buf[1] = old[1];
-	buf[2] = old[2];
-	buf[3] = old[3];
-#endif
-}
+	size_t frame_size;
+	uint8_t *dst;
+	float f;
+	int i, j, idx;
+	gboolean in_order;
 
-/*
- * Returns the number of samples used in the current channel buffers,
- * or -1 if they're not all the same.
- */
-static int check_chanbuf_size(const struct sr_output *o)
-{
-	struct out_context *outc;
-	int size, i;
+	frame_size = outc->num_channels * 4;
 
-	outc = o->priv;
-	size = 0;
-	for (i = 0; i < outc->num_channels; i++) {
-		if (size == 0) {
-			if (outc->chanbuf_used[i] == 0) {
-				/* Nothing in all the buffers yet. */
-				size = -1;
-				break;
-			} else {
-				/* New high water mark. */
-				size = outc->chanbuf_used[i];
+	/* Common case: every channel, in order, and equally filled in. */
+	in_order = num_channels == outc->num_channels;
+	for (j = 0; in_order && j < num_channels; j++) {
+		if (outc->chan_idx[j] != j
+				|| outc->chanbuf_used[j] != outc->chanbuf_used[0])
+			in_order = FALSE;
+	}
+
+	if (in_order) {
+		dst = outc->frames + outc->chanbuf_used[0] * frame_size;
+#ifndef WORDS_BIGENDIAN
+		if (outc->scale == 1.0) {
+			memcpy(dst, data, (size_t)num_samples * frame_size);
+		} else
+#endif
+		{
+			for (i = 0; i < num_samples * num_channels; i++) {
+				f = data[i];
+				if (outc->scale != 1.0)
+					f /= outc->scale;
+				WLFL(dst + i * 4, f);
 			}
-		} else if (outc->chanbuf_used[i] != size) {
-			/* All channel buffers are not equally full yet. */
-			size = -1;
-			break;
 		}
+		for (j = 0; j < num_channels; j++)
+			outc->chanbuf_used[j] += num_samples;
+		return;
 	}
 
-	return size;
+	for (j = 0; j < num_channels; j++) {
+		idx = outc->chan_idx[j];
+		dst = outc->frames + outc->chanbuf_used[idx] * frame_size + idx * 4;
+		for (i = 0; i < num_samples; i++) {
+			f = data[i * num_channels + j];
+			if (outc->scale != 1.0)
+				f /= outc->scale;
+			WLFL(dst, f);
+			dst += frame_size;
+		}
+		outc->chanbuf_used[idx] += num_samples;
+	}
+}
+
+/* Fill in the RIFF and data chunk sizes, if the output can seek. */
+static void patch_header(struct out_context *outc)
+{
+	uint8_t tmp[4];
+	off_t end;
+
+	if (outc->data_bytes > UINT32_MAX - (HEADER_SIZE - 8))
+		return;
+	if ((end = lseek(outc->fd, 0, SEEK_CUR)) < 0)
+		return;
+
+	WL32(tmp, HEADER_SIZE - 8 + outc->data_bytes);
+	if (lseek(outc->fd, RIFF_SIZE_OFFSET, SEEK_SET) == RIFF_SIZE_OFFSET)
+		write_fd(outc, tmp, 4);
+	WL32(tmp, outc->data_bytes);
+	if (lseek(outc->fd, DATA_SIZE_OFFSET, SEEK_SET) == DATA_SIZE_OFFSET)
+		write_fd(outc, tmp, 4);
+	lseek(outc->fd, end, SEEK_SET);
 }
 
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
@@ -240,13 +328,11 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_analog *analog;
 	const struct sr_config *src;
-	struct sr_channel *ch;
+	GString *header;
 	GSList *l;
 	const GSList *channels;
-	float f;
-	int num_channels, num_samples, size, *chan_idx, idx, i, j, ret;
-	float *data;
-	uint8_t *buf;
+	size_t num_frames, max_frames;
+	int num_channels, num_samples, i, ret;
 
 	*out = NULL;
 	if (!o || !o->sdi || !(outc = o->priv))
@@ -264,20 +350,33 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_ANALOG:
 		if (!outc->header_done) {
-			*out = gen_header(o);
+			header = gen_header(o);
 			outc->header_done = TRUE;
-		} else {
-			*out = g_string_sized_new(512);
+			if (outc->fd >= 0) {
+				ret = write_fd(outc, header->str, header->len);
+				g_string_free(header, TRUE);
+				if (ret != SR_OK)
+					return ret;
+			} else {
+				*out = header;
+			}
 		}
+		if (outc->fd < 0 && !*out)
+			*out = g_string_sized_new(512);
 
 		analog = packet->payload;
 		num_samples = analog->num_samples;
 		channels = analog->meaning->channels;
 		num_channels = g_slist_length(analog->meaning->channels);
-		if (!(data = g_try_realloc(outc->fdata, sizeof(float) * num_samples * num_channels)))
-			return SR_ERR_MALLOC;
-		outc->fdata = data;
-		ret = sr_analog_to_float(analog, data);
+		if ((size_t)num_samples * num_channels > outc->fdata_size) {
+			g_free(outc->fdata);
+			outc->fdata_size = (size_t)num_samples * num_channels;
+			if (!(outc->fdata = g_try_malloc(sizeof(float) * outc->fdata_size))) {
+				outc->fdata_size = 0;
+				return SR_ERR_MALLOC;
+			}
+		}
+		ret = sr_analog_to_float(analog, outc->fdata);
 		if (ret != SR_OK)
 			return ret;
 
@@ -290,42 +389,34 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			return SR_ERR;
 		}
 
-		if (num_samples > outc->chanbuf_size) {
-			if (realloc_chanbufs(o, analog->num_samples) != SR_OK)
-				return SR_ERR_MALLOC;
-		}
-
 		/* Index the channels in this packet, so we can interleave quicker. */
-		chan_idx = g_malloc(sizeof(int) * outc->num_channels);
-		for (i = 0; i < num_channels; i++) {
-			ch = g_slist_nth_data((GSList *) channels, i);
-			chan_idx[i] = g_slist_index(outc->channels, ch);
-		}
-
-		for (i = 0; i < num_samples; i++) {
-			for (j = 0; j < num_channels; j++) {
-				idx = chan_idx[j];
-				buf = outc->chanbuf[idx] + outc->chanbuf_used[idx]++ * 4;
-				f = data[i * num_channels + j];
-				if (outc->scale != 1.0)
-					f /= outc->scale;
-				float_to_le(buf, f);
+		for (i = 0, l = (GSList *)channels; i < num_channels; i++, l = l->next) {
+			outc->chan_idx[i] = g_slist_index(outc->channels, l->data);
+			if (outc->chan_idx[i] < 0) {
+				sr_err("Packet has a channel that wasn't enabled.");
+				return SR_ERR;
 			}
 		}
-		g_free(chan_idx);
 
-		size = check_chanbuf_size(o);
-		if (size > MIN_DATA_CHUNK_SAMPLES)
-			if (flush_chanbufs(o, *out) != SR_OK)
-				return SR_ERR;
+		complete_frames(outc, &max_frames);
+		if ((ret = grow_frames(outc, max_frames + num_samples)) != SR_OK)
+			return ret;
+		interleave(outc, outc->fdata, num_samples, num_channels);
+
+		num_frames = complete_frames(outc, &max_frames);
+		if (num_frames > MIN_DATA_CHUNK_SAMPLES)
+			return flush_frames(o, num_frames, max_frames, *out);
 		break;
 	case SR_DF_END:
-		size = check_chanbuf_size(o);
-		if (size > 0) {
-			*out = g_string_sized_new(4 * size * outc->num_channels);
-			if (flush_chanbufs(o, *out) != SR_OK)
-				return SR_ERR;
+		num_frames = complete_frames(outc, &max_frames);
+		if (num_frames > 0) {
+			if (outc->fd < 0)
+				*out = g_string_sized_new(4 * num_frames * outc->num_channels);
+			if ((ret = flush_frames(o, num_frames, max_frames, *out)) != SR_OK)
+				return ret;
 		}
+		if (outc->fd >= 0 && outc->header_done)
+			patch_header(outc);
 		break;
 	}
 
@@ -334,13 +425,17 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 static struct sr_option options[] = {
 	{ "scale", "Scale", "Scale values by factor", NULL, NULL },
+	{ "fd", "File descriptor", "Write straight to this open file "
+		"descriptor instead of returning the data", NULL, NULL },
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
-	if (!options[0].def)
+	if (!options[0].def) {
 		options[0].def = g_variant_ref_sink(g_variant_new_double(1.0));
+		options[1].def = g_variant_ref_sink(g_variant_new_int32(-1));
+	}
 
 	return options;
 }
@@ -348,15 +443,12 @@ static const struct sr_option *get_options(void)
 static int cleanup(struct sr_output *o)
 {
 	struct out_context *outc;
-	int i;
 
 	outc = o->priv;
 	g_slist_free(outc->channels);
-	g_variant_unref(options[0].def);
-	for (i = 0; i < outc->num_channels; i++)
-		g_free(outc->chanbuf[i]);
+	g_free(outc->frames);
 	g_free(outc->chanbuf_used);
-	g_free(outc->chanbuf);
+	g_free(outc->chan_idx);
 	g_free(outc->fdata);
 	g_free(outc);
 	o->priv = NULL;
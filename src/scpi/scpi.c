@@ -813,10 +813,173 @@ SR_PRIV int sr_scpi_get_opc(struct sr_scpi_dev_inst *scpi)
 	return SR_ERR;
 }
 
+/*
+ * Exact powers of ten which are representable as doubles. Multiplying
+ * or dividing a mantissa of at most 2^53 by one of these yields the
+ * correctly rounded result (Clinger's fast path).
+ */
+static const double scpi_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Count the comma separated items in a SCPI response.
+ *
+ * @param str The response string.
+ *
+ * @return The number of items, 0 for an empty response.
+ */
+static size_t scpi_count_items(const char *str)
+{
+	size_t count;
+
+	if (!*str)
+		return 0;
+
+	count = 1;
+	while ((str = strchr(str, ',')))
+		count++, str++;
+
+	return count;
+}
+
+/**
+ * Parse a plain decimal number (with optional sign, fraction and
+ * exponent) which is terminated by a comma or by the end of the string.
+ *
+ * Only values that can be converted exactly by the fast path are
+ * handled here. Everything else is left to the caller's fallback, so
+ * that the result is identical to the result of g_ascii_strtod().
+ *
+ * @param str The number's text, must be followed by ',' or NUL.
+ * @param end The number's end (the comma or NUL).
+ * @param ret Pointer where to store the converted value.
+ *
+ * @return TRUE if the value was converted, FALSE if it needs the fallback.
+ */
+static gboolean scpi_parse_double_fast(const char *str, const char *end,
+		double *ret)
+{
+	uint64_t mantissa;
+	int digits, exponent, exp_value;
+	gboolean negative, exp_negative, seen_digit;
+	double value;
+
+	while (str < end && (*str == ' ' || *str == '\t'))
+		str++;
+
+	negative = FALSE;
+	if (str < end && (*str == '+' || *str == '-'))
+		negative = (*str++ == '-');
+
+	mantissa = 0;
+	digits = 0;
+	exponent = 0;
+	seen_digit = FALSE;
+	while (str < end && *str >= '0' && *str <= '9') {
+		seen_digit = TRUE;
+		if (mantissa || *str != '0') {
+			if (++digits > 19)
+				return FALSE;
+			mantissa = mantissa * 10 + (*str - '0');
+		}
+		str++;
+	}
+	if (str < end && *str == '.') {
+		str++;
+		while (str < end && *str >= '0' && *str <= '9') {
+			seen_digit = TRUE;
+			if (mantissa || *str != '0') {
+				if (++digits > 19)
+					return FALSE;
+				mantissa = mantissa * 10 + (*str - '0');
+			}
+			exponent--;
+			str++;
+		}
+	}
+	if (!seen_digit)
+		return FALSE;
+
+	if (str < end && (*str == 'e' || *str == 'E')) {
+		str++;
+		exp_negative = FALSE;
+		if (str < end && (*str == '+' || *str == '-'))
+			exp_negative = (*str++ == '-');
+		if (str == end || *str < '0' || *str > '9')
+			return FALSE;
+		exp_value = 0;
+		while (str < end && *str >= '0' && *str <= '9') {
+			if (exp_value > 1000)
+				return FALSE;
+			exp_value = exp_value * 10 + (*str++ - '0');
+		}
+		exponent += exp_negative ? -exp_value : exp_value;
+	}
+
+	if (str != end)
+		return FALSE;
+	if (mantissa > (UINT64_C(1) << 53))
+		return FALSE;
+	if (exponent < -22 || exponent > 22)
+		return FALSE;
+
+	value = (double)mantissa;
+	if (exponent < 0)
+		value /= scpi_pow10[-exponent];
+	else
+		value *= scpi_pow10[exponent];
+
+	*ret = negative ? -value : value;
+
+	return TRUE;
+}
+
+/**
+ * Parse a plain decimal integer which is terminated by a comma or by the
+ * end of the string.
+ *
+ * @param str The number's text, must be followed by ',' or NUL.
+ * @param end The number's end (the comma or NUL).
+ * @param ret Pointer where to store the converted value.
+ *
+ * @return TRUE if the value was converted, FALSE if it needs the fallback.
+ */
+static gboolean scpi_parse_int_fast(const char *str, const char *end, int *ret)
+{
+	int value;
+	gboolean negative;
+
+	while (str < end && (*str == ' ' || *str == '\t'))
+		str++;
+
+	negative = FALSE;
+	if (str < end && (*str == '+' || *str == '-'))
+		negative = (*str++ == '-');
+
+	if (str == end || end - str > 9)
+		return FALSE;
+
+	value = 0;
+	while (str < end) {
+		if (*str < '0' || *str > '9')
+			return FALSE;
+		value = value * 10 + (*str++ - '0');
+	}
+
+	*ret = negative ? -value : value;
+
+	return TRUE;
+}
+
 /**
  * Send a SCPI command, read the reply, parse it as comma separated list of
  * floats and store the as an result in scpi_response.
  *
+ * The response is parsed in a single pass and in place. Plain decimal
+ * values take a fast path, anything else gets handed to sr_atof_ascii().
+ *
  * @param scpi Previously initialised SCPI device structure.
  * @param command The SCPI command to send to the device (can be NULL).
  * @param scpi_response Pointer where to store the parsed result.
@@ -831,32 +994,43 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 {
 	int ret;
 	float tmp;
-	char *response;
-	gchar **ptr, **tokens;
+	double value;
+	char *response, *ptr, *end;
+	size_t count;
+	gboolean last;
 	GArray *response_array;
 
 	response = NULL;
-	tokens = NULL;
 
 	ret = sr_scpi_get_string(scpi, command, &response);
 	if (ret != SR_OK && !response)
 		return ret;
 
-	tokens = g_strsplit(response, ",", 0);
-	ptr = tokens;
-
-	response_array = g_array_sized_new(TRUE, FALSE, sizeof(float), 256);
-
-	while (*ptr) {
-		if (sr_atof_ascii(*ptr, &tmp) == SR_OK)
-			response_array = g_array_append_val(response_array,
-							    tmp);
-		else
-			ret = SR_ERR_DATA;
+	count = scpi_count_items(response);
+	response_array = g_array_sized_new(TRUE, FALSE, sizeof(float),
+		MAX(count, 1));
+
+	ptr = response;
+	last = (count == 0);
+	while (!last) {
+		end = strchr(ptr, ',');
+		if (!end)
+			end = ptr + strlen(ptr);
+		last = (*end == '\0');
+
+		if (scpi_parse_double_fast(ptr, end, &value)) {
+			tmp = (float)value;
+			g_array_append_val(response_array, tmp);
+		} else {
+			*end = '\0';
+			if (sr_atof_ascii(ptr, &tmp) == SR_OK)
+				g_array_append_val(response_array, tmp);
+			else
+				ret = SR_ERR_DATA;
+		}
 
-		ptr++;
+		ptr = end + 1;
 	}
-	g_strfreev(tokens);
 	g_free(response);
 
 	if (ret != SR_OK && response_array->len == 0) {
@@ -874,6 +1048,9 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
  * Send a SCPI command, read the reply, parse it as comma separated list of
  * unsigned 8 bit integers and store the as an result in scpi_response.
  *
+ * The response is parsed in a single pass and in place. Plain decimal
+ * values take a fast path, anything else gets handed to sr_atoi().
+ *
  * @param scpi Previously initialised SCPI device structure.
  * @param command The SCPI command to send to the device (can be NULL).
  * @param scpi_response Pointer where to store the parsed result.
@@ -887,32 +1064,43 @@ SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GArray **scpi_response)
 {
 	int tmp, ret;
-	char *response;
-	gchar **ptr, **tokens;
+	uint8_t value;
+	char *response, *ptr, *end;
+	size_t count;
+	gboolean last;
 	GArray *response_array;
 
 	response = NULL;
-	tokens = NULL;
 
 	ret = sr_scpi_get_string(scpi, command, &response);
 	if (ret != SR_OK && !response)
 		return ret;
 
-	tokens = g_strsplit(response, ",", 0);
-	ptr = tokens;
-
-	response_array = g_array_sized_new(TRUE, FALSE, sizeof(uint8_t), 256);
-
-	while (*ptr) {
-		if (sr_atoi(*ptr, &tmp) == SR_OK)
-			response_array = g_array_append_val(response_array,
-							    tmp);
-		else
-			ret = SR_ERR_DATA;
+	count = scpi_count_items(response);
+	response_array = g_array_sized_new(TRUE, FALSE, sizeof(uint8_t),
+		MAX(count, 1));
+
+	ptr = response;
+	last = (count == 0);
+	while (!last) {
+		end = strchr(ptr, ',');
+		if (!end)
+			end = ptr + strlen(ptr);
+		last = (*end == '\0');
+
+		if (!scpi_parse_int_fast(ptr, end, &tmp)) {
+			*end = '\0';
+			if (sr_atoi(ptr, &tmp) != SR_OK) {
+				ret = SR_ERR_DATA;
+				ptr = end + 1;
+				continue;
+			}
+		}
+		value = (uint8_t)tmp;
+		g_array_append_val(response_array, value);
 
-		ptr++;
+		ptr = end + 1;
 	}
-	g_strfreev(tokens);
 	g_free(response);
 
 	if (response_array->len == 0) {
@@ -926,9 +1114,113 @@ SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 	return ret;
 }
 
+/**
+ * Read into a caller provided buffer until at least a minimum number of
+ * bytes were received, or until an error or timeout occurs, without mutex.
+ *
+ * The receive call may return up to maxlen bytes, which lets callers
+ * consume trailing terminators along with the last chunk of a data block.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param buf Buffer to store the received data.
+ * @param minlen Minimum number of bytes to receive.
+ * @param maxlen Maximum number of bytes to receive (size of buf).
+ * @param timeout Absolute timeout in microseconds, gets updated upon
+ *                the reception of data.
+ *
+ * @return Number of bytes received on success, SR_ERR* on failure.
+ */
+static int scpi_read_block_data(struct sr_scpi_dev_inst *scpi,
+		uint8_t *buf, size_t minlen, size_t maxlen, gint64 *timeout)
+{
+	size_t pos, chunk;
+	int len;
+
+	pos = 0;
+	while (pos < minlen) {
+		chunk = MIN(maxlen - pos, G_MAXINT);
+		len = scpi_read_data(scpi, (char *)&buf[pos], chunk);
+		if (len < 0) {
+			sr_err("Incompletely read SCPI response.");
+			return SR_ERR;
+		}
+		if (len > 0) {
+			pos += len;
+			*timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+			continue;
+		}
+		if (g_get_monotonic_time() > *timeout) {
+			sr_err("Timed out waiting for SCPI response.");
+			return SR_ERR_TIMEOUT;
+		}
+	}
+
+	return pos;
+}
+
+/**
+ * Read the data of an "indefinite length block", which extends up to the
+ * end of the response, without mutex. The line terminator is not part of
+ * the data.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param block Pointer where to store the data.
+ * @param timeout Absolute timeout in microseconds, gets updated upon
+ *                the reception of data.
+ *
+ * @return SR_OK on success, SR_ERR* on failure.
+ */
+static int scpi_read_indefinite_block(struct sr_scpi_dev_inst *scpi,
+		GByteArray **block, gint64 *timeout)
+{
+	GByteArray *response;
+	guint oldlen;
+	int len;
+
+	response = g_byte_array_sized_new(4096);
+	while (!sr_scpi_read_complete(scpi)) {
+		if (response->len > G_MAXINT - 4096) {
+			sr_err("SCPI data block too large.");
+			g_byte_array_free(response, TRUE);
+			return SR_ERR_DATA;
+		}
+		oldlen = response->len;
+		g_byte_array_set_size(response, oldlen + 4096);
+		len = scpi_read_data(scpi, (char *)&response->data[oldlen], 4096);
+		g_byte_array_set_size(response, oldlen + MAX(len, 0));
+		if (len < 0) {
+			sr_err("Incompletely read SCPI response.");
+			g_byte_array_free(response, TRUE);
+			return SR_ERR;
+		}
+		if (len > 0) {
+			*timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+			continue;
+		}
+		if (g_get_monotonic_time() > *timeout) {
+			sr_err("Timed out waiting for SCPI response.");
+			g_byte_array_free(response, TRUE);
+			return SR_ERR_TIMEOUT;
+		}
+	}
+
+	if (response->len && response->data[response->len - 1] == '\n')
+		g_byte_array_set_size(response, response->len - 1);
+	*block = response;
+
+	return SR_OK;
+}
+
 /**
  * Send a SCPI command, read the reply, parse it as binary data with a
  * "definite length block" header and store the as an result in scpi_response.
+ * An "indefinite length block" ("#0" header) is accepted as well, its data
+ * extends up to the end of the response.
+ *
+ * The header gets read first, the response buffer is then allocated at
+ * its final size, and the payload is received directly into it. Large
+ * blocks thus get transferred with few large reads and without copying
+ * or re-allocating the data that was already received.
  *
  * @param scpi Previously initialised SCPI device structure.
  * @param command The SCPI command to send to the device (can be NULL).
@@ -943,12 +1235,15 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GByteArray **scpi_response)
 {
 	int ret;
-	GString* response;
+	uint8_t header[2 + 9];
 	char buf[10];
 	long llen;
 	long datalen;
+	GByteArray *response;
 	gint64 timeout;
 
+	*scpi_response = NULL;
+
 	g_mutex_lock(&scpi->scpi_mutex);
 
 	if (command)
@@ -962,26 +1257,8 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 		return SR_ERR;
 	}
 
-	/*
-	 * Assume an initial maximum length, optionally gets adjusted below.
-	 * Prepare a NULL return value for when error paths will be taken.
-	 */
-	response = g_string_sized_new(1024);
-
 	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
 
-	*scpi_response = NULL;
-
-	/* Get (the first chunk of) the response. */
-	while (response->len < 2) {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
-			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
-		}
-	}
-
 	/*
 	 * SCPI protocol data blocks are preceeded with a length spec.
 	 * The length spec consists of a '#' marker, one digit which
@@ -990,69 +1267,65 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 	 * length. Raw data bytes follow (thus one must no longer assume
 	 * that the received input stream would be an ASCIIZ string).
 	 *
-	 * Get the data block length, and strip off the length spec from
-	 * the input buffer, leaving just the data bytes.
+	 * Read exactly the length spec, so that all data bytes can get
+	 * received into their final location.
 	 */
-	if (response->str[0] != '#') {
+	ret = scpi_read_block_data(scpi, header, 2, 2, &timeout);
+	if (ret < 0) {
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return ret;
+	}
+	if (header[0] != '#') {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
 		return SR_ERR_DATA;
 	}
-	buf[0] = response->str[1];
+	buf[0] = header[1];
 	buf[1] = '\0';
 	ret = sr_atol(buf, &llen);
-	if ((ret != SR_OK) || (llen == 0)) {
+	if (ret != SR_OK) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
 		return ret;
 	}
-
-	while (response->len < (unsigned long)(2 + llen)) {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
-			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
-		}
+	if (llen == 0) {
+		/* "#0" starts an indefinite length block. */
+		ret = scpi_read_indefinite_block(scpi, scpi_response, &timeout);
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return ret;
 	}
 
-	memcpy(buf, &response->str[2], llen);
+	ret = scpi_read_block_data(scpi, &header[2], llen, llen, &timeout);
+	if (ret < 0) {
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return ret;
+	}
+	memcpy(buf, &header[2], llen);
 	buf[llen] = '\0';
 	ret = sr_atol(buf, &datalen);
-	if ((ret != SR_OK) || (datalen == 0)) {
+	if ((ret != SR_OK) || (datalen <= 0) || (datalen > G_MAXINT)) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
-		return ret;
+		return (ret != SR_OK) ? ret : SR_ERR_DATA;
 	}
-	g_string_erase(response, 0, 2 + llen);
 
 	/*
-	 * If the initially assumed length does not cover the data block
-	 * length, then re-allocate the buffer size to the now known
-	 * length, and keep reading more chunks of response data.
+	 * Allocate the complete data block plus room for a line
+	 * terminator. Allowing the last read to include the terminator
+	 * keeps it from lingering in the input stream.
 	 */
-	if (response->len < (unsigned long)(datalen)) {
-		int oldlen = response->len;
-		g_string_set_size(response, datalen);
-		g_string_set_size(response, oldlen);
-	}
+	response = g_byte_array_sized_new(datalen + 2);
+	g_byte_array_set_size(response, datalen + 2);
 
-	while (response->len < (unsigned long)(datalen)) {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
-			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
-		}
-		if (ret > 0)
-			timeout = g_get_monotonic_time() + scpi->read_timeout_us;
-	}
+	ret = scpi_read_block_data(scpi, response->data, datalen,
+		datalen + 2, &timeout);
 
 	g_mutex_unlock(&scpi->scpi_mutex);
 
-	/* Convert received data to byte array. */
-	*scpi_response = g_byte_array_new_take(
-		(guint8*)g_string_free(response, FALSE), datalen);
+	if (ret < 0) {
+		g_byte_array_free(response, TRUE);
+		return ret;
+	}
+
+	g_byte_array_set_size(response, datalen);
+	*scpi_response = response;
 
 	return SR_OK;
 }
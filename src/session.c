@@ -25,6 +25,9 @@
 #include <unistd.h>
 #include <string.h>
 #include <glib.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -49,6 +52,24 @@
 struct datafeed_callback {
 	sr_datafeed_callback cb;
 	void *cb_data;
+	/* Whether the callback accepts SR_DF_LOGIC_RLE packets. */
+	gboolean logic_rle;
+	/* Whether the callback accepts SR_DF_LOGIC_PLANAR packets. */
+	gboolean logic_planar;
+	/* Registration ID for the pipeline statistics. */
+	unsigned int stats_id;
+};
+
+/* Maximum size of the SR_DF_LOGIC chunks expanded from SR_DF_LOGIC_RLE. */
+#define LOGIC_RLE_EXPAND_SIZE (1024 * 1024)
+
+/** Pipeline statistics of a session stage.
+ * @internal
+ */
+struct session_stats {
+	/* Registration ID of the stage, see sr_session_stats_id_new(). */
+	unsigned int id;
+	struct sr_session_stats stats;
 };
 
 /** Custom GLib event source for generic descriptor I/O.
@@ -64,10 +85,176 @@ struct fd_source {
 	/* Meta-data needed to keep track of installed sources */
 	struct sr_session *session;
 	void *key;
+	/* Registration ID for the pipeline statistics. */
+	unsigned int stats_id;
+
+	GPollFD pollfd;
+
+	/* Fields used only if the source is driven by the I/O reactor. */
+	gboolean attached;
+	struct reactor *reactor;
+	sr_receive_data_callback cb;
+	void *cb_data;
+	/* Link into the timer wheel slot, if a timeout is scheduled. */
+	GList wheel_link;
+	gboolean scheduled;
+	/* Whether the source is queued for dispatch. */
+	gboolean ready;
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/* Number of timer wheel slots, each covering 1ms. */
+#define REACTOR_WHEEL_SLOTS 1024
+/* Maximum number of events fetched per epoll_wait() call. */
+#define REACTOR_MAX_EVENTS 64
+
+/** Session-wide I/O reactor.
+ *
+ * Multiplexes the file descriptors of many fd sources through one epoll
+ * instance, which is the only descriptor polled by the GLib main loop,
+ * and keeps their timeouts on a timer wheel.
+ * @internal
+ */
+struct reactor {
+	GSource base;
 
+	struct sr_session *session;
+	/* The epoll descriptor, as polled by the main loop. */
 	GPollFD pollfd;
+	/* Registered fd sources, and the number of those with a timeout. */
+	unsigned int num_sources;
+	unsigned int num_timed;
+	/* Maps file descriptors to the fd source registered for them. */
+	GHashTable *fds;
+	/* Last processed timer wheel tick [ms], and the next due time. */
+	int64_t wheel_ms;
+	int64_t next_due_us;
+	GQueue wheel[REACTOR_WHEEL_SLOTS];
 };
 
+#endif
+
+/**
+ * Get a new registration ID for a pipeline stage.
+ *
+ * Statistics are accounted per ID, so a stage which is registered anew
+ * gets its own entry, even if it reuses the memory of an earlier one.
+ *
+ * @param session The session the stage belongs to.
+ *
+ * @return The ID, unique within the session.
+ *
+ * @private
+ */
+SR_PRIV unsigned int sr_session_stats_id_new(struct sr_session *session)
+{
+	return g_atomic_int_add(&session->stats_last_id, 1) + 1;
+}
+
+/** Account one invocation of a pipeline stage.
+ *
+ * The stage's name is its kind, followed by the address of its callback
+ * (identity) if given. It is only formatted when the stage is seen first.
+ * @internal
+ */
+static void session_stats_update(struct sr_session *session, unsigned int id,
+		int stage, const char *name, const void *identity,
+		const struct sr_datafeed_packet *packet, uint64_t bytes,
+		int64_t start_us)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
+	const struct sr_datafeed_analog *analog;
+	struct session_stats *entry;
+	struct sr_session_stats *stats;
+	GSList *l;
+	uint64_t elapsed_us;
+	unsigned int bucket;
+
+	elapsed_us = MAX(g_get_monotonic_time() - start_us, 0);
+
+	g_mutex_lock(&session->stats_mutex);
+
+	entry = NULL;
+	for (l = session->stats; l; l = l->next) {
+		entry = l->data;
+		if (entry->id == id)
+			break;
+	}
+	if (!l) {
+		entry = g_malloc0(sizeof(*entry));
+		entry->id = id;
+		entry->stats.stage = stage;
+		entry->stats.id = id;
+		entry->stats.name = identity
+			? g_strdup_printf("%s %p", name, identity)
+			: g_strdup(name);
+		session->stats = g_slist_append(session->stats, entry);
+	}
+	stats = &entry->stats;
+
+	stats->bytes += bytes;
+	if (packet && packet->type >= SR_DF_HEADER
+			&& packet->type < SR_DF_HEADER + SR_STATS_PACKET_TYPES) {
+		stats->packets[packet->type - SR_DF_HEADER]++;
+		if (packet->type == SR_DF_LOGIC) {
+			logic = packet->payload;
+			stats->bytes += logic->length;
+		} else if (packet->type == SR_DF_ANALOG) {
+			analog = packet->payload;
+			stats->bytes += (uint64_t)analog->num_samples
+				* analog->encoding->unitsize;
+		} else if (packet->type == SR_DF_LOGIC_RLE) {
+			rle = packet->payload;
+			stats->bytes += rle->num_runs
+				* (rle->unitsize + sizeof(uint64_t));
+		} else if (packet->type == SR_DF_LOGIC_PLANAR) {
+			planar = packet->payload;
+			stats->bytes += planar->num_planes
+				* ((planar->num_samples + 7) / 8);
+		}
+	}
+
+	stats->calls++;
+	stats->total_us += elapsed_us;
+	stats->max_us = MAX(stats->max_us, elapsed_us);
+	bucket = elapsed_us ? g_bit_storage(elapsed_us) : 0;
+	stats->latency[MIN(bucket, SR_STATS_LATENCY_BUCKETS - 1)]++;
+
+	g_mutex_unlock(&session->stats_mutex);
+}
+
+/**
+ * Account one USB transfer of a streaming acquisition.
+ *
+ * @param session The session the acquisition belongs to.
+ * @param id The stream's registration ID, see sr_session_stats_id_new().
+ * @param bytes The number of bytes transferred.
+ * @param submit_us Monotonic time of the transfer's submission.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_stats_usb_transfer(struct sr_session *session,
+		unsigned int id, uint64_t bytes, int64_t submit_us)
+{
+	if (!session || !g_atomic_int_get(&session->stats_enabled))
+		return;
+
+	session_stats_update(session, id, SR_STATS_USB_TRANSFER, "usb",
+		NULL, NULL, bytes, submit_us);
+}
+
+static void session_stats_free(void *data)
+{
+	struct session_stats *entry;
+
+	entry = data;
+	g_free(entry->stats.name);
+	g_free(entry);
+}
+
 /** FD event source prepare() method.
  * This is called immediately before poll().
  */
@@ -110,6 +297,25 @@ static gboolean fd_source_check(GSource *source)
 			&& fsource->due_us <= g_source_get_time(source)));
 }
 
+/** Run the callback of an FD event source. */
+static gboolean fd_source_call(struct fd_source *fsource,
+		sr_receive_data_callback cb, void *cb_data, unsigned int revents)
+{
+	gboolean keep;
+	int64_t start_us;
+
+	start_us = g_atomic_int_get(&fsource->session->stats_enabled)
+		? g_get_monotonic_time() : 0;
+	keep = cb(fsource->pollfd.fd, revents, cb_data);
+	if (start_us)
+		session_stats_update(fsource->session, fsource->stats_id,
+			SR_STATS_EVENT_SOURCE,
+			(fsource->pollfd.fd < 0) ? "timer" : "fd", (void *)cb,
+			NULL, 0, start_us);
+
+	return keep;
+}
+
 /** FD event source dispatch() method.
  * This is called if either prepare() or check() returned TRUE.
  */
@@ -127,8 +333,8 @@ static gboolean fd_source_dispatch(GSource *source,
 		sr_err("Callback not set, cannot dispatch event.");
 		return G_SOURCE_REMOVE;
 	}
-	keep = (*(sr_receive_data_callback)callback)
-			(fsource->pollfd.fd, revents, user_data);
+	keep = fd_source_call(fsource, (sr_receive_data_callback)callback,
+			user_data, revents);
 
 	if (fsource->timeout_us >= 0 && G_LIKELY(keep)
 			&& G_LIKELY(!g_source_is_destroyed(source)))
@@ -198,6 +404,455 @@ static GSource *fd_source_new(struct sr_session *session, void *key,
 	return source;
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+
+static unsigned int session_source_attach(struct sr_session *session,
+		GSource *source);
+
+static uint32_t gio_to_epoll(unsigned int events)
+{
+	uint32_t epoll_events;
+
+	epoll_events = 0;
+	if (events & G_IO_IN)
+		epoll_events |= EPOLLIN;
+	if (events & G_IO_PRI)
+		epoll_events |= EPOLLPRI;
+	if (events & G_IO_OUT)
+		epoll_events |= EPOLLOUT;
+
+	return epoll_events;
+}
+
+static unsigned int epoll_to_gio(uint32_t epoll_events)
+{
+	unsigned int events;
+
+	events = 0;
+	if (epoll_events & EPOLLIN)
+		events |= G_IO_IN;
+	if (epoll_events & EPOLLPRI)
+		events |= G_IO_PRI;
+	if (epoll_events & EPOLLOUT)
+		events |= G_IO_OUT;
+	if (epoll_events & EPOLLERR)
+		events |= G_IO_ERR;
+	if (epoll_events & EPOLLHUP)
+		events |= G_IO_HUP;
+
+	return events;
+}
+
+/** Put an fd source on the timer wheel, due at fsource->due_us. */
+static void reactor_schedule(struct reactor *reactor,
+		struct fd_source *fsource)
+{
+	unsigned int slot;
+
+	slot = (fsource->due_us / 1000) % REACTOR_WHEEL_SLOTS;
+	fsource->wheel_link.data = fsource;
+	g_queue_push_tail_link(&reactor->wheel[slot], &fsource->wheel_link);
+	fsource->scheduled = TRUE;
+	reactor->num_timed++;
+	reactor->next_due_us = MIN(reactor->next_due_us, fsource->due_us);
+}
+
+static void reactor_unschedule(struct reactor *reactor,
+		struct fd_source *fsource)
+{
+	unsigned int slot;
+
+	if (!fsource->scheduled)
+		return;
+
+	slot = (fsource->due_us / 1000) % REACTOR_WHEEL_SLOTS;
+	g_queue_unlink(&reactor->wheel[slot], &fsource->wheel_link);
+	fsource->scheduled = FALSE;
+	reactor->num_timed--;
+}
+
+/** Find the earliest due time on the timer wheel. */
+static int64_t reactor_next_due(struct reactor *reactor, int64_t now_us)
+{
+	struct fd_source *fsource;
+	GList *l;
+	int64_t now_ms, limit_us, due_us;
+	unsigned int i;
+
+	if (!reactor->num_timed)
+		return INT64_MAX;
+
+	/*
+	 * Slots hold the sources of all wheel revolutions, so only the
+	 * ones due within the tick of the slot count. Nothing found within
+	 * one revolution means the next due time is at least that far out.
+	 */
+	now_ms = now_us / 1000;
+	due_us = INT64_MAX;
+	for (i = 0; i < REACTOR_WHEEL_SLOTS; i++) {
+		limit_us = (now_ms + i + 1) * 1000;
+		l = reactor->wheel[(now_ms + i) % REACTOR_WHEEL_SLOTS].head;
+		for (; l; l = l->next) {
+			fsource = l->data;
+			if (fsource->due_us < limit_us)
+				due_us = MIN(due_us, fsource->due_us);
+		}
+		if (due_us != INT64_MAX)
+			return due_us;
+	}
+
+	return (now_ms + REACTOR_WHEEL_SLOTS) * 1000;
+}
+
+static gboolean reactor_prepare(GSource *source, int *timeout)
+{
+	struct reactor *reactor;
+	int64_t now_us;
+
+	reactor = (struct reactor *)source;
+
+	if (!reactor->num_timed) {
+		reactor->next_due_us = INT64_MAX;
+		*timeout = -1;
+		return FALSE;
+	}
+
+	now_us = g_source_get_time(source);
+	reactor->next_due_us = reactor_next_due(reactor, now_us);
+	*timeout = (MAX(0, reactor->next_due_us - now_us) + 999) / 1000;
+
+	return (*timeout == 0);
+}
+
+static gboolean reactor_check(GSource *source)
+{
+	struct reactor *reactor;
+
+	reactor = (struct reactor *)source;
+
+	return (reactor->pollfd.revents != 0
+		|| reactor->next_due_us <= g_source_get_time(source));
+}
+
+static void reactor_queue(GPtrArray *ready, struct fd_source *fsource,
+		unsigned int revents)
+{
+	if (!fsource->ready) {
+		fsource->ready = TRUE;
+		fsource->pollfd.revents = 0;
+		g_ptr_array_add(ready, g_source_ref(&fsource->base));
+	}
+	fsource->pollfd.revents |= revents;
+}
+
+static void reactor_detach(struct fd_source *fsource);
+
+static gboolean reactor_dispatch(GSource *source,
+		GSourceFunc callback, void *user_data)
+{
+	struct reactor *reactor;
+	struct fd_source *fsource;
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	GPtrArray *ready;
+	GList *l, *next;
+	int64_t now_us, now_ms, tick;
+	unsigned int i;
+	int num_events;
+
+	(void)callback;
+	(void)user_data;
+
+	reactor = (struct reactor *)source;
+	ready = g_ptr_array_new();
+	now_us = g_source_get_time(source);
+
+	/* Collect the sources with I/O events. */
+	if (reactor->pollfd.revents) {
+		num_events = epoll_wait(reactor->pollfd.fd, events,
+				REACTOR_MAX_EVENTS, 0);
+		for (i = 0; (int)i < num_events; i++)
+			reactor_queue(ready, events[i].data.ptr,
+				epoll_to_gio(events[i].events));
+	}
+
+	/* Collect the sources whose timeout expired since the last run. */
+	now_ms = now_us / 1000;
+	tick = MAX(reactor->wheel_ms, now_ms - REACTOR_WHEEL_SLOTS + 1);
+	for (; reactor->num_timed && tick <= now_ms; tick++) {
+		l = reactor->wheel[tick % REACTOR_WHEEL_SLOTS].head;
+		for (; l; l = next) {
+			next = l->next;
+			fsource = l->data;
+			if (fsource->due_us > now_us)
+				continue;
+			reactor_unschedule(reactor, fsource);
+			reactor_queue(ready, fsource, 0);
+		}
+	}
+	reactor->wheel_ms = now_ms;
+
+	for (i = 0; i < ready->len; i++) {
+		fsource = g_ptr_array_index(ready, i);
+		fsource->ready = FALSE;
+		if (g_source_is_destroyed(&fsource->base)) {
+			g_source_unref(&fsource->base);
+			continue;
+		}
+		if (fsource->reactor)
+			reactor_unschedule(fsource->reactor, fsource);
+
+		if (fd_source_call(fsource, fsource->cb, fsource->cb_data,
+				fsource->pollfd.revents)) {
+			/* The callback may have removed its own source. */
+			if (fsource->reactor && fsource->timeout_us >= 0
+					&& !fsource->scheduled
+					&& !g_source_is_destroyed(&fsource->base)) {
+				fsource->due_us = g_get_monotonic_time()
+						+ fsource->timeout_us;
+				reactor_schedule(fsource->reactor, fsource);
+			}
+		} else if (!g_source_is_destroyed(&fsource->base)) {
+			reactor_detach(fsource);
+			g_source_destroy(&fsource->base);
+		}
+		g_source_unref(&fsource->base);
+	}
+	g_ptr_array_free(ready, TRUE);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void reactor_finalize(GSource *source)
+{
+	struct reactor *reactor;
+
+	reactor = (struct reactor *)source;
+
+	if (reactor->session->reactor == source)
+		reactor->session->reactor = NULL;
+	g_hash_table_unref(reactor->fds);
+	close(reactor->pollfd.fd);
+}
+
+/** Get the session's reactor, creating it if necessary. */
+static struct reactor *reactor_get(struct sr_session *session)
+{
+	static GSourceFuncs reactor_funcs = {
+		.prepare  = &reactor_prepare,
+		.check    = &reactor_check,
+		.dispatch = &reactor_dispatch,
+		.finalize = &reactor_finalize,
+	};
+	GSource *source;
+	struct reactor *reactor;
+	unsigned int i;
+	int epfd;
+
+	if (session->reactor)
+		return (struct reactor *)session->reactor;
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		sr_err("Failed to create epoll instance: %s.",
+			g_strerror(errno));
+		return NULL;
+	}
+
+	source = g_source_new(&reactor_funcs, sizeof(struct reactor));
+	g_source_set_name(source, "reactor");
+	reactor = (struct reactor *)source;
+	reactor->session = session;
+	reactor->fds = g_hash_table_new(NULL, NULL);
+	reactor->wheel_ms = g_get_monotonic_time() / 1000;
+	reactor->next_due_us = INT64_MAX;
+	for (i = 0; i < REACTOR_WHEEL_SLOTS; i++)
+		g_queue_init(&reactor->wheel[i]);
+	reactor->pollfd.fd = epfd;
+	reactor->pollfd.events = G_IO_IN;
+	g_source_add_poll(source, &reactor->pollfd);
+
+	session->reactor = source;
+	if (session_source_attach(session, source) == 0) {
+		session->reactor = NULL;
+		g_source_unref(source);
+		return NULL;
+	}
+	g_source_unref(source);
+
+	return reactor;
+}
+
+/** Remove an fd source from its reactor. */
+static void reactor_detach(struct fd_source *fsource)
+{
+	struct reactor *reactor;
+	gpointer fd_key;
+
+	if (!(reactor = fsource->reactor))
+		return;
+	fsource->reactor = NULL;
+
+	reactor_unschedule(reactor, fsource);
+
+	/*
+	 * The descriptor may have been re-registered for another source
+	 * after having been closed and reused. Leave that one alone.
+	 */
+	fd_key = GINT_TO_POINTER(fsource->pollfd.fd);
+	if (fsource->pollfd.fd >= 0
+			&& g_hash_table_lookup(reactor->fds, fd_key) == fsource) {
+		g_hash_table_remove(reactor->fds, fd_key);
+		epoll_ctl(reactor->pollfd.fd, EPOLL_CTL_DEL,
+			fsource->pollfd.fd, NULL);
+	}
+
+	if (--reactor->num_sources == 0) {
+		if (reactor->session->reactor == &reactor->base)
+			reactor->session->reactor = NULL;
+		g_source_destroy(&reactor->base);
+	}
+}
+
+/** Register an fd source with the session's reactor. */
+static int reactor_attach(struct sr_session *session,
+		struct fd_source *fsource)
+{
+	struct reactor *reactor;
+	struct fd_source *previous;
+	struct epoll_event event;
+	gpointer fd_key;
+	int op;
+
+	if (!(reactor = reactor_get(session)))
+		return SR_ERR;
+
+	if (fsource->pollfd.fd >= 0) {
+		fd_key = GINT_TO_POINTER(fsource->pollfd.fd);
+		previous = g_hash_table_lookup(reactor->fds, fd_key);
+		if (previous && !g_source_is_destroyed(&previous->base))
+			return SR_ERR; /* Shared descriptor, poll it directly. */
+
+		memset(&event, 0, sizeof(event));
+		event.events = gio_to_epoll(fsource->pollfd.events);
+		event.data.ptr = fsource;
+		op = previous ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		if (epoll_ctl(reactor->pollfd.fd, op, fsource->pollfd.fd,
+				&event) < 0 && (op == EPOLL_CTL_ADD
+				|| epoll_ctl(reactor->pollfd.fd, EPOLL_CTL_ADD,
+					fsource->pollfd.fd, &event) < 0)) {
+			/* E.g. regular files, which epoll doesn't support. */
+			sr_dbg("Cannot use reactor for fd %d: %s.",
+				fsource->pollfd.fd, g_strerror(errno));
+			if (!reactor->num_sources) {
+				session->reactor = NULL;
+				g_source_destroy(&reactor->base);
+			}
+			return SR_ERR;
+		}
+		g_hash_table_insert(reactor->fds, fd_key, fsource);
+	}
+
+	fsource->reactor = reactor;
+	reactor->num_sources++;
+	if (fsource->timeout_us >= 0) {
+		fsource->due_us = g_get_monotonic_time() + fsource->timeout_us;
+		reactor_schedule(reactor, fsource);
+	}
+
+	return SR_OK;
+}
+
+/** Reactor-driven FD event source prepare() method.
+ * The reactor polls and dispatches the source, the main loop never does.
+ */
+static gboolean reactor_source_prepare(GSource *source, int *timeout)
+{
+	(void)source;
+
+	*timeout = -1;
+
+	return FALSE;
+}
+
+static gboolean reactor_source_check(GSource *source)
+{
+	(void)source;
+
+	return FALSE;
+}
+
+static gboolean reactor_source_dispatch(GSource *source,
+		GSourceFunc callback, void *user_data)
+{
+	(void)source;
+	(void)callback;
+	(void)user_data;
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void reactor_source_finalize(GSource *source)
+{
+	/* Never registered if the reactor couldn't take the source. */
+	if (!((struct fd_source *)source)->attached)
+		return;
+	reactor_detach((struct fd_source *)source);
+	fd_source_finalize(source);
+}
+
+#endif
+
+/** Create an event source driven by the session's I/O reactor.
+ *
+ * @return A new event source object, or NULL if the reactor cannot
+ *         handle the descriptor.
+ */
+static GSource *reactor_source_new(struct sr_session *session, void *key,
+		gintptr fd, int events, int timeout_ms,
+		sr_receive_data_callback cb, void *cb_data)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	static GSourceFuncs reactor_source_funcs = {
+		.prepare  = &reactor_source_prepare,
+		.check    = &reactor_source_check,
+		.dispatch = &reactor_source_dispatch,
+		.finalize = &reactor_source_finalize
+	};
+	GSource *source;
+	struct fd_source *fsource;
+
+	source = g_source_new(&reactor_source_funcs, sizeof(struct fd_source));
+	fsource = (struct fd_source *)source;
+
+	g_source_set_name(source, (fd < 0) ? "timer" : "fd");
+
+	fsource->timeout_us = (timeout_ms >= 0) ? 1000 * (int64_t)timeout_ms : -1;
+	fsource->session = session;
+	fsource->key = key;
+	fsource->pollfd.fd = fd;
+	fsource->pollfd.events = events;
+	fsource->cb = cb;
+	fsource->cb_data = cb_data;
+
+	if (reactor_attach(session, fsource) != SR_OK) {
+		g_source_unref(source);
+		return NULL;
+	}
+	fsource->attached = TRUE;
+
+	return source;
+#else
+	(void)session;
+	(void)key;
+	(void)fd;
+	(void)events;
+	(void)timeout_ms;
+	(void)cb;
+	(void)cb_data;
+
+	return NULL;
+#endif
+}
+
 /**
  * Create a new session.
  *
@@ -224,6 +879,7 @@ SR_API int sr_session_new(struct sr_context *ctx,
 	session->ctx = ctx;
 
 	g_mutex_init(&session->main_mutex);
+	g_mutex_init(&session->stats_mutex);
 
 	/* To maintain API compatibility, we need a lookup table
 	 * which maps poll_object IDs to GSource* pointers.
@@ -262,6 +918,10 @@ SR_API int sr_session_destroy(struct sr_session *session)
 
 	g_mutex_clear(&session->main_mutex);
 
+	g_slist_free_full(session->stats, session_stats_free);
+	g_mutex_clear(&session->stats_mutex);
+
+	g_free(session->planar_buf);
 	g_free(session);
 
 	return SR_OK;
@@ -293,6 +953,7 @@ SR_API int sr_session_dev_remove_all(struct sr_session *session)
 	for (l = session->devs; l; l = l->next) {
 		sdi = (struct sr_dev_inst *) l->data;
 		sdi->session = NULL;
+		sr_sw_limits_session_end(sdi);
 	}
 
 	g_slist_free(session->devs);
@@ -439,6 +1100,7 @@ SR_API int sr_session_dev_remove(struct sr_session *session,
 
 	session->devs = g_slist_remove(session->devs, sdi);
 	sdi->session = NULL;
+	sr_sw_limits_session_end(sdi);
 
 	return SR_OK;
 }
@@ -497,6 +1159,7 @@ SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 	cb_struct = g_malloc0(sizeof(struct datafeed_callback));
 	cb_struct->cb = cb;
 	cb_struct->cb_data = cb_data;
+	cb_struct->stats_id = sr_session_stats_id_new(session);
 
 	session->datafeed_callbacks =
 	    g_slist_append(session->datafeed_callbacks, cb_struct);
@@ -505,33 +1168,97 @@ SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 }
 
 /**
- * Get the trigger assigned to this session.
+ * Add a datafeed callback which accepts run-length encoded logic data.
  *
- * @param session The session to use.
+ * Other than callbacks added with sr_session_datafeed_callback_add(),
+ * this callback receives SR_DF_LOGIC_RLE packets as sent by the driver,
+ * instead of the SR_DF_LOGIC packets expanded from them.
  *
- * @retval NULL Invalid (NULL) session was passed to the function.
- * @retval other The trigger assigned to this session (can be NULL).
+ * @param session The session to use. Must not be NULL.
+ * @param cb Function to call when a chunk of data is received.
+ *           Must not be NULL.
+ * @param cb_data Opaque pointer passed in by the caller.
  *
- * @since 0.4.0
+ * @retval SR_OK Success.
+ * @retval SR_ERR_BUG No session exists.
+ *
+ * @since 0.6.0
  */
-SR_API struct sr_trigger *sr_session_trigger_get(struct sr_session *session)
+SR_API int sr_session_datafeed_callback_add_rle(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data)
 {
-	if (!session)
-		return NULL;
+	struct datafeed_callback *cb_struct;
+	int ret;
 
-	return session->trigger;
+	if ((ret = sr_session_datafeed_callback_add(session, cb, cb_data)) != SR_OK)
+		return ret;
+
+	cb_struct = g_slist_last(session->datafeed_callbacks)->data;
+	cb_struct->logic_rle = TRUE;
+
+	return SR_OK;
 }
 
 /**
- * Set the trigger of this session.
+ * Add a datafeed callback which accepts planar logic data.
+ *
+ * Other than callbacks added with sr_session_datafeed_callback_add(),
+ * this callback receives SR_DF_LOGIC_PLANAR packets as sent by the
+ * driver, instead of the SR_DF_LOGIC packets converted from them.
  *
  * @param session The session to use. Must not be NULL.
- * @param trig The trigger to assign to this session. Can be NULL.
+ * @param cb Function to call when a chunk of data is received.
+ *           Must not be NULL.
+ * @param cb_data Opaque pointer passed in by the caller.
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_BUG No session exists.
  *
- * @since 0.4.0
+ * @since 0.6.0
+ */
+SR_API int sr_session_datafeed_callback_add_planar(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data)
+{
+	struct datafeed_callback *cb_struct;
+	int ret;
+
+	if ((ret = sr_session_datafeed_callback_add(session, cb, cb_data)) != SR_OK)
+		return ret;
+
+	cb_struct = g_slist_last(session->datafeed_callbacks)->data;
+	cb_struct->logic_planar = TRUE;
+
+	return SR_OK;
+}
+
+/**
+ * Get the trigger assigned to this session.
+ *
+ * @param session The session to use.
+ *
+ * @retval NULL Invalid (NULL) session was passed to the function.
+ * @retval other The trigger assigned to this session (can be NULL).
+ *
+ * @since 0.4.0
+ */
+SR_API struct sr_trigger *sr_session_trigger_get(struct sr_session *session)
+{
+	if (!session)
+		return NULL;
+
+	return session->trigger;
+}
+
+/**
+ * Set the trigger of this session.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param trig The trigger to assign to this session. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.4.0
  */
 SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger *trig)
 {
@@ -1034,6 +1761,8 @@ static void datafeed_dump(const struct sr_datafeed_packet *packet)
 {
 	const struct sr_datafeed_logic *logic;
 	const struct sr_datafeed_analog *analog;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
 
 	/* Please use the same order as in libsigrok.h. */
 	switch (packet->type) {
@@ -1065,49 +1794,85 @@ static void datafeed_dump(const struct sr_datafeed_packet *packet)
 		sr_dbg("bus: Received SR_DF_ANALOG packet (%d samples).",
 		       analog->num_samples);
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC_RLE packet (%" PRIu64 " runs, "
+		       "unitsize = %d).", rle->num_runs, rle->unitsize);
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC_PLANAR packet (%" PRIu64
+		       " samples, %d planes).", planar->num_samples,
+		       planar->num_planes);
+		break;
 	default:
 		sr_dbg("bus: Received unknown packet type: %d.", packet->type);
 		break;
 	}
 }
 
+/* Whether a datafeed callback accepts packets of the given type as is. */
+static gboolean datafeed_callback_accepts(const struct datafeed_callback *cb_struct,
+		int type)
+{
+	if (type == SR_DF_LOGIC_RLE)
+		return cb_struct->logic_rle;
+	if (type == SR_DF_LOGIC_PLANAR)
+		return cb_struct->logic_planar;
+
+	return TRUE;
+}
+
 /**
- * Send a packet to whatever is listening on the datafeed bus.
- *
- * Hardware drivers use this to send a data packet to the frontend.
- *
- * @param sdi TODO.
- * @param packet The datafeed packet to send to the session bus.
- *
- * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid argument.
- *
- * @private
+ * Pass a packet to the session's datafeed callbacks.
+ *
+ * @param sdi The device instance which sent the packet.
+ * @param packet The packet to pass. SR_DF_LOGIC_RLE and SR_DF_LOGIC_PLANAR
+ *               packets are only passed to the callbacks which accept them.
+ * @param source_type The type of the packet this one was converted from,
+ *                    or 0. Converted packets are only passed to the
+ *                    callbacks which don't accept the original.
  */
-SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
+static void datafeed_callbacks_run(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, int source_type)
+{
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+	int64_t start_us;
+
+	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (source_type && datafeed_callback_accepts(cb_struct, source_type))
+			continue;
+		if (!datafeed_callback_accepts(cb_struct, packet->type))
+			continue;
+		if (sr_log_loglevel_get() >= SR_LOG_DBG)
+			datafeed_dump(packet);
+		start_us = g_atomic_int_get(&sdi->session->stats_enabled)
+			? g_get_monotonic_time() : 0;
+		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+		if (start_us)
+			session_stats_update(sdi->session, cb_struct->stats_id,
+				SR_STATS_DATAFEED_CALLBACK, "datafeed",
+				(void *)cb_struct->cb, packet, 0, start_us);
+	}
+}
+
+static int session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet)
 {
 	GSList *l;
 	struct datafeed_callback *cb_struct;
 	struct sr_datafeed_packet *packet_in, *packet_out;
+	struct sr_datafeed_packet expanded;
+	struct sr_datafeed_logic logic;
+	struct sr_logic_rle_expander exp;
+	const struct sr_datafeed_logic_planar *planar;
+	struct sr_session *session;
 	struct sr_transform *t;
+	int64_t start_us;
 	int ret;
 
-	if (!sdi) {
-		sr_err("%s: sdi was NULL", __func__);
-		return SR_ERR_ARG;
-	}
-
-	if (!packet) {
-		sr_err("%s: packet was NULL", __func__);
-		return SR_ERR_ARG;
-	}
-
-	if (!sdi->session) {
-		sr_err("%s: session was NULL", __func__);
-		return SR_ERR_BUG;
-	}
-
 	/*
 	 * Pass the packet to the first transform module. If that returns
 	 * another packet (instead of NULL), pass that packet to the next
@@ -1117,7 +1882,13 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 	for (l = sdi->session->transforms; l; l = l->next) {
 		t = l->data;
 		sr_spew("Running transform module '%s'.", t->module->id);
+		start_us = g_atomic_int_get(&sdi->session->stats_enabled)
+			? g_get_monotonic_time() : 0;
 		ret = t->module->receive(t, packet_in, &packet_out);
+		if (start_us)
+			session_stats_update(sdi->session, t->stats_id,
+				SR_STATS_TRANSFORM, t->module->id, NULL,
+				packet_in, 0, start_us);
 		if (ret < 0) {
 			sr_err("Error while running transform module: %d.", ret);
 			return SR_ERR;
@@ -1143,16 +1914,336 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 	 * If the last transform did output a packet, pass it to all datafeed
 	 * callbacks.
 	 */
+	datafeed_callbacks_run(sdi, packet, 0);
+	if (packet->type != SR_DF_LOGIC_RLE && packet->type != SR_DF_LOGIC_PLANAR)
+		return SR_OK;
+
 	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
-		if (sr_log_loglevel_get() >= SR_LOG_DBG)
-			datafeed_dump(packet);
 		cb_struct = l->data;
-		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+		if (!datafeed_callback_accepts(cb_struct, packet->type))
+			break;
 	}
+	if (!l)
+		return SR_OK;
+
+	expanded.type = SR_DF_LOGIC;
+	expanded.payload = &logic;
+
+	if (packet->type == SR_DF_LOGIC_PLANAR) {
+		/*
+		 * Callbacks which don't accept planar logic data share one
+		 * conversion to sample-major layout, in a buffer that is
+		 * kept for the next packet.
+		 */
+		session = sdi->session;
+		planar = packet->payload;
+		logic.length = planar->num_samples * planar->unitsize;
+		logic.unitsize = planar->unitsize;
+		if (logic.length > session->planar_bufsize) {
+			g_free(session->planar_buf);
+			session->planar_buf = g_malloc(logic.length);
+			session->planar_bufsize = logic.length;
+		}
+		sr_logic_planar_to_samples(planar, session->planar_buf);
+		logic.data = session->planar_buf;
+		datafeed_callbacks_run(sdi, &expanded, SR_DF_LOGIC_PLANAR);
+		return SR_OK;
+	}
+
+	/*
+	 * Callbacks which don't accept run-length encoded logic data get
+	 * the expanded samples, one chunk at a time.
+	 */
+	sr_logic_rle_expander_init(&exp, packet->payload);
+	while (sr_logic_rle_expander_next(&exp, &logic))
+		datafeed_callbacks_run(sdi, &expanded, SR_DF_LOGIC_RLE);
+	sr_logic_rle_expander_clear(&exp);
 
 	return SR_OK;
 }
 
+/*
+ * Send a packet of a device whose acquisition runs with software limits,
+ * clipped to the samples which are still within the limits.
+ */
+static int session_send_limited(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_datafeed_packet clipped;
+	union {
+		struct sr_datafeed_logic logic;
+		struct sr_datafeed_logic_rle rle;
+		struct sr_datafeed_logic_planar planar;
+		struct sr_datafeed_analog analog;
+	} payload;
+	const uint64_t *lengths;
+	uint64_t samples, allowed, i;
+	int ret;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		payload.logic = *(const struct sr_datafeed_logic *)packet->payload;
+		if (!payload.logic.unitsize)
+			return session_send(sdi, packet);
+		samples = payload.logic.length / payload.logic.unitsize;
+		allowed = sr_sw_limits_session_clip(sdi->sw_limits, samples);
+		payload.logic.length = allowed * payload.logic.unitsize;
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		/* The planes stay valid for fewer samples. */
+		payload.planar = *(const struct sr_datafeed_logic_planar *)packet->payload;
+		samples = payload.planar.num_samples;
+		allowed = sr_sw_limits_session_clip(sdi->sw_limits, samples);
+		payload.planar.num_samples = allowed;
+		break;
+	case SR_DF_ANALOG:
+		payload.analog = *(const struct sr_datafeed_analog *)packet->payload;
+		samples = payload.analog.num_samples;
+		allowed = sr_sw_limits_session_clip_analog(sdi->sw_limits,
+			payload.analog.meaning->channels, samples);
+		payload.analog.num_samples = allowed;
+		break;
+	case SR_DF_LOGIC_RLE:
+		payload.rle = *(const struct sr_datafeed_logic_rle *)packet->payload;
+		lengths = payload.rle.lengths;
+		for (samples = 0, i = 0; i < payload.rle.num_runs; i++)
+			samples += lengths[i];
+		allowed = sr_sw_limits_session_clip(sdi->sw_limits, samples);
+		if (!allowed || allowed == samples)
+			break;
+		/* Keep the runs which fit, and send the rest of a split run separately. */
+		for (samples = 0, i = 0; samples + lengths[i] <= allowed; i++)
+			samples += lengths[i];
+		payload.rle.num_runs = i;
+		if (i) {
+			clipped.type = SR_DF_LOGIC_RLE;
+			clipped.payload = &payload;
+			if ((ret = session_send(sdi, &clipped)) != SR_OK)
+				return ret;
+		}
+		if (samples == allowed)
+			return SR_OK;
+		payload.rle.values = (uint8_t *)payload.rle.values
+			+ i * payload.rle.unitsize;
+		allowed -= samples;
+		payload.rle.lengths = &allowed;
+		payload.rle.num_runs = 1;
+		clipped.type = SR_DF_LOGIC_RLE;
+		clipped.payload = &payload;
+		return session_send(sdi, &clipped);
+	case SR_DF_END:
+		/* The limits apply until the end of the acquisition. */
+		ret = session_send(sdi, packet);
+		sr_sw_limits_session_end((struct sr_dev_inst *)sdi);
+		return ret;
+	default:
+		return session_send(sdi, packet);
+	}
+
+	if (allowed == samples)
+		return session_send(sdi, packet);
+	if (!allowed)
+		return SR_OK;
+
+	clipped.type = packet->type;
+	clipped.payload = &payload;
+
+	return session_send(sdi, &clipped);
+}
+
+/**
+ * Send a packet to whatever is listening on the datafeed bus.
+ *
+ * Hardware drivers use this to send a data packet to the frontend.
+ * For devices whose acquisition was started with
+ * sr_sw_limits_session_start(), packets are clipped to the limits.
+ *
+ * @param sdi TODO.
+ * @param packet The datafeed packet to send to the session bus.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	if (!sdi) {
+		sr_err("%s: sdi was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!packet) {
+		sr_err("%s: packet was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!sdi->session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	if (sdi->sw_limits)
+		return session_send_limited(sdi, packet);
+
+	return session_send(sdi, packet);
+}
+
+/**
+ * Enable or disable the collection of pipeline statistics.
+ *
+ * While enabled, the number of packets and bytes, and the time spent are
+ * recorded for every transform module, datafeed callback and event source
+ * of the session. The time of an event source includes the time spent
+ * in all stages it sends packets to. Collected statistics are kept when
+ * disabling the collection.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE to enable, FALSE to disable the collection.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_stats_enable(struct sr_session *session,
+		gboolean enable)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	g_atomic_int_set(&session->stats_enabled, enable ? 1 : 0);
+
+	return SR_OK;
+}
+
+/**
+ * Enable or disable the I/O reactor.
+ *
+ * While enabled, the file descriptors of newly added event sources are
+ * multiplexed through a single epoll instance, and their timeouts are
+ * kept on a timer wheel. The GLib main loop then only polls one
+ * descriptor, no matter how many devices the session has. This helps
+ * sessions with hundreds of serial or network instruments.
+ *
+ * Sources which were added before remain polled by the main loop. It is
+ * therefore best to enable the reactor before starting the session.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE to enable, FALSE to disable the reactor.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR_NA The reactor is not supported on this platform.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_reactor_enable(struct sr_session *session,
+		gboolean enable)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+#ifdef HAVE_SYS_EPOLL_H
+	session->reactor_enabled = enable;
+
+	return SR_OK;
+#else
+	return enable ? SR_ERR_NA : SR_OK;
+#endif
+}
+
+/**
+ * Discard all pipeline statistics collected so far.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_stats_reset(struct sr_session *session)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	g_mutex_lock(&session->stats_mutex);
+	g_slist_free_full(session->stats, session_stats_free);
+	session->stats = NULL;
+	g_mutex_unlock(&session->stats_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get a snapshot of the pipeline statistics.
+ *
+ * This may be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param stats Pointer where to store a list of struct sr_session_stats
+ *              pointers, one per stage in order of first appearance.
+ *              Must be freed with sr_session_stats_free().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_stats_get(struct sr_session *session, GSList **stats)
+{
+	struct session_stats *entry;
+	struct sr_session_stats *copy;
+	GSList *l;
+
+	if (!session || !stats)
+		return SR_ERR_ARG;
+
+	*stats = NULL;
+
+	g_mutex_lock(&session->stats_mutex);
+	for (l = session->stats; l; l = l->next) {
+		entry = l->data;
+		copy = g_memdup(&entry->stats, sizeof(*copy));
+		copy->name = g_strdup(entry->stats.name);
+		*stats = g_slist_prepend(*stats, copy);
+	}
+	g_mutex_unlock(&session->stats_mutex);
+
+	*stats = g_slist_reverse(*stats);
+
+	return SR_OK;
+}
+
+static void stats_free(void *data)
+{
+	struct sr_session_stats *stats;
+
+	stats = data;
+	g_free(stats->name);
+	g_free(stats);
+}
+
+/**
+ * Free a list of pipeline statistics.
+ *
+ * @param stats List as returned by sr_session_stats_get().
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_stats_free(GSList *stats)
+{
+	g_slist_free_full(stats, stats_free);
+}
+
 /**
  * Add an event source for a file descriptor.
  *
@@ -1196,11 +2287,17 @@ SR_PRIV int sr_session_fd_source_add(struct sr_session *session,
 	GSource *source;
 	int ret;
 
-	source = fd_source_new(session, key, fd, events, timeout);
-	if (!source)
-		return SR_ERR;
-
-	g_source_set_callback(source, (GSourceFunc)cb, cb_data, NULL);
+	source = NULL;
+	if (session->reactor_enabled)
+		source = reactor_source_new(session, key, fd, events, timeout,
+				cb, cb_data);
+	if (!source) {
+		source = fd_source_new(session, key, fd, events, timeout);
+		if (!source)
+			return SR_ERR;
+		g_source_set_callback(source, (GSourceFunc)cb, cb_data, NULL);
+	}
+	((struct fd_source *)source)->stats_id = sr_session_stats_id_new(session);
 
 	ret = sr_session_source_add_internal(session, key, source);
 	g_source_unref(source);
@@ -1460,7 +2557,12 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	struct sr_datafeed_logic *logic_copy;
 	const struct sr_datafeed_analog *analog;
 	struct sr_datafeed_analog *analog_copy;
+	const struct sr_datafeed_logic_rle *rle;
+	struct sr_datafeed_logic_rle *rle_copy;
+	const struct sr_datafeed_logic_planar *planar;
+	struct sr_datafeed_logic_planar *planar_copy;
 	uint8_t *payload;
+	unsigned int i;
 
 	*copy = g_malloc0(sizeof(struct sr_datafeed_packet));
 	(*copy)->type = packet->type;
@@ -1514,6 +2616,30 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 				sizeof(struct sr_analog_spec));
 		(*copy)->payload = analog_copy;
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		rle_copy = g_malloc(sizeof(*rle_copy));
+		rle_copy->num_runs = rle->num_runs;
+		rle_copy->unitsize = rle->unitsize;
+		rle_copy->values = g_memdup(rle->values,
+				rle->num_runs * rle->unitsize);
+		rle_copy->lengths = g_memdup(rle->lengths,
+				rle->num_runs * sizeof(uint64_t));
+		(*copy)->payload = rle_copy;
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		planar_copy = g_malloc(sizeof(*planar_copy));
+		*planar_copy = *planar;
+		planar_copy->planes = g_malloc0(planar->num_planes * sizeof(void *));
+		for (i = 0; i < planar->num_planes; i++) {
+			if (!planar->planes[i])
+				continue;
+			planar_copy->planes[i] = g_memdup(planar->planes[i],
+					(planar->num_samples + 7) / 8);
+		}
+		(*copy)->payload = planar_copy;
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 		return SR_ERR;
@@ -1527,8 +2653,11 @@ void sr_packet_free(struct sr_datafeed_packet *packet)
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_datafeed_analog *analog;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
 	struct sr_config *src;
 	GSList *l;
+	unsigned int i;
 
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
@@ -1563,6 +2692,19 @@ void sr_packet_free(struct sr_datafeed_packet *packet)
 		g_free(analog->spec);
 		g_free((void *)packet->payload);
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		g_free(rle->values);
+		g_free(rle->lengths);
+		g_free((void *)packet->payload);
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		for (i = 0; i < planar->num_planes; i++)
+			g_free(planar->planes[i]);
+		g_free(planar->planes);
+		g_free((void *)packet->payload);
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 	}
@@ -1570,4 +2712,148 @@ void sr_packet_free(struct sr_datafeed_packet *packet)
 
 }
 
+/**
+ * Prepare expanding the runs of an SR_DF_LOGIC_RLE payload.
+ *
+ * @param exp The expander to initialize.
+ * @param rle The payload to expand. Must stay valid until
+ *            sr_logic_rle_expander_clear() is called.
+ *
+ * @private
+ */
+SR_PRIV void sr_logic_rle_expander_init(struct sr_logic_rle_expander *exp,
+		const struct sr_datafeed_logic_rle *rle)
+{
+	uint64_t i, samples, maxsamples;
+
+	exp->rle = rle;
+	exp->run = 0;
+	exp->done = 0;
+
+	/* Don't allocate more than the expanded payload needs. */
+	maxsamples = LOGIC_RLE_EXPAND_SIZE / MAX(rle->unitsize, 1);
+	samples = 0;
+	for (i = 0; i < rle->num_runs && samples < maxsamples; i++)
+		samples += rle->lengths[i];
+	exp->bufsize = MIN(samples, maxsamples) * rle->unitsize;
+	exp->buf = exp->bufsize ? g_malloc(exp->bufsize) : NULL;
+}
+
+/**
+ * Expand the next chunk of samples.
+ *
+ * @param exp The expander to use.
+ * @param logic Filled in with the next chunk of samples. The data remains
+ *              valid until the next call.
+ *
+ * @return TRUE if a chunk was expanded, FALSE if all runs are done.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_logic_rle_expander_next(struct sr_logic_rle_expander *exp,
+		struct sr_datafeed_logic *logic)
+{
+	const struct sr_datafeed_logic_rle *rle;
+	const uint8_t *value;
+	uint64_t pos, count, filled;
+
+	rle = exp->rle;
+	pos = 0;
+	while (exp->run < rle->num_runs && pos < exp->bufsize) {
+		count = rle->lengths[exp->run] - exp->done;
+		count = MIN(count, (exp->bufsize - pos) / rle->unitsize);
+		if (count) {
+			/* Replicate the value by doubling the filled range. */
+			value = (const uint8_t *)rle->values
+				+ exp->run * rle->unitsize;
+			memcpy(exp->buf + pos, value, rle->unitsize);
+			filled = 1;
+			while (filled < count) {
+				memcpy(exp->buf + pos + filled * rle->unitsize,
+					exp->buf + pos,
+					MIN(filled, count - filled) * rle->unitsize);
+				filled += MIN(filled, count - filled);
+			}
+			pos += count * rle->unitsize;
+			exp->done += count;
+		}
+		if (exp->done == rle->lengths[exp->run]) {
+			exp->run++;
+			exp->done = 0;
+		}
+	}
+
+	logic->length = pos;
+	logic->unitsize = rle->unitsize;
+	logic->data = exp->buf;
+
+	return pos > 0;
+}
+
+/**
+ * Free the resources of an expander.
+ *
+ * @param exp The expander to clear.
+ *
+ * @private
+ */
+SR_PRIV void sr_logic_rle_expander_clear(struct sr_logic_rle_expander *exp)
+{
+	g_free(exp->buf);
+	exp->buf = NULL;
+	exp->bufsize = 0;
+}
+
+/* Move bit k of b to bit 0 of byte k. */
+static inline uint64_t spread_bits(uint8_t b)
+{
+	uint64_t x;
+
+	x = b;
+	x = (x | (x << 28)) & 0x0000000f0000000fULL;
+	x = (x | (x << 14)) & 0x0003000300030003ULL;
+	x = (x | (x << 7)) & 0x0101010101010101ULL;
+
+	return x;
+}
+
+/**
+ * Convert a planar logic payload to sample-major samples.
+ *
+ * Takes eight samples of up to eight planes at a time, so the cost is
+ * roughly one operation per plane byte rather than one per bit.
+ *
+ * @param planar The payload to convert. Must not be NULL.
+ * @param data Where to store planar->num_samples * planar->unitsize bytes
+ *             of samples, laid out as in struct sr_datafeed_logic.
+ *             Must not be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_logic_planar_to_samples(
+		const struct sr_datafeed_logic_planar *planar, void *data)
+{
+	const uint8_t *plane;
+	uint8_t *out;
+	uint64_t group, num_groups, acc;
+	unsigned int unitsize, lane, c, k, count;
+
+	out = data;
+	unitsize = planar->unitsize;
+	num_groups = (planar->num_samples + 7) / 8;
+	for (group = 0; group < num_groups; group++) {
+		count = MIN(8, planar->num_samples - group * 8);
+		for (lane = 0; lane < unitsize; lane++) {
+			acc = 0;
+			for (c = lane * 8; c < MIN(lane * 8 + 8, planar->num_planes); c++) {
+				if ((plane = planar->planes[c]))
+					acc |= spread_bits(plane[group]) << (c & 7);
+			}
+			for (k = 0; k < count; k++)
+				out[k * unitsize + lane] = acc >> (k * 8);
+		}
+		out += count * unitsize;
+	}
+}
+
 /** @} */
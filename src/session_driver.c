@@ -200,6 +200,98 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 	return got_data;
 }
 
+/* Read a whole archive member, or return NULL if there's none. */
+static uint8_t *read_member(struct zip *archive, const char *name,
+		size_t *len)
+{
+	struct zip_stat zs;
+	struct zip_file *zf;
+	uint8_t *buf;
+	zip_int64_t ret;
+
+	if (zip_stat(archive, name, 0, &zs) < 0)
+		return NULL;
+	if (!zs.size || zs.size > G_MAXINT || !(buf = g_try_malloc(zs.size)))
+		return NULL;
+	if (!(zf = zip_fopen_index(archive, zs.index, 0))) {
+		g_free(buf);
+		return NULL;
+	}
+	ret = zip_fread(zf, buf, zs.size);
+	zip_fclose(zf);
+	if (ret < 0 || (zip_uint64_t)ret != zs.size) {
+		sr_err("Failed to read %s.", name);
+		g_free(buf);
+		return NULL;
+	}
+	*len = zs.size;
+
+	return buf;
+}
+
+static void restore_pyramid(const struct sr_transform *t,
+		const struct sr_channel *ch, struct zip *archive,
+		const char *name)
+{
+	uint8_t *buf;
+	size_t len;
+	int ret;
+
+	if (!(buf = read_member(archive, name, &len)))
+		return;
+	ret = sr_transform_overview_load(t, ch, buf, len);
+	if (ret == SR_ERR_NA)
+		sr_dbg("Overview %s has other block sizes, rebuilding it.", name);
+	else if (ret != SR_OK)
+		sr_warn("Invalid overview %s, rebuilding it.", name);
+	g_free(buf);
+}
+
+/*
+ * Restore the overview pyramids which the srzip output stored next to
+ * the samples, so an overview transform doesn't rebuild them. Must be
+ * called after the header was sent, which resets the transform.
+ */
+static void restore_overview(const struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	const struct sr_transform *t;
+	struct sr_channel *ch;
+	struct zip_stat zs;
+	GKeyFile *kf;
+	GSList *l;
+	char name[32];
+	int version;
+
+	vdev = sdi->priv;
+	if (!(t = sr_transform_overview_find(sdi)))
+		return;
+
+	if (zip_stat(vdev->archive, "metadata", 0, &zs) < 0)
+		return;
+	if (!(kf = sr_sessionfile_read_metadata(vdev->archive, &zs)))
+		return;
+	version = g_key_file_get_integer(kf, "device 1", "overview version",
+		NULL);
+	g_key_file_free(kf);
+	if (version != 1) {
+		if (version)
+			sr_dbg("Unknown overview version %d, ignoring.", version);
+		return;
+	}
+
+	if (vdev->num_logic_channels)
+		restore_pyramid(t, NULL, vdev->archive, "overview-logic-1");
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_ANALOG)
+			continue;
+		snprintf(name, sizeof(name), "overview-analog-1-%d",
+			ch->index + 1);
+		restore_pyramid(t, ch, vdev->archive, name);
+	}
+}
+
 static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
@@ -361,6 +453,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	}
 
 	std_session_send_df_header(sdi);
+	restore_overview(sdi);
 
 	/* freewheeling source */
 	sr_session_source_add(sdi->session, -1, 0, 0, receive_data, (void *)sdi);
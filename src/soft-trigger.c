@@ -26,11 +26,29 @@
 #define LOG_PREFIX "soft-trigger"
 /* @endcond */
 
+/* A driver buffer which is retained for the pre-trigger window. */
+struct pre_trigger_chunk {
+	uint8_t *data;
+	int len;
+	int size;
+};
+
 SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
 		int pre_trigger_samples)
 {
 	struct soft_trigger_logic *stl;
+	struct sr_trigger_stage *stage;
+	GSList *l;
+
+	for (l = trigger->stages; l; l = l->next) {
+		stage = l->data;
+		if (!stage->matches) {
+			/* No matches supplied, client error. */
+			sr_err("Trigger stage %d has no matches.", stage->stage);
+			return NULL;
+		}
+	}
 
 	stl = g_malloc0(sizeof(struct soft_trigger_logic));
 	stl->sdi = sdi;
@@ -49,6 +67,7 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		return NULL;
 	}
 	stl->pre_trigger_head = stl->pre_trigger_buffer;
+	g_queue_init(&stl->pre_trigger_chunks);
 
 	if (stl->pre_trigger_size > 0 && !stl->pre_trigger_buffer) {
 		soft_trigger_logic_free(stl);
@@ -58,8 +77,22 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 	return stl;
 }
 
+static void pre_trigger_chunk_free(gpointer data)
+{
+	struct pre_trigger_chunk *chunk;
+
+	chunk = data;
+	g_free(chunk->data);
+	g_free(chunk);
+}
+
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *stl)
 {
+	struct pre_trigger_chunk *chunk;
+
+	while ((chunk = g_queue_pop_head(&stl->pre_trigger_chunks)))
+		pre_trigger_chunk_free(chunk);
+	g_slist_free_full(stl->spare_buffers, pre_trigger_chunk_free);
 	g_free(stl->pre_trigger_buffer);
 	g_free(stl->prev_sample);
 	g_free(stl);
@@ -155,27 +188,22 @@ static gboolean logic_check_match(struct soft_trigger_logic *stl,
 	return result;
 }
 
-/* Returns the offset (in samples) within buf of where the trigger
- * occurred, or -1 if not triggered. */
-SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
-		uint8_t *buf, int len, int *pre_trigger_samples)
+/*
+ * Returns the offset (in samples) within buf of where the trigger
+ * occurred, or -1 if not triggered. Pre-trigger data is not handled.
+ */
+static int logic_find_trigger(struct soft_trigger_logic *stl,
+		uint8_t *buf, int len)
 {
-	struct sr_datafeed_packet packet;
 	struct sr_trigger_stage *stage;
 	struct sr_trigger_match *match;
 	GSList *l, *l_stage;
-	int offset;
 	int i;
 	gboolean match_found;
 
-	offset = -1;
 	for (i = 0; i < len; i += stl->unitsize) {
 		l_stage = g_slist_nth(stl->trigger->stages, stl->cur_stage);
 		stage = l_stage->data;
-		if (!stage->matches)
-			/* No matches supplied, client error. */
-			return SR_ERR_ARG;
-
 		match_found = TRUE;
 		for (l = stage->matches; l; l = l->next) {
 			match = l->data;
@@ -194,17 +222,8 @@ SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 				/* Advance to next stage. */
 				stl->cur_stage++;
 			} else {
-				/* Matched on last stage, send pre-trigger data. */
-				pre_trigger_append(stl, buf, i);
-				pre_trigger_send(stl, pre_trigger_samples);
-
-				/* Fire trigger. */
-				offset = i / stl->unitsize;
-
-				packet.type = SR_DF_TRIGGER;
-				packet.payload = NULL;
-				sr_session_send(stl->sdi, &packet);
-				break;
+				/* Matched on last stage. */
+				return i / stl->unitsize;
 			}
 		} else if (stl->cur_stage > 0) {
 			/*
@@ -224,8 +243,203 @@ SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 		}
 	}
 
-	if (offset == -1)
+	return -1;
+}
+
+static void trigger_send(struct soft_trigger_logic *stl)
+{
+	struct sr_datafeed_packet packet;
+
+	packet.type = SR_DF_TRIGGER;
+	packet.payload = NULL;
+	sr_session_send(stl->sdi, &packet);
+}
+
+/* Returns the offset (in samples) within buf of where the trigger
+ * occurred, or -1 if not triggered. */
+SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
+		uint8_t *buf, int len, int *pre_trigger_samples)
+{
+	int offset;
+
+	offset = logic_find_trigger(stl, buf, len);
+	if (offset == -1) {
 		pre_trigger_append(stl, buf, len);
+		return -1;
+	}
+
+	/* Send pre-trigger data, then fire trigger. */
+	pre_trigger_append(stl, buf, offset * stl->unitsize);
+	pre_trigger_send(stl, pre_trigger_samples);
+	trigger_send(stl);
+
+	return offset;
+}
+
+static void logic_send(struct soft_trigger_logic *stl, uint8_t *data, int len)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+
+	if (len <= 0)
+		return;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = stl->unitsize;
+	logic.length = len;
+	logic.data = data;
+	sr_session_send(stl->sdi, &packet);
+}
+
+static void pre_trigger_chunk_recycle(struct soft_trigger_logic *stl,
+		struct pre_trigger_chunk *chunk)
+{
+	stl->pre_trigger_retained -= chunk->len;
+	chunk->len = 0;
+	stl->spare_buffers = g_slist_prepend(stl->spare_buffers, chunk);
+}
+
+/* Take over a driver buffer, and release the ones no longer needed. */
+static int pre_trigger_retain(struct soft_trigger_logic *stl,
+		uint8_t **buf, int len, int bufsize)
+{
+	struct pre_trigger_chunk *chunk, *spare;
+
+	spare = NULL;
+	if (stl->spare_buffers) {
+		spare = stl->spare_buffers->data;
+		stl->spare_buffers = g_slist_delete_link(stl->spare_buffers,
+			stl->spare_buffers);
+		if (spare->size < bufsize) {
+			pre_trigger_chunk_free(spare);
+			spare = NULL;
+		}
+	}
+	if (!spare) {
+		spare = g_malloc0(sizeof(*spare));
+		spare->size = bufsize;
+		if (!(spare->data = g_try_malloc(bufsize))) {
+			g_free(spare);
+			return SR_ERR_MALLOC;
+		}
+	}
+
+	/* Swap the driver's buffer with the spare one. */
+	chunk = g_malloc0(sizeof(*chunk));
+	chunk->data = *buf;
+	chunk->len = len;
+	chunk->size = bufsize;
+	*buf = spare->data;
+	g_free(spare);
+
+	g_queue_push_tail(&stl->pre_trigger_chunks, chunk);
+	stl->pre_trigger_retained += len;
+
+	/* Drop the oldest buffers when the newer ones cover the window. */
+	while ((chunk = g_queue_peek_head(&stl->pre_trigger_chunks)) &&
+			stl->pre_trigger_retained - chunk->len
+			>= stl->pre_trigger_size) {
+		g_queue_pop_head(&stl->pre_trigger_chunks);
+		pre_trigger_chunk_recycle(stl, chunk);
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Send the retained buffers' content which is part of the window. It is
+ * collected into a single packet, so the window is copied once when the
+ * trigger fires. Should that allocation fail, the buffers get sent one
+ * by one instead.
+ */
+static void pre_trigger_send_retained(struct soft_trigger_logic *stl,
+		uint8_t *buf, int len, int *pre_trigger_samples)
+{
+	struct pre_trigger_chunk *chunk;
+	uint8_t *window;
+	int skip, size, pos;
+
+	size = MIN(stl->pre_trigger_retained + len, stl->pre_trigger_size);
+	skip = stl->pre_trigger_retained + len - size;
+
+	if (pre_trigger_samples)
+		*pre_trigger_samples = size / stl->unitsize;
+
+	window = g_try_malloc(size);
+	pos = 0;
+	while ((chunk = g_queue_pop_head(&stl->pre_trigger_chunks))) {
+		if (skip < chunk->len) {
+			if (window)
+				memcpy(window + pos, chunk->data + skip,
+					chunk->len - skip);
+			else
+				logic_send(stl, chunk->data + skip,
+					chunk->len - skip);
+			pos += chunk->len - skip;
+		}
+		skip = MAX(skip - chunk->len, 0);
+		pre_trigger_chunk_recycle(stl, chunk);
+	}
+	if (!window) {
+		logic_send(stl, buf + skip, len - skip);
+		return;
+	}
+	memcpy(window + pos, buf + skip, len - skip);
+	logic_send(stl, window, size);
+	g_free(window);
+}
+
+/**
+ * Check for a trigger match like soft_trigger_logic_check(), but retain
+ * the caller's buffer for the pre-trigger window instead of copying it.
+ *
+ * When the trigger did not fire, the soft trigger takes ownership of the
+ * (g_malloc()'ed) buffer, and *buf gets replaced by a buffer of at least
+ * bufsize bytes which the caller can re-use, e.g. for resubmitting a USB
+ * transfer. Buffers which are no longer needed for the window get
+ * recycled that way, so no memory is copied and only a window's worth
+ * of buffers is held.
+ *
+ * When the trigger fires, the window is sent as a single packet, made of
+ * the retained buffers and the part of buf before the trigger point, and
+ * *buf is left untouched.
+ *
+ * A soft trigger must not be used with both this function and
+ * soft_trigger_logic_check().
+ *
+ * @param stl The soft trigger.
+ * @param buf Pointer to the g_malloc()'ed buffer holding the samples.
+ * @param len Number of bytes of sample data in the buffer.
+ * @param bufsize The buffer's allocated size.
+ * @param pre_trigger_samples Pointer where to store the number of
+ *        pre-trigger samples sent (can be NULL).
+ *
+ * @return The offset (in samples) within the buffer where the trigger
+ *         occurred, -1 if not triggered, or SR_ERR_* upon failure.
+ */
+SR_PRIV int soft_trigger_logic_check_retain(struct soft_trigger_logic *stl,
+		uint8_t **buf, int len, int bufsize, int *pre_trigger_samples)
+{
+	int offset, ret;
+
+	/* The copy buffer is not needed when retaining the caller's. */
+	g_free(stl->pre_trigger_buffer);
+	stl->pre_trigger_buffer = stl->pre_trigger_head = NULL;
+
+	offset = logic_find_trigger(stl, *buf, len);
+	if (offset == -1) {
+		if (stl->pre_trigger_size == 0)
+			return -1;
+		if ((ret = pre_trigger_retain(stl, buf, len, bufsize)) != SR_OK)
+			return ret;
+		return -1;
+	}
+
+	/* Send pre-trigger data, then fire trigger. */
+	pre_trigger_send_retained(stl, *buf, offset * stl->unitsize,
+		pre_trigger_samples);
+	trigger_send(stl);
 
 	return offset;
 }
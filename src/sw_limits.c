@@ -46,6 +46,7 @@ SR_PRIV void sr_sw_limits_init(struct sr_sw_limits *limits)
 {
 	limits->limit_samples = 0;
 	limits->limit_msec = 0;
+	limits->analog_sent = NULL;
 }
 
 /**
@@ -118,6 +119,153 @@ SR_PRIV void sr_sw_limits_acquisition_start(struct sr_sw_limits *limits)
 	limits->start_time = g_get_monotonic_time();
 }
 
+static gboolean time_limit_reached(struct sr_sw_limits *limits)
+{
+	guint64 now;
+
+	if (!limits->limit_msec)
+		return FALSE;
+
+	now = g_get_monotonic_time();
+
+	return now > limits->start_time &&
+		now - limits->start_time > limits->limit_msec;
+}
+
+/**
+ * Start a new data acquisition, with the limits enforced by the session
+ *
+ * Like sr_sw_limits_acquisition_start(), but additionally makes
+ * sr_session_send() apply the limits to the device's packets until it
+ * sends SR_DF_END, or the device leaves its session. Logic and analog
+ * packets get clipped exactly at the sample limit (by adjusting their
+ * length, without copying), and are dropped once the sample or time
+ * limit has been reached. The samples which were passed on are
+ * accounted for, so the driver must not call
+ * sr_sw_limits_update_samples_read() itself. It only needs to poll
+ * sr_sw_limits_check() to stop the hardware.
+ *
+ * @param limits software limits instance
+ * @param sdi the device instance whose packets get limited
+ */
+SR_PRIV void sr_sw_limits_session_start(struct sr_sw_limits *limits,
+	struct sr_dev_inst *sdi)
+{
+	sr_sw_limits_session_end(sdi);
+	sr_sw_limits_acquisition_start(limits);
+	limits->logic_sent = 0;
+	limits->analog_sent = g_hash_table_new_full(g_direct_hash,
+		g_direct_equal, NULL, g_free);
+	sdi->sw_limits = limits;
+}
+
+/**
+ * Stop enforcing the limits of sr_sw_limits_session_start()
+ *
+ * Called by the session once the device sent SR_DF_END, or left the
+ * session. Does nothing if the device's packets aren't limited.
+ *
+ * @param sdi the device instance whose packets were limited
+ */
+SR_PRIV void sr_sw_limits_session_end(struct sr_dev_inst *sdi)
+{
+	struct sr_sw_limits *limits;
+
+	if (!(limits = sdi->sw_limits))
+		return;
+
+	g_hash_table_destroy(limits->analog_sent);
+	limits->analog_sent = NULL;
+	sdi->sw_limits = NULL;
+}
+
+/* The number of the samples which may still be sent after 'sent'. */
+static uint64_t clip_count(struct sr_sw_limits *limits, uint64_t sent,
+	uint64_t samples)
+{
+	if (!limits->limit_samples)
+		return samples;
+	if (sent >= limits->limit_samples)
+		return 0;
+
+	return MIN(samples, limits->limit_samples - sent);
+}
+
+static uint64_t *analog_sent(struct sr_sw_limits *limits,
+	struct sr_channel *ch)
+{
+	uint64_t *sent;
+
+	if (!(sent = g_hash_table_lookup(limits->analog_sent, ch))) {
+		sent = g_malloc0(sizeof(*sent));
+		g_hash_table_insert(limits->analog_sent, ch, sent);
+	}
+
+	return sent;
+}
+
+/**
+ * Clip a number of logic samples to the configured limits
+ *
+ * Used by sr_session_send() for devices which started their acquisition
+ * with sr_sw_limits_session_start().
+ *
+ * @param limits software limits instance
+ * @param samples the number of samples which are about to be sent
+ * @returns the number of samples which may be sent, 0 once a limit has
+ *          been reached.
+ */
+SR_PRIV uint64_t sr_sw_limits_session_clip(struct sr_sw_limits *limits,
+	uint64_t samples)
+{
+	if (time_limit_reached(limits))
+		return 0;
+
+	samples = clip_count(limits, limits->logic_sent, samples);
+	limits->logic_sent += samples;
+	limits->samples_read = MAX(limits->samples_read, limits->logic_sent);
+
+	return samples;
+}
+
+/**
+ * Clip a number of analog samples to the configured limits
+ *
+ * Like sr_sw_limits_session_clip(), but the samples of every analog
+ * channel are counted separately, as a packet carries num_samples
+ * samples for each of its channels. So analog channels which are sent
+ * together or in separate packets, as well as the logic channels of
+ * mixed signal devices, all get clipped at the same sample. The largest
+ * count of any channel is the number of samples read.
+ *
+ * @param limits software limits instance
+ * @param channels the channels of the packet, see sr_analog_meaning
+ * @param samples the number of samples per channel which are about to be
+ *        sent
+ * @returns the number of samples per channel which may be sent, 0 once
+ *          a limit has been reached.
+ */
+SR_PRIV uint64_t sr_sw_limits_session_clip_analog(struct sr_sw_limits *limits,
+	GSList *channels, uint64_t samples)
+{
+	uint64_t *sent;
+	GSList *l;
+
+	if (time_limit_reached(limits))
+		return 0;
+
+	for (l = channels; l; l = l->next)
+		samples = clip_count(limits, *analog_sent(limits, l->data),
+			samples);
+	for (l = channels; l; l = l->next) {
+		sent = analog_sent(limits, l->data);
+		*sent += samples;
+		limits->samples_read = MAX(limits->samples_read, *sent);
+	}
+
+	return samples;
+}
+
 /**
  * Check if any of the configured software limits has been reached
  *
@@ -138,15 +286,10 @@ SR_PRIV gboolean sr_sw_limits_check(struct sr_sw_limits *limits)
 		}
 	}
 
-	if (limits->limit_msec) {
-		guint64 now;
-		now = g_get_monotonic_time();
-		if (now > limits->start_time &&
-			now - limits->start_time > limits->limit_msec) {
-			sr_dbg("Requested sampling time (%" PRIu64
-			       "ms) reached.", limits->limit_msec / 1000);
-			return TRUE;
-		}
+	if (time_limit_reached(limits)) {
+		sr_dbg("Requested sampling time (%" PRIu64
+		       "ms) reached.", limits->limit_msec / 1000);
+		return TRUE;
 	}
 
 	return FALSE;
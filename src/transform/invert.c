@@ -24,11 +24,84 @@
 
 #define LOG_PREFIX "transform/invert"
 
+struct context {
+	/* Planar logic output, with planes for all channels. */
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_planar planar;
+	void **planes;
+	uint16_t max_planes;
+	/* Inverted planes of channels without data. */
+	uint8_t *ones;
+	size_t ones_size;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	(void)options;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	t->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+/*
+ * Channels without data read as all-zero, so their inverted planes
+ * are all-one. These are filled again for every packet, as downstream
+ * transforms may modify them in place.
+ */
+static struct sr_datafeed_packet *invert_planar(struct context *ctx,
+		const struct sr_datafeed_logic_planar *planar)
+{
+	size_t plane_size;
+	uint16_t num_planes, j;
+	uint8_t *b;
+	uint64_t i;
+
+	plane_size = (planar->num_samples + 7) / 8;
+	num_planes = planar->unitsize * 8;
+
+	if (num_planes > ctx->max_planes) {
+		g_free(ctx->planes);
+		ctx->planes = g_malloc(num_planes * sizeof(*ctx->planes));
+		ctx->max_planes = num_planes;
+	}
+	if (plane_size * num_planes > ctx->ones_size) {
+		g_free(ctx->ones);
+		ctx->ones_size = plane_size * num_planes;
+		ctx->ones = g_malloc(ctx->ones_size);
+	}
+
+	for (j = 0; j < num_planes; j++) {
+		b = (j < planar->num_planes) ? planar->planes[j] : NULL;
+		if (b) {
+			for (i = 0; i < plane_size; i++)
+				b[i] = ~b[i];
+		} else {
+			b = ctx->ones + j * plane_size;
+			memset(b, 0xff, plane_size);
+		}
+		ctx->planes[j] = b;
+	}
+
+	ctx->planar = *planar;
+	ctx->planar.num_planes = num_planes;
+	ctx->planar.planes = ctx->planes;
+	ctx->packet.type = SR_DF_LOGIC_PLANAR;
+	ctx->packet.payload = &ctx->planar;
+
+	return &ctx->packet;
+}
+
 static int receive(const struct sr_transform *t,
 		struct sr_datafeed_packet *packet_in,
 		struct sr_datafeed_packet **packet_out)
 {
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
 	const struct sr_datafeed_analog *analog;
 	uint8_t *b;
 	int64_t p;
@@ -37,6 +110,9 @@ static int receive(const struct sr_transform *t,
 	if (!t || !t->sdi || !packet_in || !packet_out)
 		return SR_ERR_ARG;
 
+	/* Return the in-place-modified packet, unless replaced below. */
+	*packet_out = packet_in;
+
 	switch (packet_in->type) {
 	case SR_DF_LOGIC:
 		logic = packet_in->payload;
@@ -48,6 +124,17 @@ static int receive(const struct sr_transform *t,
 			}
 		}
 		break;
+	case SR_DF_LOGIC_RLE:
+		/* Inverting the run values inverts all samples. */
+		rle = packet_in->payload;
+		b = rle->values;
+		for (i = 0; i < rle->num_runs * rle->unitsize; i++)
+			b[i] = ~b[i];
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet_in->payload;
+		*packet_out = invert_planar(t->priv, planar);
+		break;
 	case SR_DF_ANALOG:
 		analog = packet_in->payload;
 		p = analog->encoding->scale.p;
@@ -62,8 +149,22 @@ static int receive(const struct sr_transform *t,
 		break;
 	}
 
-	/* Return the in-place-modified packet. */
-	*packet_out = packet_in;
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	ctx = t->priv;
+
+	g_free(ctx->planes);
+	g_free(ctx->ones);
+	g_free(ctx);
+	t->priv = NULL;
 
 	return SR_OK;
 }
@@ -73,7 +174,7 @@ SR_PRIV struct sr_transform_module transform_invert = {
 	.name = "Invert",
 	.desc = "Invert values",
 	.options = NULL,
-	.init = NULL,
+	.init = init,
 	.receive = receive,
-	.cleanup = NULL,
+	.cleanup = cleanup,
 };
@@ -0,0 +1,1031 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <float.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/overview"
+
+/*
+ * The overview transform passes all packets through unchanged, and builds
+ * a pyramid of summaries of the data on the way. Level 0 summarizes blocks
+ * of 'blocksize' samples, every further level summarizes blocks of
+ * 'factor' blocks of the level below. A viewer can thus pick the level
+ * which matches its zoom, and needs to look at about as many blocks as it
+ * has pixels.
+ *
+ * There is one pyramid for the logic data, and one for every analog
+ * channel. Levels only hold complete blocks while the acquisition runs.
+ * The partial blocks are added at the end of the acquisition, after which
+ * the top level holds a single block which covers all samples.
+ *
+ * The srzip output stores the pyramids next to the samples, see
+ * sr_transform_overview_save(). When such a file is loaded, the session
+ * driver restores them right after the header, and the samples which
+ * follow are no longer added to the restored pyramids.
+ */
+
+/*
+ * Summary of a block of logic samples. It is followed by the OR and the
+ * AND of all samples, unitsize bytes each.
+ */
+struct logic_record {
+	uint64_t num_samples;
+	/* Number of samples which differ from their predecessor. */
+	uint64_t transitions;
+};
+
+/* Summary of a block of analog samples. */
+struct analog_record {
+	uint64_t num_samples;
+	float min;
+	float max;
+	double sum;
+};
+
+struct level {
+	/* The complete blocks of this level. */
+	GByteArray *records;
+	/* The block under construction. */
+	uint8_t *acc;
+	/* Samples (level 0) or blocks (other levels) in acc. */
+	uint64_t acc_count;
+};
+
+struct pyramid {
+	/* Unitsize of logic samples, 0 for analog pyramids. */
+	unsigned int unitsize;
+	size_t record_size;
+	/* Array of struct level *, from the finest to the coarsest level. */
+	GPtrArray *levels;
+	/* Last logic sample, to count transitions across packets. */
+	uint8_t *prev;
+	gboolean have_prev;
+	/* Restored from a session file, so no data is added. */
+	gboolean restored;
+};
+
+struct context {
+	uint64_t blocksize;
+	uint64_t factor;
+	/* Protects the pyramids against concurrent queries. */
+	GMutex mutex;
+	struct pyramid *logic;
+	/* Analog pyramids, keyed by struct sr_channel *. */
+	GHashTable *analog;
+	/* Scratch buffer for planar logic and analog data. */
+	uint8_t *buf;
+	size_t buf_size;
+};
+
+static struct level *level_new(size_t record_size)
+{
+	struct level *l;
+
+	l = g_malloc0(sizeof(*l));
+	l->records = g_byte_array_new();
+	l->acc = g_malloc0(record_size);
+
+	return l;
+}
+
+static void level_free(struct level *l)
+{
+	g_byte_array_free(l->records, TRUE);
+	g_free(l->acc);
+	g_free(l);
+}
+
+static struct pyramid *pyramid_new(unsigned int unitsize)
+{
+	struct pyramid *p;
+
+	p = g_malloc0(sizeof(*p));
+	p->unitsize = unitsize;
+	if (unitsize) {
+		/* Keep the records of a level 8-byte aligned. */
+		p->record_size = sizeof(struct logic_record) + 2 * unitsize;
+		p->record_size = (p->record_size + 7) & ~(size_t)7;
+		p->prev = g_malloc0(unitsize);
+	} else {
+		p->record_size = sizeof(struct analog_record);
+	}
+	p->levels = g_ptr_array_new_with_free_func((GDestroyNotify)level_free);
+	g_ptr_array_add(p->levels, level_new(p->record_size));
+
+	return p;
+}
+
+static void pyramid_free(struct pyramid *p)
+{
+	if (!p)
+		return;
+
+	g_ptr_array_free(p->levels, TRUE);
+	g_free(p->prev);
+	g_free(p);
+}
+
+static void merge_logic(const struct pyramid *p, uint8_t *dst,
+		const uint8_t *src)
+{
+	struct logic_record *d, *s;
+	unsigned int i;
+
+	d = (struct logic_record *)dst;
+	s = (struct logic_record *)src;
+	if (!d->num_samples) {
+		memcpy(dst, src, p->record_size);
+		return;
+	}
+
+	d->num_samples += s->num_samples;
+	d->transitions += s->transitions;
+	dst += sizeof(*d);
+	src += sizeof(*s);
+	for (i = 0; i < p->unitsize; i++)
+		dst[i] |= src[i];
+	dst += p->unitsize;
+	src += p->unitsize;
+	for (i = 0; i < p->unitsize; i++)
+		dst[i] &= src[i];
+}
+
+static void merge_analog(uint8_t *dst, const uint8_t *src)
+{
+	struct analog_record *d, *s;
+
+	d = (struct analog_record *)dst;
+	s = (struct analog_record *)src;
+	if (!d->num_samples) {
+		*d = *s;
+		return;
+	}
+
+	d->num_samples += s->num_samples;
+	d->min = MIN(d->min, s->min);
+	d->max = MAX(d->max, s->max);
+	d->sum += s->sum;
+}
+
+static void merge(const struct pyramid *p, uint8_t *dst, const uint8_t *src)
+{
+	if (p->unitsize)
+		merge_logic(p, dst, src);
+	else
+		merge_analog(dst, src);
+}
+
+/*
+ * Finish the complete block under construction in a level, and merge it
+ * into the next level, which is created if needed.
+ */
+static void level_finish(struct context *ctx, struct pyramid *p,
+		unsigned int n)
+{
+	struct level *l, *up;
+
+	while (n < p->levels->len) {
+		l = g_ptr_array_index(p->levels, n);
+		g_byte_array_append(l->records, l->acc, p->record_size);
+		if (n + 1 == p->levels->len)
+			g_ptr_array_add(p->levels, level_new(p->record_size));
+		up = g_ptr_array_index(p->levels, n + 1);
+		merge(p, up->acc, l->acc);
+		up->acc_count++;
+		memset(l->acc, 0, p->record_size);
+		l->acc_count = 0;
+		if (up->acc_count < ctx->factor)
+			break;
+		n++;
+	}
+}
+
+/* Add the partial blocks at the end of the acquisition. */
+static void pyramid_flush(struct context *ctx, struct pyramid *p)
+{
+	struct level *l, *up;
+	unsigned int n;
+
+	for (n = 0; n < p->levels->len; n++) {
+		l = g_ptr_array_index(p->levels, n);
+		if (!l->acc_count)
+			continue;
+		g_byte_array_append(l->records, l->acc, p->record_size);
+		if (n + 1 < p->levels->len) {
+			up = g_ptr_array_index(p->levels, n + 1);
+			merge(p, up->acc, l->acc);
+			up->acc_count++;
+		}
+		memset(l->acc, 0, p->record_size);
+		l->acc_count = 0;
+	}
+}
+
+/* Add num_samples logic samples which all have the given value. */
+static void add_logic_run(struct context *ctx, struct pyramid *p,
+		const uint8_t *value, uint64_t num_samples)
+{
+	struct level *l;
+	struct logic_record *r;
+	uint8_t *or_bits, *and_bits;
+	uint64_t count, transitions;
+	unsigned int i;
+
+	if (!num_samples)
+		return;
+
+	transitions = p->have_prev && memcmp(value, p->prev, p->unitsize);
+	memcpy(p->prev, value, p->unitsize);
+	p->have_prev = TRUE;
+
+	l = g_ptr_array_index(p->levels, 0);
+	while (num_samples) {
+		count = MIN(num_samples, ctx->blocksize - l->acc_count);
+		r = (struct logic_record *)l->acc;
+		or_bits = l->acc + sizeof(*r);
+		and_bits = or_bits + p->unitsize;
+		if (!r->num_samples) {
+			memcpy(or_bits, value, p->unitsize);
+			memcpy(and_bits, value, p->unitsize);
+		} else {
+			for (i = 0; i < p->unitsize; i++) {
+				or_bits[i] |= value[i];
+				and_bits[i] &= value[i];
+			}
+		}
+		r->num_samples += count;
+		/* The transition belongs to the run's first sample. */
+		r->transitions += transitions;
+		transitions = 0;
+		l->acc_count += count;
+		num_samples -= count;
+		if (l->acc_count == ctx->blocksize)
+			level_finish(ctx, p, 0);
+	}
+}
+
+/* Add logic samples, one run of equal samples at a time. */
+static void add_logic(struct context *ctx, struct pyramid *p,
+		const uint8_t *data, uint64_t num_samples)
+{
+	uint64_t i, j;
+
+	for (i = 0; i < num_samples; i = j) {
+		for (j = i + 1; j < num_samples; j++) {
+			if (memcmp(data + j * p->unitsize,
+					data + i * p->unitsize, p->unitsize))
+				break;
+		}
+		add_logic_run(ctx, p, data + i * p->unitsize, j - i);
+	}
+}
+
+static void add_analog(struct context *ctx, struct pyramid *p,
+		const float *data, uint64_t num_samples)
+{
+	struct level *l;
+	struct analog_record *r;
+	uint64_t count, i;
+	float min, max;
+	double sum;
+
+	l = g_ptr_array_index(p->levels, 0);
+	while (num_samples) {
+		count = MIN(num_samples, ctx->blocksize - l->acc_count);
+		min = FLT_MAX;
+		max = -FLT_MAX;
+		sum = 0;
+		for (i = 0; i < count; i++) {
+			min = MIN(min, data[i]);
+			max = MAX(max, data[i]);
+			sum += data[i];
+		}
+		r = (struct analog_record *)l->acc;
+		if (!r->num_samples) {
+			r->min = min;
+			r->max = max;
+		} else {
+			r->min = MIN(r->min, min);
+			r->max = MAX(r->max, max);
+		}
+		r->num_samples += count;
+		r->sum += sum;
+		l->acc_count += count;
+		data += count;
+		num_samples -= count;
+		if (l->acc_count == ctx->blocksize)
+			level_finish(ctx, p, 0);
+	}
+}
+
+static uint8_t *scratch_buf(struct context *ctx, size_t size)
+{
+	if (size > ctx->buf_size) {
+		g_free(ctx->buf);
+		ctx->buf = g_try_malloc(size);
+		ctx->buf_size = ctx->buf ? size : 0;
+	}
+
+	return ctx->buf;
+}
+
+static struct pyramid *logic_pyramid(struct context *ctx,
+		unsigned int unitsize)
+{
+	if (!ctx->logic)
+		ctx->logic = pyramid_new(unitsize);
+	if (ctx->logic->restored)
+		return NULL;
+	if (ctx->logic->unitsize != unitsize) {
+		sr_dbg("Unitsize changed from %u to %u, ignoring data.",
+			ctx->logic->unitsize, unitsize);
+		return NULL;
+	}
+
+	return ctx->logic;
+}
+
+static void receive_analog(struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	struct sr_channel *ch;
+	struct pyramid *p;
+	float *fdata;
+
+	/* Without a single channel, the samples can't be attributed. */
+	if (!analog->meaning->channels || analog->meaning->channels->next) {
+		sr_spew("Analog packet without a single channel, ignoring.");
+		return;
+	}
+	ch = analog->meaning->channels->data;
+	p = g_hash_table_lookup(ctx->analog, ch);
+	if (p && p->restored)
+		return;
+
+	fdata = (float *)scratch_buf(ctx, analog->num_samples * sizeof(float));
+	if (!fdata) {
+		sr_err("Failed to allocate conversion buffer.");
+		return;
+	}
+	if (sr_analog_to_float(analog, fdata) != SR_OK)
+		return;
+
+	if (!p) {
+		p = pyramid_new(0);
+		g_hash_table_insert(ctx->analog, ch, p);
+	}
+	add_analog(ctx, p, fdata, analog->num_samples);
+}
+
+static void reset(struct context *ctx)
+{
+	pyramid_free(ctx->logic);
+	ctx->logic = NULL;
+	g_hash_table_remove_all(ctx->analog);
+}
+
+static void flush(struct context *ctx)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (ctx->logic)
+		pyramid_flush(ctx, ctx->logic);
+	g_hash_table_iter_init(&iter, ctx->analog);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		pyramid_flush(ctx, value);
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+
+	ctx->blocksize = g_variant_get_uint64(g_hash_table_lookup(options,
+			"blocksize"));
+	ctx->factor = g_variant_get_uint64(g_hash_table_lookup(options,
+			"factor"));
+	if (!ctx->blocksize || ctx->factor < 2) {
+		sr_err("Invalid block size or factor.");
+		g_free(ctx);
+		t->priv = NULL;
+		return SR_ERR_ARG;
+	}
+
+	g_mutex_init(&ctx->mutex);
+	ctx->analog = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, (GDestroyNotify)pyramid_free);
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
+	struct pyramid *p;
+	const uint8_t *values;
+	uint8_t *samples;
+	uint64_t i;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	g_mutex_lock(&ctx->mutex);
+	switch (packet_in->type) {
+	case SR_DF_HEADER:
+		reset(ctx);
+		break;
+	case SR_DF_LOGIC:
+		logic = packet_in->payload;
+		if (!logic->unitsize)
+			break;
+		if ((p = logic_pyramid(ctx, logic->unitsize)))
+			add_logic(ctx, p, logic->data,
+				logic->length / logic->unitsize);
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet_in->payload;
+		if (!rle->unitsize || !(p = logic_pyramid(ctx, rle->unitsize)))
+			break;
+		values = rle->values;
+		for (i = 0; i < rle->num_runs; i++)
+			add_logic_run(ctx, p, values + i * rle->unitsize,
+				rle->lengths[i]);
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet_in->payload;
+		if (!planar->unitsize)
+			break;
+		if (!(p = logic_pyramid(ctx, planar->unitsize)))
+			break;
+		samples = scratch_buf(ctx, planar->num_samples * planar->unitsize);
+		if (!samples) {
+			sr_err("Failed to allocate conversion buffer.");
+			break;
+		}
+		sr_logic_planar_to_samples(planar, samples);
+		add_logic(ctx, p, samples, planar->num_samples);
+		break;
+	case SR_DF_ANALOG:
+		receive_analog(ctx, packet_in->payload);
+		break;
+	case SR_DF_END:
+		flush(ctx);
+		break;
+	default:
+		break;
+	}
+	g_mutex_unlock(&ctx->mutex);
+
+	/* The packet passes through unchanged. */
+	*packet_out = packet_in;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	pyramid_free(ctx->logic);
+	g_hash_table_destroy(ctx->analog);
+	g_mutex_clear(&ctx->mutex);
+	g_free(ctx->buf);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "blocksize", "Block size", "Number of samples per block of the finest level", NULL, NULL },
+	{ "factor", "Factor", "Number of blocks merged into a block of the next level", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(1024));
+		options[1].def = g_variant_ref_sink(g_variant_new_uint64(16));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_overview = {
+	.id = "overview",
+	.name = "Overview",
+	.desc = "Build a multi-resolution overview of the data",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
+
+static struct context *overview_context(const struct sr_transform *t)
+{
+	if (!t || t->module != &transform_overview || !t->priv)
+		return NULL;
+
+	return t->priv;
+}
+
+static struct pyramid *find_pyramid(struct context *ctx,
+		const struct sr_channel *ch)
+{
+	if (!ch)
+		return ctx->logic;
+
+	return g_hash_table_lookup(ctx->analog, ch);
+}
+
+/* Look up a range of blocks of a level. Must be called with the lock held. */
+static const uint8_t *find_records(struct context *ctx,
+		const struct sr_channel *ch, gboolean logic, unsigned int level,
+		uint64_t first, uint64_t count, struct pyramid **pp)
+{
+	struct pyramid *p;
+	struct level *l;
+	uint64_t num_blocks;
+
+	p = find_pyramid(ctx, ch);
+	if (!p || !p->unitsize != !logic || level >= p->levels->len)
+		return NULL;
+	l = g_ptr_array_index(p->levels, level);
+	num_blocks = l->records->len / p->record_size;
+	if (first > num_blocks || count > num_blocks - first)
+		return NULL;
+	*pp = p;
+
+	return l->records->data + first * p->record_size;
+}
+
+/**
+ * Get the size and extent of a level of an overview.
+ *
+ * The block size doubles as the number of samples covered by each block,
+ * except for the last block of a level, which may cover fewer samples at
+ * the end of the acquisition. Blocks are only added to a level once they
+ * are complete, so levels grow while the acquisition is running.
+ *
+ * @param[in] t The transform instance, which must use the "overview"
+ *              transform module.
+ * @param[in] ch The analog channel, or NULL for the logic data.
+ * @param[in] level The level, 0 being the finest one.
+ * @param[out] block_samples The number of samples per block. Can be NULL.
+ * @param[out] num_blocks The number of blocks in the level. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA No such level, or no data was received yet.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_transform_overview_level(const struct sr_transform *t,
+		const struct sr_channel *ch, unsigned int level,
+		uint64_t *block_samples, uint64_t *num_blocks)
+{
+	struct context *ctx;
+	struct pyramid *p;
+	struct level *l;
+	unsigned int i;
+	int ret;
+
+	if (!(ctx = overview_context(t)))
+		return SR_ERR_ARG;
+
+	ret = SR_ERR_NA;
+	g_mutex_lock(&ctx->mutex);
+	p = find_pyramid(ctx, ch);
+	if (p && level < p->levels->len) {
+		l = g_ptr_array_index(p->levels, level);
+		if (block_samples) {
+			*block_samples = ctx->blocksize;
+			for (i = 0; i < level; i++)
+				*block_samples *= ctx->factor;
+		}
+		if (num_blocks)
+			*num_blocks = l->records->len / p->record_size;
+		ret = SR_OK;
+	}
+	g_mutex_unlock(&ctx->mutex);
+
+	return ret;
+}
+
+/**
+ * Get the unitsize of the logic data of an overview.
+ *
+ * @param t The transform instance, which must use the "overview"
+ *          transform module.
+ *
+ * @return The size of a logic sample in bytes, or 0 if no logic data
+ *         was received yet.
+ *
+ * @since 0.6.0
+ */
+SR_API unsigned int sr_transform_overview_unitsize(const struct sr_transform *t)
+{
+	struct context *ctx;
+	unsigned int unitsize;
+
+	if (!(ctx = overview_context(t)))
+		return 0;
+
+	g_mutex_lock(&ctx->mutex);
+	unitsize = ctx->logic ? ctx->logic->unitsize : 0;
+	g_mutex_unlock(&ctx->mutex);
+
+	return unitsize;
+}
+
+/**
+ * Get blocks of the logic data overview.
+ *
+ * For every block, the OR and the AND of all its samples are stored,
+ * unitsize bytes each (see sr_transform_overview_unitsize()). A bit set
+ * in the OR means the channel was high at some point in the block, a bit
+ * cleared in the AND means it was low at some point. The transitions are
+ * the number of samples in the block which differ from their predecessor.
+ *
+ * @param[in] t The transform instance, which must use the "overview"
+ *              transform module.
+ * @param[in] level The level, 0 being the finest one.
+ * @param[in] first Index of the first block.
+ * @param[in] count Number of blocks.
+ * @param[out] or_bits Room for count * unitsize bytes. Can be NULL.
+ * @param[out] and_bits Room for count * unitsize bytes. Can be NULL.
+ * @param[out] transitions Room for count values. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The blocks don't exist.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_transform_overview_logic(const struct sr_transform *t,
+		unsigned int level, uint64_t first, uint64_t count,
+		uint8_t *or_bits, uint8_t *and_bits, uint64_t *transitions)
+{
+	struct context *ctx;
+	struct pyramid *p;
+	const struct logic_record *r;
+	const uint8_t *rec;
+	uint64_t i;
+
+	if (!(ctx = overview_context(t)))
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&ctx->mutex);
+	if (!(rec = find_records(ctx, NULL, TRUE, level, first, count, &p))) {
+		g_mutex_unlock(&ctx->mutex);
+		return SR_ERR_NA;
+	}
+	for (i = 0; i < count; i++, rec += p->record_size) {
+		r = (const struct logic_record *)rec;
+		if (or_bits)
+			memcpy(or_bits + i * p->unitsize, rec + sizeof(*r),
+				p->unitsize);
+		if (and_bits)
+			memcpy(and_bits + i * p->unitsize,
+				rec + sizeof(*r) + p->unitsize, p->unitsize);
+		if (transitions)
+			transitions[i] = r->transitions;
+	}
+	g_mutex_unlock(&ctx->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get blocks of the overview of an analog channel.
+ *
+ * @param[in] t The transform instance, which must use the "overview"
+ *              transform module.
+ * @param[in] ch The analog channel. Must not be NULL.
+ * @param[in] level The level, 0 being the finest one.
+ * @param[in] first Index of the first block.
+ * @param[in] count Number of blocks.
+ * @param[out] min Room for count values. Can be NULL.
+ * @param[out] max Room for count values. Can be NULL.
+ * @param[out] mean Room for count values. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The blocks don't exist.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_transform_overview_analog(const struct sr_transform *t,
+		const struct sr_channel *ch, unsigned int level,
+		uint64_t first, uint64_t count,
+		float *min, float *max, float *mean)
+{
+	struct context *ctx;
+	struct pyramid *p;
+	const struct analog_record *r;
+	const uint8_t *rec;
+	uint64_t i;
+
+	if (!(ctx = overview_context(t)) || !ch)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&ctx->mutex);
+	if (!(rec = find_records(ctx, ch, FALSE, level, first, count, &p))) {
+		g_mutex_unlock(&ctx->mutex);
+		return SR_ERR_NA;
+	}
+	r = (const struct analog_record *)rec;
+	for (i = 0; i < count; i++) {
+		if (min)
+			min[i] = r[i].min;
+		if (max)
+			max[i] = r[i].max;
+		if (mean)
+			mean[i] = r[i].sum / r[i].num_samples;
+	}
+	g_mutex_unlock(&ctx->mutex);
+
+	return SR_OK;
+}
+
+/*
+ * Stored pyramids start with the unitsize (0 for analog pyramids) and the
+ * number of levels as 32 bit values, followed by the block size and the
+ * factor as 64 bit values. Every level follows as the number of blocks,
+ * and the blocks. A logic block is stored as the number of samples and
+ * transitions, and the OR and AND of its samples. An analog block is
+ * stored as the number of samples, the minimum and maximum as floats,
+ * and the sum as a double. All values are little endian.
+ */
+#define STORED_HEADER_SIZE	24
+#define STORED_ANALOG_SIZE	24
+
+static size_t stored_record_size(const struct pyramid *p)
+{
+	if (p->unitsize)
+		return 16 + 2 * p->unitsize;
+
+	return STORED_ANALOG_SIZE;
+}
+
+static void append_u32(GByteArray *buf, uint32_t value)
+{
+	uint8_t b[4];
+
+	WL32(b, value);
+	g_byte_array_append(buf, b, sizeof(b));
+}
+
+static void append_u64(GByteArray *buf, uint64_t value)
+{
+	append_u32(buf, value & 0xffffffff);
+	append_u32(buf, value >> 32);
+}
+
+static void append_record(const struct pyramid *p, GByteArray *buf,
+		const uint8_t *rec)
+{
+	const struct logic_record *lr;
+	const struct analog_record *ar;
+	union { uint32_t u; float f; } fl;
+	union { uint64_t u; double d; } db;
+
+	if (p->unitsize) {
+		lr = (const struct logic_record *)rec;
+		append_u64(buf, lr->num_samples);
+		append_u64(buf, lr->transitions);
+		g_byte_array_append(buf, rec + sizeof(*lr), 2 * p->unitsize);
+		return;
+	}
+
+	ar = (const struct analog_record *)rec;
+	append_u64(buf, ar->num_samples);
+	fl.f = ar->min;
+	append_u32(buf, fl.u);
+	fl.f = ar->max;
+	append_u32(buf, fl.u);
+	db.d = ar->sum;
+	append_u64(buf, db.u);
+}
+
+/* Read a stored block back into a record. */
+static void parse_record(const struct pyramid *p, uint8_t *rec,
+		const uint8_t *src)
+{
+	struct logic_record *lr;
+	struct analog_record *ar;
+	union { uint64_t u; double d; } db;
+
+	if (p->unitsize) {
+		lr = (struct logic_record *)rec;
+		lr->num_samples = RL64(src);
+		lr->transitions = RL64(src + 8);
+		memcpy(rec + sizeof(*lr), src + 16, 2 * p->unitsize);
+		return;
+	}
+
+	ar = (struct analog_record *)rec;
+	ar->num_samples = RL64(src);
+	ar->min = RLFL(src + 8);
+	ar->max = RLFL(src + 12);
+	db.u = RL64(src + 16);
+	ar->sum = db.d;
+}
+
+/**
+ * Find the overview transform of a device.
+ *
+ * @param sdi The device instance.
+ *
+ * @return The first overview transform in the device's session which
+ *         was created for the device, or NULL if there is none.
+ *
+ * @private
+ */
+SR_PRIV const struct sr_transform *sr_transform_overview_find(
+		const struct sr_dev_inst *sdi)
+{
+	const struct sr_transform *t;
+	GSList *l;
+
+	if (!sdi || !sdi->session)
+		return NULL;
+
+	for (l = sdi->session->transforms; l; l = l->next) {
+		t = l->data;
+		if (t->module == &transform_overview && t->sdi == sdi)
+			return t;
+	}
+
+	return NULL;
+}
+
+/**
+ * Store a pyramid of an overview, in the format which
+ * sr_transform_overview_load() reads back.
+ *
+ * @param t The transform instance, which must use the "overview"
+ *          transform module.
+ * @param ch The analog channel, or NULL for the logic data.
+ *
+ * @return The stored pyramid, or NULL if there is none. The caller
+ *         must free it with g_byte_array_free().
+ *
+ * @private
+ */
+SR_PRIV GByteArray *sr_transform_overview_save(const struct sr_transform *t,
+		const struct sr_channel *ch)
+{
+	struct context *ctx;
+	struct pyramid *p;
+	struct level *l;
+	GByteArray *buf;
+	uint64_t num_blocks, i;
+	unsigned int n;
+
+	if (!(ctx = overview_context(t)))
+		return NULL;
+
+	buf = NULL;
+	g_mutex_lock(&ctx->mutex);
+	p = find_pyramid(ctx, ch);
+	if (p && ((struct level *)g_ptr_array_index(p->levels, 0))->records->len) {
+		buf = g_byte_array_new();
+		append_u32(buf, p->unitsize);
+		append_u32(buf, p->levels->len);
+		append_u64(buf, ctx->blocksize);
+		append_u64(buf, ctx->factor);
+		for (n = 0; n < p->levels->len; n++) {
+			l = g_ptr_array_index(p->levels, n);
+			num_blocks = l->records->len / p->record_size;
+			append_u64(buf, num_blocks);
+			for (i = 0; i < num_blocks; i++)
+				append_record(p, buf,
+					l->records->data + i * p->record_size);
+		}
+	}
+	g_mutex_unlock(&ctx->mutex);
+
+	return buf;
+}
+
+/**
+ * Restore a pyramid of an overview, which sr_transform_overview_save()
+ * stored. Data for the pyramid is ignored until the next acquisition.
+ *
+ * @param t The transform instance, which must use the "overview"
+ *          transform module.
+ * @param ch The analog channel, or NULL for the logic data.
+ * @param data The stored pyramid.
+ * @param len The length of the stored pyramid in bytes.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The pyramid was stored with another block size or
+ *                   factor than the transform uses.
+ * @retval SR_ERR_DATA The stored pyramid is invalid.
+ *
+ * @private
+ */
+SR_PRIV int sr_transform_overview_load(const struct sr_transform *t,
+		const struct sr_channel *ch, const uint8_t *data, size_t len)
+{
+	struct context *ctx;
+	struct pyramid *p;
+	struct level *l;
+	const uint8_t *end;
+	uint64_t num_blocks, i;
+	unsigned int unitsize, num_levels, n;
+	size_t stored_size;
+	uint8_t *rec;
+
+	if (!(ctx = overview_context(t)) || !data)
+		return SR_ERR_ARG;
+
+	end = data + len;
+	if (len < STORED_HEADER_SIZE)
+		return SR_ERR_DATA;
+	unitsize = RL32(data);
+	num_levels = RL32(data + 4);
+	if (!ch != !unitsize || unitsize > len || !num_levels)
+		return SR_ERR_DATA;
+	if (RL64(data + 8) != ctx->blocksize || RL64(data + 16) != ctx->factor)
+		return SR_ERR_NA;
+	data += STORED_HEADER_SIZE;
+
+	p = pyramid_new(unitsize);
+	stored_size = stored_record_size(p);
+	for (n = 0; n < num_levels; n++) {
+		if (n)
+			g_ptr_array_add(p->levels, level_new(p->record_size));
+		l = g_ptr_array_index(p->levels, n);
+		if ((size_t)(end - data) < 8)
+			goto err;
+		num_blocks = RL64(data);
+		data += 8;
+		if (!num_blocks || num_blocks > (size_t)(end - data) / stored_size)
+			goto err;
+		g_byte_array_set_size(l->records, num_blocks * p->record_size);
+		memset(l->records->data, 0, l->records->len);
+		for (i = 0; i < num_blocks; i++, data += stored_size) {
+			/* Every block starts with its number of samples. */
+			if (!RL64(data))
+				goto err;
+			rec = l->records->data + i * p->record_size;
+			parse_record(p, rec, data);
+		}
+	}
+	if (data != end)
+		goto err;
+	p->restored = TRUE;
+
+	g_mutex_lock(&ctx->mutex);
+	if (!ch) {
+		pyramid_free(ctx->logic);
+		ctx->logic = p;
+	} else {
+		g_hash_table_insert(ctx->analog, (struct sr_channel *)ch, p);
+	}
+	g_mutex_unlock(&ctx->mutex);
+
+	return SR_OK;
+
+err:
+	pyramid_free(p);
+
+	return SR_ERR_DATA;
+}
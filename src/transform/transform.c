@@ -45,12 +45,14 @@
 extern SR_PRIV struct sr_transform_module transform_nop;
 extern SR_PRIV struct sr_transform_module transform_scale;
 extern SR_PRIV struct sr_transform_module transform_invert;
+extern SR_PRIV struct sr_transform_module transform_overview;
 /* @endcond */
 
 static const struct sr_transform_module *transform_module_list[] = {
 	&transform_nop,
 	&transform_scale,
 	&transform_invert,
+	&transform_overview,
 	NULL,
 };
 
@@ -127,6 +129,13 @@ SR_API const struct sr_transform_module *sr_transform_find(const char *id)
 	return NULL;
 }
 
+/*
+ * Serialises the modules' lazy set-up of their option defaults with
+ * sr_transform_options_free() releasing them, as instances may be created
+ * on several threads at once.
+ */
+static GMutex options_lock;
+
 /**
  * Returns a NULL-terminated array of struct sr_option, or NULL if the
  * module takes no options.
@@ -144,7 +153,9 @@ SR_API const struct sr_option **sr_transform_options_get(const struct sr_transfo
 	if (!tmod || !tmod->options)
 		return NULL;
 
+	g_mutex_lock(&options_lock);
 	mod_opts = tmod->options();
+	g_mutex_unlock(&options_lock);
 
 	for (size = 0; mod_opts[size].id; size++)
 		;
@@ -170,6 +181,7 @@ SR_API void sr_transform_options_free(const struct sr_option **options)
 	if (!options)
 		return;
 
+	g_mutex_lock(&options_lock);
 	for (i = 0; options[i]; i++) {
 		if (options[i]->def) {
 			g_variant_unref(options[i]->def);
@@ -181,6 +193,7 @@ SR_API void sr_transform_options_free(const struct sr_option **options)
 			((struct sr_option *)options[i])->values = NULL;
 		}
 	}
+	g_mutex_unlock(&options_lock);
 	g_free(options);
 }
 
@@ -215,6 +228,7 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 	new_opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
 			(GDestroyNotify)g_variant_unref);
 	if (tmod->options) {
+		g_mutex_lock(&options_lock);
 		mod_opts = tmod->options();
 		for (i = 0; mod_opts[i].id; i++) {
 			if (options && g_hash_table_lookup_extended(options,
@@ -224,6 +238,7 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 				if (!g_variant_is_of_type(value, gvt)) {
 					sr_err("Invalid type for '%s' option.",
 						(char *)key);
+					g_mutex_unlock(&options_lock);
 					g_free(t);
 					return NULL;
 				}
@@ -235,6 +250,7 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 						g_variant_ref(mod_opts[i].def));
 			}
 		}
+		g_mutex_unlock(&options_lock);
 
 		/* Make sure no invalid options were given. */
 		if (options) {
@@ -259,7 +275,10 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 		g_hash_table_destroy(new_opts);
 
 	/* Add the transform to the session's list of transforms. */
-	sdi->session->transforms = g_slist_append(sdi->session->transforms, t);
+	if (t) {
+		t->stats_id = sr_session_stats_id_new(sdi->session);
+		sdi->session->transforms = g_slist_append(sdi->session->transforms, t);
+	}
 
 	return t;
 }
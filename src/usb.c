@@ -20,6 +20,8 @@
  */
 
 #include <config.h>
+#include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <memory.h>
 #include <glib.h>
@@ -37,6 +39,163 @@
 typedef int libusb_os_handle;
 #endif
 
+/* USB transfer recordings: header, then records, all little endian. */
+#define USB_REC_MAGIC "SRUSBREC"
+#define USB_REC_VERSION 1
+#define USB_REC_FILE_HEADER_SIZE 12
+#define USB_REC_HEADER_SIZE 24
+/* Largest data length of a record, well above any transfer in use. */
+#define USB_REC_MAX_LENGTH (256 * 1024 * 1024)
+
+/* Maximum number of transfers completed per replay dispatch. */
+#define USB_REPLAY_BATCH 64
+
+enum usb_rec_type {
+	USB_REC_CONTROL,
+	USB_REC_TRANSFER,
+};
+
+/** One record of a USB transfer recording.
+ * @internal
+ */
+struct usb_rec {
+	uint8_t type;
+	/* bmRequestType of control, endpoint of other transfers. */
+	uint8_t endpoint;
+	uint8_t request;
+	/* Completion status of other transfers. */
+	uint8_t status;
+	uint16_t value;
+	uint16_t index;
+	/* Time since the start of the recording [us]. */
+	uint64_t timestamp_us;
+	/* Return value of control, actual length of other transfers. */
+	int32_t result;
+	/* Number of data bytes following the record header. */
+	uint32_t length;
+};
+
+/** Records or replays the USB transfers of a libsigrok context.
+ * @internal
+ */
+struct sr_usb_recorder {
+	/*
+	 * Recording: protects the file and the transfers, as completions
+	 * may be recorded on the USB event thread.
+	 */
+	GMutex lock;
+	gboolean replay;
+	/* Replay at the recorded pace, instead of as fast as possible. */
+	gboolean throttle;
+	/* Recording: output. Replay: cursor for non-control transfers. */
+	FILE *file;
+	/* Replay: cursor for control transfers. */
+	FILE *control_file;
+	/* Recording: start time. Replay: recorded time 0 as of now [us]. */
+	int64_t start_us;
+	/* Recording: struct usb_rec_transfer of submitted transfers. */
+	GHashTable *transfers;
+	/* Replay: submitted and cancelled transfers. */
+	GQueue pending;
+	GQueue cancelled;
+	/* Replay: next non-control record, if already read. */
+	struct usb_rec next;
+	uint8_t *next_data;
+	gboolean have_next;
+	gboolean eof;
+};
+
+/* Poll interval of the USB event thread for its quit flag [us]. */
+#define USB_EVENT_THREAD_POLL_US 50000
+
+/** Handles libusb events on a dedicated thread.
+ * @internal
+ */
+struct sr_usb_event_thread {
+	/* Separate libusb context for the devices of handoff drivers. */
+	libusb_context *usb_ctx;
+	GThread *thread;
+	/* Number of handoffs keeping the thread running. */
+	unsigned int users;
+	gint quit;
+};
+
+/** Single producer, single consumer queue of fixed size elements.
+ * @internal
+ */
+struct usb_ring {
+	uint8_t *slots;
+	size_t elem_size;
+	guint size;
+	/* Written by the consumer only. */
+	gint head;
+	/* Written by the producer only. */
+	gint tail;
+};
+
+/** Hands completed transfers over from the USB event thread.
+ * @internal
+ */
+struct sr_usb_handoff {
+	struct sr_context *ctx;
+	struct sr_usb_event_thread *thread;
+	size_t buffer_size;
+	/* Filled buffers and deferred transfers, to the session thread. */
+	struct usb_ring filled;
+	/* Free buffers, back to the event thread. */
+	struct usb_ring free;
+	/* Event thread: bytes dropped since the last filled buffer. */
+	uint64_t dropped;
+	/* Session thread: total bytes dropped. */
+	uint64_t dropped_total;
+	/* Set when entries are waiting for the session thread. */
+	gint pending;
+	/* Main context of the session to wake up, while a source is added. */
+	GMutex lock;
+	GMainContext *context;
+};
+
+/* Completions after which a stream reconsiders a deeper queue. */
+#define USB_STREAM_WINDOW 256
+
+/** Adaptive sizing of the transfers of a streaming acquisition.
+ * @internal
+ */
+struct sr_usb_stream {
+	struct sr_usb_stream_config config;
+	struct sr_session *session;
+	/* Registration ID for the session's pipeline statistics. */
+	unsigned int stats_id;
+	/* Completions may be accounted on the USB event thread. */
+	GMutex lock;
+	size_t size;
+	/* Number of transfers to keep in flight, initially and currently. */
+	unsigned int initial;
+	unsigned int target;
+	unsigned int in_flight;
+	/* Maps transfers to their last submission time [us]. */
+	GHashTable *submit_us;
+	int64_t last_us;
+	/* Longest gap between completions in the current window [us]. */
+	int64_t max_gap_us;
+	unsigned int window;
+	/* Statistics. */
+	uint64_t completed;
+	uint64_t empty;
+	uint64_t bytes;
+	unsigned int grown;
+	unsigned int shrunk;
+};
+
+/** A transfer submitted while recording.
+ * @internal
+ */
+struct usb_rec_transfer {
+	struct sr_usb_recorder *recorder;
+	libusb_transfer_cb_fn callback;
+	void *user_data;
+};
+
 /** Custom GLib event source for libusb I/O.
  * @internal
  */
@@ -48,11 +207,21 @@ struct usb_source {
 
 	/* Needed to keep track of installed sources */
 	struct sr_session *session;
+	/* Key of the source in the session. */
+	void *key;
 
 	struct libusb_context *usb_ctx;
 	GPtrArray *pollfds;
+
+	/* Set if transfers are replayed from a recording. */
+	struct sr_usb_recorder *replay;
+	/* Set if dispatched for entries waiting in a handoff instead. */
+	struct sr_usb_handoff *handoff;
 };
 
+static int64_t usb_replay_due(struct sr_usb_recorder *rec);
+static void usb_replay_dispatch(struct sr_usb_recorder *rec);
+
 /** USB event source prepare() method.
  */
 static gboolean usb_source_prepare(GSource *source, int *timeout)
@@ -65,7 +234,11 @@ static gboolean usb_source_prepare(GSource *source, int *timeout)
 
 	usource = (struct usb_source *)source;
 
-	ret = libusb_get_next_timeout(usource->usb_ctx, &usb_timeout);
+	/* The event thread takes care of libusb timeouts. */
+	if (usource->handoff)
+		ret = 0;
+	else
+		ret = libusb_get_next_timeout(usource->usb_ctx, &usb_timeout);
 	if (G_UNLIKELY(ret < 0)) {
 		sr_err("Failed to get libusb timeout: %s",
 			libusb_error_name(ret));
@@ -82,6 +255,15 @@ static gboolean usb_source_prepare(GSource *source, int *timeout)
 		if (usb_due_us < usource->due_us)
 			usource->due_us = usb_due_us;
 	}
+	if (usource->replay) {
+		usb_due_us = usb_replay_due(usource->replay);
+		if (usb_due_us < usource->due_us)
+			usource->due_us = MAX(usb_due_us, now_us);
+	}
+	if (usource->handoff && g_atomic_int_get(&usource->handoff->pending)) {
+		*timeout = 0;
+		return TRUE;
+	}
 	if (usource->due_us != INT64_MAX)
 		remaining_ms = (MAX(0, usource->due_us - now_us) + 999) / 1000;
 	else
@@ -108,6 +290,11 @@ static gboolean usb_source_check(GSource *source)
 		pollfd = g_ptr_array_index(usource->pollfds, i);
 		revents |= pollfd->revents;
 	}
+	if (usource->replay && usb_replay_due(usource->replay)
+			<= g_source_get_time(source))
+		return TRUE;
+	if (usource->handoff && g_atomic_int_get(&usource->handoff->pending))
+		return TRUE;
 	return (revents != 0 || (usource->due_us != INT64_MAX
 			&& usource->due_us <= g_source_get_time(source)));
 }
@@ -139,6 +326,12 @@ static gboolean usb_source_dispatch(GSource *source,
 		sr_err("Callback not set, cannot dispatch event.");
 		return G_SOURCE_REMOVE;
 	}
+	/* Complete replayed transfers, as libusb would for real ones. */
+	if (usource->replay)
+		usb_replay_dispatch(usource->replay);
+	/* Entries pushed from now on need another dispatch. */
+	if (usource->handoff)
+		g_atomic_int_set(&usource->handoff->pending, 0);
 	keep = (*(sr_receive_data_callback)callback)(-1, revents, user_data);
 
 	if (G_LIKELY(keep) && G_LIKELY(!g_source_is_destroyed(source))) {
@@ -161,13 +354,14 @@ static void usb_source_finalize(GSource *source)
 
 	sr_spew("%s", __func__);
 
-	libusb_set_pollfd_notifiers(usource->usb_ctx, NULL, NULL, NULL);
+	/* The handoff may be gone, see sr_usb_handoff_source_remove(). */
+	if (!usource->handoff)
+		libusb_set_pollfd_notifiers(usource->usb_ctx, NULL, NULL, NULL);
 
 	g_ptr_array_unref(usource->pollfds);
 	usource->pollfds = NULL;
 
-	sr_session_source_destroyed(usource->session,
-			usource->usb_ctx, source);
+	sr_session_source_destroyed(usource->session, usource->key, source);
 }
 
 /** Callback invoked when a new libusb FD should be added to the poll set.
@@ -244,13 +438,18 @@ static void usb_source_free_pollfd(void *data)
  * API at some point. Instead, drivers should install separate timer
  * event sources for their polling needs.
  *
+ * With a handoff given, see sr_usb_handoff_new(), libusb events are
+ * handled on the USB event thread, and the event source is dispatched
+ * whenever entries wait in that handoff instead.
+ *
  * @param session The session the event source belongs to.
- * @param usb_ctx The libusb context for which to handle events.
+ * @param ctx The libsigrok context whose libusb events to handle.
+ * @param h The handoff to collect entries from, or NULL.
  * @param timeout_ms The timeout interval in ms, or -1 to wait indefinitely.
  * @return A new event source object, or NULL on failure.
  */
 static GSource *usb_source_new(struct sr_session *session,
-		struct libusb_context *usb_ctx, int timeout_ms)
+		struct sr_context *ctx, struct sr_usb_handoff *h, int timeout_ms)
 {
 	static GSourceFuncs usb_source_funcs = {
 		.prepare  = &usb_source_prepare,
@@ -261,9 +460,12 @@ static GSource *usb_source_new(struct sr_session *session,
 	GSource *source;
 	struct usb_source *usource;
 	const struct libusb_pollfd **upollfds, **upfd;
+	struct libusb_context *usb_ctx;
 
-	upollfds = libusb_get_pollfds(usb_ctx);
-	if (!upollfds) {
+	usb_ctx = ctx->libusb_ctx;
+
+	upollfds = NULL;
+	if (!h && !(upollfds = libusb_get_pollfds(usb_ctx))) {
 		sr_err("Failed to get libusb file descriptors.");
 		return NULL;
 	}
@@ -280,8 +482,19 @@ static GSource *usb_source_new(struct sr_session *session,
 		usource->due_us = INT64_MAX;
 	}
 	usource->session = session;
+	usource->key = h ? (void *)h : (void *)usb_ctx;
 	usource->usb_ctx = usb_ctx;
 	usource->pollfds = g_ptr_array_new_full(8, &usb_source_free_pollfd);
+	if (ctx->usb_recorder && ctx->usb_recorder->replay)
+		usource->replay = ctx->usb_recorder;
+
+	if (h) {
+		usource->handoff = h;
+		g_mutex_lock(&h->lock);
+		h->context = g_main_context_ref(session->main_context);
+		g_mutex_unlock(&h->lock);
+		return source;
+	}
 
 	for (upfd = upollfds; *upfd != NULL; upfd++)
 		usb_pollfd_added((*upfd)->fd, (*upfd)->events, usource);
@@ -297,6 +510,983 @@ static GSource *usb_source_new(struct sr_session *session,
 	return source;
 }
 
+static void usb_ring_init(struct usb_ring *ring, size_t elem_size,
+		guint size)
+{
+	ring->slots = g_malloc0(elem_size * size);
+	ring->elem_size = elem_size;
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+/* Producer side. The atomic accesses order the slot contents. */
+static gboolean usb_ring_push(struct usb_ring *ring, const void *elem)
+{
+	guint head, tail;
+
+	head = g_atomic_int_get(&ring->head);
+	tail = ring->tail;
+	if (tail - head == ring->size)
+		return FALSE;
+
+	memcpy(ring->slots + (tail % ring->size) * ring->elem_size,
+		elem, ring->elem_size);
+	g_atomic_int_set(&ring->tail, tail + 1);
+
+	return TRUE;
+}
+
+/* Consumer side. */
+static gboolean usb_ring_pop(struct usb_ring *ring, void *elem)
+{
+	guint head, tail;
+
+	head = ring->head;
+	tail = g_atomic_int_get(&ring->tail);
+	if (head == tail)
+		return FALSE;
+
+	memcpy(elem, ring->slots + (head % ring->size) * ring->elem_size,
+		ring->elem_size);
+	g_atomic_int_set(&ring->head, head + 1);
+
+	return TRUE;
+}
+
+static gpointer usb_event_thread_run(gpointer data)
+{
+	struct sr_usb_event_thread *thread;
+	struct timeval tv;
+
+	thread = data;
+
+	while (!g_atomic_int_get(&thread->quit)) {
+		tv.tv_sec = 0;
+		tv.tv_usec = USB_EVENT_THREAD_POLL_US;
+		libusb_handle_events_timeout_completed(thread->usb_ctx,
+			&tv, NULL);
+	}
+
+	return NULL;
+}
+
+/* Let the session thread know that handoff entries are waiting. */
+static void usb_handoff_notify(struct sr_usb_handoff *h)
+{
+	g_atomic_int_set(&h->pending, 1);
+
+	g_mutex_lock(&h->lock);
+	if (h->context)
+		g_main_context_wakeup(h->context);
+	g_mutex_unlock(&h->lock);
+}
+
+/**
+ * Allow handling libusb events on a dedicated thread.
+ *
+ * This is enabled by setting the environment variable
+ * SIGROK_USB_EVENT_THREAD. The thread only runs while drivers which
+ * support it have a handoff active, see sr_usb_handoff_new(). It only
+ * handles the events of devices opened on a libusb context of its own,
+ * see sr_usb_handoff_context(), so the transfers of all other devices
+ * keep completing on the session thread.
+ *
+ * @param ctx The libsigrok context to set up.
+ */
+SR_PRIV void sr_usb_event_thread_init(struct sr_context *ctx)
+{
+	struct sr_usb_event_thread *thread;
+	int ret;
+
+	ctx->usb_event_thread = NULL;
+	if (!g_getenv("SIGROK_USB_EVENT_THREAD"))
+		return;
+
+	/* Replayed transfers complete from the session thread. */
+	if (ctx->usb_recorder && ctx->usb_recorder->replay) {
+		sr_warn("USB event thread not available during replay.");
+		return;
+	}
+
+	thread = g_malloc0(sizeof(*thread));
+	if ((ret = libusb_init(&thread->usb_ctx)) != LIBUSB_SUCCESS) {
+		sr_warn("USB event thread not available, libusb_init() "
+			"returned %s.", libusb_error_name(ret));
+		g_free(thread);
+		return;
+	}
+	ctx->usb_event_thread = thread;
+}
+
+/** Release the resources of the USB event thread. */
+SR_PRIV void sr_usb_event_thread_cleanup(struct sr_context *ctx)
+{
+	struct sr_usb_event_thread *thread;
+
+	if (!(thread = ctx->usb_event_thread))
+		return;
+
+	libusb_exit(thread->usb_ctx);
+	g_free(thread);
+	ctx->usb_event_thread = NULL;
+}
+
+/**
+ * Get the libusb context to open devices on, for drivers which use
+ * handoffs.
+ *
+ * @param ctx The libsigrok context.
+ *
+ * @return The USB event thread's libusb context if the thread is enabled,
+ *         see sr_usb_event_thread_init(), the libsigrok context's one
+ *         otherwise.
+ */
+SR_PRIV libusb_context *sr_usb_handoff_context(struct sr_context *ctx)
+{
+	if (ctx->usb_event_thread)
+		return ctx->usb_event_thread->usb_ctx;
+
+	return ctx->libusb_ctx;
+}
+
+/**
+ * Create a handoff of completed transfers to the session thread.
+ *
+ * With a handoff active, libusb events are handled on a dedicated
+ * thread, so the driver's transfer callbacks run there. They hand each
+ * filled buffer over with sr_usb_handoff_push(), which swaps in a free
+ * buffer, and resubmit the transfer straight away. Transfers needing
+ * further attention are passed on with sr_usb_handoff_defer(). On the
+ * session thread, the driver's usb_source_add() callback collects the
+ * entries with sr_usb_handoff_pop(), and returns the buffers with
+ * sr_usb_handoff_release(). This way, slow session consumers do not
+ * delay resubmission as long as free buffers are left.
+ *
+ * Only devices opened on the context returned by sr_usb_handoff_context()
+ * have their events handled on the thread. The transfers' buffers must
+ * have been allocated with g_malloc() and be of @p buffer_size bytes.
+ * Collect the entries from the event source added with
+ * sr_usb_handoff_source_add(), in place of usb_source_add().
+ *
+ * @param ctx The libsigrok context.
+ * @param num_transfers The maximum number of transfers in flight.
+ * @param num_buffers The number of spare buffers to fill.
+ * @param buffer_size The size of each buffer, in bytes.
+ *
+ * @return The new handoff, or NULL if the USB event thread is not
+ *         enabled, see sr_usb_event_thread_init().
+ */
+SR_PRIV struct sr_usb_handoff *sr_usb_handoff_new(struct sr_context *ctx,
+		unsigned int num_transfers, unsigned int num_buffers,
+		size_t buffer_size)
+{
+	struct sr_usb_event_thread *thread;
+	struct sr_usb_handoff *h;
+	unsigned int i;
+	uint8_t *buf;
+
+	if (!(thread = ctx->usb_event_thread))
+		return NULL;
+
+	h = g_malloc0(sizeof(*h));
+	h->ctx = ctx;
+	h->thread = thread;
+	h->buffer_size = buffer_size;
+	g_mutex_init(&h->lock);
+	/* Deferred transfers never need to wait for a free slot. */
+	usb_ring_init(&h->filled, sizeof(struct sr_usb_handoff_entry),
+		num_buffers + num_transfers);
+	usb_ring_init(&h->free, sizeof(uint8_t *), num_buffers);
+	for (i = 0; i < num_buffers; i++) {
+		buf = g_malloc(buffer_size);
+		usb_ring_push(&h->free, &buf);
+	}
+
+	if (thread->users++ == 0) {
+		g_atomic_int_set(&thread->quit, 0);
+		thread->thread = g_thread_new("sr-usb-events",
+			usb_event_thread_run, thread);
+	}
+
+	return h;
+}
+
+/**
+ * Free a handoff, and its buffers.
+ *
+ * No transfers must be in flight any more, and this must not be called
+ * from a transfer callback.
+ */
+SR_PRIV void sr_usb_handoff_free(struct sr_usb_handoff *h)
+{
+	struct sr_usb_event_thread *thread;
+	struct sr_usb_handoff_entry entry;
+	uint8_t *buf;
+
+	if (!h)
+		return;
+
+	thread = h->thread;
+	if (--thread->users == 0) {
+		g_atomic_int_set(&thread->quit, 1);
+		g_thread_join(thread->thread);
+		thread->thread = NULL;
+	}
+
+	while (usb_ring_pop(&h->filled, &entry))
+		g_free(entry.data);
+	while (usb_ring_pop(&h->free, &buf))
+		g_free(buf);
+	g_free(h->filled.slots);
+	g_free(h->free.slots);
+	if (h->context)
+		g_main_context_unref(h->context);
+	g_mutex_clear(&h->lock);
+
+	if (h->dropped_total > 0)
+		sr_warn("Dropped %" PRIu64 " bytes of USB data, the session "
+			"did not keep up.", h->dropped_total);
+	g_free(h);
+}
+
+/**
+ * Hand a completed transfer's data over to the session thread.
+ *
+ * Called from the transfer callback on the USB event thread. The
+ * transfer's buffer is replaced by a free one, so the transfer can be
+ * resubmitted right away. If no free buffer is left, the data is
+ * dropped, and reported with the next entry which gets through.
+ *
+ * @retval TRUE The data was handed over.
+ * @retval FALSE The data was dropped.
+ */
+SR_PRIV gboolean sr_usb_handoff_push(struct sr_usb_handoff *h,
+		struct libusb_transfer *transfer)
+{
+	struct sr_usb_handoff_entry entry;
+	uint8_t *buf;
+
+	if (!usb_ring_pop(&h->free, &buf)) {
+		h->dropped += transfer->actual_length;
+		return FALSE;
+	}
+
+	entry.data = transfer->buffer;
+	entry.length = transfer->actual_length;
+	entry.transfer = NULL;
+	entry.dropped = h->dropped;
+	h->dropped = 0;
+	transfer->buffer = buf;
+
+	usb_ring_push(&h->filled, &entry);
+	usb_handoff_notify(h);
+
+	return TRUE;
+}
+
+/**
+ * Pass a transfer on to the session thread, for the driver to handle it
+ * there, in order with the data handed over before.
+ */
+SR_PRIV void sr_usb_handoff_defer(struct sr_usb_handoff *h,
+		struct libusb_transfer *transfer)
+{
+	struct sr_usb_handoff_entry entry;
+
+	entry.data = NULL;
+	entry.length = 0;
+	entry.transfer = transfer;
+	entry.dropped = 0;
+
+	usb_ring_push(&h->filled, &entry);
+	usb_handoff_notify(h);
+}
+
+/**
+ * Take the next entry on the session thread.
+ *
+ * For filled buffers, @p entry->data must be passed back with
+ * sr_usb_handoff_release() once done.
+ *
+ * @retval TRUE An entry was taken.
+ * @retval FALSE No entries are waiting.
+ */
+SR_PRIV gboolean sr_usb_handoff_pop(struct sr_usb_handoff *h,
+		struct sr_usb_handoff_entry *entry)
+{
+	if (!usb_ring_pop(&h->filled, entry))
+		return FALSE;
+
+	h->dropped_total += entry->dropped;
+
+	return TRUE;
+}
+
+/**
+ * Return a buffer to the handoff, for the event thread to fill.
+ *
+ * @param h The handoff.
+ * @param buf A buffer of the handoff's buffer size, allocated with
+ *            g_malloc(). Not necessarily one taken from an entry.
+ */
+SR_PRIV void sr_usb_handoff_release(struct sr_usb_handoff *h, uint8_t *buf)
+{
+	if (!usb_ring_push(&h->free, &buf))
+		g_free(buf);
+}
+
+/**
+ * Set up adaptive sizing for the transfers of a streaming acquisition.
+ *
+ * The transfer size is picked from the expected data rate, and fixed
+ * for the acquisition. The number of transfers in flight starts out
+ * covering the configured queue time, and adapts to the host: when
+ * completions are handled late compared to the data kept in flight, the
+ * queue is deepened, and when that no longer happens for a while, it
+ * shrinks back. Drivers report each transfer's submission and
+ * completion, and submit or retire transfers as requested.
+ *
+ * Completed transfers are accounted in the session's statistics, see
+ * sr_session_stats_enable().
+ *
+ * @param config Bounds of the transfer size and count.
+ * @param session The session of the acquisition.
+ *
+ * @return The new stream.
+ */
+SR_PRIV struct sr_usb_stream *sr_usb_stream_new(
+		const struct sr_usb_stream_config *config,
+		struct sr_session *session)
+{
+	struct sr_usb_stream *s;
+	uint64_t bytes_per_ms;
+	size_t block_size;
+
+	s = g_malloc0(sizeof(*s));
+	s->config = *config;
+	s->session = session;
+	if (session)
+		s->stats_id = sr_session_stats_id_new(session);
+	g_mutex_init(&s->lock);
+	s->submit_us = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+	bytes_per_ms = MAX(config->bytes_per_ms, 1);
+	block_size = MAX(config->block_size, 1);
+	s->size = config->transfer_ms * bytes_per_ms;
+	s->size = CLAMP(s->size, config->min_size, config->max_size);
+	s->size = (s->size + block_size - 1) / block_size * block_size;
+
+	s->initial = (config->queue_ms * bytes_per_ms + s->size - 1) / s->size;
+	s->initial = CLAMP(s->initial, config->min_transfers,
+		config->max_transfers);
+	s->target = s->initial;
+	if (!config->adaptive)
+		s->config.max_transfers = s->initial;
+
+	sr_dbg("Streaming with %u transfers of %zu bytes, up to %u.",
+		s->target, s->size, config->max_transfers);
+
+	return s;
+}
+
+/** Free a stream, and log its statistics. */
+SR_PRIV void sr_usb_stream_free(struct sr_usb_stream *s)
+{
+	if (!s)
+		return;
+
+	sr_dbg("Stream: %" PRIu64 " transfers, %" PRIu64 " empty, %" PRIu64
+		" bytes (%.1f%% fill), queue grown %u, shrunk %u times.",
+		s->completed, s->empty, s->bytes,
+		s->completed ? 100.0 * s->bytes / (s->completed * s->size) : 0,
+		s->grown, s->shrunk);
+
+	g_hash_table_destroy(s->submit_us);
+	g_mutex_clear(&s->lock);
+	g_free(s);
+}
+
+/** Get the size of the stream's transfers, in bytes. */
+SR_PRIV size_t sr_usb_stream_buffer_size(struct sr_usb_stream *s)
+{
+	return s->size;
+}
+
+/** Get the maximum number of transfers in flight. */
+SR_PRIV unsigned int sr_usb_stream_max_transfers(struct sr_usb_stream *s)
+{
+	return s->config.max_transfers;
+}
+
+/** Get the timeout for the stream's transfers, in ms. */
+SR_PRIV unsigned int sr_usb_stream_timeout(struct sr_usb_stream *s)
+{
+	unsigned int timeout;
+
+	g_mutex_lock(&s->lock);
+	timeout = s->target * s->size / MAX(s->config.bytes_per_ms, 1);
+	g_mutex_unlock(&s->lock);
+
+	return timeout + timeout / 4; /* Leave a headroom of 25%. */
+}
+
+/** Account a transfer's (re)submission. */
+SR_PRIV void sr_usb_stream_submitted(struct sr_usb_stream *s,
+		struct libusb_transfer *transfer)
+{
+	int64_t *submit_us;
+
+	g_mutex_lock(&s->lock);
+	if (!(submit_us = g_hash_table_lookup(s->submit_us, transfer))) {
+		submit_us = g_malloc(sizeof(*submit_us));
+		g_hash_table_insert(s->submit_us, transfer, submit_us);
+	}
+	*submit_us = g_get_monotonic_time();
+	s->in_flight++;
+	g_mutex_unlock(&s->lock);
+}
+
+/**
+ * Account a transfer's completion, and adapt the queue depth.
+ *
+ * @retval TRUE The transfer should be resubmitted.
+ * @retval FALSE The transfer should be retired, the queue is too deep.
+ */
+SR_PRIV gboolean sr_usb_stream_completed(struct sr_usb_stream *s,
+		struct libusb_transfer *transfer)
+{
+	int64_t now_us, gap_us, queue_us, *submit_us;
+	gboolean resubmit;
+
+	now_us = g_get_monotonic_time();
+
+	g_mutex_lock(&s->lock);
+
+	s->in_flight = s->in_flight ? s->in_flight - 1 : 0;
+	s->completed++;
+	s->bytes += transfer->actual_length;
+	if (transfer->actual_length == 0)
+		s->empty++;
+
+	submit_us = g_hash_table_lookup(s->submit_us, transfer);
+	if (submit_us)
+		sr_session_stats_usb_transfer(s->session, s->stats_id,
+			transfer->actual_length, *submit_us);
+
+	/* Time it takes the device to fill the transfers in flight. */
+	queue_us = (int64_t)s->target * s->size * 1000
+		/ MAX(s->config.bytes_per_ms, 1);
+	gap_us = s->last_us ? now_us - s->last_us : 0;
+	s->last_us = now_us;
+	s->max_gap_us = MAX(s->max_gap_us, gap_us);
+
+	if (!s->config.adaptive) {
+		/* Keep the initial queue depth. */
+	} else if (gap_us > queue_us / 2
+			&& s->target < s->config.max_transfers) {
+		/* Handled late, with the device about to run out. */
+		s->target = MIN(s->target * 2, s->config.max_transfers);
+		s->grown++;
+		s->window = 0;
+		s->max_gap_us = 0;
+		sr_dbg("Completion %" PRId64 " us late, %u transfers now.",
+			gap_us, s->target);
+	} else if (++s->window >= USB_STREAM_WINDOW) {
+		if (s->max_gap_us < queue_us / 8 && s->target > s->initial) {
+			s->target--;
+			s->shrunk++;
+		}
+		s->window = 0;
+		s->max_gap_us = 0;
+	}
+
+	resubmit = (s->in_flight < s->target);
+
+	g_mutex_unlock(&s->lock);
+
+	return resubmit;
+}
+
+/** Get the number of transfers to submit in addition. */
+SR_PRIV unsigned int sr_usb_stream_wanted(struct sr_usb_stream *s)
+{
+	unsigned int wanted;
+
+	g_mutex_lock(&s->lock);
+	wanted = (s->target > s->in_flight) ? s->target - s->in_flight : 0;
+	g_mutex_unlock(&s->lock);
+
+	return wanted;
+}
+
+static int usb_rec_write(struct sr_usb_recorder *rec,
+		struct usb_rec *r, const uint8_t *data)
+{
+	uint8_t hdr[USB_REC_HEADER_SIZE];
+	int ret;
+
+	r->timestamp_us = g_get_monotonic_time() - rec->start_us;
+
+	hdr[0] = r->type;
+	hdr[1] = r->endpoint;
+	hdr[2] = r->request;
+	hdr[3] = r->status;
+	WL16(&hdr[4], r->value);
+	WL16(&hdr[6], r->index);
+	WL32(&hdr[8], r->timestamp_us & 0xffffffff);
+	WL32(&hdr[12], r->timestamp_us >> 32);
+	WL32(&hdr[16], r->result);
+	WL32(&hdr[20], r->length);
+
+	ret = SR_OK;
+	g_mutex_lock(&rec->lock);
+	if (fwrite(hdr, sizeof(hdr), 1, rec->file) != 1
+			|| (r->length && fwrite(data, r->length, 1, rec->file) != 1)) {
+		sr_err("Failed to write USB recording: %s.", g_strerror(errno));
+		ret = SR_ERR_IO;
+	}
+	g_mutex_unlock(&rec->lock);
+
+	return ret;
+}
+
+/** Read the next record, and its data into a newly allocated buffer. */
+static gboolean usb_rec_read(FILE *file, struct usb_rec *r, uint8_t **data)
+{
+	uint8_t hdr[USB_REC_HEADER_SIZE];
+
+	*data = NULL;
+	if (fread(hdr, sizeof(hdr), 1, file) != 1)
+		return FALSE;
+
+	r->type = hdr[0];
+	r->endpoint = hdr[1];
+	r->request = hdr[2];
+	r->status = hdr[3];
+	r->value = RL16(&hdr[4]);
+	r->index = RL16(&hdr[6]);
+	r->timestamp_us = RL64(&hdr[8]);
+	r->result = RL32S(&hdr[16]);
+	r->length = RL32(&hdr[20]);
+
+	/* Checked by usb_rec_check(), unless the file changed since. */
+	if (r->length > USB_REC_MAX_LENGTH) {
+		sr_err("Invalid record length %u in USB recording.", r->length);
+		return FALSE;
+	}
+
+	*data = g_malloc(r->length + 1);
+	if (r->length && fread(*data, r->length, 1, file) != 1) {
+		sr_err("Truncated USB recording.");
+		g_free(*data);
+		*data = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Check that all records of a recording are complete, and that their
+ * data lengths are sane, before replaying it. Leaves the file position
+ * at the first record.
+ */
+static gboolean usb_rec_check(FILE *file)
+{
+	uint8_t hdr[USB_REC_HEADER_SIZE];
+	long start, end, pos;
+	uint32_t length;
+
+	if ((start = ftell(file)) < 0 || fseek(file, 0, SEEK_END) < 0
+			|| (end = ftell(file)) < 0)
+		return FALSE;
+
+	for (pos = start; pos < end; pos += USB_REC_HEADER_SIZE + length) {
+		if (end - pos < USB_REC_HEADER_SIZE
+				|| fseek(file, pos, SEEK_SET) < 0
+				|| fread(hdr, sizeof(hdr), 1, file) != 1)
+			return FALSE;
+		length = RL32(&hdr[20]);
+		if (length > USB_REC_MAX_LENGTH
+				|| length > end - pos - USB_REC_HEADER_SIZE)
+			return FALSE;
+	}
+
+	return fseek(file, start, SEEK_SET) == 0;
+}
+
+static FILE *usb_rec_open(const char *filename, gboolean write)
+{
+	uint8_t hdr[USB_REC_FILE_HEADER_SIZE];
+	FILE *file;
+
+	if (!(file = g_fopen(filename, write ? "wb" : "rb"))) {
+		sr_err("Failed to open USB recording '%s': %s.",
+			filename, g_strerror(errno));
+		return NULL;
+	}
+
+	if (write) {
+		memcpy(hdr, USB_REC_MAGIC, 8);
+		WL32(&hdr[8], USB_REC_VERSION);
+		if (fwrite(hdr, sizeof(hdr), 1, file) == 1)
+			return file;
+	} else if (fread(hdr, sizeof(hdr), 1, file) == 1
+			&& !memcmp(hdr, USB_REC_MAGIC, 8)
+			&& RL32(&hdr[8]) == USB_REC_VERSION
+			&& usb_rec_check(file)) {
+		return file;
+	}
+
+	sr_err("Invalid USB recording '%s'.", filename);
+	fclose(file);
+
+	return NULL;
+}
+
+/**
+ * Set up recording or replay of USB transfers.
+ *
+ * Recording is enabled by setting the environment variable
+ * SIGROK_USB_RECORD to the name of the file to write. Setting
+ * SIGROK_USB_REPLAY instead serves the transfers from such a file
+ * without talking to the device, as fast as possible, or at the
+ * recorded pace if SIGROK_USB_REPLAY_THROTTLE is set as well.
+ *
+ * Only transfers issued through sr_usb_control_transfer(),
+ * sr_usb_submit_transfer() and sr_usb_cancel_transfer() are covered.
+ * Replay does not stand in for the device otherwise: scanning, opening
+ * and claiming it, and uploading firmware still go through libusb, so
+ * the device must be attached, and have been scanned and opened as in
+ * the recording. What replay takes over is the acquisition itself, i.e.
+ * the driver's control requests and its data path.
+ *
+ * @param ctx The libsigrok context to set up.
+ *
+ * @retval SR_OK Success, also if neither recording nor replay is enabled.
+ * @retval SR_ERR_IO The file cannot be opened.
+ */
+SR_PRIV int sr_usb_recorder_init(struct sr_context *ctx)
+{
+	struct sr_usb_recorder *rec;
+	const char *record, *replay;
+
+	ctx->usb_recorder = NULL;
+
+	record = g_getenv("SIGROK_USB_RECORD");
+	replay = g_getenv("SIGROK_USB_REPLAY");
+	if (!record && !replay)
+		return SR_OK;
+
+	rec = g_malloc0(sizeof(*rec));
+	g_mutex_init(&rec->lock);
+	g_queue_init(&rec->pending);
+	g_queue_init(&rec->cancelled);
+
+	if (replay) {
+		rec->replay = TRUE;
+		rec->throttle = (g_getenv("SIGROK_USB_REPLAY_THROTTLE") != NULL);
+		rec->file = usb_rec_open(replay, FALSE);
+		rec->control_file = usb_rec_open(replay, FALSE);
+		sr_info("Replaying USB transfers from '%s'.", replay);
+	} else {
+		rec->file = usb_rec_open(record, TRUE);
+		rec->transfers = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+		rec->start_us = g_get_monotonic_time();
+		sr_info("Recording USB transfers to '%s'.", record);
+	}
+
+	ctx->usb_recorder = rec;
+	if (!rec->file || (rec->replay && !rec->control_file)) {
+		sr_usb_recorder_cleanup(ctx);
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+/** Stop recording or replay of USB transfers. */
+SR_PRIV void sr_usb_recorder_cleanup(struct sr_context *ctx)
+{
+	struct sr_usb_recorder *rec;
+
+	if (!(rec = ctx->usb_recorder))
+		return;
+
+	if (rec->file)
+		fclose(rec->file);
+	if (rec->control_file)
+		fclose(rec->control_file);
+	if (rec->transfers)
+		g_hash_table_destroy(rec->transfers);
+	g_queue_clear(&rec->pending);
+	g_queue_clear(&rec->cancelled);
+	g_free(rec->next_data);
+	g_mutex_clear(&rec->lock);
+	g_free(rec);
+	ctx->usb_recorder = NULL;
+}
+
+/**
+ * Perform a synchronous control transfer.
+ *
+ * Same as libusb_control_transfer(), but recorded or replayed if
+ * enabled, see sr_usb_recorder_init().
+ */
+SR_PRIV int sr_usb_control_transfer(struct sr_context *ctx,
+		libusb_device_handle *hdl, uint8_t request_type, uint8_t request,
+		uint16_t value, uint16_t index, unsigned char *data,
+		uint16_t length, unsigned int timeout)
+{
+	struct sr_usb_recorder *rec;
+	struct usb_rec r;
+	uint8_t *rdata;
+	int ret;
+
+	rec = ctx->usb_recorder;
+
+	if (rec && rec->replay) {
+		do {
+			if (!usb_rec_read(rec->control_file, &r, &rdata))
+				return LIBUSB_ERROR_NO_DEVICE;
+			if (r.type != USB_REC_CONTROL)
+				g_free(rdata);
+		} while (r.type != USB_REC_CONTROL);
+
+		if (r.endpoint != request_type || r.request != request
+				|| r.value != value || r.index != index)
+			sr_warn("Replayed control transfer %02x/%02x does not "
+				"match request %02x/%02x.", r.endpoint,
+				r.request, request_type, request);
+		if ((request_type & LIBUSB_ENDPOINT_IN) && r.result > 0)
+			memcpy(data, rdata, MIN(r.length, length));
+		g_free(rdata);
+
+		return r.result;
+	}
+
+	ret = libusb_control_transfer(hdl, request_type, request, value, index,
+			data, length, timeout);
+
+	if (rec) {
+		memset(&r, 0, sizeof(r));
+		r.type = USB_REC_CONTROL;
+		r.endpoint = request_type;
+		r.request = request;
+		r.value = value;
+		r.index = index;
+		r.result = ret;
+		if (request_type & LIBUSB_ENDPOINT_IN)
+			r.length = MAX(ret, 0);
+		else
+			r.length = length;
+		usb_rec_write(rec, &r, data);
+	}
+
+	return ret;
+}
+
+/* Record a completed transfer, then pass it on to the driver. */
+static void LIBUSB_CALL usb_rec_callback(struct libusb_transfer *transfer)
+{
+	struct sr_usb_recorder *rec;
+	struct usb_rec_transfer *rt;
+	struct usb_rec r;
+	uint8_t endpoint;
+
+	rt = transfer->user_data;
+	endpoint = transfer->endpoint;
+
+	memset(&r, 0, sizeof(r));
+	r.type = USB_REC_TRANSFER;
+	r.endpoint = endpoint;
+	r.status = transfer->status;
+	r.result = transfer->actual_length;
+	if (endpoint & LIBUSB_ENDPOINT_IN)
+		r.length = MAX(transfer->actual_length, 0);
+	/* Cancelled transfers are not replayed, the driver cancels them. */
+	if (transfer->status != LIBUSB_TRANSFER_CANCELLED)
+		usb_rec_write(rt->recorder, &r, transfer->buffer);
+
+	rec = rt->recorder;
+	transfer->callback = rt->callback;
+	transfer->user_data = rt->user_data;
+	g_mutex_lock(&rec->lock);
+	g_hash_table_remove(rec->transfers, transfer);
+	g_mutex_unlock(&rec->lock);
+
+	transfer->callback(transfer);
+}
+
+/**
+ * Submit an asynchronous transfer.
+ *
+ * Same as libusb_submit_transfer(), but recorded or replayed if
+ * enabled, see sr_usb_recorder_init(). Replayed transfers complete
+ * from the event source installed by usb_source_add().
+ */
+SR_PRIV int sr_usb_submit_transfer(struct sr_context *ctx,
+		struct libusb_transfer *transfer)
+{
+	struct sr_usb_recorder *rec;
+	struct usb_rec_transfer *rt;
+	int ret;
+
+	if (!(rec = ctx->usb_recorder))
+		return libusb_submit_transfer(transfer);
+
+	if (rec->replay) {
+		if (rec->eof)
+			return LIBUSB_ERROR_NO_DEVICE;
+		g_queue_push_tail(&rec->pending, transfer);
+		return 0;
+	}
+
+	rt = g_malloc(sizeof(*rt));
+	rt->recorder = rec;
+	rt->callback = transfer->callback;
+	rt->user_data = transfer->user_data;
+	transfer->callback = usb_rec_callback;
+	transfer->user_data = rt;
+
+	/* The transfer may complete on the USB event thread right away. */
+	g_mutex_lock(&rec->lock);
+	g_hash_table_insert(rec->transfers, transfer, rt);
+	g_mutex_unlock(&rec->lock);
+
+	if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		transfer->callback = rt->callback;
+		transfer->user_data = rt->user_data;
+		g_mutex_lock(&rec->lock);
+		g_hash_table_remove(rec->transfers, transfer);
+		g_mutex_unlock(&rec->lock);
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * Cancel an asynchronous transfer.
+ *
+ * Same as libusb_cancel_transfer(), for transfers submitted with
+ * sr_usb_submit_transfer().
+ */
+SR_PRIV int sr_usb_cancel_transfer(struct sr_context *ctx,
+		struct libusb_transfer *transfer)
+{
+	struct sr_usb_recorder *rec;
+
+	rec = ctx->usb_recorder;
+	if (!rec || !rec->replay)
+		return libusb_cancel_transfer(transfer);
+
+	if (!g_queue_remove(&rec->pending, transfer))
+		return LIBUSB_ERROR_NOT_FOUND;
+	g_queue_push_tail(&rec->cancelled, transfer);
+
+	return 0;
+}
+
+/* Read ahead the next non-control record. */
+static gboolean usb_replay_peek(struct sr_usb_recorder *rec)
+{
+	while (!rec->have_next && !rec->eof) {
+		g_free(rec->next_data);
+		if (!usb_rec_read(rec->file, &rec->next, &rec->next_data))
+			rec->eof = TRUE;
+		else if (rec->next.type == USB_REC_TRANSFER)
+			rec->have_next = TRUE;
+	}
+
+	return rec->have_next;
+}
+
+/* Find a pending transfer on the given endpoint. */
+static GList *usb_replay_find(struct sr_usb_recorder *rec, uint8_t endpoint)
+{
+	GList *l;
+	struct libusb_transfer *transfer;
+
+	for (l = rec->pending.head; l; l = l->next) {
+		transfer = l->data;
+		if (transfer->endpoint == endpoint)
+			return l;
+	}
+
+	return NULL;
+}
+
+/* Time at which replay has transfers to complete [us], or INT64_MAX. */
+static int64_t usb_replay_due(struct sr_usb_recorder *rec)
+{
+	if (!g_queue_is_empty(&rec->cancelled))
+		return 0;
+	if (g_queue_is_empty(&rec->pending))
+		return INT64_MAX;
+	if (!usb_replay_peek(rec))
+		return 0;
+	/* Wait for the driver to submit a transfer on this endpoint. */
+	if (!usb_replay_find(rec, rec->next.endpoint))
+		return INT64_MAX;
+	if (!rec->throttle || !rec->start_us)
+		return 0;
+
+	return rec->start_us + rec->next.timestamp_us;
+}
+
+/* Complete cancelled transfers and those due in the recording. */
+static void usb_replay_dispatch(struct sr_usb_recorder *rec)
+{
+	struct libusb_transfer *transfer;
+	GList *l;
+	int64_t now_us;
+	int count;
+
+	while ((transfer = g_queue_pop_head(&rec->cancelled))) {
+		transfer->status = LIBUSB_TRANSFER_CANCELLED;
+		transfer->actual_length = 0;
+		transfer->callback(transfer);
+	}
+
+	now_us = g_get_monotonic_time();
+	for (count = 0; count < USB_REPLAY_BATCH; count++) {
+		if (g_queue_is_empty(&rec->pending))
+			break;
+
+		if (!usb_replay_peek(rec)) {
+			/* End of recording, the device is gone. */
+			transfer = g_queue_pop_head(&rec->pending);
+			transfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+			transfer->actual_length = 0;
+			transfer->callback(transfer);
+			continue;
+		}
+
+		if (rec->throttle) {
+			/* Recorded time 0 is when the first record is served. */
+			if (!rec->start_us)
+				rec->start_us = now_us - rec->next.timestamp_us;
+			if (rec->start_us + (int64_t)rec->next.timestamp_us > now_us)
+				break;
+		}
+
+		if (!(l = usb_replay_find(rec, rec->next.endpoint)))
+			break;
+		transfer = l->data;
+		g_queue_delete_link(&rec->pending, l);
+
+		rec->have_next = FALSE;
+		transfer->status = rec->next.status;
+		transfer->actual_length = MIN(rec->next.result, transfer->length);
+		if (transfer->endpoint & LIBUSB_ENDPOINT_IN)
+			memcpy(transfer->buffer, rec->next_data,
+				MIN(rec->next.length, (uint32_t)transfer->length));
+		transfer->callback(transfer);
+	}
+}
+
 /**
  * Find USB devices according to a connection string.
  *
@@ -452,7 +1642,7 @@ SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 	GSource *source;
 	int ret;
 
-	source = usb_source_new(session, ctx->libusb_ctx, timeout);
+	source = usb_source_new(session, ctx, NULL, timeout);
 	if (!source)
 		return SR_ERR;
 
@@ -469,6 +1659,47 @@ SR_PRIV int usb_source_remove(struct sr_session *session, struct sr_context *ctx
 	return sr_session_source_remove_internal(session, ctx->libusb_ctx);
 }
 
+/**
+ * Add an event source collecting the entries of a handoff.
+ *
+ * Same as usb_source_add(), except that the source is dispatched for
+ * entries waiting in @p h, instead of for libusb events. The libusb
+ * events of all other devices are unaffected.
+ */
+SR_PRIV int sr_usb_handoff_source_add(struct sr_session *session,
+		struct sr_usb_handoff *h, int timeout,
+		sr_receive_data_callback cb, void *cb_data)
+{
+	GSource *source;
+	int ret;
+
+	source = usb_source_new(session, h->ctx, h, timeout);
+	g_source_set_callback(source, (GSourceFunc)cb, cb_data, NULL);
+
+	ret = sr_session_source_add_internal(session, h, source);
+	g_source_unref(source);
+
+	return ret;
+}
+
+/**
+ * Remove the event source added with sr_usb_handoff_source_add().
+ *
+ * The handoff may be freed right after, even if called from the
+ * source's callback.
+ */
+SR_PRIV int sr_usb_handoff_source_remove(struct sr_session *session,
+		struct sr_usb_handoff *h)
+{
+	g_mutex_lock(&h->lock);
+	if (h->context)
+		g_main_context_unref(h->context);
+	h->context = NULL;
+	g_mutex_unlock(&h->lock);
+
+	return sr_session_source_remove_internal(session, h);
+}
+
 SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len)
 {
 	uint8_t port_numbers[8];
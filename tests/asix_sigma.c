@@ -0,0 +1,90 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#ifdef HAVE_HW_ASIX_SIGMA
+#include "hardware/asix-sigma/protocol.h"
+#endif
+#include "lib.h"
+
+#ifdef HAVE_HW_ASIX_SIGMA
+
+/*
+ * Deinterlace sample idx of an item bit by bit, where bit (step * n + idx)
+ * is bit n of the sample.
+ */
+static uint16_t deinterlace_ref(uint16_t item16, unsigned int step,
+		unsigned int idx)
+{
+	uint16_t sample;
+	unsigned int n;
+
+	sample = 0;
+	for (n = 0; n < 16 / step; n++) {
+		if (item16 & (1 << (step * n + idx)))
+			sample |= 1 << n;
+	}
+
+	return sample;
+}
+
+/* Check the deinterlace lookup tables against the reference, for all items. */
+START_TEST(test_deinterlace)
+{
+	uint32_t item, data100;
+	uint64_t data200;
+	unsigned int idx;
+
+	sigma_init_deinterlace_luts();
+
+	for (item = 0; item < 0x10000; item++) {
+		data100 = sigma_deinterlace_100mhz(item);
+		for (idx = 0; idx < 2; idx++) {
+			fail_unless(((data100 >> (16 * idx)) & 0xffff)
+				== deinterlace_ref(item, 2, idx),
+				"100MHz item 0x%04x, sample %u.", item, idx);
+		}
+		data200 = sigma_deinterlace_200mhz(item);
+		for (idx = 0; idx < 4; idx++) {
+			fail_unless(((data200 >> (16 * idx)) & 0xffff)
+				== deinterlace_ref(item, 4, idx),
+				"200MHz item 0x%04x, sample %u.", item, idx);
+		}
+	}
+}
+END_TEST
+
+#endif
+
+Suite *suite_asix_sigma(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("asix_sigma");
+
+	tc = tcase_create("deinterlace");
+#ifdef HAVE_HW_ASIX_SIGMA
+	tcase_add_test(tc, test_deinterlace);
+#endif
+	suite_add_tcase(s, tc);
+
+	return s;
+}
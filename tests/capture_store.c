@@ -0,0 +1,356 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+/* An odd sample size, so segments don't end on a power of two. */
+#define UNITSIZE 3
+
+/* The byte at offset i of sample n. */
+static uint8_t pattern(uint64_t n, unsigned int i)
+{
+	return (n >> (i * 8)) ^ (n * 7 + i);
+}
+
+static void fill(uint8_t *data, uint64_t start, uint64_t count)
+{
+	uint64_t n;
+	unsigned int i;
+
+	for (n = 0; n < count; n++)
+		for (i = 0; i < UNITSIZE; i++)
+			data[n * UNITSIZE + i] = pattern(start + n, i);
+}
+
+/*
+ * Get the number of samples per segment, which is how many samples
+ * sr_capture_store_get() returns at most.
+ */
+static uint64_t segment_samples(void)
+{
+	struct sr_capture_store *store;
+	uint64_t count;
+
+	store = sr_capture_store_new(UNITSIZE, 0);
+	fail_unless(store != NULL, "sr_capture_store_new() failed.");
+	sr_capture_store_set_length(store, 8 * 1024 * 1024);
+	count = UINT64_MAX;
+	sr_capture_store_get(store, 0, &count);
+	sr_capture_store_free(store);
+	fail_unless(count > 1 && count < 8 * 1024 * 1024,
+		"Unexpected segment size %" PRIu64 ".", count);
+
+	return count;
+}
+
+/* Check every sample in the store against the pattern. */
+static void check_store(struct sr_capture_store *store, uint64_t num_samples)
+{
+	uint8_t *data, *expected;
+	uint64_t pos, count;
+
+	fail_unless(sr_capture_store_samples(store) == num_samples,
+		"Store has %" PRIu64 " samples, expected %" PRIu64 ".",
+		sr_capture_store_samples(store), num_samples);
+	for (pos = 0; pos < num_samples; pos += count) {
+		count = num_samples - pos;
+		data = sr_capture_store_get(store, pos, &count);
+		fail_unless(data != NULL && count > 0,
+			"No samples at %" PRIu64 ".", pos);
+		expected = g_malloc(count * UNITSIZE);
+		fill(expected, pos, count);
+		fail_unless(!memcmp(data, expected, count * UNITSIZE),
+			"Wrong samples at %" PRIu64 ".", pos);
+		g_free(expected);
+	}
+
+	count = 1;
+	fail_unless(sr_capture_store_get(store, num_samples, &count) == NULL
+		&& count == 0, "Got samples beyond the end.");
+}
+
+/* Append in chunks which don't divide the segment size. */
+static void append_pattern(struct sr_capture_store *store,
+		uint64_t num_samples)
+{
+	uint8_t buf[4099 * UNITSIZE];
+	uint64_t pos, count;
+	int ret;
+
+	for (pos = 0; pos < num_samples; pos += count) {
+		count = MIN(num_samples - pos, 4099);
+		fill(buf, pos, count);
+		ret = sr_capture_store_append(store, buf, count);
+		fail_unless(ret == SR_OK,
+			"sr_capture_store_append() failed: %d.", ret);
+	}
+}
+
+/* Check that invalid sample sizes are rejected. */
+START_TEST(test_new_invalid)
+{
+	fail_unless(sr_capture_store_new(0, 0) == NULL,
+		"Zero unitsize was accepted.");
+	fail_unless(sr_capture_store_new(UINT32_MAX, 0) == NULL,
+		"Huge unitsize was accepted.");
+	sr_capture_store_free(NULL);
+}
+END_TEST
+
+/* Check that samples read back the same across segment boundaries. */
+START_TEST(test_segment_boundary)
+{
+	struct sr_capture_store *store;
+	uint64_t seg, count;
+	uint8_t *data, expected[10 * UNITSIZE];
+
+	seg = segment_samples();
+	store = sr_capture_store_new(UNITSIZE, 0);
+	append_pattern(store, 2 * seg + 10);
+	check_store(store, 2 * seg + 10);
+
+	/* A range across a boundary ends at it, the rest follows. */
+	count = 10;
+	data = sr_capture_store_get(store, seg - 4, &count);
+	fail_unless(count == 4, "Range crossed a segment: %" PRIu64 ".",
+		count);
+	fill(expected, seg - 4, 10);
+	fail_unless(!memcmp(data, expected, 4 * UNITSIZE),
+		"Wrong samples before the boundary.");
+	count = 6;
+	data = sr_capture_store_get(store, seg, &count);
+	fail_unless(count == 6 && !memcmp(data, expected + 4 * UNITSIZE,
+		6 * UNITSIZE), "Wrong samples after the boundary.");
+
+	/* A range at the end is cut short. */
+	count = 100;
+	sr_capture_store_get(store, 2 * seg + 5, &count);
+	fail_unless(count == 5, "Range beyond the end: %" PRIu64 ".", count);
+
+	sr_capture_store_free(store);
+}
+END_TEST
+
+/*
+ * Check that a store sized up front can be filled in any order, here
+ * from the end backwards, and that shrinking keeps the samples.
+ */
+START_TEST(test_fill_backwards)
+{
+	struct sr_capture_store *store;
+	uint64_t seg, num_samples, start, end, pos, count;
+	uint8_t *data;
+	int ret;
+
+	seg = segment_samples();
+	num_samples = 2 * seg + 7;
+	store = sr_capture_store_new(UNITSIZE, 0);
+	ret = sr_capture_store_set_length(store, num_samples);
+	fail_unless(ret == SR_OK, "sr_capture_store_set_length() failed.");
+
+	/* New samples are zero. */
+	count = 1;
+	data = sr_capture_store_get(store, seg, &count);
+	fail_unless(count == 1 && !data[0] && !data[1] && !data[2],
+		"New samples aren't zero.");
+
+	/* Fill blocks of up to 1000 samples, the last block first. */
+	for (end = num_samples; end > 0; end = start) {
+		start = end > 1000 ? end - 1000 : 0;
+		for (pos = start; pos < end; pos += count) {
+			count = end - pos;
+			data = sr_capture_store_get(store, pos, &count);
+			fail_unless(data != NULL, "No samples at %" PRIu64 ".",
+				pos);
+			fill(data, pos, count);
+		}
+	}
+	check_store(store, num_samples);
+
+	/* Shrinking and growing again keeps the samples. */
+	sr_capture_store_set_length(store, seg - 1);
+	check_store(store, seg - 1);
+	sr_capture_store_set_length(store, num_samples);
+	check_store(store, num_samples);
+
+	sr_capture_store_free(store);
+}
+END_TEST
+
+/*
+ * Check stores which exceed a small memory budget: with all segments
+ * beyond the budget, with only the first segment on the heap, and with
+ * a first segment which outgrows the budget.
+ */
+START_TEST(test_spill)
+{
+	struct sr_capture_store *store;
+	uint64_t seg;
+
+	seg = segment_samples();
+	store = sr_capture_store_new(UNITSIZE, 1);
+	append_pattern(store, 2 * seg + 10);
+	check_store(store, 2 * seg + 10);
+	sr_capture_store_free(store);
+
+	store = sr_capture_store_new(UNITSIZE, seg * UNITSIZE);
+	append_pattern(store, 3 * seg);
+	check_store(store, 3 * seg);
+	sr_capture_store_set_length(store, 3 * seg + 1);
+	fail_unless(sr_capture_store_samples(store) == 3 * seg + 1,
+		"Failed to grow a spilled store.");
+	sr_capture_store_free(store);
+
+	store = sr_capture_store_new(UNITSIZE, 100000);
+	append_pattern(store, seg + 10);
+	check_store(store, seg + 10);
+	sr_capture_store_free(store);
+}
+END_TEST
+
+/* What the output wrote, for the ChronoVu LA8 output test. */
+static GString *la8_data;
+
+static void la8_send(const struct sr_output *o, int type, const void *payload)
+{
+	struct sr_datafeed_packet packet;
+	GString *out;
+	int ret;
+
+	packet.type = type;
+	packet.payload = payload;
+	out = NULL;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "sr_output_send() failed: %d.", ret);
+	if (out) {
+		g_string_append_len(la8_data, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+}
+
+/*
+ * Run a capture of num_samples through the ChronoVu LA8 output, with
+ * a trigger after trigger_pos samples, or none if that's beyond the end.
+ */
+static void la8_capture(uint64_t num_samples, uint64_t trigger_pos)
+{
+	struct sr_dev_inst *sdi;
+	const struct sr_output *o;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_logic logic;
+	uint8_t buf[1000];
+	uint64_t pos, count;
+	char name[8];
+	int i;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	for (i = 0; i < 8; i++) {
+		g_snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	o = sr_output_new(sr_output_find((char *)"chronovu-la8"), NULL,
+		sdi, NULL);
+	fail_unless(o != NULL, "Failed to create the output.");
+
+	la8_data = g_string_new(NULL);
+	memset(&header, 0, sizeof(header));
+	la8_send(o, SR_DF_HEADER, &header);
+	logic.unitsize = 1;
+	logic.data = buf;
+	for (pos = 0; pos < num_samples; pos += count) {
+		if (pos == trigger_pos)
+			la8_send(o, SR_DF_TRIGGER, NULL);
+		/* Packets end at the trigger, and don't divide anything. */
+		count = MIN(num_samples - pos, sizeof(buf) - 3);
+		if (pos < trigger_pos)
+			count = MIN(count, trigger_pos - pos);
+		for (i = 0; i < (int)count; i++)
+			buf[i] = pattern(pos + i, 0);
+		logic.length = count;
+		la8_send(o, SR_DF_LOGIC, &logic);
+	}
+	la8_send(o, SR_DF_END, NULL);
+
+	sr_output_free(o);
+	sr_dev_inst_free(sdi);
+}
+
+/* Check the divcount, trigger point and samples the output wrote. */
+static void la8_check(uint64_t num_samples, uint64_t trigger_point)
+{
+	const uint8_t *data;
+	uint64_t n;
+
+	data = (const uint8_t *)la8_data->str;
+	fail_unless(la8_data->len == 5 + num_samples, "Wrote %zu bytes.",
+		(size_t)la8_data->len);
+	/* Without a samplerate the divcount is invalid. */
+	fail_unless(data[0] == 0xff, "Divcount 0x%02x.", data[0]);
+	fail_unless(RL32(data + 1) == trigger_point,
+		"Trigger point %" PRIu32 ".", RL32(data + 1));
+	for (n = 0; n < num_samples; n++)
+		fail_unless(data[5 + n] == pattern(n, 0),
+			"Wrong sample %" PRIu64 ".", n);
+	g_string_free(la8_data, TRUE);
+}
+
+/*
+ * Check that the ChronoVu LA8 output, which holds the samples before
+ * the trigger in a capture store, writes them after the trigger point.
+ * Without a trigger it writes an empty one, followed by all samples.
+ */
+START_TEST(test_la8_output)
+{
+	la8_capture(11, UINT64_MAX);
+	la8_check(11, 0);
+
+	/* Beyond the initial size of the first segment. */
+	la8_capture(200000, UINT64_MAX);
+	la8_check(200000, 0);
+
+	la8_capture(200000, 150001);
+	la8_check(200000, 150001);
+}
+END_TEST
+
+Suite *suite_capture_store(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("capture_store");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_new_invalid);
+	tcase_add_test(tc, test_segment_boundary);
+	tcase_add_test(tc, test_fill_backwards);
+	tcase_add_test(tc, test_spill);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("users");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_la8_output);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
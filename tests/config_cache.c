@@ -0,0 +1,467 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+/* Setting the sample limit to this fails in the device. */
+#define FAILING_LIMIT	666
+
+static const uint32_t devopts[] = {
+	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+};
+
+/* The settings of the fake device, and how often the driver was asked. */
+struct fake_dev {
+	uint64_t samplerate;
+	uint64_t limit_samples;
+	uint64_t capture_ratio;
+	gboolean ratio_fails;
+	int get_calls[3];
+	int set_calls;
+	int list_calls;
+	int get_multi_calls;
+	int get_multi_keys;
+};
+
+static struct fake_dev dev;
+static struct sr_dev_inst *sdi;
+
+static int key_index(uint32_t key)
+{
+	switch (key) {
+	case SR_CONF_SAMPLERATE:
+		return 0;
+	case SR_CONF_LIMIT_SAMPLES:
+		return 1;
+	case SR_CONF_CAPTURE_RATIO:
+		return 2;
+	}
+
+	return -1;
+}
+
+static int config_get(uint32_t key, GVariant **data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	(void)sdi;
+	(void)cg;
+
+	if (key_index(key) < 0)
+		return SR_ERR_NA;
+	dev.get_calls[key_index(key)]++;
+
+	switch (key) {
+	case SR_CONF_SAMPLERATE:
+		*data = g_variant_new_uint64(dev.samplerate);
+		break;
+	case SR_CONF_LIMIT_SAMPLES:
+		*data = g_variant_new_uint64(dev.limit_samples);
+		break;
+	case SR_CONF_CAPTURE_RATIO:
+		if (dev.ratio_fails)
+			return SR_ERR_IO;
+		*data = g_variant_new_uint64(dev.capture_ratio);
+		break;
+	}
+
+	return SR_OK;
+}
+
+static int config_set(uint32_t key, GVariant *data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	(void)sdi;
+	(void)cg;
+
+	dev.set_calls++;
+	switch (key) {
+	case SR_CONF_SAMPLERATE:
+		dev.samplerate = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_LIMIT_SAMPLES:
+		if (g_variant_get_uint64(data) == FAILING_LIMIT)
+			return SR_ERR_IO;
+		dev.limit_samples = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_CAPTURE_RATIO:
+		dev.capture_ratio = g_variant_get_uint64(data);
+		break;
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+static int config_list(uint32_t key, GVariant **data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	(void)sdi;
+	(void)cg;
+
+	if (key != SR_CONF_DEVICE_OPTIONS)
+		return SR_ERR_NA;
+	dev.list_calls++;
+	*data = std_gvar_array_u32(ARRAY_AND_SIZE(devopts));
+
+	return SR_OK;
+}
+
+static int config_get_multi(GSList *configs,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	struct sr_config *src;
+	GSList *l;
+	int ret, r;
+
+	dev.get_multi_calls++;
+	ret = SR_OK;
+	for (l = configs; l; l = l->next) {
+		src = l->data;
+		dev.get_multi_keys++;
+		if ((r = config_get(src->key, &src->data, sdi, cg)) != SR_OK)
+			src->data = NULL;
+		ret = (ret == SR_OK) ? r : ret;
+	}
+
+	return ret;
+}
+
+static struct sr_dev_driver fake_driver = {
+	.name = "fake",
+	.longname = "Fake device",
+	.api_version = 1,
+	.config_get = config_get,
+	.config_set = config_set,
+	.config_list = config_list,
+};
+
+static void setup(void)
+{
+	const uint32_t cacheable[] = { SR_CONF_SAMPLERATE };
+
+	srtest_setup();
+
+	memset(&dev, 0, sizeof(dev));
+	dev.samplerate = SR_MHZ(1);
+	dev.limit_samples = 1000;
+	dev.capture_ratio = 20;
+	fake_driver.config_get_multi = NULL;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sdi->driver = &fake_driver;
+	sdi->priv = &dev;
+	sdi->status = SR_ST_ACTIVE;
+	sr_config_cache_enable(sdi, ARRAY_AND_SIZE(cacheable));
+}
+
+static void teardown(void)
+{
+	sr_dev_inst_free(sdi);
+
+	srtest_teardown();
+}
+
+static uint64_t get_u64(uint32_t key)
+{
+	GVariant *data;
+	uint64_t value;
+	int ret;
+
+	ret = sr_config_get(&fake_driver, sdi, NULL, key, &data);
+	fail_unless(ret == SR_OK, "sr_config_get() failed: %d.", ret);
+	value = g_variant_get_uint64(data);
+	g_variant_unref(data);
+
+	return value;
+}
+
+static GSList *configs_new(const uint32_t *keys, const uint64_t *values,
+		unsigned int count)
+{
+	GSList *configs;
+	struct sr_config *src;
+	unsigned int i;
+
+	configs = NULL;
+	for (i = 0; i < count; i++) {
+		src = g_malloc0(sizeof(*src));
+		src->key = keys[i];
+		if (values)
+			src->data = g_variant_ref_sink(
+				g_variant_new_uint64(values[i]));
+		configs = g_slist_append(configs, src);
+	}
+
+	return configs;
+}
+
+static void configs_free(GSList *configs)
+{
+	struct sr_config *src;
+	GSList *l;
+
+	for (l = configs; l; l = l->next) {
+		src = l->data;
+		if (src->data)
+			g_variant_unref(src->data);
+		g_free(src);
+	}
+	g_slist_free(configs);
+}
+
+static GVariant *config_data(GSList *configs, unsigned int index)
+{
+	return ((struct sr_config *)g_slist_nth_data(configs, index))->data;
+}
+
+/*
+ * Check that cacheable keys are read from the device once, others every
+ * time, and that the option list is fetched once for all checks.
+ */
+START_TEST(test_hits)
+{
+	unsigned int i;
+
+	for (i = 0; i < 3; i++) {
+		fail_unless(get_u64(SR_CONF_SAMPLERATE) == SR_MHZ(1),
+			"Wrong samplerate.");
+		fail_unless(get_u64(SR_CONF_LIMIT_SAMPLES) == 1000,
+			"Wrong sample limit.");
+	}
+	fail_unless(dev.get_calls[0] == 1, "Samplerate read %d times.",
+		dev.get_calls[0]);
+	fail_unless(dev.get_calls[1] == 3, "Sample limit read %d times.",
+		dev.get_calls[1]);
+	fail_unless(dev.list_calls == 1, "Options listed %d times.",
+		dev.list_calls);
+}
+END_TEST
+
+/* Check that the cache is only used while the device is open. */
+START_TEST(test_closed)
+{
+	GVariant *data;
+
+	sdi->status = SR_ST_INACTIVE;
+	get_u64(SR_CONF_SAMPLERATE);
+	get_u64(SR_CONF_SAMPLERATE);
+	fail_unless(dev.get_calls[0] == 2, "Samplerate read %d times.",
+		dev.get_calls[0]);
+	fail_unless(sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_MHZ(2))) == SR_ERR_DEV_CLOSED,
+		"Closed device was set.");
+
+	/* Nothing read while closed lingers once open. */
+	sdi->status = SR_ST_ACTIVE;
+	dev.samplerate = SR_MHZ(3);
+	fail_unless(sr_config_get(&fake_driver, sdi, NULL,
+		SR_CONF_SAMPLERATE, &data) == SR_OK, "sr_config_get() failed.");
+	fail_unless(g_variant_get_uint64(data) == SR_MHZ(3),
+		"Stale samplerate.");
+	g_variant_unref(data);
+}
+END_TEST
+
+/*
+ * Check that setting any key, or a driver invalidating one, makes the
+ * next read go to the device.
+ */
+START_TEST(test_invalidate)
+{
+	int ret;
+
+	get_u64(SR_CONF_SAMPLERATE);
+	ret = sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_MHZ(2)));
+	fail_unless(ret == SR_OK, "sr_config_set() failed: %d.", ret);
+	fail_unless(get_u64(SR_CONF_SAMPLERATE) == SR_MHZ(2),
+		"Stale samplerate after setting it.");
+	fail_unless(dev.get_calls[0] == 2, "Samplerate read %d times.",
+		dev.get_calls[0]);
+
+	/* Another key may affect the samplerate as well. */
+	ret = sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(500));
+	fail_unless(ret == SR_OK, "sr_config_set() failed: %d.", ret);
+	get_u64(SR_CONF_SAMPLERATE);
+	fail_unless(dev.get_calls[0] == 3, "Samplerate read %d times.",
+		dev.get_calls[0]);
+
+	/* Changed behind the driver's back, e.g. on the front panel. */
+	dev.samplerate = SR_KHZ(100);
+	fail_unless(get_u64(SR_CONF_SAMPLERATE) == SR_MHZ(2),
+		"Samplerate wasn't cached.");
+	sr_config_cache_invalidate(sdi, NULL, SR_CONF_SAMPLERATE);
+	fail_unless(get_u64(SR_CONF_SAMPLERATE) == SR_KHZ(100),
+		"Stale samplerate after invalidating it.");
+	dev.samplerate = SR_KHZ(200);
+	sr_config_cache_clear(sdi);
+	fail_unless(get_u64(SR_CONF_SAMPLERATE) == SR_KHZ(200),
+		"Stale samplerate after clearing the cache.");
+}
+END_TEST
+
+/*
+ * Check that invalid entries make sr_config_set_multi() set nothing,
+ * and that a key failing in the device stops at that key.
+ */
+START_TEST(test_set_multi)
+{
+	const uint32_t keys[] = {
+		SR_CONF_SAMPLERATE, SR_CONF_LIMIT_SAMPLES, SR_CONF_CAPTURE_RATIO,
+	};
+	const uint64_t invalid[] = { SR_MHZ(2), 500, 200 };
+	const uint64_t failing[] = { SR_MHZ(2), FAILING_LIMIT, 50 };
+	const uint64_t valid[] = { SR_MHZ(4), 2000, 50 };
+	const uint32_t unknown_keys[] = { SR_CONF_SAMPLERATE, SR_CONF_CONN };
+	const uint64_t unknown_values[] = { SR_MHZ(2), 0 };
+	GSList *configs;
+	int ret;
+
+	get_u64(SR_CONF_SAMPLERATE);
+
+	configs = configs_new(keys, invalid, ARRAY_SIZE(keys));
+	ret = sr_config_set_multi(sdi, NULL, configs);
+	configs_free(configs);
+	fail_unless(ret == SR_ERR_ARG, "Invalid value accepted: %d.", ret);
+	fail_unless(dev.set_calls == 0, "Invalid list was partly set.");
+
+	configs = configs_new(unknown_keys, unknown_values,
+		ARRAY_SIZE(unknown_keys));
+	ret = sr_config_set_multi(sdi, NULL, configs);
+	configs_free(configs);
+	fail_unless(ret == SR_ERR_ARG, "Unsupported key accepted: %d.", ret);
+	fail_unless(dev.set_calls == 0, "Invalid list was partly set.");
+
+	configs = configs_new(keys, failing, ARRAY_SIZE(keys));
+	ret = sr_config_set_multi(sdi, NULL, configs);
+	configs_free(configs);
+	fail_unless(ret == SR_ERR_IO, "Failure wasn't passed on: %d.", ret);
+	fail_unless(dev.set_calls == 2, "%d keys set.", dev.set_calls);
+	fail_unless(dev.samplerate == SR_MHZ(2) && dev.limit_samples == 1000
+		&& dev.capture_ratio == 20, "Wrong keys were applied.");
+	/* What did get applied isn't served from the cache. */
+	fail_unless(get_u64(SR_CONF_SAMPLERATE) == SR_MHZ(2),
+		"Stale samplerate after a partial set.");
+
+	configs = configs_new(keys, valid, ARRAY_SIZE(keys));
+	ret = sr_config_set_multi(sdi, NULL, configs);
+	configs_free(configs);
+	fail_unless(ret == SR_OK, "sr_config_set_multi() failed: %d.", ret);
+	fail_unless(dev.samplerate == SR_MHZ(4) && dev.limit_samples == 2000
+		&& dev.capture_ratio == 50, "Keys weren't applied.");
+}
+END_TEST
+
+/*
+ * Check that sr_config_get_multi() reads all keys it can, and reports
+ * unsupported keys and keys failing in the device.
+ */
+START_TEST(test_get_multi)
+{
+	const uint32_t keys[] = {
+		SR_CONF_SAMPLERATE, SR_CONF_CONN, SR_CONF_LIMIT_SAMPLES,
+	};
+	const uint32_t failing_keys[] = {
+		SR_CONF_CAPTURE_RATIO, SR_CONF_SAMPLERATE,
+	};
+	GSList *configs;
+	int ret;
+
+	configs = configs_new(keys, NULL, ARRAY_SIZE(keys));
+	ret = sr_config_get_multi(&fake_driver, sdi, NULL, configs);
+	fail_unless(ret == SR_ERR_ARG, "Unsupported key accepted: %d.", ret);
+	fail_unless(config_data(configs, 1) == NULL,
+		"Unsupported key has a value.");
+	fail_unless(config_data(configs, 0) && config_data(configs, 2)
+		&& g_variant_get_uint64(config_data(configs, 0)) == SR_MHZ(1)
+		&& g_variant_get_uint64(config_data(configs, 2)) == 1000,
+		"Supported keys weren't read.");
+	configs_free(configs);
+
+	dev.ratio_fails = TRUE;
+	configs = configs_new(failing_keys, NULL, ARRAY_SIZE(failing_keys));
+	ret = sr_config_get_multi(&fake_driver, sdi, NULL, configs);
+	fail_unless(ret == SR_ERR_IO, "Failure wasn't passed on: %d.", ret);
+	fail_unless(config_data(configs, 0) == NULL
+		&& config_data(configs, 1) != NULL,
+		"Wrong keys were read.");
+	configs_free(configs);
+
+	/* The samplerate came from the cache the second time. */
+	fail_unless(dev.get_calls[0] == 1, "Samplerate read %d times.",
+		dev.get_calls[0]);
+	fail_unless(dev.list_calls == 1, "Options listed %d times.",
+		dev.list_calls);
+}
+END_TEST
+
+/* Check that drivers get all keys not in the cache in one call. */
+START_TEST(test_get_multi_driver)
+{
+	const uint32_t keys[] = {
+		SR_CONF_SAMPLERATE, SR_CONF_LIMIT_SAMPLES, SR_CONF_CAPTURE_RATIO,
+	};
+	GSList *configs;
+	int ret;
+
+	fake_driver.config_get_multi = config_get_multi;
+	get_u64(SR_CONF_SAMPLERATE);
+
+	configs = configs_new(keys, NULL, ARRAY_SIZE(keys));
+	ret = sr_config_get_multi(&fake_driver, sdi, NULL, configs);
+	fail_unless(ret == SR_OK, "sr_config_get_multi() failed: %d.", ret);
+	fail_unless(dev.get_multi_calls == 1 && dev.get_multi_keys == 2,
+		"Driver got %d calls for %d keys.", dev.get_multi_calls,
+		dev.get_multi_keys);
+	fail_unless(g_variant_get_uint64(config_data(configs, 2)) == 20,
+		"Wrong capture ratio.");
+	configs_free(configs);
+}
+END_TEST
+
+Suite *suite_config_cache(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("config_cache");
+
+	tc = tcase_create("cache");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_hits);
+	tcase_add_test(tc, test_closed);
+	tcase_add_test(tc, test_invalidate);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("multi");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_set_multi);
+	tcase_add_test(tc, test_get_multi);
+	tcase_add_test(tc, test_get_multi_driver);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,358 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#define NUM_FILES 4
+
+static const char *hello = "Hello world";
+
+/* Two logic channels at 1 MHz, and their VCD value changes. */
+static const char *csv_data = "0,1\n1,1\n1,0\n";
+static const char *vcd_changes = "#0 0! 1\"\n#1 1!\n#2 0\"\n#3\n";
+
+/* Create a converter which copies logic data from binary to binary. */
+static struct sr_convert *binary_converter(void)
+{
+	struct sr_convert *conv;
+	int ret;
+
+	ret = sr_convert_new(srtest_ctx, &conv);
+	fail_unless(ret == SR_OK, "sr_convert_new() failed: %d.", ret);
+	ret = sr_convert_set_input(conv, sr_input_find("binary"), NULL);
+	fail_unless(ret == SR_OK, "sr_convert_set_input() failed: %d.", ret);
+	ret = sr_convert_set_output(conv, sr_output_find("binary"), NULL);
+	fail_unless(ret == SR_OK, "sr_convert_set_output() failed: %d.", ret);
+
+	return conv;
+}
+
+/* Create a converter from one format to another, by module ID. */
+static struct sr_convert *format_converter(char *in_id,
+		GHashTable *in_options, char *out_id)
+{
+	struct sr_convert *conv;
+	int ret;
+
+	ret = sr_convert_new(srtest_ctx, &conv);
+	fail_unless(ret == SR_OK, "sr_convert_new() failed: %d.", ret);
+	ret = sr_convert_set_input(conv,
+		in_id ? sr_input_find(in_id) : NULL, in_options);
+	fail_unless(ret == SR_OK, "sr_convert_set_input() failed: %d.", ret);
+	ret = sr_convert_set_output(conv, sr_output_find(out_id), NULL);
+	fail_unless(ret == SR_OK, "sr_convert_set_output() failed: %d.", ret);
+
+	return conv;
+}
+
+static GHashTable *csv_options(void)
+{
+	GHashTable *options;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("samplerate"),
+		g_variant_ref_sink(g_variant_new_uint64(SR_MHZ(1))));
+
+	return options;
+}
+
+/* Check the value changes of a VCD file, the header has a timestamp. */
+static void check_vcd_changes(const char *filename, const char *expected)
+{
+	gchar *contents, *changes;
+	const char *end = "$enddefinitions $end\n";
+
+	fail_unless(g_file_get_contents(filename, &contents, NULL, NULL),
+		"Failed to read %s.", filename);
+	changes = strstr(contents, end);
+	fail_unless(changes != NULL, "No VCD header in %s.", filename);
+	fail_unless(!strcmp(changes + strlen(end), expected),
+		"Unexpected value changes in %s.", filename);
+	g_free(contents);
+}
+
+static char *tmp_file_name(const char *dir, int i)
+{
+	char name[16];
+
+	g_snprintf(name, sizeof(name), "file%d", i);
+
+	return g_build_filename(dir, name, NULL);
+}
+
+static void check_file_contents(const char *filename, const char *expected)
+{
+	gchar *contents;
+	gsize length;
+
+	fail_unless(g_file_get_contents(filename, &contents, &length, NULL),
+		"Failed to read %s.", filename);
+	fail_unless(length == strlen(expected) &&
+		!memcmp(contents, expected, length),
+		"Unexpected contents of %s.", filename);
+	g_free(contents);
+}
+
+/* Check whether sr_convert_new() and sr_convert_free() work. */
+START_TEST(test_convert_new_free)
+{
+	struct sr_convert *conv;
+	int ret;
+
+	ret = sr_convert_new(NULL, &conv);
+	fail_unless(ret == SR_ERR_ARG, "sr_convert_new(NULL) didn't fail.");
+
+	conv = binary_converter();
+	ret = sr_convert_set_workers(conv, 0);
+	fail_unless(ret == SR_ERR_ARG, "Zero workers were accepted.");
+	ret = sr_convert_free(conv);
+	fail_unless(ret == SR_OK, "sr_convert_free() failed: %d.", ret);
+}
+END_TEST
+
+/* Check whether sr_convert_file() passes data through unchanged. */
+START_TEST(test_convert_file)
+{
+	struct sr_convert *conv;
+	char *dir, *infile, *outfile;
+	int ret;
+
+	dir = g_dir_make_tmp("sr-convert-XXXXXX", NULL);
+	fail_unless(dir != NULL, "Failed to create a directory.");
+	infile = tmp_file_name(dir, 0);
+	outfile = tmp_file_name(dir, 1);
+	g_file_set_contents(infile, hello, -1, NULL);
+
+	conv = binary_converter();
+	ret = sr_convert_file(conv, infile, outfile);
+	fail_unless(ret == SR_OK, "sr_convert_file() failed: %d.", ret);
+	check_file_contents(outfile, hello);
+	sr_convert_free(conv);
+
+	g_unlink(infile);
+	g_unlink(outfile);
+	g_rmdir(dir);
+	g_free(infile);
+	g_free(outfile);
+	g_free(dir);
+}
+END_TEST
+
+/* Check whether sr_convert_files() converts all files, in parallel. */
+START_TEST(test_convert_files)
+{
+	struct sr_convert *conv;
+	char *dir, *infiles[NUM_FILES], *outfiles[NUM_FILES];
+	int i, ret;
+
+	dir = g_dir_make_tmp("sr-convert-XXXXXX", NULL);
+	fail_unless(dir != NULL, "Failed to create a directory.");
+	for (i = 0; i < NUM_FILES; i++) {
+		infiles[i] = tmp_file_name(dir, i);
+		outfiles[i] = tmp_file_name(dir, NUM_FILES + i);
+		g_file_set_contents(infiles[i], hello + i, -1, NULL);
+	}
+
+	conv = binary_converter();
+	sr_convert_set_workers(conv, 2);
+	ret = sr_convert_files(conv, (const char *const *)infiles,
+		(const char *const *)outfiles, NUM_FILES);
+	fail_unless(ret == SR_OK, "sr_convert_files() failed: %d.", ret);
+	for (i = 0; i < NUM_FILES; i++)
+		check_file_contents(outfiles[i], hello + i);
+	sr_convert_free(conv);
+
+	for (i = 0; i < NUM_FILES; i++) {
+		g_unlink(infiles[i]);
+		g_unlink(outfiles[i]);
+		g_free(infiles[i]);
+		g_free(outfiles[i]);
+	}
+	g_rmdir(dir);
+	g_free(dir);
+}
+END_TEST
+
+/*
+ * Check that output and input modules with option defaults work when
+ * instantiated and freed on several workers at once.
+ */
+START_TEST(test_convert_files_analog)
+{
+	struct sr_convert *conv;
+	char *dir, *infiles[NUM_FILES], *outfiles[NUM_FILES];
+	int8_t samples[256];
+	gchar *contents;
+	gsize length;
+	uint32_t u;
+	float f;
+	int i, j, n, ret;
+
+	/* S8 samples, which the wav output turns into exact floats. */
+	for (j = 0; j < (int)sizeof(samples); j++)
+		samples[j] = j - 128;
+
+	dir = g_dir_make_tmp("sr-convert-XXXXXX", NULL);
+	fail_unless(dir != NULL, "Failed to create a directory.");
+	for (i = 0; i < NUM_FILES; i++) {
+		infiles[i] = tmp_file_name(dir, i);
+		outfiles[i] = tmp_file_name(dir, NUM_FILES + i);
+		g_file_set_contents(infiles[i], (const char *)samples,
+			sizeof(samples) - i, NULL);
+	}
+
+	conv = format_converter("raw_analog", NULL, "wav");
+	sr_convert_set_workers(conv, NUM_FILES);
+	ret = sr_convert_files(conv, (const char *const *)infiles,
+		(const char *const *)outfiles, NUM_FILES);
+	fail_unless(ret == SR_OK, "sr_convert_files() failed: %d.", ret);
+
+	for (i = 0; i < NUM_FILES; i++) {
+		n = sizeof(samples) - i;
+		fail_unless(g_file_get_contents(outfiles[i], &contents,
+			&length, NULL), "Failed to read %s.", outfiles[i]);
+		fail_unless(length == 46 + 4 * (gsize)n,
+			"Unexpected size of %s: %zu.", outfiles[i], length);
+		fail_unless(!memcmp(contents, "RIFF", 4) &&
+			!memcmp(contents + 8, "WAVE", 4),
+			"No WAV header in %s.", outfiles[i]);
+		for (j = 0; j < n; j++) {
+			u = (uint8_t)contents[46 + 4 * j]
+				| (uint8_t)contents[47 + 4 * j] << 8
+				| (uint8_t)contents[48 + 4 * j] << 16
+				| (uint32_t)(uint8_t)contents[49 + 4 * j] << 24;
+			memcpy(&f, &u, sizeof(f));
+			fail_unless(f == samples[j] / 128.0f,
+				"Sample %d of %s is %f.", j, outfiles[i], f);
+		}
+		g_free(contents);
+	}
+	sr_convert_free(conv);
+
+	for (i = 0; i < NUM_FILES; i++) {
+		g_unlink(infiles[i]);
+		g_unlink(outfiles[i]);
+		g_free(infiles[i]);
+		g_free(outfiles[i]);
+	}
+	g_rmdir(dir);
+	g_free(dir);
+}
+END_TEST
+
+/* Check a conversion between real formats, CSV to VCD. */
+START_TEST(test_convert_csv_vcd)
+{
+	struct sr_convert *conv;
+	GHashTable *options;
+	char *dir, *infile, *outfile;
+	int ret;
+
+	dir = g_dir_make_tmp("sr-convert-XXXXXX", NULL);
+	fail_unless(dir != NULL, "Failed to create a directory.");
+	infile = tmp_file_name(dir, 0);
+	outfile = tmp_file_name(dir, 1);
+	g_file_set_contents(infile, csv_data, -1, NULL);
+
+	options = csv_options();
+	conv = format_converter("csv", options, "vcd");
+	g_hash_table_unref(options);
+	ret = sr_convert_file(conv, infile, outfile);
+	fail_unless(ret == SR_OK, "sr_convert_file() failed: %d.", ret);
+	check_vcd_changes(outfile, vcd_changes);
+	sr_convert_free(conv);
+
+	g_unlink(infile);
+	g_unlink(outfile);
+	g_rmdir(dir);
+	g_free(infile);
+	g_free(outfile);
+	g_free(dir);
+}
+END_TEST
+
+/*
+ * Check that session files, which no input module reads, convert when
+ * the format is detected: CSV to a session file, and that to VCD.
+ */
+START_TEST(test_convert_session_file)
+{
+	struct sr_convert *conv;
+	GHashTable *options;
+	char *dir, *infile, *srfile, *outfile;
+	int ret;
+
+	dir = g_dir_make_tmp("sr-convert-XXXXXX", NULL);
+	fail_unless(dir != NULL, "Failed to create a directory.");
+	infile = tmp_file_name(dir, 0);
+	srfile = tmp_file_name(dir, 1);
+	outfile = tmp_file_name(dir, 2);
+	g_file_set_contents(infile, csv_data, -1, NULL);
+
+	options = csv_options();
+	conv = format_converter("csv", options, "srzip");
+	g_hash_table_unref(options);
+	ret = sr_convert_file(conv, infile, srfile);
+	fail_unless(ret == SR_OK, "Conversion to srzip failed: %d.", ret);
+	sr_convert_free(conv);
+
+	conv = format_converter(NULL, NULL, "vcd");
+	ret = sr_convert_file(conv, srfile, outfile);
+	fail_unless(ret == SR_OK, "Conversion from srzip failed: %d.", ret);
+	check_vcd_changes(outfile, vcd_changes);
+	sr_convert_free(conv);
+
+	g_unlink(infile);
+	g_unlink(srfile);
+	g_unlink(outfile);
+	g_rmdir(dir);
+	g_free(infile);
+	g_free(srfile);
+	g_free(outfile);
+	g_free(dir);
+}
+END_TEST
+
+Suite *suite_convert(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("convert");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_convert_new_free);
+	tcase_add_test(tc, test_convert_file);
+	tcase_add_test(tc, test_convert_files);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("formats");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_convert_files_analog);
+	tcase_add_test(tc, test_convert_csv_vcd);
+	tcase_add_test(tc, test_convert_session_file);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+/*
+ * Tests of internal functions. This program links the static library,
+ * since the shared one only exports the public API.
+ */
+int main(void)
+{
+	int ret;
+	Suite *s;
+	SRunner *srunner;
+
+	s = suite_create("internalsuite");
+	srunner = srunner_create(s);
+
+	srunner_add_suite(srunner, suite_asix_sigma());
+	srunner_add_suite(srunner, suite_capture_store());
+	srunner_add_suite(srunner, suite_config_cache());
+	srunner_add_suite(srunner, suite_logic_rle());
+	srunner_add_suite(srunner, suite_scpi());
+	srunner_add_suite(srunner, suite_session_reactor());
+	srunner_add_suite(srunner, suite_soft_trigger());
+	srunner_add_suite(srunner, suite_sw_limits());
+	srunner_add_suite(srunner, suite_usb_handoff());
+	srunner_add_suite(srunner, suite_usb_record());
+	srunner_add_suite(srunner, suite_usb_stream());
+
+	srunner_run_all(srunner, CK_VERBOSE);
+	ret = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+
+	return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
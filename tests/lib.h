@@ -46,12 +46,29 @@ Suite *suite_driver_all(void);
 Suite *suite_input_all(void);
 Suite *suite_input_binary(void);
 Suite *suite_output_all(void);
+Suite *suite_output_text(void);
 Suite *suite_transform_all(void);
+Suite *suite_transform_overview(void);
 Suite *suite_session(void);
 Suite *suite_strutil(void);
 Suite *suite_version(void);
 Suite *suite_device(void);
 Suite *suite_trigger(void);
 Suite *suite_analog(void);
+Suite *suite_convert(void);
+Suite *suite_wav(void);
+
+/* Suites of tests/internal, which test SR_PRIV functions. */
+Suite *suite_asix_sigma(void);
+Suite *suite_capture_store(void);
+Suite *suite_config_cache(void);
+Suite *suite_logic_rle(void);
+Suite *suite_scpi(void);
+Suite *suite_session_reactor(void);
+Suite *suite_soft_trigger(void);
+Suite *suite_sw_limits(void);
+Suite *suite_usb_handoff(void);
+Suite *suite_usb_record(void);
+Suite *suite_usb_stream(void);
 
 #endif
@@ -0,0 +1,369 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+/* The size of the chunks the runs get expanded to, see session.c. */
+#define EXPAND_SIZE	(1024 * 1024)
+
+/* Runs of 16 bit samples, including zero-length ones. */
+static const uint8_t values[] = {
+	0x01, 0x80, 0x02, 0x00, 0x03, 0x00, 0xff, 0xff, 0x04, 0x00,
+};
+static const uint64_t lengths[] = { 3, 0, 2, 1, 0 };
+static const uint8_t samples[] = {
+	0x01, 0x80, 0x01, 0x80, 0x01, 0x80,
+	0x03, 0x00, 0x03, 0x00,
+	0xff, 0xff,
+};
+
+static struct sr_session *session;
+static struct sr_dev_inst *sdi;
+static GByteArray *logic;
+static GByteArray *rle_values;
+static GArray *rle_lengths;
+
+static void init_rle(struct sr_datafeed_logic_rle *rle)
+{
+	rle->num_runs = ARRAY_SIZE(lengths);
+	rle->unitsize = 2;
+	rle->values = g_memdup(values, sizeof(values));
+	rle->lengths = (uint64_t *)lengths;
+}
+
+/* Expand all runs, and check the expander's chunks on the way. */
+static GByteArray *expand(const struct sr_datafeed_logic_rle *rle)
+{
+	struct sr_logic_rle_expander exp;
+	struct sr_datafeed_logic l;
+	GByteArray *result;
+
+	result = g_byte_array_new();
+	sr_logic_rle_expander_init(&exp, rle);
+	while (sr_logic_rle_expander_next(&exp, &l)) {
+		fail_unless(l.unitsize == rle->unitsize, "Wrong unitsize.");
+		fail_unless(l.length > 0 && l.length <= EXPAND_SIZE
+			&& l.length % l.unitsize == 0,
+			"Chunk of %" PRIu64 " bytes.", l.length);
+		g_byte_array_append(result, l.data, l.length);
+	}
+	sr_logic_rle_expander_clear(&exp);
+
+	return result;
+}
+
+/* Check the expansion of runs, including zero-length ones. */
+START_TEST(test_expand)
+{
+	struct sr_datafeed_logic_rle rle;
+	GByteArray *result;
+
+	init_rle(&rle);
+	result = expand(&rle);
+	fail_unless(result->len == sizeof(samples)
+		&& !memcmp(result->data, samples, sizeof(samples)),
+		"Wrong expanded samples.");
+	g_byte_array_free(result, TRUE);
+	g_free(rle.values);
+}
+END_TEST
+
+/* Check that payloads without samples expand to nothing. */
+START_TEST(test_expand_empty)
+{
+	struct sr_datafeed_logic_rle rle;
+	uint64_t zero[] = { 0, 0 };
+	GByteArray *result;
+
+	init_rle(&rle);
+	rle.num_runs = 0;
+	result = expand(&rle);
+	fail_unless(result->len == 0, "No runs expanded to samples.");
+	g_byte_array_free(result, TRUE);
+
+	rle.num_runs = ARRAY_SIZE(zero);
+	rle.lengths = zero;
+	result = expand(&rle);
+	fail_unless(result->len == 0, "Empty runs expanded to samples.");
+	g_byte_array_free(result, TRUE);
+	g_free(rle.values);
+}
+END_TEST
+
+/* Check runs which are longer than a chunk, with an odd unitsize. */
+START_TEST(test_expand_chunks)
+{
+	struct sr_datafeed_logic_rle rle;
+	uint8_t run_values[] = { 0x12, 0x34, 0x56, 0x00, 0x00, 0x00, 0x78, 0x9a, 0xbc };
+	uint64_t run_lengths[] = { EXPAND_SIZE, 0, 5 };
+	GByteArray *result;
+	uint64_t i;
+
+	rle.num_runs = ARRAY_SIZE(run_lengths);
+	rle.unitsize = 3;
+	rle.values = run_values;
+	rle.lengths = run_lengths;
+	result = expand(&rle);
+	fail_unless(result->len == (EXPAND_SIZE + 5) * 3,
+		"Expanded to %u bytes.", result->len);
+	for (i = 0; i < EXPAND_SIZE + 5; i++)
+		fail_unless(!memcmp(result->data + i * 3,
+			i < EXPAND_SIZE ? run_values : run_values + 6, 3),
+			"Wrong sample %" PRIu64 ".", i);
+	g_byte_array_free(result, TRUE);
+}
+END_TEST
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *l;
+
+	(void)sdi;
+	(void)cb_data;
+
+	fail_unless(packet->type != SR_DF_LOGIC_RLE,
+		"Got runs without asking for them.");
+	if (packet->type == SR_DF_LOGIC) {
+		l = packet->payload;
+		g_byte_array_append(logic, l->data, l->length);
+	}
+}
+
+static void datafeed_in_rle(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic_rle *rle;
+
+	(void)sdi;
+	(void)cb_data;
+
+	fail_unless(packet->type != SR_DF_LOGIC,
+		"Got expanded samples instead of the runs.");
+	if (packet->type == SR_DF_LOGIC_RLE) {
+		rle = packet->payload;
+		fail_unless(rle->unitsize == 2, "Wrong unitsize.");
+		g_byte_array_append(rle_values, rle->values,
+			rle->num_runs * rle->unitsize);
+		g_array_append_vals(rle_lengths, rle->lengths, rle->num_runs);
+	}
+}
+
+static void setup(void)
+{
+	char name[8];
+	int i;
+
+	srtest_setup();
+
+	sr_session_new(srtest_ctx, &session);
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	for (i = 0; i < 16; i++) {
+		snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	sr_session_dev_add(session, sdi);
+
+	logic = g_byte_array_new();
+	rle_values = g_byte_array_new();
+	rle_lengths = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+}
+
+static void teardown(void)
+{
+	g_array_free(rle_lengths, TRUE);
+	g_byte_array_free(rle_values, TRUE);
+	g_byte_array_free(logic, TRUE);
+	if (session)
+		sr_session_destroy(session);
+	sr_dev_inst_free(sdi);
+
+	srtest_teardown();
+}
+
+static void send_rle(void)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	int ret;
+
+	init_rle(&rle);
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+	ret = sr_session_send(sdi, &packet);
+	fail_unless(ret == SR_OK, "sr_session_send() failed: %d.", ret);
+	g_free(rle.values);
+}
+
+/*
+ * Check that transforms which don't deal with logic data pass the runs
+ * on, and that only callbacks which asked for runs get them.
+ */
+START_TEST(test_session_passthrough)
+{
+	const struct sr_transform *nop, *scale;
+
+	nop = sr_transform_new(sr_transform_find("nop"), NULL, sdi);
+	scale = sr_transform_new(sr_transform_find("scale"), NULL, sdi);
+	fail_unless(nop && scale, "Failed to create transforms.");
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+	sr_session_datafeed_callback_add_rle(session, datafeed_in_rle, NULL);
+
+	send_rle();
+
+	fail_unless(logic->len == sizeof(samples)
+		&& !memcmp(logic->data, samples, sizeof(samples)),
+		"Wrong expanded samples.");
+	fail_unless(rle_values->len == sizeof(values)
+		&& !memcmp(rle_values->data, values, sizeof(values)),
+		"Wrong run values.");
+	fail_unless(rle_lengths->len == ARRAY_SIZE(lengths)
+		&& !memcmp(rle_lengths->data, lengths, sizeof(lengths)),
+		"Wrong run lengths.");
+
+	/* Transforms don't get unlinked from the session when freed. */
+	sr_session_destroy(session);
+	session = NULL;
+	sr_transform_free(scale);
+	sr_transform_free(nop);
+}
+END_TEST
+
+/* Check that the invert transform inverts the values of the runs. */
+START_TEST(test_session_invert)
+{
+	const struct sr_transform *invert;
+	unsigned int i;
+
+	invert = sr_transform_new(sr_transform_find("invert"), NULL, sdi);
+	fail_unless(invert != NULL, "Failed to create transform.");
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+
+	send_rle();
+
+	fail_unless(logic->len == sizeof(samples), "Wrong number of samples.");
+	for (i = 0; i < sizeof(samples); i++)
+		fail_unless(logic->data[i] == (uint8_t)~samples[i],
+			"Sample byte %u wasn't inverted.", i);
+
+	sr_session_destroy(session);
+	session = NULL;
+	sr_transform_free(invert);
+}
+END_TEST
+
+/* Get the complete output of a module for a packet. */
+static GString *output_text(const char *id,
+		const struct sr_datafeed_packet *packet)
+{
+	const struct sr_output *o;
+	struct sr_datafeed_packet end;
+	GString *text, *out;
+	int ret;
+
+	o = sr_output_new(sr_output_find((char *)id), NULL, sdi, NULL);
+	fail_unless(o != NULL, "Failed to create %s output.", id);
+	text = g_string_new(NULL);
+	out = NULL;
+	ret = sr_output_send(o, packet, &out);
+	fail_unless(ret == SR_OK, "sr_output_send() failed: %d.", ret);
+	if (out) {
+		g_string_append_len(text, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+	end.type = SR_DF_END;
+	end.payload = NULL;
+	out = NULL;
+	ret = sr_output_send(o, &end, &out);
+	fail_unless(ret == SR_OK, "sr_output_send() failed: %d.", ret);
+	if (out) {
+		g_string_append_len(text, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+	sr_output_free(o);
+
+	return text;
+}
+
+/*
+ * Check that output modules which don't deal with runs produce the
+ * same output as for the expanded samples.
+ */
+START_TEST(test_output_passthrough)
+{
+	const char *ids[] = { "bits", "hex", "ascii", "binary" };
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic l;
+	struct sr_datafeed_logic_rle rle;
+	GString *expected, *text;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(ids); i++) {
+		fail_unless(!sr_output_test_flag(sr_output_find((char *)ids[i]),
+			SR_OUTPUT_LOGIC_RLE), "%s output handles runs.", ids[i]);
+
+		l.length = sizeof(samples);
+		l.unitsize = 2;
+		l.data = (void *)samples;
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &l;
+		expected = output_text(ids[i], &packet);
+
+		init_rle(&rle);
+		packet.type = SR_DF_LOGIC_RLE;
+		packet.payload = &rle;
+		text = output_text(ids[i], &packet);
+		g_free(rle.values);
+
+		fail_unless(expected->len > 0, "No %s output.", ids[i]);
+		fail_unless(text->len == expected->len
+			&& !memcmp(text->str, expected->str, text->len),
+			"Wrong %s output for runs.", ids[i]);
+		g_string_free(expected, TRUE);
+		g_string_free(text, TRUE);
+	}
+}
+END_TEST
+
+Suite *suite_logic_rle(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("logic_rle");
+
+	tc = tcase_create("expand");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_expand);
+	tcase_add_test(tc, test_expand_empty);
+	tcase_add_test(tc, test_expand_chunks);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("passthrough");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_session_passthrough);
+	tcase_add_test(tc, test_session_invert);
+	tcase_add_test(tc, test_output_passthrough);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,179 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+/* Logic channels by bit position, one of which is disabled. */
+static const struct {
+	int index;
+	const char *name;
+	gboolean enabled;
+} channels[] = {
+	{ 0, "D0", TRUE },
+	{ 5, "D5", FALSE },
+	{ 9, "D9", TRUE },
+	{ 17, "D17", TRUE },
+	{ 23, "D23", TRUE },
+};
+
+/* Samples per packet, with a trigger after the first one. */
+static const unsigned int packet_samples[] = { 5, 17, 7 };
+
+/*
+ * Output of the text modules for 29 samples, after the header. The
+ * lines don't line up with the packets or bytes, and the width of
+ * hex lines leaves a partial byte at their end.
+ */
+static const struct {
+	const char *id;
+	uint32_t width;
+	unsigned int unitsize;
+	const char *expected;
+} golden[] = {
+
+};
+
+static uint8_t sample_byte(unsigned int sample, unsigned int byte)
+{
+	return sample * 29 + byte * 71 + ((sample * sample) >> 3);
+}
+
+static struct sr_dev_inst *new_sdi(void)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	GSList *l;
+	unsigned int i;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	fail_unless(sdi != NULL, "sr_dev_inst_user_new() failed.");
+	for (i = 0; i < ARRAY_SIZE(channels); i++)
+		sr_dev_inst_channel_add(sdi, channels[i].index,
+			SR_CHANNEL_LOGIC, channels[i].name);
+	for (i = 0, l = sr_dev_inst_channels_get(sdi); l; i++, l = l->next) {
+		ch = l->data;
+		sr_dev_channel_enable(ch, channels[i].enabled);
+	}
+
+	return sdi;
+}
+
+static void output_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *text)
+{
+	GString *out;
+	int ret;
+
+	out = NULL;
+	ret = sr_output_send(o, packet, &out);
+	fail_unless(ret == SR_OK, "sr_output_send() error: %d.", ret);
+	if (out) {
+		g_string_append_len(text, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+}
+
+/* Run the samples through an output module, return what it wrote. */
+static GString *run_output(const char *id, uint32_t width,
+		unsigned int unitsize)
+{
+	struct sr_dev_inst *sdi;
+	const struct sr_output *o;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	GHashTable *options;
+	GString *text;
+	uint8_t *data;
+	unsigned int i, j, b, sample;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("width"),
+		g_variant_ref_sink(g_variant_new_uint32(width)));
+	sdi = new_sdi();
+	o = sr_output_new(sr_output_find((char *)id), options, sdi, NULL);
+	g_hash_table_destroy(options);
+	fail_unless(o != NULL, "Failed to create the %s output.", id);
+
+	text = g_string_new(NULL);
+	sample = 0;
+	for (i = 0; i < ARRAY_SIZE(packet_samples); i++) {
+		data = g_malloc(packet_samples[i] * unitsize);
+		for (j = 0; j < packet_samples[i]; j++, sample++)
+			for (b = 0; b < unitsize; b++)
+				data[j * unitsize + b] = sample_byte(sample, b);
+		logic.length = packet_samples[i] * unitsize;
+		logic.unitsize = unitsize;
+		logic.data = data;
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		output_send(o, &packet, text);
+		g_free(data);
+
+		if (i == 0) {
+			packet.type = SR_DF_TRIGGER;
+			packet.payload = NULL;
+			output_send(o, &packet, text);
+		}
+	}
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	output_send(o, &packet, text);
+	sr_output_free(o);
+
+	return text;
+}
+
+/* Check the text outputs against what they always wrote. */
+START_TEST(test_golden)
+{
+	GString *text;
+	const char *body;
+
+	/* Note: _i is the loop variable from tcase_add_loop_test(). */
+
+	text = run_output(golden[_i].id, golden[_i].width, golden[_i].unitsize);
+	/* Skip the header, a version and an acquisition line. */
+	body = strchr(text->str, '\n');
+	fail_unless(body != NULL, "No header.");
+	body = strchr(body + 1, '\n');
+	fail_unless(body != NULL, "No header.");
+	fail_unless(!strcmp(body + 1, golden[_i].expected),
+		"%s output with width %" PRIu32 " and unitsize %u:\n%s",
+		golden[_i].id, golden[_i].width, golden[_i].unitsize, body + 1);
+	g_string_free(text, TRUE);
+}
+END_TEST
+
+Suite *suite_output_text(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("output-text");
+
+	tc = tcase_create("golden");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_loop_test(tc, test_golden, 0, ARRAY_SIZE(golden));
+	suite_add_tcase(s, tc);
+
+	return s;
+}
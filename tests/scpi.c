@@ -0,0 +1,250 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "scpi.h"
+#include "lib.h"
+
+/*
+ * A device which replies with a canned response, in reads of at most
+ * 'chunk' bytes. Once the response is used up, reads return nothing or
+ * fail, like a device which went silent or an interface which broke.
+ */
+struct fake_scpi {
+	const char *response;
+	size_t len;
+	size_t pos;
+	size_t chunk;
+	gboolean fail_at_end;
+	int reads;
+};
+
+static struct fake_scpi fake;
+static struct sr_scpi_dev_inst *scpi;
+
+static int fake_send(void *priv, const char *command)
+{
+	(void)priv;
+	(void)command;
+
+	return SR_OK;
+}
+
+static int fake_read_begin(void *priv)
+{
+	(void)priv;
+
+	return SR_OK;
+}
+
+static int fake_read_data(void *priv, char *buf, int maxlen)
+{
+	struct fake_scpi *f;
+	size_t len;
+
+	f = priv;
+	if (f->pos == f->len)
+		return f->fail_at_end ? SR_ERR : 0;
+	len = MIN(MIN(f->chunk, f->len - f->pos), (size_t)maxlen);
+	memcpy(buf, f->response + f->pos, len);
+	f->pos += len;
+	f->reads++;
+
+	return len;
+}
+
+static int fake_read_complete(void *priv)
+{
+	struct fake_scpi *f;
+
+	f = priv;
+
+	return f->pos == f->len;
+}
+
+static void setup(void)
+{
+	srtest_setup();
+
+	memset(&fake, 0, sizeof(fake));
+	scpi = g_malloc0(sizeof(*scpi));
+	scpi->name = "fake";
+	scpi->send = fake_send;
+	scpi->read_begin = fake_read_begin;
+	scpi->read_data = fake_read_data;
+	scpi->read_complete = fake_read_complete;
+	scpi->read_timeout_us = 10 * 1000;
+	scpi->priv = &fake;
+	g_mutex_init(&scpi->scpi_mutex);
+}
+
+static void teardown(void)
+{
+	g_mutex_clear(&scpi->scpi_mutex);
+	g_free(scpi);
+
+	srtest_teardown();
+}
+
+static void set_response(const char *response, size_t len, size_t chunk)
+{
+	fake.response = response;
+	fake.len = len;
+	fake.pos = 0;
+	fake.chunk = chunk;
+}
+
+static void check_block(const char *response, size_t len, size_t chunk,
+		const char *expected, size_t expected_len)
+{
+	GByteArray *block;
+	int ret;
+
+	set_response(response, len, chunk);
+	ret = sr_scpi_get_block(scpi, "DATA?", &block);
+	fail_unless(ret == SR_OK, "sr_scpi_get_block() failed: %d.", ret);
+	fail_unless(block != NULL, "No block returned.");
+	fail_unless(block->len == expected_len, "Block of %u bytes, expected "
+		"%zu.", block->len, expected_len);
+	fail_unless(!memcmp(block->data, expected, expected_len),
+		"Wrong block data.");
+	g_byte_array_free(block, TRUE);
+}
+
+static void check_block_error(const char *response, size_t len,
+		size_t chunk)
+{
+	GByteArray *block;
+	int ret;
+
+	set_response(response, len, chunk);
+	block = (void *)&fake;
+	ret = sr_scpi_get_block(scpi, "DATA?", &block);
+	fail_unless(ret < 0, "Invalid block was accepted.");
+	fail_unless(block == NULL, "Block returned on error.");
+}
+
+#define RESPONSE(s)	s, sizeof(s) - 1
+
+/* Check a definite length block, including binary data. */
+START_TEST(test_definite)
+{
+	check_block(RESPONSE("#15ab\0\ncd\n"), 1024, "ab\0\nc", 5);
+	check_block(RESPONSE("#210\xff\x00\x01\x02\x03\x04\x05\x06\x07\x08\n"),
+		1024, "\xff\x00\x01\x02\x03\x04\x05\x06\x07\x08", 10);
+	/* Without a terminator. */
+	check_block(RESPONSE("#13xyz"), 1024, "xyz", 3);
+}
+END_TEST
+
+/* Check that the block is read exactly, and with few large reads. */
+START_TEST(test_definite_reads)
+{
+	char *response;
+	GByteArray *block;
+	int ret;
+
+	response = g_malloc(5 + 10000 + 1);
+	memcpy(response, "#5", 2);
+	memcpy(response + 2, "10000", 5);
+	memset(response + 7, 0x5a, 10000);
+	response[7 + 10000] = '\n';
+	set_response(response, 7 + 10000 + 1, 65536);
+
+	ret = sr_scpi_get_block(scpi, "DATA?", &block);
+	fail_unless(ret == SR_OK, "sr_scpi_get_block() failed: %d.", ret);
+	fail_unless(block->len == 10000 && block->data[9999] == 0x5a,
+		"Wrong block data.");
+	fail_unless(fake.pos == fake.len, "Terminator was left unread.");
+	fail_unless(fake.reads == 3, "Block read in %d reads.", fake.reads);
+
+	g_byte_array_free(block, TRUE);
+	g_free(response);
+}
+END_TEST
+
+/* Check an indefinite length block, which ends with the response. */
+START_TEST(test_indefinite)
+{
+	char *response;
+	size_t i;
+
+	check_block(RESPONSE("#0abc\n"), 1024, "abc", 3);
+	check_block(RESPONSE("#0\n"), 1024, "", 0);
+
+	/* Larger than one read of the parser. */
+	response = g_malloc(2 + 10000 + 1);
+	memcpy(response, "#0", 2);
+	for (i = 0; i < 10000; i++)
+		response[2 + i] = i;
+	response[2 + 10000] = '\n';
+	check_block(response, 2 + 10000 + 1, 65536, response + 2, 10000);
+	g_free(response);
+}
+END_TEST
+
+/* Check that short reads, down to single bytes, are put together. */
+START_TEST(test_short_reads)
+{
+	check_block(RESPONSE("#15hello\n"), 1, "hello", 5);
+	check_block(RESPONSE("#212hello world!\n"), 3, "hello world!", 12);
+	check_block(RESPONSE("#0hello\n"), 1, "hello", 5);
+}
+END_TEST
+
+/* Check that malformed and truncated blocks are rejected. */
+START_TEST(test_invalid)
+{
+	/* No block. */
+	check_block_error(RESPONSE("1.234\n"), 1024);
+	check_block_error(RESPONSE("#x5hello\n"), 1024);
+	check_block_error(RESPONSE("#2x5hello\n"), 1024);
+	check_block_error(RESPONSE("#10\n"), 1024);
+	/* Truncated header, length or data. */
+	check_block_error(RESPONSE("#"), 1024);
+	check_block_error(RESPONSE("#3"), 1024);
+	check_block_error(RESPONSE("#310"), 1024);
+	check_block_error(RESPONSE("#15hel"), 1024);
+	check_block_error(RESPONSE("#15hel"), 1);
+	/* Failure of the interface. */
+	fake.fail_at_end = TRUE;
+	check_block_error(RESPONSE("#15hel"), 1024);
+}
+END_TEST
+
+Suite *suite_scpi(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("scpi");
+
+	tc = tcase_create("get_block");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_definite);
+	tcase_add_test(tc, test_definite_reads);
+	tcase_add_test(tc, test_indefinite);
+	tcase_add_test(tc, test_short_reads);
+	tcase_add_test(tc, test_invalid);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -19,6 +19,7 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -185,6 +186,153 @@ START_TEST(test_session_trigger_get_null)
 }
 END_TEST
 
+/*
+ * Check that planar logic data converts to the expected sample-major
+ * data, including NULL (all zero) planes and a partial last byte.
+ */
+START_TEST(test_logic_planar_to_samples)
+{
+	uint8_t plane0[] = { 0x55, 0x01 };
+	uint8_t plane2[] = { 0xf0, 0x00 };
+	void *planes[] = { plane0, NULL, plane2 };
+	struct sr_datafeed_logic_planar planar;
+	uint8_t samples[9];
+	unsigned int i;
+
+	planar.num_samples = ARRAY_SIZE(samples);
+	planar.unitsize = 1;
+	planar.num_planes = ARRAY_SIZE(planes);
+	planar.planes = planes;
+
+	memset(samples, 0xff, sizeof(samples));
+	sr_logic_planar_to_samples(&planar, samples);
+	for (i = 0; i < 8; i++)
+		fail_unless(samples[i] == (((i & 1) ? 0 : 1) | (i >= 4 ? 4 : 0)),
+			"Sample %u is 0x%02x.", i, samples[i]);
+	fail_unless(samples[8] == 0x01, "Sample 8 is 0x%02x.", samples[8]);
+}
+END_TEST
+
+static void datafeed_count_a(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	(void)sdi;
+	(void)packet;
+
+	(*(uint64_t *)cb_data)++;
+}
+
+static void datafeed_count_b(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	(void)sdi;
+	(void)packet;
+
+	(*(uint64_t *)cb_data)++;
+}
+
+/* Send some logic data through a session, using the binary input. */
+static void send_binary_input(struct sr_session *session)
+{
+	const struct sr_input *in;
+	GString *buf;
+	int ret;
+
+	in = sr_input_new(sr_input_find("binary"), NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	sr_session_dev_add(session, sr_input_dev_inst_get(in));
+
+	buf = g_string_new("Hello world");
+	ret = sr_input_send(in, buf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	g_string_free(buf, TRUE);
+
+	sr_session_dev_remove_all(session);
+	sr_input_free(in);
+}
+
+static gint compare_stats_id(gconstpointer a, gconstpointer b)
+{
+	const struct sr_session_stats *sa = a, *sb = b;
+
+	return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/* Get the statistics of the datafeed callbacks, ordered by ID. */
+static GSList *datafeed_stats(struct sr_session *session)
+{
+	GSList *stats, *l, *result;
+	struct sr_session_stats *entry;
+	int ret;
+
+	ret = sr_session_stats_get(session, &stats);
+	fail_unless(ret == SR_OK, "sr_session_stats_get() failed: %d.", ret);
+
+	result = NULL;
+	for (l = stats; l; l = l->next) {
+		entry = l->data;
+		if (entry->stage != SR_STATS_DATAFEED_CALLBACK)
+			continue;
+		entry = g_memdup(entry, sizeof(*entry));
+		entry->name = g_strdup(entry->name);
+		result = g_slist_insert_sorted(result, entry, compare_stats_id);
+	}
+	sr_session_stats_free(stats);
+
+	return result;
+}
+
+/*
+ * Check whether the statistics keep datafeed callbacks apart, including
+ * a callback which is removed and added again.
+ */
+START_TEST(test_session_stats)
+{
+	struct sr_session *sess;
+	struct sr_session_stats *a, *b, *again;
+	GSList *stats;
+	uint64_t count_a, count_b, count_again;
+	int ret;
+
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_stats_enable(sess, TRUE);
+	fail_unless(ret == SR_OK, "sr_session_stats_enable() failed: %d.", ret);
+
+	count_a = count_b = count_again = 0;
+	sr_session_datafeed_callback_add(sess, datafeed_count_a, &count_a);
+	sr_session_datafeed_callback_add(sess, datafeed_count_b, &count_b);
+	send_binary_input(sess);
+	fail_unless(count_a > 0, "No packets were sent.");
+
+	sr_session_datafeed_callback_remove_all(sess);
+	sr_session_datafeed_callback_add(sess, datafeed_count_a, &count_again);
+	send_binary_input(sess);
+
+	stats = datafeed_stats(sess);
+	fail_unless(g_slist_length(stats) == 3,
+		"Expected 3 datafeed stages, got %d.", g_slist_length(stats));
+	a = g_slist_nth_data(stats, 0);
+	b = g_slist_nth_data(stats, 1);
+	again = g_slist_nth_data(stats, 2);
+	fail_unless(a->calls == count_a && b->calls == count_b
+		&& again->calls == count_again, "Wrong number of calls.");
+	fail_unless(strcmp(a->name, b->name) != 0,
+		"Different callbacks have the same name.");
+	fail_unless(!strcmp(a->name, again->name),
+		"The same callback has different names.");
+	sr_session_stats_free(stats);
+
+	ret = sr_session_stats_reset(sess);
+	fail_unless(ret == SR_OK, "sr_session_stats_reset() failed: %d.", ret);
+	stats = datafeed_stats(sess);
+	fail_unless(stats == NULL, "Statistics were not reset.");
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
 Suite *suite_session(void)
 {
 	Suite *s;
@@ -209,5 +357,14 @@ Suite *suite_session(void)
 	tcase_add_test(tc, test_session_trigger_get_null);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("stats");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_stats);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("planar");
+	tcase_add_test(tc, test_logic_planar_to_samples);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -0,0 +1,338 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <unistd.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/* Longest time to wait for an event, before the test fails [ms]. */
+#define MAX_WAIT_MS	5000
+
+struct event {
+	int id;
+	int fd;
+	unsigned int revents;
+	int64_t time_us;
+	/* Number of calls before the source is dropped, -1 for never. */
+	int calls_left;
+	/* Another source's event to remove in the callback, if any. */
+	struct event *remove;
+};
+
+static struct sr_session *session;
+static GMainContext *main_context;
+/* The IDs of the events, in the order the callbacks ran. */
+static GArray *fired;
+
+static int event_cb(int fd, int revents, void *cb_data)
+{
+	struct event *ev;
+	char c;
+
+	ev = cb_data;
+	ev->fd = fd;
+	ev->revents = revents;
+	ev->time_us = g_get_monotonic_time();
+	g_array_append_val(fired, ev->id);
+	if (fd >= 0 && (revents & G_IO_IN))
+		fail_unless(read(fd, &c, 1) == 1, "Readable pipe wasn't.");
+	if (ev->remove) {
+		sr_session_source_remove_internal(session, ev->remove);
+		ev->remove = NULL;
+	}
+	if (ev->calls_left > 0)
+		ev->calls_left--;
+
+	return ev->calls_left != 0;
+}
+
+static void setup(void)
+{
+	srtest_setup();
+
+	sr_session_new(srtest_ctx, &session);
+	fail_unless(sr_session_reactor_enable(session, TRUE) == SR_OK,
+		"Failed to enable the reactor.");
+	/* Sources need a main context, which a started session has. */
+	main_context = g_main_context_new();
+	session->main_context = main_context;
+	fired = g_array_new(FALSE, FALSE, sizeof(int));
+}
+
+static void teardown(void)
+{
+	fail_unless(g_hash_table_size(session->event_sources) == 0,
+		"Event sources are left.");
+	fail_unless(session->reactor == NULL,
+		"Reactor remains without sources.");
+	while (g_main_context_iteration(main_context, FALSE))
+		;
+	session->main_context = NULL;
+	g_main_context_unref(main_context);
+	g_array_free(fired, TRUE);
+	sr_session_destroy(session);
+
+	srtest_teardown();
+}
+
+static gboolean wait_timeout(void *data)
+{
+	*(gboolean *)data = TRUE;
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Run the main loop until the given number of callbacks ran. */
+static void run_until_fired(unsigned int count)
+{
+	GSource *timeout;
+	gboolean timed_out;
+
+	timed_out = FALSE;
+	timeout = g_timeout_source_new(MAX_WAIT_MS);
+	g_source_set_callback(timeout, wait_timeout, &timed_out, NULL);
+	g_source_attach(timeout, main_context);
+	while (fired->len < count && !timed_out)
+		g_main_context_iteration(main_context, TRUE);
+	g_source_destroy(timeout);
+	g_source_unref(timeout);
+	fail_unless(fired->len >= count, "Only %u of %u callbacks ran.",
+		fired->len, count);
+}
+
+/* Run the main loop for a while. */
+static void run_for(unsigned int ms)
+{
+	GSource *timeout;
+	gboolean timed_out;
+
+	timed_out = FALSE;
+	timeout = g_timeout_source_new(ms);
+	g_source_set_callback(timeout, wait_timeout, &timed_out, NULL);
+	g_source_attach(timeout, main_context);
+	while (!timed_out)
+		g_main_context_iteration(main_context, TRUE);
+	g_source_unref(timeout);
+}
+
+static void add_timer(struct event *ev, int id, int timeout_ms)
+{
+	int ret;
+
+	ev->id = id;
+	ret = sr_session_fd_source_add(session, ev, -1, 0, timeout_ms,
+		event_cb, ev);
+	fail_unless(ret == SR_OK, "Failed to add timer: %d.", ret);
+}
+
+/* Check that a pipe's source runs once the pipe becomes readable. */
+START_TEST(test_fd_ready)
+{
+	struct event ev = { .id = 1, .calls_left = -1 };
+	int fds[2], ret;
+
+	fail_unless(pipe(fds) == 0, "Failed to create a pipe.");
+	ret = sr_session_source_add(session, fds[0], G_IO_IN, -1,
+		event_cb, &ev);
+	fail_unless(ret == SR_OK, "Failed to add source: %d.", ret);
+	fail_unless(session->reactor != NULL, "Source isn't using the reactor.");
+
+	run_for(20);
+	fail_unless(fired->len == 0, "Callback ran without data.");
+
+	fail_unless(write(fds[1], "a", 1) == 1, "Failed to write to pipe.");
+	run_until_fired(1);
+	fail_unless(ev.fd == fds[0], "Callback got fd %d.", ev.fd);
+	fail_unless(ev.revents & G_IO_IN, "Callback got revents 0x%x.",
+		ev.revents);
+
+	/* Once read, the pipe isn't ready anymore, until written again. */
+	run_for(20);
+	fail_unless(fired->len == 1, "Callback ran without data.");
+	fail_unless(write(fds[1], "b", 1) == 1, "Failed to write to pipe.");
+	run_until_fired(2);
+
+	/* The reactor goes away with its last source. */
+	sr_session_source_remove(session, fds[0]);
+	run_for(1);
+	close(fds[0]);
+	close(fds[1]);
+}
+END_TEST
+
+/* Check that a pipe's source times out when there is no data. */
+START_TEST(test_fd_timeout)
+{
+	struct event ev = { .id = 1, .calls_left = 1 };
+	int64_t start_us;
+	int fds[2], ret;
+
+	fail_unless(pipe(fds) == 0, "Failed to create a pipe.");
+	start_us = g_get_monotonic_time();
+	ret = sr_session_source_add(session, fds[0], G_IO_IN, 30,
+		event_cb, &ev);
+	fail_unless(ret == SR_OK, "Failed to add source: %d.", ret);
+
+	run_until_fired(1);
+	fail_unless(ev.revents == 0, "Timeout had revents 0x%x.", ev.revents);
+	fail_unless(ev.time_us - start_us >= 30 * 1000,
+		"Timed out after %" PRId64 "us.", ev.time_us - start_us);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+END_TEST
+
+/*
+ * Check that timers expire in the order of their timeouts, not of their
+ * creation, and not before their time. One is beyond a revolution of
+ * the timer wheel.
+ */
+START_TEST(test_timer_order)
+{
+	struct event ev[4] = {
+		{ .calls_left = 1 }, { .calls_left = 1 },
+		{ .calls_left = 1 }, { .calls_left = 1 },
+	};
+	const int timeouts[] = { 30, 1100, 10, 20 };
+	const int order[] = { 2, 3, 0, 1 };
+	int64_t start_us;
+	unsigned int i;
+
+	start_us = g_get_monotonic_time();
+	for (i = 0; i < ARRAY_SIZE(ev); i++)
+		add_timer(&ev[i], i, timeouts[i]);
+
+	run_until_fired(ARRAY_SIZE(ev));
+	for (i = 0; i < ARRAY_SIZE(ev); i++) {
+		fail_unless(g_array_index(fired, int, i) == order[i],
+			"Timer %d expired as #%u.",
+			g_array_index(fired, int, i), i);
+		fail_unless(ev[i].time_us - start_us >= timeouts[i] * 1000,
+			"Timer %u expired after %" PRId64 "us.", i,
+			ev[i].time_us - start_us);
+		fail_unless(ev[i].fd < 0 && ev[i].revents == 0,
+			"Timer %u got fd %d, revents 0x%x.", i, ev[i].fd,
+			ev[i].revents);
+	}
+}
+END_TEST
+
+/* Check that a timer which is kept expires again after its timeout. */
+START_TEST(test_timer_repeat)
+{
+	struct event ev = { .calls_left = 3 };
+	int64_t last_us;
+	unsigned int i;
+
+	add_timer(&ev, 0, 15);
+	last_us = g_get_monotonic_time();
+	for (i = 1; i <= 3; i++) {
+		run_until_fired(i);
+		fail_unless(ev.time_us - last_us >= 15 * 1000,
+			"Timer expired after %" PRId64 "us.",
+			ev.time_us - last_us);
+		last_us = ev.time_us;
+	}
+	run_for(50);
+	fail_unless(fired->len == 3, "Dropped timer expired again.");
+}
+END_TEST
+
+/*
+ * Check that a source removed by another source's callback doesn't run,
+ * even when both are ready at the same time, and that a source can
+ * remove itself.
+ */
+START_TEST(test_remove_in_callback)
+{
+	struct event a = { .id = 0, .calls_left = -1 };
+	struct event b = { .id = 1, .calls_left = -1 };
+	struct event self = { .calls_left = -1 };
+	int fds_a[2], fds_b[2], ret;
+
+	fail_unless(pipe(fds_a) == 0 && pipe(fds_b) == 0,
+		"Failed to create pipes.");
+	/* Whichever runs first removes the other. */
+	a.remove = GINT_TO_POINTER(fds_b[0]);
+	b.remove = GINT_TO_POINTER(fds_a[0]);
+	ret = sr_session_source_add(session, fds_a[0], G_IO_IN, -1,
+		event_cb, &a);
+	ret |= sr_session_source_add(session, fds_b[0], G_IO_IN, -1,
+		event_cb, &b);
+	fail_unless(ret == SR_OK, "Failed to add sources.");
+
+	fail_unless(write(fds_a[1], "a", 1) == 1
+		&& write(fds_b[1], "b", 1) == 1, "Failed to write to pipes.");
+	run_until_fired(1);
+	run_for(20);
+	fail_unless(fired->len == 1, "Removed source ran.");
+	fail_unless(g_hash_table_size(session->event_sources) == 1,
+		"Source wasn't removed.");
+	sr_session_source_remove(session,
+		g_array_index(fired, int, 0) == 0 ? fds_a[0] : fds_b[0]);
+
+	/* A timer which removes itself, but asks to be kept. */
+	self.id = 2;
+	self.remove = &self;
+	add_timer(&self, 2, 5);
+	run_until_fired(2);
+	run_for(30);
+	fail_unless(fired->len == 2, "Removed timer expired again.");
+
+	run_for(1);
+	close(fds_a[0]);
+	close(fds_a[1]);
+	close(fds_b[0]);
+	close(fds_b[1]);
+}
+END_TEST
+
+#endif
+
+Suite *suite_session_reactor(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("session_reactor");
+
+#ifdef HAVE_SYS_EPOLL_H
+	tc = tcase_create("fd");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_fd_ready);
+	tcase_add_test(tc, test_fd_timeout);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("timer");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_set_timeout(tc, 10);
+	tcase_add_test(tc, test_timer_order);
+	tcase_add_test(tc, test_timer_repeat);
+	tcase_add_test(tc, test_remove_in_callback);
+	suite_add_tcase(s, tc);
+#else
+	(void)tc;
+#endif
+
+	return s;
+}
@@ -0,0 +1,223 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#define PRE_TRIGGER_SAMPLES	5
+#define BUFSIZE			16
+
+/*
+ * 8 channels, so one byte per sample. The trigger is a rising edge on
+ * the first channel, which is the odd sample in the last buffer.
+ */
+static const uint8_t buf1[] = { 10, 12, 14, 16, 18, 20 };
+static const uint8_t buf2[] = { 22, 24, 26, 28 };
+static const uint8_t buf3[] = { 30, 32, 33, 35 };
+static const uint8_t window[] = { 24, 26, 28, 30, 32 };
+
+static struct sr_session *session;
+static struct sr_dev_inst *sdi;
+static struct sr_trigger *trigger;
+static GByteArray *logic;
+static int logic_packets;
+static gboolean triggered;
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *l;
+
+	(void)sdi;
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		fail_unless(!triggered, "Logic data after the trigger.");
+		l = packet->payload;
+		fail_unless(l->unitsize == 1, "Wrong unitsize %d.", l->unitsize);
+		g_byte_array_append(logic, l->data, l->length);
+		logic_packets++;
+		break;
+	case SR_DF_TRIGGER:
+		fail_unless(!triggered, "Multiple triggers.");
+		triggered = TRUE;
+		break;
+	}
+}
+
+static void setup(void)
+{
+	struct sr_trigger_stage *stage;
+	char name[8];
+	int i;
+
+	srtest_setup();
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	for (i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	sr_session_dev_add(session, sdi);
+
+	trigger = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(trigger);
+	sr_trigger_match_add(stage, sdi->channels->data, SR_TRIGGER_RISING, 0);
+
+	logic = g_byte_array_new();
+	logic_packets = 0;
+	triggered = FALSE;
+}
+
+static void teardown(void)
+{
+	g_byte_array_free(logic, TRUE);
+	sr_trigger_free(trigger);
+	sr_session_destroy(session);
+	sr_dev_inst_free(sdi);
+
+	srtest_teardown();
+}
+
+static void check_window(int pre_trigger_samples)
+{
+	fail_unless(triggered, "Trigger wasn't sent.");
+	fail_unless(pre_trigger_samples == PRE_TRIGGER_SAMPLES,
+		"Reported %d pre-trigger samples.", pre_trigger_samples);
+	fail_unless(logic->len == sizeof(window),
+		"Sent %u pre-trigger samples.", logic->len);
+	fail_unless(!memcmp(logic->data, window, sizeof(window)),
+		"Wrong pre-trigger samples or order.");
+}
+
+/* Check the window of the copying soft trigger. */
+START_TEST(test_pre_trigger_copy)
+{
+	struct soft_trigger_logic *stl;
+	int ret, pre;
+
+	stl = soft_trigger_logic_new(sdi, trigger, PRE_TRIGGER_SAMPLES);
+	fail_unless(stl != NULL, "soft_trigger_logic_new() failed.");
+
+	pre = 0;
+	ret = soft_trigger_logic_check(stl, (uint8_t *)buf1, sizeof(buf1), &pre);
+	fail_unless(ret == -1, "Triggered in the first buffer: %d.", ret);
+	ret = soft_trigger_logic_check(stl, (uint8_t *)buf2, sizeof(buf2), &pre);
+	fail_unless(ret == -1, "Triggered in the second buffer: %d.", ret);
+	ret = soft_trigger_logic_check(stl, (uint8_t *)buf3, sizeof(buf3), &pre);
+	fail_unless(ret == 2, "Trigger at %d, expected 2.", ret);
+	check_window(pre);
+
+	soft_trigger_logic_free(stl);
+}
+END_TEST
+
+/*
+ * Check that the retaining soft trigger sends the window, made of two
+ * buffers and the start of the third, as one packet.
+ */
+START_TEST(test_pre_trigger_retain)
+{
+	struct soft_trigger_logic *stl;
+	const uint8_t *bufs[] = { buf1, buf2, buf3 };
+	const int lens[] = { sizeof(buf1), sizeof(buf2), sizeof(buf3) };
+	uint8_t *buf;
+	unsigned int i;
+	int ret, pre;
+
+	stl = soft_trigger_logic_new(sdi, trigger, PRE_TRIGGER_SAMPLES);
+	fail_unless(stl != NULL, "soft_trigger_logic_new() failed.");
+
+	pre = 0;
+	buf = g_malloc(BUFSIZE);
+	for (i = 0; i < ARRAY_SIZE(bufs); i++) {
+		memcpy(buf, bufs[i], lens[i]);
+		ret = soft_trigger_logic_check_retain(stl, &buf, lens[i],
+			BUFSIZE, &pre);
+		if (i < ARRAY_SIZE(bufs) - 1)
+			fail_unless(ret == -1, "Triggered in buffer %u: %d.",
+				i, ret);
+		else
+			fail_unless(ret == 2, "Trigger at %d, expected 2.", ret);
+		fail_unless(buf != NULL, "No buffer to re-use.");
+	}
+	check_window(pre);
+	fail_unless(logic_packets == 1, "Window sent in %d packets.",
+		logic_packets);
+
+	g_free(buf);
+	soft_trigger_logic_free(stl);
+}
+END_TEST
+
+/* Check a window which is longer than the data before the trigger. */
+START_TEST(test_pre_trigger_short)
+{
+	struct soft_trigger_logic *stl;
+	uint8_t *buf;
+	int ret, pre;
+
+	stl = soft_trigger_logic_new(sdi, trigger, 100);
+	fail_unless(stl != NULL, "soft_trigger_logic_new() failed.");
+
+	pre = 0;
+	buf = g_malloc(BUFSIZE);
+	memcpy(buf, buf2, sizeof(buf2));
+	ret = soft_trigger_logic_check_retain(stl, &buf, sizeof(buf2),
+		BUFSIZE, &pre);
+	fail_unless(ret == -1, "Triggered in the first buffer: %d.", ret);
+	memcpy(buf, buf3, sizeof(buf3));
+	ret = soft_trigger_logic_check_retain(stl, &buf, sizeof(buf3),
+		BUFSIZE, &pre);
+	fail_unless(ret == 2, "Trigger at %d, expected 2.", ret);
+
+	fail_unless(triggered, "Trigger wasn't sent.");
+	fail_unless(pre == 6, "Reported %d pre-trigger samples.", pre);
+	fail_unless(logic->len == 6 && !memcmp(logic->data, buf2, 4)
+		&& !memcmp(logic->data + 4, buf3, 2),
+		"Wrong pre-trigger samples or order.");
+	fail_unless(logic_packets == 1, "Window sent in %d packets.",
+		logic_packets);
+
+	g_free(buf);
+	soft_trigger_logic_free(stl);
+}
+END_TEST
+
+Suite *suite_soft_trigger(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("soft_trigger");
+
+	tc = tcase_create("pre_trigger");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_pre_trigger_copy);
+	tcase_add_test(tc, test_pre_trigger_retain);
+	tcase_add_test(tc, test_pre_trigger_short);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
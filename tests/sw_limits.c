@@ -0,0 +1,298 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#define LIMIT_SAMPLES	10
+
+static struct sr_session *session;
+static struct sr_dev_inst *sdi;
+static struct sr_channel *analog_ch[2];
+static struct sr_sw_limits limits;
+/* The logic samples, and the number of analog samples per channel. */
+static GByteArray *logic;
+static uint64_t analog_samples[2];
+static gboolean ended;
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *l;
+	const struct sr_datafeed_analog *analog;
+	GSList *ch;
+	unsigned int i;
+
+	(void)sdi;
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		l = packet->payload;
+		fail_unless(l->unitsize == 1, "Wrong unitsize %d.", l->unitsize);
+		g_byte_array_append(logic, l->data, l->length);
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		for (ch = analog->meaning->channels; ch; ch = ch->next)
+			for (i = 0; i < ARRAY_SIZE(analog_ch); i++)
+				if (ch->data == analog_ch[i])
+					analog_samples[i] += analog->num_samples;
+		break;
+	case SR_DF_END:
+		ended = TRUE;
+		break;
+	}
+}
+
+static void setup(void)
+{
+	char name[8];
+	int i;
+
+	srtest_setup();
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	for (i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	for (i = 0; i < 2; i++) {
+		snprintf(name, sizeof(name), "A%d", i);
+		sr_dev_inst_channel_add(sdi, 8 + i, SR_CHANNEL_ANALOG, name);
+		analog_ch[i] = g_slist_last(sdi->channels)->data;
+	}
+	sr_session_dev_add(session, sdi);
+
+	sr_sw_limits_init(&limits);
+	limits.limit_samples = LIMIT_SAMPLES;
+	sr_sw_limits_session_start(&limits, sdi);
+
+	logic = g_byte_array_new();
+	analog_samples[0] = analog_samples[1] = 0;
+	ended = FALSE;
+}
+
+static void teardown(void)
+{
+	g_byte_array_free(logic, TRUE);
+	sr_session_destroy(session);
+	fail_unless(sdi->sw_limits == NULL,
+		"Limits still applied after leaving the session.");
+	sr_dev_inst_free(sdi);
+
+	srtest_teardown();
+}
+
+static void send_logic(const uint8_t *data, uint64_t length)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic l;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &l;
+	l.length = length;
+	l.unitsize = 1;
+	l.data = (void *)data;
+	sr_session_send(sdi, &packet);
+}
+
+/* Send samples for a number of the analog channels. */
+static void send_analog(int first_ch, int num_channels, uint32_t num_samples)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	float *data;
+	int i;
+
+	data = g_malloc0(num_channels * num_samples * sizeof(float));
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 3);
+	for (i = first_ch; i < first_ch + num_channels; i++)
+		meaning.channels = g_slist_append(meaning.channels,
+			analog_ch[i]);
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	analog.data = data;
+	analog.num_samples = num_samples;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	sr_session_send(sdi, &packet);
+	g_slist_free(meaning.channels);
+	g_free(data);
+}
+
+static void send_end(void)
+{
+	struct sr_datafeed_packet packet;
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	sr_session_send(sdi, &packet);
+}
+
+static void check_logic(const uint8_t *expected, unsigned int length)
+{
+	fail_unless(logic->len == length, "Got %u logic samples, expected %u.",
+		logic->len, length);
+	fail_unless(!memcmp(logic->data, expected, length),
+		"Wrong logic samples.");
+	fail_unless(limits.samples_read == LIMIT_SAMPLES,
+		"%" PRIu64 " samples read.", limits.samples_read);
+	fail_unless(sr_sw_limits_check(&limits), "Limit not reached.");
+}
+
+/* Check that logic packets get clipped at the limit, then dropped. */
+START_TEST(test_logic)
+{
+	uint8_t data[18];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	send_logic(data, 6);
+	send_logic(data + 6, 6);
+	send_logic(data + 12, 6);
+	check_logic(data, LIMIT_SAMPLES);
+}
+END_TEST
+
+/* Check that a run-length encoded packet gets clipped within a run. */
+START_TEST(test_rle)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	uint8_t values[] = { 0x01, 0x02, 0x03 };
+	uint64_t lengths[] = { 4, 5, 3 };
+	const uint8_t expected[] = { 1, 1, 1, 1, 2, 2, 2, 2, 2, 3 };
+
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+	rle.num_runs = ARRAY_SIZE(values);
+	rle.unitsize = 1;
+	rle.values = values;
+	rle.lengths = lengths;
+	sr_session_send(sdi, &packet);
+	sr_session_send(sdi, &packet);
+	check_logic(expected, sizeof(expected));
+}
+END_TEST
+
+/* Check that a planar packet gets clipped within a plane's byte. */
+START_TEST(test_planar)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_planar planar;
+	uint8_t plane[] = { 0x55, 0x03 };
+	void *planes[] = { plane };
+	const uint8_t expected[] = { 1, 0, 1, 0, 1, 0, 1, 0, 1, 1 };
+
+	packet.type = SR_DF_LOGIC_PLANAR;
+	packet.payload = &planar;
+	planar.num_samples = 16;
+	planar.unitsize = 1;
+	planar.num_planes = ARRAY_SIZE(planes);
+	planar.planes = planes;
+	sr_session_send(sdi, &packet);
+	sr_session_send(sdi, &packet);
+	check_logic(expected, sizeof(expected));
+}
+END_TEST
+
+/*
+ * Check that the samples of every analog channel are counted, whether
+ * they are sent together with the other channel or on their own.
+ */
+START_TEST(test_analog_channels)
+{
+	send_analog(0, 2, 6);
+	fail_unless(analog_samples[0] == 6 && analog_samples[1] == 6,
+		"Two channels were clipped at half the limit.");
+	send_analog(0, 1, 6);
+	send_analog(1, 1, 6);
+	send_analog(0, 2, 2);
+	fail_unless(analog_samples[0] == LIMIT_SAMPLES
+		&& analog_samples[1] == LIMIT_SAMPLES,
+		"Got %" PRIu64 " and %" PRIu64 " samples, expected %d.",
+		analog_samples[0], analog_samples[1], LIMIT_SAMPLES);
+	fail_unless(limits.samples_read == LIMIT_SAMPLES,
+		"%" PRIu64 " samples read.", limits.samples_read);
+	fail_unless(sr_sw_limits_check(&limits), "Limit not reached.");
+}
+END_TEST
+
+/* Check that logic and analog channels get clipped at the same sample. */
+START_TEST(test_mixed)
+{
+	uint8_t data[12];
+
+	memset(data, 0xaa, sizeof(data));
+	send_analog(0, 2, 8);
+	send_logic(data, sizeof(data));
+	send_analog(0, 2, 8);
+	fail_unless(logic->len == LIMIT_SAMPLES,
+		"Got %u logic samples.", logic->len);
+	fail_unless(analog_samples[0] == LIMIT_SAMPLES
+		&& analog_samples[1] == LIMIT_SAMPLES,
+		"Got %" PRIu64 " and %" PRIu64 " analog samples.",
+		analog_samples[0], analog_samples[1]);
+}
+END_TEST
+
+/* Check that the limits no longer apply after the end of the acquisition. */
+START_TEST(test_end)
+{
+	uint8_t data[12];
+
+	memset(data, 0x55, sizeof(data));
+	send_logic(data, sizeof(data));
+	send_end();
+	fail_unless(ended, "SR_DF_END wasn't passed on.");
+	fail_unless(sdi->sw_limits == NULL, "Limits applied after the end.");
+	send_logic(data, sizeof(data));
+	fail_unless(logic->len == LIMIT_SAMPLES + sizeof(data),
+		"Got %u logic samples.", logic->len);
+}
+END_TEST
+
+Suite *suite_sw_limits(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("sw_limits");
+
+	tc = tcase_create("session");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_logic);
+	tcase_add_test(tc, test_rle);
+	tcase_add_test(tc, test_planar);
+	tcase_add_test(tc, test_analog_channels);
+	tcase_add_test(tc, test_mixed);
+	tcase_add_test(tc, test_end);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
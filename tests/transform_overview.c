@@ -0,0 +1,547 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+/* Small blocks, so that a few samples make several levels. */
+#define BLOCKSIZE	4
+#define FACTOR		2
+
+/*
+ * Logic samples, split into the pieces which get passed to the input.
+ * The binary input holds back the first piece, so the packets are
+ * pieces 1+2, 3 and 4. A transition falls on the start of the packet
+ * with piece 3, and the value of piece 3 continues into piece 4.
+ */
+static const uint8_t logic_data[] = {
+	0x01, 0x01, 0x03, 0x03, 0x03, 0x02, 0x02, 0x00, 0x00,
+	0x80, 0x80, 0x80, 0x81, 0x81, 0x81, 0x80,
+	0x80, 0x80, 0xff, 0x00, 0x00, 0x00, 0x10,
+};
+static const size_t logic_pieces[] = { 5, 4, 7, 7 };
+
+static struct sr_session *session;
+
+static const struct sr_transform *overview_new(struct sr_dev_inst *sdi)
+{
+	const struct sr_transform *t;
+	GHashTable *options;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, "blocksize",
+		g_variant_ref_sink(g_variant_new_uint64(BLOCKSIZE)));
+	g_hash_table_insert(options, "factor",
+		g_variant_ref_sink(g_variant_new_uint64(FACTOR)));
+	t = sr_transform_new(sr_transform_find("overview"), options, sdi);
+	g_hash_table_destroy(options);
+	fail_unless(t != NULL, "Failed to create overview transform.");
+
+	return t;
+}
+
+/* Send data through the session, one piece per sr_input_send() call. */
+static void send_pieces(const struct sr_input *in, const uint8_t *data,
+		const size_t *pieces, unsigned int num_pieces)
+{
+	GString *buf;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < num_pieces; i++) {
+		buf = g_string_new_len((const char *)data, pieces[i]);
+		ret = sr_input_send(in, buf);
+		fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+		g_string_free(buf, TRUE);
+		data += pieces[i];
+	}
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+}
+
+/*
+ * Check the number of levels and blocks: every level covers all
+ * samples, the top level with a single block.
+ */
+static unsigned int check_levels(const struct sr_transform *t,
+		const struct sr_channel *ch, uint64_t num_samples)
+{
+	uint64_t block_samples, num_blocks, expected;
+	unsigned int level;
+	int ret;
+
+	expected = BLOCKSIZE;
+	for (level = 0; ; level++) {
+		ret = sr_transform_overview_level(t, ch, level,
+			&block_samples, &num_blocks);
+		fail_unless(ret == SR_OK, "No level %u.", level);
+		fail_unless(block_samples == expected,
+			"Level %u has blocks of %" PRIu64 " samples.",
+			level, block_samples);
+		fail_unless(num_blocks ==
+			(num_samples + block_samples - 1) / block_samples,
+			"Level %u has %" PRIu64 " blocks.", level, num_blocks);
+		if (num_blocks == 1)
+			break;
+		expected *= FACTOR;
+	}
+	ret = sr_transform_overview_level(t, ch, level + 1, NULL, NULL);
+	fail_unless(ret == SR_ERR_NA, "Level above the top exists.");
+
+	return level + 1;
+}
+
+/* Check that ranges of blocks beyond a level are rejected. */
+static void check_bounds(const struct sr_transform *t,
+		const struct sr_channel *ch, unsigned int levels)
+{
+	uint64_t num_blocks;
+	uint8_t bits[2];
+	float value[2];
+	int ret;
+
+	sr_transform_overview_level(t, ch, 0, NULL, &num_blocks);
+	if (ch) {
+		ret = sr_transform_overview_analog(t, ch, 0, num_blocks, 0,
+			value, NULL, NULL);
+		fail_unless(ret == SR_OK, "Empty range at the end failed.");
+		ret = sr_transform_overview_analog(t, ch, 0, num_blocks, 1,
+			value, NULL, NULL);
+		fail_unless(ret == SR_ERR_NA, "Block beyond the end exists.");
+		ret = sr_transform_overview_analog(t, ch, 0, num_blocks - 1,
+			2, value, NULL, NULL);
+		fail_unless(ret == SR_ERR_NA, "Range beyond the end exists.");
+		ret = sr_transform_overview_analog(t, ch, levels, 0, 1,
+			value, NULL, NULL);
+		fail_unless(ret == SR_ERR_NA, "Level above the top exists.");
+		ret = sr_transform_overview_logic(t, 0, 0, 1, bits, NULL, NULL);
+		fail_unless(ret == SR_ERR_NA, "Analog data has a logic overview.");
+	} else {
+		ret = sr_transform_overview_logic(t, 0, num_blocks, 0,
+			bits, NULL, NULL);
+		fail_unless(ret == SR_OK, "Empty range at the end failed.");
+		ret = sr_transform_overview_logic(t, 0, num_blocks, 1,
+			bits, NULL, NULL);
+		fail_unless(ret == SR_ERR_NA, "Block beyond the end exists.");
+		ret = sr_transform_overview_logic(t, 0, num_blocks - 1, 2,
+			bits, NULL, NULL);
+		fail_unless(ret == SR_ERR_NA, "Range beyond the end exists.");
+		ret = sr_transform_overview_logic(t, levels, 0, 1,
+			bits, NULL, NULL);
+		fail_unless(ret == SR_ERR_NA, "Level above the top exists.");
+		ret = sr_transform_overview_analog(t, NULL, 0, 0, 1,
+			value, NULL, NULL);
+		fail_unless(ret == SR_ERR_ARG, "Analog overview without channel.");
+	}
+}
+
+/* Check every block of every level against the samples. */
+static void check_logic(const struct sr_transform *t, const uint8_t *data,
+		uint64_t num_samples)
+{
+	uint64_t block_samples, num_blocks, b, i, end, transitions;
+	uint64_t *trans;
+	uint8_t *or_bits, *and_bits, or_exp, and_exp;
+	unsigned int levels, level;
+	int ret;
+
+	fail_unless(sr_transform_overview_unitsize(t) == 1,
+		"Unexpected unitsize %u.", sr_transform_overview_unitsize(t));
+	levels = check_levels(t, NULL, num_samples);
+
+	for (level = 0; level < levels; level++) {
+		sr_transform_overview_level(t, NULL, level,
+			&block_samples, &num_blocks);
+		or_bits = g_malloc(num_blocks);
+		and_bits = g_malloc(num_blocks);
+		trans = g_malloc(num_blocks * sizeof(*trans));
+		ret = sr_transform_overview_logic(t, level, 0, num_blocks,
+			or_bits, and_bits, trans);
+		fail_unless(ret == SR_OK, "Failed to get level %u.", level);
+
+		for (b = 0; b < num_blocks; b++) {
+			end = MIN((b + 1) * block_samples, num_samples);
+			or_exp = 0x00;
+			and_exp = 0xff;
+			transitions = 0;
+			for (i = b * block_samples; i < end; i++) {
+				or_exp |= data[i];
+				and_exp &= data[i];
+				if (i > 0 && data[i] != data[i - 1])
+					transitions++;
+			}
+			fail_unless(or_bits[b] == or_exp && and_bits[b] == and_exp,
+				"Level %u block %" PRIu64 ": OR 0x%02x AND 0x%02x.",
+				level, b, or_bits[b], and_bits[b]);
+			fail_unless(trans[b] == transitions,
+				"Level %u block %" PRIu64 ": %" PRIu64
+				" transitions, expected %" PRIu64 ".",
+				level, b, trans[b], transitions);
+		}
+		g_free(or_bits);
+		g_free(and_bits);
+		g_free(trans);
+	}
+	check_bounds(t, NULL, levels);
+}
+
+static void check_analog(const struct sr_transform *t,
+		const struct sr_channel *ch, const float *data,
+		uint64_t num_samples)
+{
+	uint64_t block_samples, num_blocks, b, i, end;
+	float *min, *max, *mean, min_exp, max_exp;
+	double sum;
+	unsigned int levels, level;
+	int ret;
+
+	levels = check_levels(t, ch, num_samples);
+
+	for (level = 0; level < levels; level++) {
+		sr_transform_overview_level(t, ch, level,
+			&block_samples, &num_blocks);
+		min = g_malloc(num_blocks * sizeof(float));
+		max = g_malloc(num_blocks * sizeof(float));
+		mean = g_malloc(num_blocks * sizeof(float));
+		ret = sr_transform_overview_analog(t, ch, level, 0, num_blocks,
+			min, max, mean);
+		fail_unless(ret == SR_OK, "Failed to get level %u.", level);
+
+		for (b = 0; b < num_blocks; b++) {
+			end = MIN((b + 1) * block_samples, num_samples);
+			min_exp = max_exp = data[b * block_samples];
+			sum = 0;
+			for (i = b * block_samples; i < end; i++) {
+				min_exp = MIN(min_exp, data[i]);
+				max_exp = MAX(max_exp, data[i]);
+				sum += data[i];
+			}
+			sum /= end - b * block_samples;
+			fail_unless(min[b] == min_exp && max[b] == max_exp,
+				"Level %u block %" PRIu64 ": min %f max %f.",
+				level, b, min[b], max[b]);
+			fail_unless(mean[b] == (float)sum,
+				"Level %u block %" PRIu64 ": mean %f, expected %f.",
+				level, b, mean[b], sum);
+		}
+		g_free(min);
+		g_free(max);
+		g_free(mean);
+	}
+	check_bounds(t, ch, levels);
+}
+
+static void setup(void)
+{
+	srtest_setup();
+	sr_session_new(srtest_ctx, &session);
+}
+
+static void teardown(void)
+{
+	sr_session_destroy(session);
+	srtest_teardown();
+}
+
+/* Check the overview of logic data which doesn't fill the top block. */
+START_TEST(test_overview_logic)
+{
+	const struct sr_input *in;
+	const struct sr_transform *t;
+	struct sr_dev_inst *sdi;
+
+	in = sr_input_new(sr_input_find("binary"), NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	sdi = sr_input_dev_inst_get(in);
+	sr_session_dev_add(session, sdi);
+	t = overview_new(sdi);
+
+	fail_unless(sr_transform_overview_unitsize(t) == 0,
+		"Unitsize before any data.");
+	fail_unless(sr_transform_overview_level(t, NULL, 0, NULL, NULL)
+		== SR_ERR_NA, "Level before any data.");
+
+	send_pieces(in, logic_data, logic_pieces, ARRAY_SIZE(logic_pieces));
+	check_logic(t, logic_data, sizeof(logic_data));
+
+	sr_session_dev_remove_all(session);
+	sr_input_free(in);
+	sr_transform_free(t);
+}
+END_TEST
+
+/*
+ * Check the overview of logic data which fills complete blocks on all
+ * levels, so only the top level's block is added at the end.
+ */
+START_TEST(test_overview_logic_complete)
+{
+	const struct sr_input *in;
+	const struct sr_transform *t;
+	struct sr_dev_inst *sdi;
+	const size_t pieces[] = { 3, 13 };
+
+	in = sr_input_new(sr_input_find("binary"), NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	sdi = sr_input_dev_inst_get(in);
+	sr_session_dev_add(session, sdi);
+	t = overview_new(sdi);
+
+	send_pieces(in, logic_data, pieces, ARRAY_SIZE(pieces));
+	check_logic(t, logic_data, 16);
+
+	sr_session_dev_remove_all(session);
+	sr_input_free(in);
+	sr_transform_free(t);
+}
+END_TEST
+
+/* Check the overview of an analog channel, S8 samples from raw_analog. */
+START_TEST(test_overview_analog)
+{
+	const struct sr_input *in;
+	const struct sr_transform *t;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	int8_t samples[37];
+	float values[37];
+	const size_t pieces[] = { 10, 10, 17 };
+	unsigned int i;
+
+	/* A triangle, scaled by the input to exact floats. */
+	for (i = 0; i < ARRAY_SIZE(samples); i++) {
+		samples[i] = i < 20 ? 6 * i - 60 : 180 - 6 * i;
+		values[i] = samples[i] / 128.0f;
+	}
+
+	in = sr_input_new(sr_input_find("raw_analog"), NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	sdi = sr_input_dev_inst_get(in);
+	sr_session_dev_add(session, sdi);
+	t = overview_new(sdi);
+
+	send_pieces(in, (const uint8_t *)samples, pieces, ARRAY_SIZE(pieces));
+	ch = sr_dev_inst_channels_get(sdi)->data;
+	check_analog(t, ch, values, ARRAY_SIZE(values));
+
+	sr_session_dev_remove_all(session);
+	sr_input_free(in);
+	sr_transform_free(t);
+}
+END_TEST
+
+/* Check that a new acquisition starts a new overview. */
+START_TEST(test_overview_restart)
+{
+	const struct sr_input *in;
+	const struct sr_transform *t;
+	struct sr_dev_inst *sdi;
+	const size_t pieces[] = { 5, 2 };
+
+	in = sr_input_new(sr_input_find("binary"), NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	sdi = sr_input_dev_inst_get(in);
+	sr_session_dev_add(session, sdi);
+	t = overview_new(sdi);
+
+	send_pieces(in, logic_data, logic_pieces, ARRAY_SIZE(logic_pieces));
+	fail_unless(sr_input_reset(in) == SR_OK, "sr_input_reset() failed.");
+	send_pieces(in, logic_data + 9, pieces, ARRAY_SIZE(pieces));
+	check_logic(t, logic_data + 9, 7);
+
+	sr_session_dev_remove_all(session);
+	sr_input_free(in);
+	sr_transform_free(t);
+}
+END_TEST
+
+/* Create an empty temporary file, which the srzip output replaces. */
+static char *tmp_srzip(void)
+{
+	char *filename;
+	int fd;
+
+	fd = g_file_open_tmp("sr-overview-XXXXXX.sr", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create a temporary file.");
+	close(fd);
+
+	return filename;
+}
+
+/* The srzip output which the session saves to. */
+static const struct sr_output *srzip_output;
+
+static void datafeed_save(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	GString *out;
+	int ret;
+
+	(void)sdi;
+	(void)cb_data;
+
+	out = NULL;
+	ret = sr_output_send(srzip_output, packet, &out);
+	fail_unless(ret == SR_OK, "sr_output_send() error: %d", ret);
+	if (out)
+		g_string_free(out, TRUE);
+}
+
+/* Save the logic samples to an srzip file, optionally with an overview. */
+static void save_srzip(const char *filename, gboolean with_overview)
+{
+	const struct sr_input *in;
+	const struct sr_transform *t;
+	struct sr_dev_inst *sdi;
+	GHashTable *options;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, "samplerate",
+		g_variant_ref_sink(g_variant_new_uint64(SR_MHZ(1))));
+	in = sr_input_new(sr_input_find("binary"), options);
+	g_hash_table_destroy(options);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	sdi = sr_input_dev_inst_get(in);
+	sr_session_dev_add(session, sdi);
+	t = with_overview ? overview_new(sdi) : NULL;
+	srzip_output = sr_output_new(sr_output_find("srzip"), NULL, sdi,
+		filename);
+	fail_unless(srzip_output != NULL, "Failed to create srzip output.");
+	sr_session_datafeed_callback_add(session, datafeed_save, NULL);
+
+	send_pieces(in, logic_data, logic_pieces, ARRAY_SIZE(logic_pieces));
+
+	sr_output_free(srzip_output);
+	sr_session_datafeed_callback_remove_all(session);
+	sr_session_dev_remove_all(session);
+	sr_input_free(in);
+	if (t)
+		sr_transform_free(t);
+}
+
+/* Blocks of level 0 when the first samples of a loaded file arrived. */
+static const struct sr_transform *loaded_overview;
+static uint64_t first_packet_blocks;
+
+static void datafeed_load(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	(void)sdi;
+	(void)cb_data;
+
+	if (packet->type != SR_DF_LOGIC || first_packet_blocks)
+		return;
+	sr_transform_overview_level(loaded_overview, NULL, 0, NULL,
+		&first_packet_blocks);
+}
+
+/*
+ * Load an srzip file with an overview transform, and check its overview.
+ * Returns whether the overview was complete before the samples arrived,
+ * which means it was restored from the file instead of rebuilt.
+ */
+static gboolean load_srzip(const char *filename)
+{
+	struct sr_session *loaded;
+	GSList *devices;
+	gboolean restored;
+	int ret;
+
+	ret = sr_session_load(srtest_ctx, filename, &loaded);
+	fail_unless(ret == SR_OK, "sr_session_load() error: %d", ret);
+	sr_session_dev_list(loaded, &devices);
+	fail_unless(devices != NULL, "No device in the session file.");
+	loaded_overview = overview_new(devices->data);
+	g_slist_free(devices);
+	first_packet_blocks = 0;
+	sr_session_datafeed_callback_add(loaded, datafeed_load, NULL);
+
+	ret = sr_session_start(loaded);
+	fail_unless(ret == SR_OK, "sr_session_start() error: %d", ret);
+	ret = sr_session_run(loaded);
+	fail_unless(ret == SR_OK, "sr_session_run() error: %d", ret);
+
+	check_logic(loaded_overview, logic_data, sizeof(logic_data));
+	/* A rebuilt level 0 lacks its partial last block until the end. */
+	restored = first_packet_blocks ==
+		(sizeof(logic_data) + BLOCKSIZE - 1) / BLOCKSIZE;
+
+	sr_session_destroy(loaded);
+	sr_transform_free(loaded_overview);
+
+	return restored;
+}
+
+/*
+ * Check that the srzip output stores the overview next to the samples,
+ * and that loading the file restores all of its levels.
+ */
+START_TEST(test_overview_srzip)
+{
+	char *filename;
+
+	filename = tmp_srzip();
+	save_srzip(filename, TRUE);
+	fail_unless(load_srzip(filename), "Overview was rebuilt.");
+	g_unlink(filename);
+	g_free(filename);
+}
+END_TEST
+
+/* Check that files without a stored overview get it rebuilt on loading. */
+START_TEST(test_overview_srzip_rebuild)
+{
+	char *filename;
+
+	filename = tmp_srzip();
+	save_srzip(filename, FALSE);
+	fail_unless(!load_srzip(filename), "Overview was restored.");
+	g_unlink(filename);
+	g_free(filename);
+}
+END_TEST
+
+Suite *suite_transform_overview(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("transform-overview");
+
+	tc = tcase_create("levels");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_overview_logic);
+	tcase_add_test(tc, test_overview_logic_complete);
+	tcase_add_test(tc, test_overview_analog);
+	tcase_add_test(tc, test_overview_restart);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("srzip");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_overview_srzip);
+	tcase_add_test(tc, test_overview_srzip_rebuild);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
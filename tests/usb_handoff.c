@@ -0,0 +1,323 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#ifdef HAVE_LIBUSB_1_0
+
+/* Longest time to wait for entries, before the test fails [ms]. */
+#define MAX_WAIT_MS	5000
+
+#define BUFSIZE		64
+#define NUM_TRANSFERS	2
+#define NUM_BUFFERS	4
+/* Number of transfer completions of the producer thread. */
+#define NUM_COMPLETIONS	100
+
+static struct sr_usb_handoff *handoff;
+static struct libusb_transfer *transfers[NUM_TRANSFERS];
+
+static void setup(void)
+{
+	unsigned int i;
+
+	g_setenv("SIGROK_USB_EVENT_THREAD", "1", TRUE);
+	srtest_setup();
+	g_unsetenv("SIGROK_USB_EVENT_THREAD");
+
+	handoff = sr_usb_handoff_new(srtest_ctx, NUM_TRANSFERS, NUM_BUFFERS,
+		BUFSIZE);
+	fail_unless(handoff != NULL, "No handoff with the event thread.");
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		transfers[i] = libusb_alloc_transfer(0);
+		transfers[i]->buffer = g_malloc0(BUFSIZE);
+		transfers[i]->length = BUFSIZE;
+	}
+}
+
+static void teardown(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		g_free(transfers[i]->buffer);
+		libusb_free_transfer(transfers[i]);
+	}
+	sr_usb_handoff_free(handoff);
+
+	srtest_teardown();
+}
+
+/* Complete a transfer with the given data, and hand it over. */
+static gboolean complete(struct libusb_transfer *transfer, uint8_t value,
+		int length)
+{
+	memset(transfer->buffer, value, length);
+	transfer->status = LIBUSB_TRANSFER_COMPLETED;
+	transfer->actual_length = length;
+
+	return sr_usb_handoff_push(handoff, transfer);
+}
+
+static void check_entry(struct sr_usb_handoff_entry *entry, uint8_t value,
+		int length, uint64_t dropped)
+{
+	int i;
+
+	fail_unless(sr_usb_handoff_pop(handoff, entry), "No entry waiting.");
+	fail_unless(entry->data != NULL && entry->transfer == NULL,
+		"Expected a filled buffer.");
+	fail_unless(entry->length == length, "Entry of %d bytes, expected %d.",
+		entry->length, length);
+	for (i = 0; i < length; i++)
+		fail_unless(entry->data[i] == value, "Wrong data in entry.");
+	fail_unless(entry->dropped == dropped, "%" PRIu64 " bytes dropped, "
+		"expected %" PRIu64 ".", entry->dropped, dropped);
+}
+
+/* Check that the event thread is only there when asked for. */
+START_TEST(test_disabled)
+{
+	struct sr_context *ctx;
+
+	fail_unless(sr_init(&ctx) == SR_OK, "sr_init() failed.");
+	fail_unless(sr_usb_handoff_new(ctx, 1, 1, BUFSIZE) == NULL,
+		"Handoff without the event thread.");
+	fail_unless(sr_usb_handoff_context(ctx) == ctx->libusb_ctx,
+		"Wrong libusb context without the event thread.");
+	sr_exit(ctx);
+}
+END_TEST
+
+/*
+ * Check that the event thread runs on a libusb context of its own, and
+ * that handoffs share it.
+ */
+START_TEST(test_thread)
+{
+	struct sr_usb_handoff *second;
+	struct sr_usb_handoff_entry entry;
+
+	fail_unless(sr_usb_handoff_context(srtest_ctx) != NULL
+		&& sr_usb_handoff_context(srtest_ctx) != srtest_ctx->libusb_ctx,
+		"Event thread shares the libsigrok libusb context.");
+
+	second = sr_usb_handoff_new(srtest_ctx, 1, 1, BUFSIZE);
+	fail_unless(second != NULL, "No second handoff.");
+	sr_usb_handoff_free(second);
+
+	/* The first one is still working. */
+	fail_unless(complete(transfers[0], 0x5a, 4), "Data was dropped.");
+	check_entry(&entry, 0x5a, 4, 0);
+	sr_usb_handoff_release(handoff, entry.data);
+}
+END_TEST
+
+/*
+ * Check that filled buffers and deferred transfers arrive in order,
+ * and that each push swaps a free buffer into the transfer.
+ */
+START_TEST(test_order)
+{
+	struct sr_usb_handoff_entry entry;
+	uint8_t *filled[2];
+
+	filled[0] = transfers[0]->buffer;
+	filled[1] = transfers[1]->buffer;
+	fail_unless(complete(transfers[0], 0x11, 10), "Data was dropped.");
+	fail_unless(complete(transfers[1], 0x22, BUFSIZE), "Data was dropped.");
+	fail_unless(transfers[0]->buffer != filled[0]
+		&& transfers[1]->buffer != filled[1],
+		"No free buffer was swapped in.");
+	transfers[0]->status = LIBUSB_TRANSFER_ERROR;
+	sr_usb_handoff_defer(handoff, transfers[0]);
+
+	check_entry(&entry, 0x11, 10, 0);
+	fail_unless(entry.data == filled[0], "Entries out of order.");
+	sr_usb_handoff_release(handoff, entry.data);
+	check_entry(&entry, 0x22, BUFSIZE, 0);
+	sr_usb_handoff_release(handoff, entry.data);
+	fail_unless(sr_usb_handoff_pop(handoff, &entry),
+		"Deferred transfer is missing.");
+	fail_unless(entry.transfer == transfers[0] && entry.data == NULL,
+		"Expected the deferred transfer.");
+	fail_unless(!sr_usb_handoff_pop(handoff, &entry), "Extra entry.");
+}
+END_TEST
+
+/*
+ * Check that data is dropped while no free buffers are left, and that
+ * the amount dropped arrives with the next buffer which gets through.
+ */
+START_TEST(test_overflow)
+{
+	struct sr_usb_handoff_entry entry[NUM_BUFFERS];
+	unsigned int i;
+
+	for (i = 0; i < NUM_BUFFERS; i++)
+		fail_unless(complete(transfers[0], i, 8), "Data was dropped.");
+	fail_unless(!complete(transfers[0], 0xff, 8), "No data was dropped.");
+	fail_unless(!complete(transfers[0], 0xff, 5), "No data was dropped.");
+
+	for (i = 0; i < NUM_BUFFERS; i++)
+		check_entry(&entry[i], i, 8, 0);
+	fail_unless(!sr_usb_handoff_pop(handoff, &entry[0]), "Extra entry.");
+	for (i = 0; i < NUM_BUFFERS; i++)
+		sr_usb_handoff_release(handoff, entry[i].data);
+
+	fail_unless(complete(transfers[0], 0x33, 8), "Data was dropped.");
+	check_entry(&entry[0], 0x33, 8, 13);
+	sr_usb_handoff_release(handoff, entry[0].data);
+}
+END_TEST
+
+/* What the session thread collected. */
+static GThread *session_thread;
+static unsigned int num_received;
+static gboolean received_in_order;
+
+/* Completes transfers as the event thread would, resubmitting at once. */
+static gpointer producer(gpointer data)
+{
+	unsigned int i;
+
+	(void)data;
+
+	for (i = 0; i < NUM_COMPLETIONS; i++) {
+		/* Retry until the session thread released a buffer. */
+		while (!complete(transfers[i % NUM_TRANSFERS], i, i % BUFSIZE))
+			g_usleep(100);
+		if (i % 10 == 0)
+			g_usleep(1000);
+	}
+
+	return NULL;
+}
+
+static int receive(int fd, int revents, void *cb_data)
+{
+	struct sr_usb_handoff_entry entry;
+
+	(void)fd;
+	(void)revents;
+	(void)cb_data;
+
+	if (g_thread_self() != session_thread)
+		received_in_order = FALSE;
+	while (sr_usb_handoff_pop(handoff, &entry)) {
+		if (entry.length != (int)(num_received % BUFSIZE) || (entry.length
+				&& entry.data[0] != (uint8_t)num_received))
+			received_in_order = FALSE;
+		num_received++;
+		sr_usb_handoff_release(handoff, entry.data);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean wait_timeout(void *data)
+{
+	*(gboolean *)data = TRUE;
+
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Check that the event source collects the entries of another thread
+ * on the session thread, in order, woken up as they arrive.
+ */
+START_TEST(test_source)
+{
+	struct sr_session *session;
+	GMainContext *main_context;
+	GThread *thread;
+	GSource *timeout;
+	gboolean timed_out;
+	int ret;
+
+	sr_session_new(srtest_ctx, &session);
+	/* Sources need a main context, which a started session has. */
+	main_context = g_main_context_new();
+	session->main_context = main_context;
+	session_thread = g_thread_self();
+	num_received = 0;
+	received_in_order = TRUE;
+	/* Without a timeout, only pushed entries dispatch the source. */
+	ret = sr_usb_handoff_source_add(session, handoff, -1, receive, NULL);
+	fail_unless(ret == SR_OK, "Failed to add the source: %d.", ret);
+
+	thread = g_thread_new("producer", producer, NULL);
+	timed_out = FALSE;
+	timeout = g_timeout_source_new(MAX_WAIT_MS);
+	g_source_set_callback(timeout, wait_timeout, &timed_out, NULL);
+	g_source_attach(timeout, main_context);
+	while (num_received < NUM_COMPLETIONS && !timed_out)
+		g_main_context_iteration(main_context, TRUE);
+	g_thread_join(thread);
+	g_source_destroy(timeout);
+	g_source_unref(timeout);
+
+	fail_unless(num_received == NUM_COMPLETIONS, "Received %u of %u "
+		"entries.", num_received, NUM_COMPLETIONS);
+	fail_unless(received_in_order, "Entries were out of order, or "
+		"collected off the session thread.");
+
+	sr_usb_handoff_source_remove(session, handoff);
+	while (g_main_context_iteration(main_context, FALSE))
+		;
+	session->main_context = NULL;
+	g_main_context_unref(main_context);
+	sr_session_destroy(session);
+}
+END_TEST
+
+#endif
+
+Suite *suite_usb_handoff(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("usb_handoff");
+
+#ifdef HAVE_LIBUSB_1_0
+	tc = tcase_create("disabled");
+	tcase_add_test(tc, test_disabled);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("thread");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_thread);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("entries");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_order);
+	tcase_add_test(tc, test_overflow);
+	tcase_add_test(tc, test_source);
+	suite_add_tcase(s, tc);
+#else
+	(void)tc;
+#endif
+
+	return s;
+}
@@ -0,0 +1,353 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#ifdef HAVE_LIBUSB_1_0
+
+/* Longest time to wait for replayed transfers, before failing [ms]. */
+#define MAX_WAIT_MS	5000
+
+#define EP_IN		0x82
+#define BUFSIZE		16
+
+/* The recording, created and removed outside of the forked tests. */
+static gchar *path;
+
+static void setup_file(void)
+{
+	int fd;
+
+	fd = g_file_open_tmp("sigrok-usb-XXXXXX", &path, NULL);
+	if (fd >= 0)
+		close(fd);
+}
+
+static void teardown_file(void)
+{
+	if (path)
+		g_unlink(path);
+	g_free(path);
+	path = NULL;
+}
+
+/*
+ * Stand-ins for the libusb functions which talk to a device. Being part
+ * of this program, they take precedence over the ones of libusb, so
+ * transfers get recorded without hardware. A device which is replayed
+ * must not see them at all.
+ */
+static int control_calls;
+static GQueue submitted;
+
+int LIBUSB_CALL libusb_control_transfer(libusb_device_handle *dev_handle,
+		uint8_t request_type, uint8_t bRequest, uint16_t wValue,
+		uint16_t wIndex, unsigned char *data, uint16_t wLength,
+		unsigned int timeout)
+{
+	uint16_t i;
+
+	(void)dev_handle;
+	(void)bRequest;
+	(void)wValue;
+	(void)wIndex;
+	(void)timeout;
+
+	control_calls++;
+	if (request_type & LIBUSB_ENDPOINT_IN)
+		for (i = 0; i < wLength; i++)
+			data[i] = 0xa0 + i;
+
+	return wLength;
+}
+
+int LIBUSB_CALL libusb_submit_transfer(struct libusb_transfer *transfer)
+{
+	g_queue_push_tail(&submitted, transfer);
+
+	return 0;
+}
+
+/* Complete a transfer submitted to the stand-in, as libusb would. */
+static void complete(int status, int length, uint8_t first)
+{
+	struct libusb_transfer *transfer;
+	int i;
+
+	transfer = g_queue_pop_head(&submitted);
+	fail_unless(transfer != NULL, "No transfer was submitted.");
+	for (i = 0; i < length; i++)
+		transfer->buffer[i] = first + i;
+	transfer->status = status;
+	transfer->actual_length = length;
+	transfer->callback(transfer);
+}
+
+/* The transfers completed towards the driver. */
+struct completion {
+	int status;
+	int actual_length;
+	uint8_t data[BUFSIZE];
+};
+static struct completion completed[4];
+static unsigned int num_completed;
+
+static void LIBUSB_CALL transfer_cb(struct libusb_transfer *transfer)
+{
+	struct completion *c;
+
+	fail_unless(num_completed < ARRAY_SIZE(completed),
+		"Too many transfers completed.");
+	c = &completed[num_completed++];
+	c->status = transfer->status;
+	c->actual_length = transfer->actual_length;
+	memcpy(c->data, transfer->buffer, BUFSIZE);
+	libusb_free_transfer(transfer);
+}
+
+static void submit(struct sr_context *ctx, uint8_t *buf)
+{
+	struct libusb_transfer *transfer;
+	int ret;
+
+	memset(buf, 0, BUFSIZE);
+	transfer = libusb_alloc_transfer(0);
+	libusb_fill_bulk_transfer(transfer, NULL, EP_IN, buf, BUFSIZE,
+		transfer_cb, NULL, 100);
+	ret = sr_usb_submit_transfer(ctx, transfer);
+	fail_unless(ret == 0, "sr_usb_submit_transfer() failed: %d.", ret);
+}
+
+static struct sr_context *init_with(const char *variable)
+{
+	struct sr_context *ctx;
+	int ret;
+
+	fail_unless(path != NULL, "No temporary file.");
+	g_setenv(variable, path, TRUE);
+	ret = sr_init(&ctx);
+	g_unsetenv(variable);
+	fail_unless(ret == SR_OK, "sr_init() failed with %s: %d.",
+		variable, ret);
+
+	return ctx;
+}
+
+/* Issue the control transfers of the test, check their results. */
+static void control_transfers(struct sr_context *ctx)
+{
+	uint8_t in[4], out[3] = { 1, 2, 3 };
+	const uint8_t expected[4] = { 0xa0, 0xa1, 0xa2, 0xa3 };
+	int ret;
+
+	memset(in, 0, sizeof(in));
+	ret = sr_usb_control_transfer(ctx, NULL,
+		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR, 0xb0, 1, 2,
+		in, sizeof(in), 100);
+	fail_unless(ret == sizeof(in), "IN control transfer returned %d.", ret);
+	fail_unless(!memcmp(in, expected, sizeof(in)),
+		"Wrong IN control transfer data.");
+	ret = sr_usb_control_transfer(ctx, NULL,
+		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR, 0xb1, 3, 4,
+		out, sizeof(out), 100);
+	fail_unless(ret == sizeof(out), "OUT control transfer returned %d.",
+		ret);
+}
+
+static int usb_cb(int fd, int revents, void *cb_data)
+{
+	(void)fd;
+	(void)revents;
+	(void)cb_data;
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean wait_timeout(void *data)
+{
+	*(gboolean *)data = TRUE;
+
+	return G_SOURCE_REMOVE;
+}
+
+static void run_until_completed(GMainContext *main_context,
+		unsigned int count)
+{
+	GSource *timeout;
+	gboolean timed_out;
+
+	timed_out = FALSE;
+	timeout = g_timeout_source_new(MAX_WAIT_MS);
+	g_source_set_callback(timeout, wait_timeout, &timed_out, NULL);
+	g_source_attach(timeout, main_context);
+	while (num_completed < count && !timed_out)
+		g_main_context_iteration(main_context, TRUE);
+	g_source_destroy(timeout);
+	g_source_unref(timeout);
+	fail_unless(num_completed >= count, "Only %u of %u transfers "
+		"completed.", num_completed, count);
+}
+
+/*
+ * Check that control and bulk transfers which were recorded are
+ * replayed with the same data, lengths and status, without talking to
+ * a device, and that the end of the recording looks like a device
+ * which is gone.
+ */
+START_TEST(test_round_trip)
+{
+	struct sr_context *ctx;
+	struct sr_session *session;
+	GMainContext *main_context;
+	uint8_t bufs[3][BUFSIZE];
+	struct completion recorded[2];
+	unsigned int i;
+	int ret;
+
+	/* Record, with the stand-ins for a device. */
+	ctx = init_with("SIGROK_USB_RECORD");
+	control_transfers(ctx);
+	fail_unless(control_calls == 2, "Control transfers weren't issued.");
+	for (i = 0; i < 3; i++)
+		submit(ctx, bufs[i]);
+	fail_unless(g_queue_get_length(&submitted) == 3,
+		"Transfers weren't submitted.");
+	complete(LIBUSB_TRANSFER_COMPLETED, 10, 0x10);
+	complete(LIBUSB_TRANSFER_COMPLETED, BUFSIZE, 0x40);
+	/* Cancelled transfers don't get recorded. */
+	complete(LIBUSB_TRANSFER_CANCELLED, 0, 0);
+	fail_unless(num_completed == 3, "Transfers weren't passed on.");
+	memcpy(recorded, completed, sizeof(recorded));
+	sr_exit(ctx);
+
+	/* Replay, the stand-ins must not be called. */
+	control_calls = 0;
+	num_completed = 0;
+	ctx = init_with("SIGROK_USB_REPLAY");
+	control_transfers(ctx);
+	fail_unless(control_calls == 0, "Replay talked to the device.");
+
+	sr_session_new(ctx, &session);
+	/* Sources need a main context, which a started session has. */
+	main_context = g_main_context_new();
+	session->main_context = main_context;
+	ret = usb_source_add(session, ctx, 100, usb_cb, NULL);
+	fail_unless(ret == SR_OK, "usb_source_add() failed: %d.", ret);
+
+	submit(ctx, bufs[0]);
+	submit(ctx, bufs[1]);
+	fail_unless(g_queue_is_empty(&submitted),
+		"Replay submitted to the device.");
+	run_until_completed(main_context, 2);
+	for (i = 0; i < 2; i++) {
+		fail_unless(completed[i].status == recorded[i].status
+			&& completed[i].actual_length
+				== recorded[i].actual_length,
+			"Transfer %u replayed with status %d, length %d.", i,
+			completed[i].status, completed[i].actual_length);
+		fail_unless(!memcmp(completed[i].data, recorded[i].data,
+			recorded[i].actual_length),
+			"Transfer %u replayed with wrong data.", i);
+	}
+
+	submit(ctx, bufs[2]);
+	run_until_completed(main_context, 3);
+	fail_unless(completed[2].status == LIBUSB_TRANSFER_NO_DEVICE,
+		"Transfer beyond the recording got status %d.",
+		completed[2].status);
+
+	usb_source_remove(session, ctx);
+	while (g_main_context_iteration(main_context, FALSE))
+		;
+	session->main_context = NULL;
+	g_main_context_unref(main_context);
+	sr_session_destroy(session);
+	sr_exit(ctx);
+}
+END_TEST
+
+static void check_replay_fails(const void *contents, gssize length,
+		const char *what)
+{
+	struct sr_context *ctx;
+	int ret;
+
+	fail_unless(g_file_set_contents(path, contents, length, NULL),
+		"Failed to write the recording.");
+	g_setenv("SIGROK_USB_REPLAY", path, TRUE);
+	ret = sr_init(&ctx);
+	g_unsetenv("SIGROK_USB_REPLAY");
+	if (ret == SR_OK)
+		sr_exit(ctx);
+	fail_unless(ret != SR_OK, "Replaying %s worked.", what);
+}
+
+/* Check that recordings which aren't valid are rejected. */
+START_TEST(test_invalid)
+{
+	uint8_t rec[12 + 24 + 4];
+
+	fail_unless(path != NULL, "No temporary file.");
+	check_replay_fails("no recording", -1, "an invalid file");
+
+	/* A record which claims more data than the file has. */
+	memset(rec, 0, sizeof(rec));
+	memcpy(rec, "SRUSBREC", 8);
+	WL32(&rec[8], 1);
+	rec[12] = 1;
+	WL32(&rec[12 + 20], 5);
+	check_replay_fails(rec, sizeof(rec), "a truncated record");
+	check_replay_fails(rec, 12 + 10, "a truncated header");
+
+	/* A huge length, as from a corrupted file. */
+	WL32(&rec[12 + 20], 0xfffffffc);
+	check_replay_fails(rec, sizeof(rec), "a huge record");
+
+	/* The same record with its data is fine. */
+	WL32(&rec[12 + 20], 4);
+	fail_unless(g_file_set_contents(path, (const char *)rec, sizeof(rec),
+		NULL), "Failed to write the recording.");
+	sr_exit(init_with("SIGROK_USB_REPLAY"));
+}
+END_TEST
+
+#endif
+
+Suite *suite_usb_record(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("usb_record");
+
+	tc = tcase_create("record_replay");
+#ifdef HAVE_LIBUSB_1_0
+	tcase_add_unchecked_fixture(tc, setup_file, teardown_file);
+	tcase_add_test(tc, test_round_trip);
+	tcase_add_test(tc, test_invalid);
+#endif
+	suite_add_tcase(s, tc);
+
+	return s;
+}
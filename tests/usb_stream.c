@@ -0,0 +1,277 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#ifdef HAVE_LIBUSB_1_0
+
+/* Completions after which a stream reconsiders its depth, see usb.c. */
+#define WINDOW		256
+#define MAX_TRANSFERS	8
+
+/*
+ * 10 MB/s in transfers of about 10 ms, at least 40 ms in flight. That's
+ * 4 transfers of 100352 bytes, which the device fills in about 40 ms.
+ */
+static const struct sr_usb_stream_config config = {
+	.bytes_per_ms = 10000,
+	.transfer_ms = 10,
+	.block_size = 512,
+	.min_size = 4096,
+	.max_size = 1024 * 1024,
+	.queue_ms = 40,
+	.min_transfers = 2,
+	.max_transfers = MAX_TRANSFERS,
+	.adaptive = TRUE,
+};
+
+static struct sr_usb_stream *stream;
+static struct libusb_transfer *transfers[MAX_TRANSFERS];
+
+static void setup(void)
+{
+	unsigned int i;
+
+	srtest_setup();
+
+	for (i = 0; i < MAX_TRANSFERS; i++)
+		transfers[i] = libusb_alloc_transfer(0);
+	stream = NULL;
+}
+
+static void teardown(void)
+{
+	unsigned int i;
+
+	sr_usb_stream_free(stream);
+	for (i = 0; i < MAX_TRANSFERS; i++)
+		libusb_free_transfer(transfers[i]);
+
+	srtest_teardown();
+}
+
+/* Submit as many transfers as the stream wants, as drivers do. */
+static void submit_wanted(void)
+{
+	unsigned int i, wanted;
+
+	wanted = sr_usb_stream_wanted(stream);
+	for (i = 0; i < MAX_TRANSFERS && wanted > 0; i++) {
+		if (transfers[i]->user_data)
+			continue;
+		transfers[i]->user_data = transfers[i];
+		sr_usb_stream_submitted(stream, transfers[i]);
+		wanted--;
+	}
+	fail_unless(wanted == 0, "More transfers wanted than allowed.");
+}
+
+/* Complete a transfer, and resubmit or retire it as the stream says. */
+static gboolean complete(struct libusb_transfer *transfer, int length)
+{
+	transfer->actual_length = length;
+	if (!sr_usb_stream_completed(stream, transfer)) {
+		transfer->user_data = NULL;
+		return FALSE;
+	}
+	sr_usb_stream_submitted(stream, transfer);
+
+	return TRUE;
+}
+
+/*
+ * Complete the transfers round-robin, as fast as possible, until one
+ * gets retired. Returns the number of completions, or 0 if none was
+ * retired within the given number.
+ */
+static unsigned int complete_until_retired(unsigned int max)
+{
+	unsigned int i, j;
+
+	for (i = 1, j = 0; i <= max; i++, j++) {
+		while (!transfers[j % MAX_TRANSFERS]->user_data)
+			j++;
+		if (!complete(transfers[j % MAX_TRANSFERS], 512))
+			return i;
+	}
+
+	return 0;
+}
+
+/* Check the transfer size, and the initial and maximum depth. */
+START_TEST(test_sizing)
+{
+	struct sr_usb_stream_config c;
+
+	stream = sr_usb_stream_new(&config, NULL);
+	fail_unless(sr_usb_stream_buffer_size(stream) == 100352,
+		"Transfers of %zu bytes.", sr_usb_stream_buffer_size(stream));
+	fail_unless(sr_usb_stream_wanted(stream) == 4,
+		"%u transfers wanted initially.", sr_usb_stream_wanted(stream));
+	fail_unless(sr_usb_stream_max_transfers(stream) == MAX_TRANSFERS,
+		"Up to %u transfers.", sr_usb_stream_max_transfers(stream));
+	/* 40 ms in flight, plus 25%. */
+	fail_unless(sr_usb_stream_timeout(stream) == 50,
+		"Timeout of %u ms.", sr_usb_stream_timeout(stream));
+	sr_usb_stream_free(stream);
+
+	/* Slow devices get the smallest transfers, but at least two. */
+	c = config;
+	c.bytes_per_ms = 10;
+	stream = sr_usb_stream_new(&c, NULL);
+	fail_unless(sr_usb_stream_buffer_size(stream) == 4096,
+		"Transfers of %zu bytes.", sr_usb_stream_buffer_size(stream));
+	fail_unless(sr_usb_stream_wanted(stream) == 2,
+		"%u transfers wanted initially.", sr_usb_stream_wanted(stream));
+	sr_usb_stream_free(stream);
+
+	/* Without adapting, the depth is fixed. */
+	c = config;
+	c.adaptive = FALSE;
+	stream = sr_usb_stream_new(&c, NULL);
+	fail_unless(sr_usb_stream_max_transfers(stream) == 4,
+		"Up to %u transfers.", sr_usb_stream_max_transfers(stream));
+}
+END_TEST
+
+/*
+ * Check that a completion handled late deepens the queue, up to the
+ * maximum, and that the queue shrinks back towards its initial depth
+ * after a window of timely completions, retiring transfers.
+ */
+START_TEST(test_adapt)
+{
+	unsigned int i, count;
+
+	stream = sr_usb_stream_new(&config, NULL);
+	submit_wanted();
+	fail_unless(sr_usb_stream_wanted(stream) == 0, "Queue isn't full.");
+
+	/* The first completion has nothing to compare with. */
+	fail_unless(complete(transfers[0], 512), "Transfer was retired.");
+	fail_unless(sr_usb_stream_wanted(stream) == 0, "Queue grew.");
+
+	/* Late by more than half the time in flight. */
+	g_usleep(50 * 1000);
+	fail_unless(complete(transfers[1], 512), "Transfer was retired.");
+	fail_unless(sr_usb_stream_wanted(stream) == 4,
+		"%u transfers wanted after a late completion.",
+		sr_usb_stream_wanted(stream));
+	submit_wanted();
+
+	/* Never deeper than the maximum. */
+	g_usleep(100 * 1000);
+	fail_unless(complete(transfers[2], 512), "Transfer was retired.");
+	fail_unless(sr_usb_stream_wanted(stream) == 0,
+		"Queue grew beyond its maximum.");
+	fail_unless(sr_usb_stream_timeout(stream) == 100,
+		"Timeout of %u ms.", sr_usb_stream_timeout(stream));
+
+	/*
+	 * Timely completions for a window give a transfer back, until the
+	 * initial depth is reached. Retry a few windows, as the test may
+	 * get descheduled just as well as a driver.
+	 */
+	for (i = 0; i < MAX_TRANSFERS - 4; i++) {
+		count = complete_until_retired(16 * WINDOW);
+		fail_unless(count > 0, "No transfer retired.");
+		fail_unless(count >= WINDOW - 1, "Transfer retired after %u "
+			"completions.", count);
+		fail_unless(sr_usb_stream_wanted(stream) == 0, "Queue grew.");
+	}
+	fail_unless(complete_until_retired(2 * WINDOW) == 0,
+		"Queue shrunk below its initial depth.");
+}
+END_TEST
+
+/* Check that a fixed depth stream doesn't adapt to late completions. */
+START_TEST(test_fixed)
+{
+	struct sr_usb_stream_config c;
+
+	c = config;
+	c.adaptive = FALSE;
+	stream = sr_usb_stream_new(&c, NULL);
+	submit_wanted();
+	fail_unless(complete(transfers[0], 512), "Transfer was retired.");
+	g_usleep(50 * 1000);
+	fail_unless(complete(transfers[1], 512), "Transfer was retired.");
+	fail_unless(sr_usb_stream_wanted(stream) == 0, "Fixed queue grew.");
+	fail_unless(complete_until_retired(2 * WINDOW) == 0,
+		"Fixed queue shrunk.");
+}
+END_TEST
+
+/* Check that completions are accounted in the session's statistics. */
+START_TEST(test_stats)
+{
+	struct sr_session *session;
+	struct sr_session_stats *stats;
+	GSList *list, *l;
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_stats_enable(session, TRUE);
+	stream = sr_usb_stream_new(&config, session);
+	submit_wanted();
+	complete(transfers[0], 100);
+	complete(transfers[1], 0);
+	complete(transfers[2], 50);
+
+	fail_unless(sr_session_stats_get(session, &list) == SR_OK,
+		"Failed to get the statistics.");
+	stats = NULL;
+	for (l = list; l; l = l->next)
+		if (((struct sr_session_stats *)l->data)->stage
+				== SR_STATS_USB_TRANSFER)
+			stats = l->data;
+	fail_unless(stats != NULL, "No USB transfer statistics.");
+	fail_unless(stats->calls == 3 && stats->bytes == 150,
+		"%" PRIu64 " transfers of %" PRIu64 " bytes accounted.",
+		stats->calls, stats->bytes);
+	sr_session_stats_free(list);
+
+	sr_usb_stream_free(stream);
+	stream = NULL;
+	sr_session_destroy(session);
+}
+END_TEST
+
+#endif
+
+Suite *suite_usb_stream(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("usb_stream");
+
+	tc = tcase_create("depth");
+#ifdef HAVE_LIBUSB_1_0
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_sizing);
+	tcase_add_test(tc, test_adapt);
+	tcase_add_test(tc, test_fixed);
+	tcase_add_test(tc, test_stats);
+#endif
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,346 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#define NUM_CHANNELS	3
+/* Not a power of two, nor a multiple of any packet size below. */
+#define NUM_SAMPLES	1001
+#define SAMPLERATE	SR_KHZ(48)
+/* Bytes per sr_input_send(), which splits frames and samples. */
+#define INPUT_CHUNK	97
+
+/* Every sample is unique, and exactly representable as a float. */
+static float sample_value(int channel, uint64_t sample)
+{
+	return (channel + 1) * 10000.0f + sample + 0.25f;
+}
+
+/* Little-endian 32 bit field of the wav header. */
+static uint32_t header_field(const GString *wav, gsize offset)
+{
+	uint32_t v;
+
+	memcpy(&v, wav->str + offset, sizeof(v));
+
+	return GUINT32_FROM_LE(v);
+}
+
+static struct sr_dev_inst *new_sdi(void)
+{
+	struct sr_dev_inst *sdi;
+	char name[8];
+	int i;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	fail_unless(sdi != NULL, "sr_dev_inst_user_new() failed.");
+	for (i = 0; i < NUM_CHANNELS; i++) {
+		snprintf(name, sizeof(name), "A%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_ANALOG, name);
+	}
+
+	return sdi;
+}
+
+/* Pass a packet to the output, collecting what it returns. */
+static void output_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *wav)
+{
+	GString *out;
+	int ret;
+
+	out = NULL;
+	ret = sr_output_send(o, packet, &out);
+	fail_unless(ret == SR_OK, "sr_output_send() error: %d.", ret);
+	if (out) {
+		g_string_append_len(wav, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+}
+
+/* Send samples of the given channels, interleaved, as drivers do. */
+static void send_analog(const struct sr_output *o, GSList *channels,
+		uint64_t first, int num_samples, GString *wav)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_channel *ch;
+	GSList *l;
+	float *data;
+	int i, j, num_channels;
+
+	num_channels = g_slist_length(channels);
+	data = g_malloc(sizeof(float) * num_samples * num_channels);
+	for (i = 0; i < num_samples; i++) {
+		for (l = channels, j = 0; l; l = l->next, j++) {
+			ch = l->data;
+			data[i * num_channels + j] = sample_value(ch->index,
+				first + i);
+		}
+	}
+
+	memset(&analog, 0, sizeof(analog));
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	encoding.unitsize = sizeof(float);
+	encoding.is_signed = TRUE;
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.q = 1;
+	meaning.channels = channels;
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+	analog.num_samples = num_samples;
+	analog.data = data;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	output_send(o, &packet, wav);
+
+	g_free(data);
+}
+
+/*
+ * Stream a capture through the wav output: some packets carry all
+ * channels, some only part of them, none of them a power of two of
+ * samples long.
+ */
+static void write_wav(GHashTable *options, GString *wav)
+{
+	struct sr_dev_inst *sdi;
+	const struct sr_output *o;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	struct sr_config *src;
+	GSList *channels, *first, *rest;
+
+	sdi = new_sdi();
+	o = sr_output_new(sr_output_find("wav"), options, sdi, NULL);
+	fail_unless(o != NULL, "Failed to create the wav output.");
+
+	src = sr_config_new(SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SAMPLERATE));
+	meta.config = g_slist_append(NULL, src);
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	output_send(o, &packet, wav);
+	g_slist_free(meta.config);
+	sr_config_free(src);
+
+	channels = sr_dev_inst_channels_get(sdi);
+	send_analog(o, channels, 0, 7, wav);
+	send_analog(o, channels, 7, 250, wav);
+	/* The first two channels, then the last one, fill in frames. */
+	first = g_slist_append(g_slist_append(NULL, channels->data),
+		channels->next->data);
+	rest = g_slist_append(NULL, channels->next->next->data);
+	send_analog(o, first, 257, 301, wav);
+	send_analog(o, rest, 257, 301, wav);
+	g_slist_free(first);
+	g_slist_free(rest);
+	send_analog(o, channels, 558, NUM_SAMPLES - 558, wav);
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	output_send(o, &packet, wav);
+
+	sr_output_free(o);
+}
+
+/* What the wav input sent to the session. */
+static uint64_t received_samplerate;
+static uint64_t received_samples;
+static gboolean received_end;
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_analog *analog;
+	const struct sr_config *src;
+	GSList *l;
+	float *data;
+	int i, j, ret;
+
+	(void)sdi;
+	(void)cb_data;
+
+	fail_unless(!received_end, "Packet after the end.");
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				received_samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		fail_unless(g_slist_length(analog->meaning->channels)
+			== NUM_CHANNELS, "Packet of %u channels.",
+			g_slist_length(analog->meaning->channels));
+		data = g_malloc(sizeof(float) * analog->num_samples * NUM_CHANNELS);
+		ret = sr_analog_to_float(analog, data);
+		fail_unless(ret == SR_OK, "sr_analog_to_float() error: %d.", ret);
+		for (i = 0; i < (int)analog->num_samples; i++) {
+			for (j = 0; j < NUM_CHANNELS; j++) {
+				fail_unless(data[i * NUM_CHANNELS + j]
+					== sample_value(j, received_samples + i),
+					"Sample %" PRIu64 " of channel %d is %f.",
+					received_samples + i, j,
+					data[i * NUM_CHANNELS + j]);
+			}
+		}
+		received_samples += analog->num_samples;
+		g_free(data);
+		break;
+	case SR_DF_END:
+		received_end = TRUE;
+		break;
+	}
+}
+
+/* Stream a wav file into the wav input, in chunks of odd sizes. */
+static void read_wav(const GString *wav)
+{
+	struct sr_input *in;
+	struct sr_session *session;
+	GString *chunk;
+	gsize offset, len;
+	int ret;
+
+	received_samplerate = received_samples = 0;
+	received_end = FALSE;
+
+	in = sr_input_new(sr_input_find("wav"), NULL);
+	fail_unless(in != NULL, "Failed to create the wav input.");
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+	sr_session_dev_add(session, sr_input_dev_inst_get(in));
+
+	for (offset = 0; offset < wav->len; offset += len) {
+		len = MIN(INPUT_CHUNK, wav->len - offset);
+		chunk = g_string_new_len(wav->str + offset, len);
+		ret = sr_input_send(in, chunk);
+		g_string_free(chunk, TRUE);
+		fail_unless(ret == SR_OK, "sr_input_send() error: %d.", ret);
+	}
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d.", ret);
+
+	fail_unless(g_slist_length(sr_dev_inst_channels_get(
+		sr_input_dev_inst_get(in))) == NUM_CHANNELS,
+		"Wrong number of channels.");
+	fail_unless(received_samplerate == SAMPLERATE, "Samplerate of %"
+		PRIu64 ".", received_samplerate);
+	fail_unless(received_samples == NUM_SAMPLES, "Read %" PRIu64
+		" of %d samples.", received_samples, NUM_SAMPLES);
+	fail_unless(received_end, "No end of the capture.");
+
+	sr_session_destroy(session);
+	sr_input_free(in);
+}
+
+/* Check that what the wav output streams, the wav input reads back. */
+START_TEST(test_round_trip)
+{
+	GString *wav;
+
+	wav = g_string_new(NULL);
+	write_wav(NULL, wav);
+	/* A 46 byte header, and all frames. */
+	fail_unless(wav->len == 46 + NUM_SAMPLES * NUM_CHANNELS * 4,
+		"Output of %zu bytes.", (size_t)wav->len);
+	read_wav(wav);
+	g_string_free(wav, TRUE);
+}
+END_TEST
+
+/*
+ * Check that output written to a file descriptor gets the sizes in its
+ * header fixed up, and reads back the same.
+ */
+START_TEST(test_round_trip_fd)
+{
+	GHashTable *options;
+	GString *wav;
+	gchar *path;
+	char buf[512];
+	ssize_t len;
+	int fd;
+
+	fd = g_file_open_tmp("sigrok-wav-XXXXXX", &path, NULL);
+	fail_unless(fd >= 0, "Failed to create a temporary file.");
+	/* The file lives on until it's closed. */
+	g_unlink(path);
+	g_free(path);
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("fd"),
+		g_variant_ref_sink(g_variant_new_int32(fd)));
+	wav = g_string_new(NULL);
+	write_wav(options, wav);
+	g_hash_table_destroy(options);
+	fail_unless(wav->len == 0, "Output returned data, too.");
+
+	fail_unless(lseek(fd, 0, SEEK_SET) == 0, "Failed to rewind.");
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		g_string_append_len(wav, buf, len);
+	close(fd);
+	fail_unless(wav->len == 46 + NUM_SAMPLES * NUM_CHANNELS * 4,
+		"Wrote %zu bytes.", (size_t)wav->len);
+	fail_unless(header_field(wav, 4) == wav->len - 8,
+		"RIFF size of %" PRIu32 ".", header_field(wav, 4));
+	fail_unless(header_field(wav, 42) == wav->len - 46,
+		"Data size of %" PRIu32 ".", header_field(wav, 42));
+
+	read_wav(wav);
+	g_string_free(wav, TRUE);
+}
+END_TEST
+
+Suite *suite_wav(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("wav");
+
+	tc = tcase_create("round_trip");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_round_trip);
+	tcase_add_test(tc, test_round_trip_fd);
+	suite_add_tcase(s, tc);
+
+	return s;
+}